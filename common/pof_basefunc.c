@@ -23,18 +23,22 @@
  * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
 
+/* For pthread_setaffinity_np(). */
+#define _GNU_SOURCE
+
 #include "../include/pof_common.h"
 #include "../include/pof_type.h"
 #include "../include/pof_log_print.h"
 #include "../include/pof_memory.h"
 #include <sys/time.h>
-#include <sys/msg.h>
+#include <time.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
 #include <unistd.h>
 #include <signal.h>
 #include <zconf.h>
 #include <stdarg.h>
-/* Define pofbf_key to build queue using ftok function. */
-static key_t pofbf_key = 0;
+#include <endian.h>
 
 /***********************************************************************
  * Create task.
@@ -61,6 +65,32 @@ uint32_t pofbf_task_create(void *arg, POF_TASK_FUNC task_func, task_t *task_id_p
     return POF_OK;
 }
 
+/***********************************************************************
+ * Pin the task to a CPU.
+ * Form:     uint32_t pofbf_task_set_cpu(uint32_t cpu)
+ * Input:    CPU index
+ * Output:   NONE
+ * Return:   POF_OK or Error code
+ * Discribe: This function binds the calling task to the CPU. The index
+ *           wraps around the number of online CPUs.
+ ***********************************************************************/
+uint32_t pofbf_task_set_cpu(uint32_t cpu) {
+    cpu_set_t set;
+    long cpuNum = sysconf(_SC_NPROCESSORS_ONLN);
+
+    if (cpuNum <= 0) {
+        return POF_ERROR;
+    }
+
+    CPU_ZERO(&set);
+    CPU_SET(cpu % cpuNum, &set);
+    if (POF_OK != pthread_setaffinity_np(pthread_self(), sizeof set, &set)) {
+        return POF_ERROR;
+    }
+
+    return POF_OK;
+}
+
 /***********************************************************************
  * Task delay.
  * Form:     uint32_t pofbf_task_delay(uint32_t delay)
@@ -76,6 +106,22 @@ uint32_t pofbf_task_delay(uint32_t delay) {
     return;
 }
 
+/***********************************************************************
+ * Monotonic time.
+ * Form:     uint64_t pofbf_time_ns()
+ * Input:    NONE
+ * Output:   NONE
+ * Return:   time in nano-second
+ * Discribe: This function returns the time of the monotonic clock. The
+ *           unit is nano-second.
+ ***********************************************************************/
+uint64_t pofbf_time_ns() {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
 /***********************************************************************
  * Delete task.
  * Form:     uint32_t pofbf_task_delete(task_t *task_id_ptr)
@@ -108,37 +154,157 @@ uint32_t pofbf_task_delete(task_t *task_id_ptr) {
     return POF_OK;
 }
 
+/* Message queue between the tasks. The queue is a ring of preallocated
+ * slots. Any task can write into it, and one task reads from it. The slot
+ * at position pos is free for the writer of pos when its seq is pos, and
+ * holds the message for the reader when its seq is pos + 1. */
+struct queueSlot{
+    uint32_t seq;
+    uint32_t len;
+    uint8_t data[POF_MESSAGE_SIZE];
+};
+
+struct pofbf_queue{
+    uint32_t mask;
+    uint32_t head;          /* Next position to write. */
+    uint32_t tail;          /* Next position to read. */
+    uint32_t readerWait;    /* The reader is waiting for a message. */
+    uint32_t writerWait;    /* Number of writers waiting for a free slot. */
+    int msgFd;              /* Eventfd to wake up the reader. */
+    int slotFd;             /* Eventfd to wake up the writers. */
+    /* Reader polling the msgFd. It drains the queue by drain() instead of
+     * sleeping when it writes into the full queue itself. */
+    task_t reader;
+    POF_QUEUE_DRAIN_FUNC drain;
+    void *drainArg;
+    struct queueSlot slot[];
+};
+
+/* The queue id is POF_VALID_QUEUEID plus the index in this array. */
+static struct pofbf_queue *pofbf_queues[POF_QUEUE_NUM_MAX] = {NULL};
+
+static struct pofbf_queue *
+queueGet(uint32_t queue_id)
+{
+    if (queue_id == POF_INVALID_QUEUEID || queue_id < POF_VALID_QUEUEID || \
+            queue_id - POF_VALID_QUEUEID >= POF_QUEUE_NUM_MAX) {
+        return NULL;
+    }
+    return pofbf_queues[queue_id - POF_VALID_QUEUEID];
+}
+
+/* Block until the eventfd is signaled. */
+static void
+queueWait(int fd)
+{
+    uint64_t count;
+
+    if (read(fd, &count, sizeof count) < 0) {
+        /* Interrupted. The caller checks the queue again. */
+    }
+    return;
+}
+
+static void
+queueWake(int fd)
+{
+    uint64_t count = 1;
+
+    if (write(fd, &count, sizeof count) < 0) {
+        /* The counter is full, so the waiter will wake up anyway. */
+    }
+    return;
+}
+
+/* Take a position to write. Return FALSE if the queue is full. */
+static uint32_t
+queuePosGet(struct pofbf_queue *q, uint32_t *pos_ptr)
+{
+    uint32_t pos = __atomic_load_n(&q->head, __ATOMIC_RELAXED), seq;
+    int32_t diff;
+
+    while (1) {
+        seq = __atomic_load_n(&q->slot[pos & q->mask].seq, __ATOMIC_ACQUIRE);
+        diff = (int32_t)(seq - pos);
+        if (diff == 0) {
+            if (__atomic_compare_exchange_n(&q->head, &pos, pos + 1, TRUE, \
+                        __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                *pos_ptr = pos;
+                return TRUE;
+            }
+        } else if (diff < 0) {
+            return FALSE;
+        } else {
+            pos = __atomic_load_n(&q->head, __ATOMIC_RELAXED);
+        }
+    }
+}
+
+/* Return whether the slot at the head is free. */
+static uint32_t
+queueSlotFree(const struct pofbf_queue *q)
+{
+    uint32_t pos = __atomic_load_n(&q->head, __ATOMIC_SEQ_CST);
+    return __atomic_load_n(&q->slot[pos & q->mask].seq, __ATOMIC_SEQ_CST) == pos;
+}
+
+/* Return whether the message at the tail is ready to read. */
+static uint32_t
+queueMsgReady(const struct pofbf_queue *q)
+{
+    uint32_t pos = q->tail;
+    return __atomic_load_n(&q->slot[pos & q->mask].seq, __ATOMIC_SEQ_CST) == pos + 1;
+}
+
 /***********************************************************************
  * Create a message queue.
  * Form:     uint32_t pofbf_queue_create(uint32_t *queue_id_ptr)
  * Input:    NONE
  * Output:   queue id
  * Return:   POF_OK or Error code
- * Discribe: This function creates a new message queue.
+ * Discribe: This function creates a new message queue with
+ *           POF_QUEUE_SLOT_NUM slots of POF_MESSAGE_SIZE bytes.
  ***********************************************************************/
-uint32_t pofbf_queue_create(uint32_t *queue_id_ptr, int j) {
-    uint32_t queue_id = POF_INVALID_QUEUEID;
-    //int i = (int)g_poflr_dev_id;
+uint32_t pofbf_queue_create(uint32_t *queue_id_ptr) {
+    struct pofbf_queue *q;
+    uint32_t i;
 
     if (queue_id_ptr == NULL) {
         POF_ERROR_HANDLE_RETURN_NO_UPWARD(POFET_SOFTWARE_FAILED, POF_QUEUE_CREATE_FAIL);
     }
+    *queue_id_ptr = POF_INVALID_QUEUEID;
 
-    /* Build the pofbf_key to create the queue. */
-    if (pofbf_key == 0) {
-        pofbf_key = ftok(".", j + 1);
+    q = MALLOC(sizeof *q + POF_QUEUE_SLOT_NUM * sizeof q->slot[0]);
+    POF_MALLOC_ERROR_HANDLE_RETURN_NO_UPWARD(q);
+    memset(q, 0, sizeof *q);
+    q->mask = POF_QUEUE_SLOT_NUM - 1;
+    for (i = 0; i < POF_QUEUE_SLOT_NUM; i++) {
+        q->slot[i].seq = i;
     }
 
-    /* Create the queue using pofbf_key. */
-    if (-1 == (queue_id = msgget(pofbf_key, IPC_CREAT | 0666))) {
-        *queue_id_ptr = POF_INVALID_QUEUEID;
-        POF_ERROR_HANDLE_RETURN_NO_UPWARD(POFET_SOFTWARE_FAILED, POF_QUEUE_CREATE_FAIL);
+    q->msgFd = eventfd(0, 0);
+    q->slotFd = eventfd(0, EFD_SEMAPHORE);
+    if (q->msgFd == -1 || q->slotFd == -1) {
+        goto fail;
     }
 
-    pofbf_key++;
-    *queue_id_ptr = queue_id;
-    POF_DEBUG_CPRINT_FL(1, GREEN, ">>the queue id is %d", queue_id);
-    return POF_OK;
+    for (i = 0; i < POF_QUEUE_NUM_MAX; i++) {
+        if (__sync_bool_compare_and_swap(&pofbf_queues[i], NULL, q)) {
+            *queue_id_ptr = POF_VALID_QUEUEID + i;
+            POF_DEBUG_CPRINT_FL(1, GREEN, ">>the queue id is %d", *queue_id_ptr);
+            return POF_OK;
+        }
+    }
+
+fail:
+    if (q->msgFd != -1) {
+        close(q->msgFd);
+    }
+    if (q->slotFd != -1) {
+        close(q->slotFd);
+    }
+    FREE(q);
+    POF_ERROR_HANDLE_RETURN_NO_UPWARD(POFET_SOFTWARE_FAILED, POF_QUEUE_CREATE_FAIL);
 }
 
 /***********************************************************************
@@ -147,24 +313,25 @@ uint32_t pofbf_queue_create(uint32_t *queue_id_ptr, int j) {
  * Input:    queue id
  * Output:   queue id
  * Return:   POF_OK or Error code
- * Discribe: This function deletes an exist message queue.
+ * Discribe: This function deletes an exist message queue. The tasks
+ *           using the queue should have been deleted.
  ***********************************************************************/
 uint32_t pofbf_queue_delete(uint32_t *queue_id_ptr) {
-    uint32_t queue_id = POF_INVALID_QUEUEID;
+    struct pofbf_queue *q;
 
     if (NULL == queue_id_ptr) {
         POF_ERROR_HANDLE_RETURN_NO_UPWARD(POFET_SOFTWARE_FAILED, POF_QUEUE_DELETE_FAIL);
     }
-    queue_id = *queue_id_ptr;
 
-    if (queue_id == POF_INVALID_QUEUEID) {
+    if ((q = queueGet(*queue_id_ptr)) == NULL) {
         POF_ERROR_HANDLE_RETURN_NO_UPWARD(POFET_SOFTWARE_FAILED, POF_QUEUE_DELETE_FAIL);
     }
 
     /* Delete the message queue. */
-    if (POF_OK != msgctl(queue_id, IPC_RMID, NULL)) {
-        POF_ERROR_HANDLE_RETURN_NO_UPWARD(POFET_SOFTWARE_FAILED, POF_QUEUE_DELETE_FAIL);
-    }
+    pofbf_queues[*queue_id_ptr - POF_VALID_QUEUEID] = NULL;
+    close(q->msgFd);
+    close(q->slotFd);
+    FREE(q);
 
     *queue_id_ptr = POF_INVALID_QUEUEID;
 
@@ -180,17 +347,18 @@ uint32_t pofbf_queue_delete(uint32_t *queue_id_ptr) {
  * Input:    queue id, max len, timeout mode
  * Output:   data buffer
  * Return:   POF_OK or Error code
- * Discribe: This function reads message from the queue.
+ * Discribe: This function reads message from the queue. Only one task
+ *           can read from one queue. With POF_WAIT_FOREVER, the task
+ *           sleeps on the eventfd of the queue until a message comes.
+ *           With POF_NO_WAIT, POF_ERROR is returned silently if the
+ *           queue is empty.
  ***********************************************************************/
 uint32_t pofbf_queue_read(uint32_t queue_id, void *buf, uint32_t max_len, int timeout) {
-    uint32_t len;
-    /* Define the message struct. */
-    struct msg {
-        long int mtype;
-        char mdata[0];
-    } *msg_ptr;
+    struct pofbf_queue *q;
+    struct queueSlot *slot;
+    uint32_t pos;
 
-    if (queue_id == POF_INVALID_QUEUEID || buf == NULL) {
+    if ((q = queueGet(queue_id)) == NULL || buf == NULL) {
         POF_ERROR_HANDLE_RETURN_NO_UPWARD(POFET_SOFTWARE_FAILED, POF_READ_MSG_QUEUE_FAILURE);
     }
 
@@ -198,18 +366,65 @@ uint32_t pofbf_queue_read(uint32_t queue_id, void *buf, uint32_t max_len, int ti
         POF_ERROR_HANDLE_RETURN_NO_UPWARD(POFET_SOFTWARE_FAILED, POF_WRITE_MSG_QUEUE_FAILURE);
     }
 
-    msg_ptr = MALLOC(max_len + sizeof(struct msg));
-    POF_MALLOC_ERROR_HANDLE_RETURN_NO_UPWARD(msg_ptr);
+    /* Wait for the message. The flag is set before checking the queue
+     * again, so a writer either sees the flag or the check sees the
+     * message. */
+    while (!queueMsgReady(q)) {
+        if (timeout == POF_NO_WAIT) {
+            return POF_ERROR;
+        }
+        __atomic_store_n(&q->readerWait, TRUE, __ATOMIC_SEQ_CST);
+        if (!queueMsgReady(q)) {
+            queueWait(q->msgFd);
+        }
+        __atomic_store_n(&q->readerWait, FALSE, __ATOMIC_RELAXED);
+    }
+
+    pos = q->tail;
+    slot = &q->slot[pos & q->mask];
+    if (slot->len > max_len) {
+        POF_ERROR_HANDLE_RETURN_NO_UPWARD(POFET_SOFTWARE_FAILED, POF_MESSAGE_SIZE_TOO_BIG);
+    }
+    memcpy(buf, slot->data, slot->len);
 
-    /* Receive the messsage from the message queue. */
-    if (-1 == (len = msgrcv(queue_id, msg_ptr, max_len + sizeof(struct msg), POF_MSGTYPE_ANY, timeout))) {
-        FREE(msg_ptr);
-        POF_ERROR_HANDLE_RETURN_NO_UPWARD(POFET_SOFTWARE_FAILED, POF_READ_MSG_QUEUE_FAILURE);
+    /* Give the slot back to the writers. */
+    q->tail = pos + 1;
+    __atomic_store_n(&slot->seq, pos + q->mask + 1, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&q->writerWait, __ATOMIC_SEQ_CST)) {
+        queueWake(q->slotFd);
     }
 
-    memcpy(buf, msg_ptr->mdata, len - sizeof(struct msg));
+    return POF_OK;
+}
+
+/***********************************************************************
+ * Poll the message queue.
+ * Form:     uint32_t pofbf_queue_poll_fd(uint32_t queue_id, \
+ *                                        POF_QUEUE_DRAIN_FUNC drain, \
+ *                                        void *arg, int *fd_ptr)
+ * Input:    queue id, drain function and its argument
+ * Output:   fd
+ * Return:   POF_OK or Error code
+ * Discribe: This function makes the calling task the reader of the queue,
+ *           which reads it with POF_NO_WAIT when the fd is readable. The
+ *           reader should read the 8 bytes counter of the fd before
+ *           reading the queue. Every message written wakes the fd up.
+ *           If the reader writes into the queue when it is full, the
+ *           drain function is called until a slot is freed, because the
+ *           reader can not wait for itself.
+ ***********************************************************************/
+uint32_t pofbf_queue_poll_fd(uint32_t queue_id, POF_QUEUE_DRAIN_FUNC drain, void *arg, int *fd_ptr) {
+    struct pofbf_queue *q;
+
+    if ((q = queueGet(queue_id)) == NULL || fd_ptr == NULL) {
+        POF_ERROR_HANDLE_RETURN_NO_UPWARD(POFET_SOFTWARE_FAILED, POF_READ_MSG_QUEUE_FAILURE);
+    }
 
-    FREE(msg_ptr);
+    q->reader = pthread_self();
+    q->drain = drain;
+    q->drainArg = arg;
+    __atomic_store_n(&q->readerWait, TRUE, __ATOMIC_SEQ_CST);
+    *fd_ptr = q->msgFd;
     return POF_OK;
 }
 
@@ -223,16 +438,16 @@ uint32_t pofbf_queue_read(uint32_t queue_id, void *buf, uint32_t max_len, int ti
  * Output:   NONE
  * Return:   POF_OK or Error code
  * Discribe: This function writes the message data to the message queue
- *           corresponding the queue id.
+ *           corresponding the queue id. If the queue is full, the task
+ *           sleeps until the reader frees a slot with POF_WAIT_FOREVER,
+ *           or fails with POF_NO_WAIT.
  ***********************************************************************/
 uint32_t pofbf_queue_write(uint32_t queue_id, const void *message, uint32_t msg_len, int timeout) {
-    /* Define the message struct. */
-    struct msg {
-        long int mtype;
-        char mdata[0];
-    } *msg_ptr;
+    struct pofbf_queue *q;
+    struct queueSlot *slot;
+    uint32_t pos;
 
-    if (queue_id == POF_INVALID_QUEUEID || message == NULL) {
+    if ((q = queueGet(queue_id)) == NULL || message == NULL) {
         POF_ERROR_HANDLE_RETURN_NO_UPWARD(POFET_SOFTWARE_FAILED, POF_WRITE_MSG_QUEUE_FAILURE);
     }
 
@@ -244,20 +459,32 @@ uint32_t pofbf_queue_write(uint32_t queue_id, const void *message, uint32_t msg_
         POF_ERROR_HANDLE_RETURN_NO_UPWARD(POFET_SOFTWARE_FAILED, POF_WRITE_MSG_QUEUE_FAILURE);
     }
 
-    msg_ptr = MALLOC(msg_len + sizeof(struct msg));
-    POF_MALLOC_ERROR_HANDLE_RETURN_NO_UPWARD(msg_ptr);
+    /* Wait for a free slot, the same way as the reader waits. */
+    while (!queuePosGet(q, &pos)) {
+        if (timeout == POF_NO_WAIT) {
+            POF_ERROR_HANDLE_RETURN_NO_UPWARD(POFET_SOFTWARE_FAILED, POF_WRITE_MSG_QUEUE_FAILURE);
+        }
+        if (q->drain != NULL && pthread_equal(q->reader, pthread_self())) {
+            q->drain(q->drainArg);
+            continue;
+        }
+        __atomic_add_fetch(&q->writerWait, 1, __ATOMIC_SEQ_CST);
+        if (!queueSlotFree(q)) {
+            queueWait(q->slotFd);
+        }
+        __atomic_sub_fetch(&q->writerWait, 1, __ATOMIC_SEQ_CST);
+    }
 
-    msg_ptr->mtype = POF_MSGTYPE;
-    memcpy(msg_ptr->mdata, message, msg_len);
+    slot = &q->slot[pos & q->mask];
+    memcpy(slot->data, message, msg_len);
+    slot->len = msg_len;
 
-//    msgsnd(queue_id, msg_ptr, msg_len+sizeof(struct msg), IPC_NOWAIT);
-    if (-1 == msgsnd(queue_id, msg_ptr, msg_len + sizeof(struct msg), timeout)) {
-        FREE(msg_ptr);
-        POF_ERROR_HANDLE_RETURN_NO_UPWARD(POFET_SOFTWARE_FAILED, POF_WRITE_MSG_QUEUE_FAILURE);
+    /* Hand the message to the reader. */
+    __atomic_store_n(&slot->seq, pos + 1, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&q->readerWait, __ATOMIC_SEQ_CST)) {
+        queueWake(q->msgFd);
     }
 
-    FREE(msg_ptr);
-
     return POF_OK;
 }
 
@@ -339,6 +566,313 @@ uint32_t pofbf_timer_delete(uint32_t *timer_id_ptr) {
     return POF_OK;
 }
 
+/***********************************************************************
+ * Map a mirrored ring buffer.
+ * Form:     uint32_t pofbf_ring_map(uint32_t size, char **ring_ptr)
+ * Input:    ring size, which is a multiple of the page size
+ * Output:   ring address
+ * Return:   POF_OK or Error code
+ * Discribe: This function maps the same memory of size bytes twice, one
+ *           right after the other. Any size bytes from an offset below
+ *           size are contiguous, so the data wrapping around the end of
+ *           the ring can be used in place without copying.
+ ***********************************************************************/
+uint32_t pofbf_ring_map(uint32_t size, char **ring_ptr) {
+    char *ring;
+    int fd;
+
+    if (ring_ptr == NULL || size == 0 || size % sysconf(_SC_PAGESIZE) != 0) {
+        POF_ERROR_HANDLE_RETURN_NO_UPWARD(POFET_SOFTWARE_FAILED, POF_ALLOCATE_RESOURCE_FAILURE);
+    }
+
+    /* Reserve the address space of both halves, then map the same file
+     * into each of them. */
+    ring = mmap(NULL, 2 * size, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (ring == MAP_FAILED) {
+        POF_ERROR_HANDLE_RETURN_NO_UPWARD(POFET_SOFTWARE_FAILED, POF_ALLOCATE_RESOURCE_FAILURE);
+    }
+    if ((fd = memfd_create("pofbf_ring", 0)) == -1) {
+        munmap(ring, 2 * size);
+        POF_ERROR_HANDLE_RETURN_NO_UPWARD(POFET_SOFTWARE_FAILED, POF_ALLOCATE_RESOURCE_FAILURE);
+    }
+    if (ftruncate(fd, size) != 0
+        || mmap(ring, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0) == MAP_FAILED
+        || mmap(ring + size, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0) == MAP_FAILED) {
+        close(fd);
+        munmap(ring, 2 * size);
+        POF_ERROR_HANDLE_RETURN_NO_UPWARD(POFET_SOFTWARE_FAILED, POF_ALLOCATE_RESOURCE_FAILURE);
+    }
+    close(fd);
+
+    *ring_ptr = ring;
+    return POF_OK;
+}
+
+/* Unmap the ring buffer mapped by pofbf_ring_map. */
+uint32_t pofbf_ring_unmap(char **ring_ptr, uint32_t size) {
+    if (ring_ptr == NULL || *ring_ptr == NULL) {
+        return POF_OK;
+    }
+    munmap(*ring_ptr, 2 * size);
+    *ring_ptr = NULL;
+    return POF_OK;
+}
+
+/* Load 64 bits from a data buffer at any bit offset, big endian. The byte
+ * after the 8 bytes is read only if the offset is not byte aligned. */
+static uint64_t
+bitLoad64(const uint8_t *data, uint32_t pos_b)
+{
+    uint64_t word;
+    const uint8_t *ptr = data + pos_b / 8;
+
+    memcpy(&word, ptr, sizeof(word));
+    word = be64toh(word);
+    if (pos_b % 8) {
+        word = (word << (pos_b % 8)) | (*(ptr + 8) >> (8 - pos_b % 8));
+    }
+    return word;
+}
+
+static inline uint64_t
+load16(const uint8_t *data)
+{
+    uint16_t v;
+    memcpy(&v, data, sizeof(v));
+    return be16toh(v);
+}
+
+static inline uint64_t
+load32(const uint8_t *data)
+{
+    uint32_t v;
+    memcpy(&v, data, sizeof(v));
+    return be32toh(v);
+}
+
+static inline void
+store16(uint8_t *data, uint64_t word)
+{
+    uint16_t v = htobe16((uint16_t)word);
+    memcpy(data, &v, sizeof(v));
+}
+
+static inline void
+store32(uint8_t *data, uint64_t word)
+{
+    uint32_t v = htobe32((uint32_t)word);
+    memcpy(data, &v, sizeof(v));
+}
+
+/* Load n bytes, n from 1 to 8, big endian into the high bytes of the
+ * word. The bytes are read by 4, 2 and 1, each once. With n a constant
+ * the loads are straight line. */
+static inline uint64_t
+bytesLoad(const uint8_t *data, uint32_t n)
+{
+    uint64_t word;
+
+    switch (n) {
+    case 1:
+        return (uint64_t)data[0] << 56;
+    case 2:
+        return load16(data) << 48;
+    case 3:
+        return (load16(data) << 48) | ((uint64_t)data[2] << 40);
+    case 4:
+        return load32(data) << 32;
+    case 5:
+        return (load32(data) << 32) | ((uint64_t)data[4] << 24);
+    case 6:
+        return (load32(data) << 32) | (load16(data + 4) << 16);
+    case 7:
+        return (load32(data) << 32) | (load16(data + 4) << 16) | ((uint64_t)data[6] << 8);
+    default:
+        memcpy(&word, data, sizeof(word));
+        return be64toh(word);
+    }
+}
+
+/* Merge the bits of the word under the mask, after a shift by s, into
+ * 1, 2 or 4 bytes of data. */
+#define BYTES_MERGE8(d, w, m, s)    ((d) = (uint8_t)(((d) & ~((m) >> (s))) | ((w) >> (s))))
+#define BYTES_MERGE16(d, w, m, s)   store16((d), (load16(d) & ~((m) >> (s))) | ((w) >> (s)))
+#define BYTES_MERGE32(d, w, m, s)   store32((d), (load32(d) & ~((m) >> (s))) | ((w) >> (s)))
+
+/* Store the high n bytes of the word big endian, n from 1 to 8. The bits
+ * in mask are taken from the word, and the others are kept. Each byte is
+ * read and written once. */
+static inline void
+bytesMerge(uint8_t *data, uint64_t word, uint64_t mask, uint32_t n)
+{
+    uint64_t old;
+
+    switch (n) {
+    case 1:
+        BYTES_MERGE8(data[0], word, mask, 56);
+        break;
+    case 2:
+        BYTES_MERGE16(data, word, mask, 48);
+        break;
+    case 3:
+        BYTES_MERGE16(data, word, mask, 48);
+        BYTES_MERGE8(data[2], word, mask, 40);
+        break;
+    case 4:
+        BYTES_MERGE32(data, word, mask, 32);
+        break;
+    case 5:
+        BYTES_MERGE32(data, word, mask, 32);
+        BYTES_MERGE8(data[4], word, mask, 24);
+        break;
+    case 6:
+        BYTES_MERGE32(data, word, mask, 32);
+        BYTES_MERGE16(data + 4, word, mask, 16);
+        break;
+    case 7:
+        BYTES_MERGE32(data, word, mask, 32);
+        BYTES_MERGE16(data + 4, word, mask, 16);
+        BYTES_MERGE8(data[6], word, mask, 8);
+        break;
+    default:
+        memcpy(&old, data, sizeof(old));
+        old = htobe64((be64toh(old) & ~mask) | word);
+        memcpy(data, &old, sizeof(old));
+    }
+}
+
+/* The mask of the first len_b bits of a word, len_b from 1 to 64. */
+#define BIT_MASK_HIGH(len_b)    (~(uint64_t)0 << (64 - (len_b)))
+
+/* The len_b bits of data_src at src_b, in the high bits of the word. The
+ * bits after them are 0. */
+static inline uint64_t
+bitWindowLoad(const uint8_t *data_src, uint32_t src_b, uint32_t len_b)
+{
+    return (bytesLoad(data_src + src_b / 8, (src_b % 8 + len_b + 7) / 8) << (src_b % 8)) \
+            & BIT_MASK_HIGH(len_b);
+}
+
+/* Copy len_b bits which fit one 64-bit window both in data_src and in
+ * data_dst, that is src_b % 8 + len_b and dst_b % 8 + len_b are no more
+ * than 64. The bytes holding the bits are read and written once. */
+static inline void
+bitWindow(uint8_t *data_dst, uint32_t dst_b, const uint8_t *data_src, uint32_t src_b, uint32_t len_b)
+{
+    bytesMerge(data_dst + dst_b / 8, bitWindowLoad(data_src, src_b, len_b) >> (dst_b % 8), \
+            BIT_MASK_HIGH(len_b) >> (dst_b % 8), (dst_b % 8 + len_b + 7) / 8);
+}
+
+/* Move len_b bits which do not fit one window. After the first byte of
+ * data_dst is filled up, the whole bytes are copied by memcpy if data_src
+ * is byte aligned too, or else by 64-bit words with shift, and the rest
+ * in one window. */
+static void
+bitMoveLong(uint8_t *data_dst, uint32_t dst, const uint8_t *data_src, uint32_t src, uint32_t len)
+{
+    const uint8_t *ptr;
+    uint8_t *out;
+    uint64_t word;
+    uint8_t n, shift;
+
+    /* Fill up the first byte of data_dst. */
+    if (dst % 8) {
+        n = 8 - dst % 8;
+        bitWindow(data_dst, dst, data_src, src, n);
+        dst += n;
+        src += n;
+        len -= n;
+    }
+
+    /* Whole bytes of data_dst. */
+    out = data_dst + dst / 8;
+    ptr = data_src + src / 8;
+    shift = src % 8;
+    if (shift == 0) {
+        memcpy(out, ptr, len / 8);
+        dst += len - len % 8;
+        src += len - len % 8;
+        len %= 8;
+    } else {
+        /* The 9th byte of each word holds bits of the field, since
+         * shift + len > 64. */
+        for (; len >= 64; len -= 64, dst += 64, src += 64, out += 8, ptr += 8) {
+            word = htobe64(bitLoad64(ptr, shift));
+            memcpy(out, &word, sizeof(word));
+        }
+        if (shift + len > 64) {
+            *out = POF_MOVE_BIT_LEFT(*ptr, shift) | POF_MOVE_BIT_RIGHT(*(ptr + 1), 8 - shift);
+            dst += 8;
+            src += 8;
+            len -= 8;
+        }
+    }
+
+    /* The rest fits one window. */
+    if (len) {
+        bitWindow(data_dst, dst, data_src, src, len);
+    }
+}
+
+/* The byte counts of a field at a byte boundary, and of the same field
+ * at a bit offset, which is the same or one more. A switch on their sum
+ * picks a case with both as constants, so that bytesLoad() and
+ * bytesMerge() have no branches left. The sum is more than 16 only for a
+ * field which does not fit one window. */
+#define BIT_WINDOW_CASES(CASE)                                  \
+            CASE(1, 1) CASE(1, 2) CASE(2, 2) CASE(2, 3)         \
+            CASE(3, 3) CASE(3, 4) CASE(4, 4) CASE(4, 5)         \
+            CASE(5, 5) CASE(5, 6) CASE(6, 6) CASE(6, 7)         \
+            CASE(7, 7) CASE(7, 8) CASE(8, 8)
+
+/* Cover: the value is at a byte boundary, the data at pos_b. */
+#define BIT_COVER_CASE(n, n_pos)                                            \
+            case (n) + (n_pos):                                             \
+                bytesMerge(data_ori + pos_b / 8,                            \
+                        (bytesLoad(value, n) & BIT_MASK_HIGH(len_b)) >> (pos_b % 8), \
+                        BIT_MASK_HIGH(len_b) >> (pos_b % 8), n_pos);        \
+                break;
+
+/* Copy: the original data is at offset_b, the result at a byte boundary.
+ * The bytes of the result are written whole. */
+#define BIT_COPY_CASE(n, n_pos)                                             \
+            case (n) + (n_pos):                                             \
+                bytesMerge(data_res,                                        \
+                        (bytesLoad(data_ori + offset_b / 8, n_pos) << (offset_b % 8)) & BIT_MASK_HIGH(len_b), \
+                        ~(uint64_t)0, n);                                   \
+                break;
+
+/* The fields of the packets and the metadata are mostly short, and fit
+ * one window. */
+#define BIT_WINDOW_FIT(dst_b, src_b, len_b) \
+            ((dst_b) % 8 + (len_b) <= 64 && (src_b) % 8 + (len_b) <= 64)
+
+/***********************************************************************
+ * Move a piece of bits from one data buffer to another.
+ * Form:     void pofbf_move_bit(uint8_t *data_dst, uint16_t dst_b, \
+ *                               const uint8_t *data_src, \
+ *                               uint16_t src_b, uint16_t len_b)
+ * Input:    source data, source offset, destination offset, length
+ *           (all in bit unit)
+ * Output:   destination data
+ * Return:   NONE
+ * Discribe: This function copies len_b bits from data_src at src_b to
+ *           data_dst at dst_b. The bits of data_dst outside are kept.
+ *           A field which fits one 64-bit window is moved in one step,
+ *           and a longer one by bytes and words. Only the bytes holding
+ *           the bits are read and written.
+ ***********************************************************************/
+void pofbf_move_bit(uint8_t *data_dst, uint16_t dst_b, const uint8_t *data_src, uint16_t src_b, uint16_t len_b) {
+    if (len_b == 0) {
+        return;
+    }
+    if (BIT_WINDOW_FIT(dst_b, src_b, len_b)) {
+        bitWindow(data_dst, dst_b, data_src, src_b, len_b);
+        return;
+    }
+    bitMoveLong(data_dst, dst_b, data_src, src_b, len_b);
+}
+
 /***********************************************************************
  * Cover the piece of data using the specified value.
  * Form:     uint32_t pofbf_cover_bit(uint8_t *data_ori, \
@@ -353,36 +887,15 @@ uint32_t pofbf_timer_delete(uint32_t *timer_id_ptr) {
  *           should make sure that data_ori and value are not NULL.
  ***********************************************************************/
 void pofbf_cover_bit(uint8_t *data_ori, const uint8_t *value, uint16_t pos_b, uint16_t len_b) {
-    uint32_t process_len_b = 0;
-    uint16_t pos_b_x, len_B, after_len_b_x;
-    uint8_t *ptr;
-
-    pos_b_x = pos_b % 8;
-    len_B = (uint16_t) ((len_b - 1) / 8 + 1);
-    after_len_b_x = (len_b + pos_b - 1) % 8 + 1;
-    ptr = data_ori + (uint16_t) (pos_b / 8);
-
-    if (len_b <= (8 - pos_b_x)) {
-        *ptr = (*ptr & POF_MOVE_BIT_LEFT(0xff, (8 - pos_b_x)) \
- | (POF_MOVE_BIT_RIGHT(*value, pos_b_x) & POF_MOVE_BIT_LEFT(0xff, 8 - after_len_b_x)) \
- | (*ptr & POF_MOVE_BIT_RIGHT(0xff, after_len_b_x)));
-        return;
-    }
-
-    *ptr = *ptr & POF_MOVE_BIT_LEFT(0xff, (8 - pos_b_x)) \
- | POF_MOVE_BIT_RIGHT(*value, pos_b_x);
-
-    process_len_b = 8 - pos_b_x;
-    while (process_len_b < (len_b - 8)) {
-        *(++ptr) = POF_MOVE_BIT_LEFT(*value, 8 - pos_b_x) | POF_MOVE_BIT_RIGHT(*(++value), pos_b_x);
-        process_len_b += 8;
+    switch ((len_b + 7) / 8 + (pos_b % 8 + len_b + 7) / 8) {
+    case 0:
+    case 1:
+        /* No bits. */
+        break;
+    BIT_WINDOW_CASES(BIT_COVER_CASE)
+    default:
+        bitMoveLong(data_ori, pos_b, value, 0, len_b);
     }
-
-    *(ptr + 1) = (POF_MOVE_BIT_LEFT(*value, 8 - pos_b_x) | POF_MOVE_BIT_RIGHT(*(++value), pos_b_x) \
- & POF_MOVE_BIT_LEFT(0xff, 8 - (len_b - process_len_b))) \
- | (*(ptr + 1) & POF_MOVE_BIT_RIGHT(0xff, len_b - process_len_b));
-
-    return;
 }
 
 /***********************************************************************
@@ -395,31 +908,21 @@ void pofbf_cover_bit(uint8_t *data_ori, const uint8_t *value, uint16_t pos_b, ui
  * Output:   result data
  * Return:   POF_OK or Error code
  * Discribe: This function copies the piece of original data to the result
- *           data buffer.
+ *           data buffer. The bits after len_b in the last byte of the
+ *           result are set to 0.
  ***********************************************************************/
 void pofbf_copy_bit(const uint8_t *data_ori, uint8_t *data_res, uint16_t offset_b, uint16_t len_b) {
-    uint32_t process_len_b = 0, offset_b_x;
-    uint16_t offset_B;
-    uint8_t *ptr;
-
-    if (NULL == data_ori || NULL == data_res) {
+    if (NULL == data_ori || NULL == data_res || 0 == len_b) {
         return;
     }
 
-    offset_B = (uint16_t) (offset_b / 8);
-    offset_b_x = offset_b % 8;
-    ptr = (uint8_t *) (data_ori + offset_B);
-
-    while (process_len_b < len_b) {
-        *(data_res++) = POF_MOVE_BIT_LEFT(*ptr, offset_b_x) \
- | POF_MOVE_BIT_RIGHT(*(++ptr), 8 - offset_b_x);
-        process_len_b += 8;
+    switch ((len_b + 7) / 8 + (offset_b % 8 + len_b + 7) / 8) {
+    BIT_WINDOW_CASES(BIT_COPY_CASE)
+    default:
+        /* The bits after the field in the last byte are left 0. */
+        *(data_res + (len_b - 1) / 8) = 0;
+        bitMoveLong(data_res, 0, data_ori, offset_b, len_b);
     }
-
-    data_res--;
-    *data_res = *data_res & POF_MOVE_BIT_LEFT(0xff, process_len_b - len_b);
-
-    return;
 }
 
 void
@@ -426,6 +426,31 @@ uint32_t pof_HtoN_transfer_queryall_request(void * ptr){
     return POF_OK;
 }
 
+uint32_t pof_NtoH_transfer_bundle_ctrl(void *ptr){
+    pof_bundle_ctrl_msg *p = (pof_bundle_ctrl_msg *)ptr;
+
+    POF_NTOHL_FUNC(p->bundle_id);
+    POF_NTOHS_FUNC(p->type);
+    POF_NTOHS_FUNC(p->flags);
+
+    return POF_OK;
+}
+
+uint32_t pof_HtoN_transfer_bundle_ctrl(void *ptr){
+    return pof_NtoH_transfer_bundle_ctrl(ptr);
+}
+
+/* The body of the message added is not transferred. */
+uint32_t pof_NtoH_transfer_bundle_add(void *ptr){
+    pof_bundle_add_msg *p = (pof_bundle_add_msg *)ptr;
+
+    POF_NTOHL_FUNC(p->bundle_id);
+    POF_NTOHS_FUNC(p->flags);
+    pof_NtoH_transfer_header(&p->message);
+
+    return POF_OK;
+}
+
 static uint32_t action_OUTPUT(void *ptr){
     pof_action_output *p = (pof_action_output *)ptr;
 
@@ -313,14 +313,15 @@ static void usr_cmd_meters(CMD_ARG){
 }
 
 static void usr_cmd_counters(CMD_ARG){
-    struct counterInfo *counter, *next;
+    struct counterInfo *counter, *next, read;
     struct pof_local_resource *lr, *lrNext;
 
     POF_COMMAND_PRINT_HEAD("counter");
     HMAP_NODES_IN_STRUCT_TRAVERSE(lr, lrNext, slotNode, dp->slotMap){
         POF_COMMAND_PRINT(1,PINK,"\n[Slot %d]\n", lr->slotID);
         HMAP_NODES_IN_STRUCT_TRAVERSE(counter, next, idNode, lr->counterMap){
-            cmdPrintCounter(counter);
+            poflr_counter_read(counter, lr, &read);
+            cmdPrintCounter(&read);
         }
     }
 }
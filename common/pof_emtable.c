@@ -0,0 +1,253 @@
+/**
+ * Copyright (c) 2012, 2013, Huawei Technologies Co., Ltd.
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met: 
+ * 
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer. 
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution. 
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <string.h>
+#include "../include/pof_emtable.h"
+#include "../include/pof_hmap.h"
+#include "../include/pof_log_print.h"
+#include "../include/pof_global.h"
+#include "../include/pof_memory.h"
+#include "../include/pof_epoch.h"
+
+/* Slots when the table is created. Should be 2^x. */
+#define EMTABLE_MIN_SLOTS (16)
+/* Slots moved from the old array on each insert or delete. */
+#define EMTABLE_MOVE_STEP (16)
+
+#define SLOTS_COUNT(array) ((array)->mask + 1)
+#define SLOT_IS_USED(slot) ((slot)->key && (slot)->key != EMTABLE_TOMBSTONE)
+
+static struct emArray *
+arrayCreate(hash_t slotNum)
+{
+    struct emArray *array;
+
+    POF_MALLOC_SAFE_RETURN_SIZE(array, 1, NULL, \
+            sizeof *array + slotNum * sizeof array->slots[0]);
+    array->mask = slotNum - 1;
+    return array;
+}
+
+/* Find the slot with the key. If ptr is not NULL, the slot must hold it.
+ * The array is read by one pointer, so the mask always matches the
+ * slots. The ptr found is returned only if the key of the slot has not
+ * changed after it is read, as a deleted slot may be reused by another
+ * key at the same time. */
+static struct emSlot *
+arrayFind(struct emArray *const *arrayPtr, hash_t hash, const uint8_t *key, \
+          const void *ptr, uint16_t keyLen, void **found)
+{
+    struct emArray *array;
+    struct emSlot *slot;
+    const uint8_t *slotKey;
+    void *slotPtr;
+    hash_t i, pos = hash;
+
+    if(!(array = __atomic_load_n(arrayPtr, __ATOMIC_ACQUIRE))){
+        return NULL;
+    }
+    for(i=0; i<=array->mask; i++, pos++){
+        slot = array->slots + (pos & array->mask);
+        if(!(slotKey = __atomic_load_n(&slot->key, __ATOMIC_ACQUIRE))){
+            return NULL;
+        }
+        if(slotKey == EMTABLE_TOMBSTONE || slot->hash != hash || \
+                memcmp(slotKey, key, keyLen) != 0){
+            continue;
+        }
+        slotPtr = __atomic_load_n(&slot->ptr, __ATOMIC_ACQUIRE);
+        if(__atomic_load_n(&slot->key, __ATOMIC_ACQUIRE) != slotKey || \
+                (ptr && slotPtr != ptr)){
+            continue;
+        }
+        if(found){
+            *found = slotPtr;
+        }
+        return slot;
+    }
+    return NULL;
+}
+
+/* Put the key into the first empty or deleted slot. There is always one,
+ * as the load of the array is kept under half. */
+static void
+arrayPut(struct emArray *array, hash_t hash, const uint8_t *key, const void *ptr)
+{
+    struct emSlot *slot;
+    hash_t pos;
+
+    for(pos=hash; ; pos++){
+        slot = array->slots + (pos & array->mask);
+        if(!slot->key){
+            array->used ++;
+            break;
+        }
+        if(slot->key == EMTABLE_TOMBSTONE){
+            break;
+        }
+    }
+    /* The key is set last, as the lookups take no lock. */
+    slot->hash = hash;
+    __atomic_store_n(&slot->ptr, (void *)ptr, __ATOMIC_RELEASE);
+    __atomic_store_n(&slot->key, key, __ATOMIC_RELEASE);
+}
+
+/* Move some slots from the old array to the current one. The moved slots
+ * are kept in the old array, so that a lookup which missed the current
+ * array still finds them there. A delete removes the key from both. The
+ * old array is freed after the lookups have left it. */
+static void
+moveStep(struct emTable *table, hash_t step)
+{
+    struct emArray *old = table->old;
+    struct emSlot *slot;
+
+    if(!old){
+        return;
+    }
+    for(; step && table->oldPos<SLOTS_COUNT(old); table->oldPos++){
+        slot = old->slots + table->oldPos;
+        if(SLOT_IS_USED(slot)){
+            arrayPut(table->cur, slot->hash, slot->key, slot->ptr);
+            step --;
+        }
+    }
+    if(table->oldPos == SLOTS_COUNT(old)){
+        __atomic_store_n(&table->old, NULL, __ATOMIC_RELEASE);
+        epoch_free(old);
+    }
+}
+
+/* Start moving to a new array if the current one is half used. The new
+ * array is doubled only if there are enough entries, otherwise it just
+ * drops the tombstones. */
+static uint32_t
+growCheck(struct emTable *table)
+{
+    struct emArray *array;
+    hash_t slotNum = SLOTS_COUNT(table->cur);
+
+    if((table->cur->used + 1) * 2 <= slotNum){
+        return POF_OK;
+    }
+
+    /* Finish the last moving first. */
+    while(table->old){
+        moveStep(table, SLOTS_COUNT(table->old));
+    }
+
+    if((table->n + 1) * 3 > slotNum){
+        slotNum *= 2;
+    }
+    if((array = arrayCreate(slotNum)) == NULL){
+        return POF_ERROR;
+    }
+
+    /* The lookups search the current array first, so the old array is
+     * published before the current one is replaced. */
+    __atomic_store_n(&table->old, table->cur, __ATOMIC_RELEASE);
+    table->oldPos = 0;
+    __atomic_store_n(&table->cur, array, __ATOMIC_RELEASE);
+    return POF_OK;
+}
+
+struct emTable * 
+emtable_create(uint16_t keyLen)
+{
+    struct emTable *table;
+
+    POF_MALLOC_SAFE_RETURN(table, 1, NULL);
+    if((table->cur = arrayCreate(EMTABLE_MIN_SLOTS)) == NULL){
+        FREE(table);
+        return NULL;
+    }
+    table->keyLen = keyLen;
+    return table;
+}
+
+struct emTable * 
+emtable_destroy(struct emTable *table)
+{
+    if(table->old){
+        FREE(table->old);
+    }
+    FREE(table->cur);
+    FREE(table);
+    return NULL;
+}
+
+/* The key is not copied, and should be kept until the ptr is deleted. */
+uint32_t 
+emtable_insert(struct emTable *table, const uint8_t *key, const void *ptr)
+{
+    moveStep(table, EMTABLE_MOVE_STEP);
+    if(growCheck(table) != POF_OK){
+        return POF_ERROR;
+    }
+
+    arrayPut(table->cur, hmap_hashForBytes(key, table->keyLen), key, ptr);
+    table->n ++;
+    return POF_OK;
+}
+
+uint32_t 
+emtable_delete(struct emTable *table, const uint8_t *key, const void *ptr)
+{
+    struct emSlot *slot;
+    hash_t hash = hmap_hashForBytes(key, table->keyLen);
+    bool found = FALSE;
+
+    moveStep(table, EMTABLE_MOVE_STEP);
+    /* A moved key is in both arrays. */
+    if((slot = arrayFind(&table->cur, hash, key, ptr, table->keyLen, NULL))){
+        __atomic_store_n(&slot->key, EMTABLE_TOMBSTONE, __ATOMIC_RELEASE);
+        found = TRUE;
+    }
+    if((slot = arrayFind(&table->old, hash, key, ptr, table->keyLen, NULL))){
+        __atomic_store_n(&slot->key, EMTABLE_TOMBSTONE, __ATOMIC_RELEASE);
+        found = TRUE;
+    }
+    if(!found){
+        return POF_ERROR;
+    }
+    table->n --;
+    return POF_OK;
+}
+
+void * 
+emtable_lookup(const struct emTable *table, const uint8_t *key)
+{
+    void *ptr;
+    hash_t hash = hmap_hashForBytes(key, table->keyLen);
+
+    /* No lock is taken. The current array is searched first: a moved key
+     * stays in the old array, and the old array is published before the
+     * current one is replaced. */
+    if(arrayFind(&table->cur, hash, key, NULL, table->keyLen, &ptr) || \
+            arrayFind(&table->old, hash, key, NULL, table->keyLen, &ptr)){
+        return ptr;
+    }
+    return NULL;
+}
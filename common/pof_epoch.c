@@ -0,0 +1,193 @@
+/**
+ * Copyright (c) 2012, 2013, Huawei Technologies Co., Ltd.
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met: 
+ * 
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer. 
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution. 
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <pthread.h>
+#include "../include/pof_type.h"
+#include "../include/pof_epoch.h"
+#include "../include/pof_log_print.h"
+#include "../include/pof_global.h"
+#include "../include/pof_memory.h"
+
+/* An object waiting for the readers. */
+struct epochRetired {
+    struct epochRetired *next;
+    void *ptr;
+    EPOCH_FREE_FUNC func;
+    uint64_t epoch;             /* Epoch when it was retired. */
+};
+
+/* The epoch only increases, starting from 1, as 0 means offline. */
+static uint64_t epoch_global = 1;
+
+/* The readers and the retired objects are only touched by the writers,
+ * and by the readers when they register and unregister. */
+static pthread_mutex_t epoch_mutex = PTHREAD_MUTEX_INITIALIZER;
+static struct epochReader *epoch_readers = NULL;
+static struct epochRetired *epoch_retiredHead = NULL;
+static struct epochRetired **epoch_retiredTail = &epoch_retiredHead;
+
+/* Register the calling thread as an online reader. */
+struct epochReader *
+epoch_readerRegister()
+{
+    struct epochReader *reader;
+
+    POF_MALLOC_SAFE_RETURN(reader, 1, NULL);
+    pthread_mutex_lock(&epoch_mutex);
+    reader->next = epoch_readers;
+    epoch_readers = reader;
+    pthread_mutex_unlock(&epoch_mutex);
+
+    epoch_online(reader);
+    return reader;
+}
+
+/* Can be used as the cleanup handler of a cancelled reader. */
+void
+epoch_readerUnregister(void *ptr)
+{
+    struct epochReader *reader = ptr, **pr;
+
+    if(!reader){
+        return;
+    }
+    pthread_mutex_lock(&epoch_mutex);
+    for(pr=&epoch_readers; *pr; pr=&(*pr)->next){
+        if(*pr == reader){
+            *pr = reader->next;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&epoch_mutex);
+    FREE(reader);
+}
+
+/* The reader holds no pointer into the shared structures now. The
+ * store is a full barrier, so the reads after it can not see anything
+ * older than the epoch. */
+void
+epoch_quiescent(struct epochReader *reader)
+{
+    __atomic_store_n(&reader->epoch, __atomic_load_n(&epoch_global, __ATOMIC_ACQUIRE), \
+            __ATOMIC_SEQ_CST);
+}
+
+/* The reader is going to block. The writers do not wait for it. */
+void
+epoch_offline(struct epochReader *reader)
+{
+    __atomic_store_n(&reader->epoch, EPOCH_OFFLINE, __ATOMIC_RELEASE);
+}
+
+/* The reader is back, and may read the shared structures again. */
+void
+epoch_online(struct epochReader *reader)
+{
+    epoch_quiescent(reader);
+}
+
+/* Free the object after all the readers have left it. It should have been
+ * unlinked, so that no reader can find it again. */
+void
+epoch_retire(void *ptr, EPOCH_FREE_FUNC func)
+{
+    struct epochRetired *retired;
+
+    if(!ptr){
+        return;
+    }
+    /* Leak the object rather than free it under a reader. */
+    if(!(retired = MALLOC(sizeof *retired))){
+        POF_ERROR_HANDLE_NO_RETURN_NO_UPWARD(POFET_SOFTWARE_FAILED, POF_ALLOCATE_RESOURCE_FAILURE);
+        return;
+    }
+    retired->next = NULL;
+    retired->ptr = ptr;
+    retired->func = func;
+
+    pthread_mutex_lock(&epoch_mutex);
+    retired->epoch = epoch_global;
+    *epoch_retiredTail = retired;
+    epoch_retiredTail = &retired->next;
+    pthread_mutex_unlock(&epoch_mutex);
+}
+
+static void
+epochFree(void *ptr)
+{
+    FREE(ptr);
+}
+
+/* FREE the object after all the readers have left it. */
+void
+epoch_free(void *ptr)
+{
+    epoch_retire(ptr, epochFree);
+}
+
+/***********************************************************************
+ * Reclaim the retired objects
+ * Form:     void epoch_reclaim()
+ * Input:    NONE
+ * Output:   NONE
+ * Return:   VOID
+ * Discribe: This function starts a new epoch, and frees the objects
+ *           retired in the epochs which every online reader has left.
+ *           The epoch only moves here when there is something to free,
+ *           so the lookup caches of the readers, which are kept within
+ *           one epoch, are not dropped for nothing.
+ ***********************************************************************/
+void
+epoch_reclaim()
+{
+    struct epochReader *reader;
+    struct epochRetired *retired;
+    uint64_t min, epoch;
+
+    pthread_mutex_lock(&epoch_mutex);
+    if(!epoch_retiredHead){
+        pthread_mutex_unlock(&epoch_mutex);
+        return;
+    }
+
+    min = __atomic_add_fetch(&epoch_global, 1, __ATOMIC_SEQ_CST);
+    for(reader=epoch_readers; reader; reader=reader->next){
+        epoch = __atomic_load_n(&reader->epoch, __ATOMIC_SEQ_CST);
+        if(epoch != EPOCH_OFFLINE && epoch < min){
+            min = epoch;
+        }
+    }
+
+    /* The list is in the order of the epoch. */
+    while((retired = epoch_retiredHead) && retired->epoch < min){
+        epoch_retiredHead = retired->next;
+        retired->func(retired->ptr);
+        FREE(retired);
+    }
+    if(!epoch_retiredHead){
+        epoch_retiredTail = &epoch_retiredHead;
+    }
+    pthread_mutex_unlock(&epoch_mutex);
+}
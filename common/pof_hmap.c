@@ -126,7 +126,7 @@ hmap_nodeGetWithHash(const struct hmap *map, hash_t hash)
 struct hnode * 
 hmap_nodeGetWithHashNext(const struct hnode *node, hash_t hash)
 {
-    for(; node, node->hash!=hash; node=node->next){
+    for(node=node->next; node && node->hash!=hash; node=node->next){
         continue;
     }
     return (struct hnode *)node;
@@ -171,8 +171,9 @@ void
 hmap_nodeInsert(struct hmap *map, struct hnode *node)
 {
     struct hnode **bkt = bucketWithHash(map, node->hash);
+    /* The lookups take no lock. Publish the node after it is linked. */
     node->next = *bkt;
-    *bkt = node;
+    __atomic_store_n(bkt, node, __ATOMIC_RELEASE);
     map->n ++;
 }
 
@@ -182,7 +183,8 @@ hmap_nodeDelete(struct hmap *map, struct hnode *node)
     struct hnode **pnode;
     for(pnode=bucketWithHash(map,node->hash); *pnode; pnode=&(*pnode)->next){
         if(*pnode == node){
-            *pnode = node->next;
+            /* node->next is kept for the lookups still on the node. */
+            __atomic_store_n(pnode, node->next, __ATOMIC_RELEASE);
             map->n --;
             return;
         }
@@ -239,17 +241,44 @@ hash_t hmap_hashForUint32(uint32_t value)
     return (uint32_t)(value * HASH_S);
 }
 
+#define HASH_ROTL(x, r) (((x) << (r)) | ((x) >> (32 - (r))))
+
+/* Scramble one 32-bit block, as in MurmurHash3. */
+static uint32_t
+hashBlock(uint32_t k)
+{
+    k *= 0xCC9E2D51;
+    k = HASH_ROTL(k, 15);
+    return k * 0x1B873593;
+}
+
+/* MurmurHash3 (x86, 32-bit). Every byte affects the whole hash, and the
+ * position of the bytes matters. */
 hash_t hmap_hashForBytes(const void *value, size_t n)
 {
-    uint32_t *p, left = 0;
-    hash_t hash = 0;
-    for(p = (uint32_t *)value; n >= 4; n -= 4, p ++){
-        hash ^= hmap_hashForUint32(*p);
+    const uint8_t *p = (const uint8_t *)value;
+    uint32_t k, hash = HASH_S;
+    size_t len = n;
+
+    for(; n >= 4; n -= 4, p += 4){
+        memcpy(&k, p, 4);
+        hash ^= hashBlock(k);
+        hash = HASH_ROTL(hash, 13);
+        hash = hash * 5 + 0xE6546B64;
     }
     if(n != 0){
-        memcpy(&left, p, n);
-        hash ^= hmap_hashForUint32(left);
+        k = 0;
+        memcpy(&k, p, n);
+        hash ^= hashBlock(k);
     }
+
+    /* Final avalanche. */
+    hash ^= (uint32_t)len;
+    hash ^= hash >> 16;
+    hash *= 0x85EBCA6B;
+    hash ^= hash >> 13;
+    hash *= 0xC2B2AE35;
+    hash ^= hash >> 16;
     return hash;
 }
 
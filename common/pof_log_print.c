@@ -162,6 +162,10 @@ cmdPrintMeter(const struct meterInfo *meter)
     POF_COMMAND_PRINT(1,WHITE,"%u ", meter->rate);
     POF_COMMAND_PRINT(1,CYAN,"meter_id=");
     POF_COMMAND_PRINT(1,WHITE,"%u ", meter->id);
+    POF_COMMAND_PRINT(1,CYAN,"drop_packets=");
+    COMMAND_PRINT_U64(meter->dropPackets);
+    POF_COMMAND_PRINT(1,CYAN,"drop_bytes=");
+    COMMAND_PRINT_U64(meter->dropBytes);
     POF_COMMAND_PRINT(1,CYAN,"\n");
 }
 
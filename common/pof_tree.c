@@ -27,6 +27,7 @@
 #include "../include/pof_log_print.h"
 #include "../include/pof_global.h"
 #include "../include/pof_memory.h"
+#include "../include/pof_epoch.h"
 
 struct tree * 
 tree_create()
@@ -71,105 +72,143 @@ tree_nodeCreate()
 void
 tree_nodeDestroy(struct treeNode **node)
 {
-    if((*node)->leftSon){
-        tree_nodeDestroy(&(*node)->leftSon);
-    }
-    if((*node)->rightSon){
-        tree_nodeDestroy(&(*node)->rightSon);
+    uint32_t i;
+    for(i=0; i<TREE_SLOT_NUM; i++){
+        if((*node)->son[i]){
+            tree_nodeDestroy(&(*node)->son[i]);
+        }
     }
     FREE(*node);
     *node = NULL;
     return;
 }
 
-static void
-moveLeft(uint8_t *value, uint32_t bitNum)
+/* Get the stride bits of the value at the depth, without touching the value. */
+static uint8_t
+getStride(const uint8_t *value, uint32_t depth)
 {
-    uint32_t i;
-    if(!bitNum){
-        return;
-    }
-    for(i=0; i<(POF_BITNUM_TO_BYTENUM_CEIL(bitNum)-1); i++){
-        *(value + i) = (*(value + i) << 1) | (*(value + i + 1) >> 7);
-    }
-    *(value + i) = *(value + i) << 1;
+    uint8_t byte = *(value + depth / 2);
+    return (depth & 1) ? (byte & 0x0F) : (byte >> 4);
 }
 
-static bool
-toLeft(const uint8_t *value)
-{
-    return ((*value & 0x80) != 0x80);
-}
-
-static bool
-isLeaf(const struct treeNode *node)
+/* Position of the prefix in the node: the depth, the prefix length r inside
+ * the node, and the index in treeNode.prefix[]. */
+static void
+prefixPos(const uint8_t *value, uint32_t bitNum, \
+          uint32_t *depth, uint32_t *r, uint32_t *index)
 {
-    return ( !node->leftSon && !node->rightSon );
+    *depth = bitNum ? (bitNum - 1) / TREE_STRIDE : 0;
+    *r = bitNum - *depth * TREE_STRIDE;
+    *index = (1 << *r) | (getStride(value, *depth) >> (TREE_STRIDE - *r));
 }
 
-static bool
-isRoot(const struct treeNode *node, const struct tree *tree)
+/* Recalculate the best prefix of the slots covered by the prefix with
+ * index in the node. */
+static void
+slotsUpdate(struct treeNode *node, uint32_t r, uint32_t index)
 {
-    return ( node == tree->root );
+    uint32_t slot, first, last, len;
+    void *best;
+
+    first = (index & ((1 << r) - 1)) << (TREE_STRIDE - r);
+    last = first + (1 << (TREE_STRIDE - r));
+    for(slot=first; slot<last; slot++){
+        best = NULL;
+        for(len=TREE_STRIDE+1; len>0 && !best; len--){
+            best = node->prefix[(1 << (len - 1)) | (slot >> (TREE_STRIDE - len + 1))];
+        }
+        __atomic_store_n(&node->best[slot], best, __ATOMIC_RELEASE);
+    }
 }
 
 uint32_t 
-tree_nodeInsert(struct tree *tree, const void *ptr, uint8_t *value, uint32_t bitNum)
+tree_nodeInsert(struct tree *tree, const void *ptr, const uint8_t *value, uint32_t bitNum)
 {
-    struct treeNode ** node = &tree->root;
-    while(bitNum > 0){
-        node = (toLeft(value)) ? &(*node)->leftSon : &(*node)->rightSon;
-        moveLeft(value, bitNum);
-        bitNum --;
-
-        if(!(*node)){
-            *node = tree_nodeCreate();
-            POF_MALLOC_ERROR_HANDLE_RETURN_NO_UPWARD(*node);
+    struct treeNode **node = &tree->root, *son;
+    uint32_t depth, r, index, i;
+
+    prefixPos(value, bitNum, &depth, &r, &index);
+    for(i=0; i<depth; i++){
+        if(!(*node)->son[getStride(value, i)]){
+            /* The lookups take no lock. Publish the son after it is zeroed. */
+            son = tree_nodeCreate();
+            POF_MALLOC_ERROR_HANDLE_RETURN_NO_UPWARD(son);
+            __atomic_store_n(&(*node)->son[getStride(value, i)], son, __ATOMIC_RELEASE);
+            (*node)->count ++;
         }
+        node = &(*node)->son[getStride(value, i)];
+    }
+
+    if(!(*node)->prefix[index]){
+        (*node)->count ++;
+        tree->count ++;
     }
-    
-    (*node)->ptr = (void *)ptr;
-    tree->count ++;
+    __atomic_store_n(&(*node)->prefix[index], (void *)ptr, __ATOMIC_RELEASE);
+    slotsUpdate(*node, r, index);
     return POF_OK;
 }
 
-uint32_t 
-tree_nodeDelete(struct tree *tree, uint8_t *value, uint32_t bitNum)
+/* Delete the prefix under the node, and FREE the nodes which become empty
+ * on the way back, after the lookups have left them. */
+static uint32_t
+nodeDelete(struct tree *tree, struct treeNode *node, const void *ptr, \
+           const uint8_t *value, uint32_t depth, uint32_t r, uint32_t index, uint32_t curDepth)
 {
-    struct treeNode ** node = &tree->root;
-    while(bitNum > 0){
-        node = (toLeft(value)) ? &(*node)->leftSon : &(*node)->rightSon;
-        moveLeft(value, bitNum);
-        bitNum --;
+    struct treeNode **son, *empty;
+    uint32_t ret;
 
-        if(!(*node)){
+    if(curDepth == depth){
+        if(!node->prefix[index]){
             return POF_ERROR;
         }
+        /* The prefix has been overwritten by another entry. */
+        if(node->prefix[index] != ptr){
+            return POF_OK;
+        }
+        __atomic_store_n(&node->prefix[index], NULL, __ATOMIC_RELEASE);
+        node->count --;
+        tree->count --;
+        slotsUpdate(node, r, index);
+        return POF_OK;
     }
 
-    (*node)->ptr = NULL;
-    if(isLeaf(*node) && !isRoot(*node, tree)){
-        FREE(*node);
-        *node = NULL;
+    son = &node->son[getStride(value, curDepth)];
+    if(!*son){
+        return POF_ERROR;
+    }
+    ret = nodeDelete(tree, *son, ptr, value, depth, r, index, curDepth + 1);
+    if((empty = *son)->count == 0){
+        __atomic_store_n(son, NULL, __ATOMIC_RELEASE);
+        epoch_free(empty);
+        node->count --;
     }
+    return ret;
+}
 
-    tree->count --;
-    return POF_OK;
+uint32_t 
+tree_nodeDelete(struct tree *tree, const void *ptr, const uint8_t *value, uint32_t bitNum)
+{
+    uint32_t depth, r, index;
+
+    prefixPos(value, bitNum, &depth, &r, &index);
+    return nodeDelete(tree, tree->root, ptr, value, depth, r, index, 0);
 }
 
+/* Walk down one stride per level. The value is only read. No lock is
+ * taken, the nodes and the entries are freed through the epoch. */
 void * 
-tree_nodeLookup(const struct tree *tree, uint8_t *value, uint32_t bitNum)
+tree_nodeLookup(const struct tree *tree, const uint8_t *value, uint32_t bitNum)
 {
-    struct treeNode *next = tree->root, *node;
-    void *ptr = NULL;
-    while(next){
-        node = next;
-        if(node->ptr){
-            ptr = node->ptr;
+    const struct treeNode *node = tree->root;
+    uint32_t depth, slot;
+    void *ptr = __atomic_load_n(&node->prefix[1], __ATOMIC_ACQUIRE), *best;
+
+    for(depth=0; node && depth*TREE_STRIDE<bitNum; depth++){
+        slot = getStride(value, depth);
+        if((best = __atomic_load_n(&node->best[slot], __ATOMIC_ACQUIRE))){
+            ptr = best;
         }
-        next = (toLeft(value)) ? node->leftSon : node->rightSon;
-        moveLeft(value,bitNum);
-        bitNum --;
+        node = __atomic_load_n(&node->son[slot], __ATOMIC_ACQUIRE);
     }
     return ptr;
 }
@@ -177,16 +216,19 @@ tree_nodeLookup(const struct tree *tree, uint8_t *value, uint32_t bitNum)
 static uint32_t
 nodeTrav(const struct treeNode *node, uint32_t func(void *), void *arg)
 {
+    uint32_t i;
     if(!node){
         return POF_OK;
     }
-    if((nodeTrav(node->leftSon, func, arg) != POF_OK) || \
-            nodeTrav(node->rightSon, func, arg) != POF_OK){
-        return POF_ERROR;
+    for(i=0; i<TREE_SLOT_NUM; i++){
+        if(nodeTrav(node->son[i], func, arg) != POF_OK){
+            return POF_ERROR;
+        }
     }
-
-    if(node->ptr){
-        return func((struct treeNode *)node);
+    for(i=1; i<TREE_SLOT_NUM*2; i++){
+        if(node->prefix[i] && func(node->prefix[i]) != POF_OK){
+            return POF_ERROR;
+        }
     }
     return POF_OK;
 }
@@ -1,4 +1,5 @@
 DATAPATH_FOLDER = datapath
 pofswitch_SOURCES += $(DATAPATH_FOLDER)/pof_action.c \
 					 $(DATAPATH_FOLDER)/pof_datapath.c \
-					 $(DATAPATH_FOLDER)/pof_instruction.c
+					 $(DATAPATH_FOLDER)/pof_instruction.c \
+					 $(DATAPATH_FOLDER)/pof_jit.c
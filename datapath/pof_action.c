@@ -41,12 +41,7 @@ static void action_update(struct pofdp_packet *dpp){
     if(--dpp->act_num < 1){
         return;
     }
-#ifdef POF_SHT_VXLAN
-    dpp->act = (struct pof_action *)( 
-            (uint8_t *)dpp->act + dpp->act->len );
-#else // POF_SHT_VXLAN
     dpp->act++;
-#endif // POF_SHT_VXLAN
     return;
 }
 
@@ -78,32 +73,67 @@ static uint32_t bzero_bit(uint8_t *data, uint16_t pos_b, uint16_t len_b){
     return POF_OK;
 }
 
-/* Insert a tag into the packet data. */
+/* The first byte of the packet in the memery. The offset can be negative
+ * after the packet has been encapsulated, and then the packet starts at
+ * buf_offset. */
+#define PACKET_HEAD(dpp) \
+    ((dpp)->offset < 0 ? (dpp)->buf_offset : (dpp)->packetBuf)
+
+/* Insert a tag into the packet data. A tag of whole bytes at a byte
+ * position makes its room by moving the shorter side of the packet: the
+ * bytes in front of the tag move into the headroom, or the bytes behind it
+ * move into the tailroom. Other tags shift the bits behind them. */
 static uint32_t
 insertTagToPacket(uint32_t tag_pos_b, uint32_t tag_len_b, const uint8_t *value, POFDP_ARG)
 {
     uint8_t  buf_behindtag[POFDP_PACKET_RAW_MAX_LEN];
-    uint32_t len_b_behindtag = 0;
+    uint8_t  *head = PACKET_HEAD(dpp), *pos;
+    uint32_t len_b_behindtag = 0, tag_len_B, front_B, back_B;
+    uint8_t  headroom, tailroom;
 
-    /* The length behind the tag, unit is bit. */
-    len_b_behindtag = dpp->left_len * 8 - tag_pos_b;
+    tag_len_B = POF_BITNUM_TO_BYTENUM_CEIL(tag_len_b);
 
     /* Check the length. */
-    if((dpp->offset + dpp->left_len + POF_BITNUM_TO_BYTENUM_CEIL(tag_len_b)) > POFDP_PACKET_RAW_MAX_LEN \
-            || len_b_behindtag < 0){
+    if(tag_pos_b > (uint32_t)dpp->left_len * POF_BITNUM_IN_BYTE){
         POF_ERROR_HANDLE_RETURN_NO_UPWARD(POFET_SOFTWARE_FAILED, POF_PACKET_LEN_ERROR);
     }
+    headroom = (head - dpp->bufStart >= tag_len_B);
+    tailroom = (dpp->bufEnd - (dpp->buf_offset + dpp->left_len) >= tag_len_B);
+
+    if((tag_pos_b % POF_BITNUM_IN_BYTE == 0) && (tag_len_b % POF_BITNUM_IN_BYTE == 0) \
+            && (headroom || tailroom)){
+        pos = dpp->buf_offset + tag_pos_b / POF_BITNUM_IN_BYTE;
+        front_B = pos - head;
+        back_B = dpp->buf_offset + dpp->left_len - pos;
+
+        if(headroom && (front_B <= back_B || !tailroom)){
+            memmove(head - tag_len_B, head, front_B);
+            dpp->packetBuf  -= tag_len_B;
+            dpp->buf_offset -= tag_len_B;
+            pos -= tag_len_B;
+        }else{
+            memmove(pos + tag_len_B, pos, back_B);
+        }
+        memcpy(pos, value, tag_len_B);
+    }else{
+        if(!tailroom){
+            POF_ERROR_HANDLE_RETURN_NO_UPWARD(POFET_SOFTWARE_FAILED, POF_PACKET_LEN_ERROR);
+        }
 
-    /* Copy the data left to a temp buffer. */
-    pofbf_copy_bit(dpp->buf_offset, buf_behindtag, tag_pos_b, len_b_behindtag);
-    /* Copy the tag value into the packet data. */
-    pofbf_cover_bit(dpp->buf_offset, value, tag_pos_b, tag_len_b);
-    /* Copy the temp buffer back to the packet data behind the tag. */
-    pofbf_cover_bit(dpp->buf_offset, buf_behindtag, tag_pos_b+tag_len_b, len_b_behindtag);
+        /* The length behind the tag, unit is bit. */
+        len_b_behindtag = dpp->left_len * POF_BITNUM_IN_BYTE - tag_pos_b;
+
+        /* Copy the data left to a temp buffer. */
+        pofbf_copy_bit(dpp->buf_offset, buf_behindtag, tag_pos_b, len_b_behindtag);
+        /* Copy the tag value into the packet data. */
+        pofbf_cover_bit(dpp->buf_offset, value, tag_pos_b, tag_len_b);
+        /* Copy the temp buffer back to the packet data behind the tag. */
+        pofbf_cover_bit(dpp->buf_offset, buf_behindtag, tag_pos_b+tag_len_b, len_b_behindtag);
+    }
 
     /* Updata the packet length. */
-    dpp->left_len += POF_BITNUM_TO_BYTENUM_CEIL(tag_len_b);
-    POF_PACKET_REL_LEN_INC(dpp, POF_BITNUM_TO_BYTENUM_CEIL(tag_len_b));
+    dpp->left_len += tag_len_B;
+    POF_PACKET_REL_LEN_INC(dpp, tag_len_B);
 
     return POF_OK;
 }
@@ -186,21 +216,35 @@ calChecksum(uint8_t *checksum_buf, uint8_t *cal_buf, \
 
 /***********************************************************************
  * Handle the action with POFAT_COUNTER type.
- * Form:     execute_COUNTER(POFDP_ARG)
+ * Form:     execute_COUNTER(POFDP_OP_ARG)
  * Input:    dpp->act, dpp->act_num, dp->resource
  * Return:   POF_OK or Error code
  * Discribe: This function handles the action with POFAT_COUNTER type. The
  *           counter value corresponding the counter_id given by
  *           action_data will increase by 1.
  ***********************************************************************/
-static uint32_t execute_COUNTER(POFDP_ARG)
+static uint32_t execute_COUNTER(POFDP_OP_ARG)
 {
-    pof_action_counter *p = (pof_action_counter *)dpp->act->action_data;
+#ifndef POF_SHT_VXLAN
+    pof_action_counter *p = (pof_action_counter *)op->data;
+#endif // POF_SHT_VXLAN
     uint32_t ret, counterID = 0;
 
+    /* Increace the Counter bound when the action was installed. */
+    if(POFLR_REF_GET(&op->ref)){
+#ifdef POF_SD2N
+        ret = poflr_counter_increace_ref(&op->ref, 0, lr);
+#else // POF_SD2N
+        ret = poflr_counter_increace_ref(&op->ref, lr);
+#endif // POF_SD2N
+        POF_CHECK_RETVALUE_RETURN_NO_UPWARD(ret);
+        action_update(dpp);
+        return POF_OK;
+    }
+
     /* Get counterID. */
 #ifdef POF_SHT_VXLAN
-    ret = pofdp_get_32value(&counterID, p->id_type, &p->counter_id, dpp);
+    ret = POFDP_OPERAND_GET(&counterID, op, 0, dpp);
     POF_CHECK_RETVALUE_RETURN_NO_UPWARD(ret);
 #else // POF_SHT_VXLAN
     counterID = p->counter_id;
@@ -267,10 +311,10 @@ headerFmtIpv4(struct ipv4_header *header, const uint8_t *sip, \
 }
 
 static uint32_t
-execute_ENCAP_VXLAN_HEADER(POFDP_ARG)
+execute_ENCAP_VXLAN_HEADER(POFDP_OP_ARG)
 {
 	struct pof_action_encap_vxlan_header *p = \
-			(struct pof_action_encap_vxlan_header *)dpp->act->action_data;
+			(struct pof_action_encap_vxlan_header *)op->data;
     uint8_t vni[POF_VXLAN_VNI_LEN] = {0};
     uint32_t ret;
 
@@ -292,10 +336,10 @@ execute_ENCAP_VXLAN_HEADER(POFDP_ARG)
 }
 
 static uint32_t
-execute_ENCAP_UDP_HEADER(POFDP_ARG)
+execute_ENCAP_UDP_HEADER(POFDP_OP_ARG)
 {
 	struct pof_action_encap_udp_header *p = \
-			(struct pof_action_encap_udp_header *)dpp->act->action_data;
+			(struct pof_action_encap_udp_header *)op->data;
     uint16_t sport = 0, dport = 0;
     uint32_t ret;
 
@@ -318,10 +362,10 @@ execute_ENCAP_UDP_HEADER(POFDP_ARG)
 }
 
 static uint32_t
-execute_ENCAP_IP_HEADER(POFDP_ARG)
+execute_ENCAP_IP_HEADER(POFDP_OP_ARG)
 {
 	struct pof_action_encap_ip_header *p = \
-			(struct pof_action_encap_ip_header *)dpp->act->action_data;
+			(struct pof_action_encap_ip_header *)op->data;
     uint16_t ethType = 0;
     uint8_t sip[POF_IPV4_ALEN] = {0}, dip[POF_IPV4_ALEN] = {0}, tos = 0, protocol = 0;
     uint32_t ret;
@@ -355,10 +399,10 @@ execute_ENCAP_IP_HEADER(POFDP_ARG)
 }
 
 static uint32_t
-execute_ENCAP_MAC_HEADER(POFDP_ARG)
+execute_ENCAP_MAC_HEADER(POFDP_OP_ARG)
 {
 	struct pof_action_encap_mac_header *p = \
-			(struct pof_action_encap_mac_header *)dpp->act->action_data;
+			(struct pof_action_encap_mac_header *)op->data;
     uint16_t ethType = 0;
     uint8_t dmac[POF_ETH_ALEN] = {0}, smac[POF_ETH_ALEN] = {0};
     uint32_t ret;
@@ -433,16 +477,16 @@ calculate_BITWISE_NOR(uint32_t value, uint32_t operand)
 }
 
 static uint32_t
-execute_CALCULATE_FIELD(POFDP_ARG)
+execute_CALCULATE_FIELD(POFDP_OP_ARG)
 {
 	struct pof_action_calc_field *p = \
-			(struct pof_action_calc_field *)dpp->act->action_data;
+			(struct pof_action_calc_field *)op->data;
 	uint32_t value1, operand, result, ret;
 
-	ret = pofdp_get_32value(&value1, POFVT_FIELD, &p->dst_field, dpp);
+	ret = POFDP_OPERAND_GET(&value1, op, 0, dpp);
 	POF_CHECK_RETVALUE_RETURN_NO_UPWARD(ret);
 
-	ret = pofdp_get_32value(&operand, p->src_type, &p->src_operand, dpp);
+	ret = POFDP_OPERAND_GET(&operand, op, 1, dpp);
 	POF_CHECK_RETVALUE_RETURN_NO_UPWARD(ret);
 
 	switch(p->calc_type){
@@ -471,39 +515,155 @@ execute_CALCULATE_FIELD(POFDP_ARG)
 
 #endif // POF_SHT_VXLAN
 
+/* Whether the bucket of a group is live. Only the output to a physical
+ * port with the immediate id is watched. */
+static uint8_t
+groupBucketLive(const struct pofdp_op *op)
+{
+    pof_action_output *p = (pof_action_output *)op->data;
+    const struct pof_local_resource *lrPort;
+    uint32_t value;
+
+    if(op->type != POFAT_OUTPUT){
+        return TRUE;
+    }
+#ifdef POF_SD2N
+    if(p->portId_type != POFVT_IMMEDIATE_NUM){
+        return TRUE;
+    }
+    value = op->opnd[0].u.value;
+#else // POF_SD2N
+    value = p->outputPortId;
+#endif // POF_SD2N
+    /* The flood port 255 and the logical ports are not watched. */
+    if((value & 0xFFFF) >= 255){
+        return TRUE;
+    }
+    if((lrPort = POFLR_REF_GET(&op->ref)) == NULL){
+        return FALSE;
+    }
+    return poflr_port_live(value & 0xFFFF, lrPort);
+}
+
+/* Hash the packet by the select hash fields, which are at the offsets from
+ * the start of the packet. The fields beyond the packet are left out. */
+static hash_t
+groupSelectHash(const struct pofdp_packet *dpp, const struct pof_local_resource *lr)
+{
+    uint8_t key[POF_MAX_FIELD_LENGTH_IN_BYTE * POF_MAX_MATCH_FIELD_NUM];
+    uint32_t i, len = 0, packetLen_b = POF_PACKET_REL_LEN_GET(dpp) * POF_BITNUM_IN_BYTE;
+    const pof_match *field;
+
+    for(i=0; i<lr->selectHashFieldNum; i++){
+        field = &lr->selectHashField[i];
+        if((uint32_t)field->offset + field->len > packetLen_b){
+            continue;
+        }
+        pofbf_copy_bit(dpp->packetBuf, key + len, field->offset, field->len);
+        len += POF_BITNUM_TO_BYTENUM_CEIL(field->len);
+    }
+    return hmap_hashForBytes(key, len);
+}
+
+/* Choose the bucket of the SELECT group by the lookup table. If it is not
+ * live, the packet probes the table a few more times, and then takes the
+ * first live bucket after it. */
+static const struct pofdp_op *
+groupBucketSelect(const struct pofdp_packet *dpp, const struct pof_local_resource *lr, \
+                  const struct groupInfo *group)
+{
+    const struct pofdp_op *bucket;
+    uint32_t i, pos, step, M = POFLR_GROUP_SELECT_TABLE_SIZE;
+    hash_t hash;
+
+    if(group->action_number == 0){
+        return NULL;
+    }
+    hash = groupSelectHash(dpp, lr);
+    pos = hash % M;
+    step = (hash >> 16) % (M - 1) + 1;
+    for(i=0; i<=POFLR_GROUP_SELECT_PROBE_NUM; i++){
+        bucket = &group->prog->op[group->selectTable[(pos + i * step) % M]];
+        if(groupBucketLive(bucket)){
+            return bucket;
+        }
+    }
+    for(i=1; i<group->action_number; i++){
+        bucket = &group->prog->op[(group->selectTable[pos] + i) % group->action_number];
+        if(groupBucketLive(bucket)){
+            return bucket;
+        }
+    }
+    return NULL;
+}
+
+/* Choose the first live bucket of the FAST_FAILOVER group. */
+static const struct pofdp_op *
+groupBucketFailover(const struct groupInfo *group)
+{
+    uint32_t i;
+
+    for(i=0; i<group->action_number; i++){
+        if(groupBucketLive(&group->prog->op[i])){
+            return &group->prog->op[i];
+        }
+    }
+    return NULL;
+}
+
 /***********************************************************************
  * Handle the action with POFAT_GROUP type.
- * Form:     uint32_t execute_GROUP(POFDP_ARG)
+ * Form:     uint32_t execute_GROUP(POFDP_OP_ARG)
  * Input:    dpp, dp->resource, 
  * Return:   POF_OK or Error code
  * Discribe: This function handles the action with POFAT_GROUP type. The
  *           packet will be forward to the group table. The group id is
- *           given in action_data. In this version, we consider all group 
- *           type is all.
+ *           given in action_data. All the actions of an ALL or INDIRECT
+ *           group are executed. Each action of a SELECT or FAST_FAILOVER
+ *           group is a bucket, and only the bucket chosen by the hash of
+ *           the packet or by the port liveness is executed. The packet is
+ *           dropped if no bucket is live.
  * Note:     If there is an ERROR, The packet_over identifier will be TRUE
  ***********************************************************************/
-static uint32_t execute_GROUP(POFDP_ARG)
+static uint32_t execute_GROUP(POFDP_OP_ARG)
 {
-    pof_action_group *p = (pof_action_group *)dpp->act->action_data;
+    pof_action_group *p = (pof_action_group *)op->data;
+    const struct pofdp_op *bucket;
     struct groupInfo *group;
     uint32_t   group_id, ret;
 
     group_id = p->group_id;
-    if(!(group = poflr_get_group_with_ID(group_id, lr))){
+    if(!(group = POFLR_REF_GET(&op->ref)) && \
+            !(group = poflr_get_group_with_ID(group_id, lr))){
         POF_ERROR_HANDLE_RETURN_NO_UPWARD(POFET_GROUP_MOD_FAILED, POFGMFC_UNKNOWN_GROUP);
     }
 
     POF_DEBUG_CPRINT_FL(1,BLUE,"Go to Group[%u]", group_id);
 
 #ifdef POF_SD2N
-    ret = poflr_counter_increace(group->counter_id, POF_PACKET_REL_LEN_GET(dpp), lr);
+    ret = poflr_counter_increace_ref(&group->counterRef, POF_PACKET_REL_LEN_GET(dpp), lr);
 #else // POF_SD2N
-    ret = poflr_counter_increace(group->counter_id, lr);
+    ret = poflr_counter_increace_ref(&group->counterRef, lr);
 #endif // POF_SD2N
     POF_CHECK_RETVALUE_RETURN_NO_UPWARD(ret);
 
-	dpp->act = group->action;
-	dpp->act_num = group->action_number;
+    if(group->type == POFGT_SELECT || group->type == POFGT_FF){
+        if(group->type == POFGT_SELECT){
+            bucket = groupBucketSelect(dpp, lr, group);
+        }else{
+            bucket = groupBucketFailover(group);
+        }
+        if(bucket == NULL){
+            POF_DEBUG_CPRINT_FL(1,BLUE,"Drop the packet: No live bucket in group[%u]", group_id);
+            dpp->packet_done = TRUE;
+            return POF_OK;
+        }
+        dpp->act = bucket;
+        dpp->act_num = 1;
+    }else{
+        dpp->act = group->prog->op;
+        dpp->act_num = group->prog->opNum;
+    }
 
     ret = pofdp_action_execute(dpp, lr);
     POF_CHECK_RETVALUE_RETURN_NO_UPWARD(ret);
@@ -514,21 +674,23 @@ static uint32_t execute_GROUP(POFDP_ARG)
 
 /***********************************************************************
  * Handle the action with POFAT_TOCP type.
- * Form:     uint32_t execute_PACKET_IN(POFDP_ARG)
- * Input:    dpp->act, dpp->act_num, dpp->buf, dpp->offset, dpp->left_len,
+ * Form:     uint32_t execute_PACKET_IN(POFDP_OP_ARG)
+ * Input:    dpp->act, dpp->act_num, dpp->packetBuf, dpp->offset, dpp->left_len,
  *           dpp->table_type, dpp->table_id, dp->resource
  * Return:   POF_OK or Error code
  * Discribe: This function send the packet upward to the Controller through
  *           the OpenFlow Channel.
  ***********************************************************************/
-static uint32_t execute_PACKET_IN(POFDP_ARG)
+static uint32_t execute_PACKET_IN(POFDP_OP_ARG)
 {
-    pof_action_packet_in *p = (pof_action_packet_in *)dpp->act->action_data;
+#ifndef POF_SHT_VXLAN
+    pof_action_packet_in *p = (pof_action_packet_in *)op->data;
+#endif // POF_SHT_VXLAN
     uint32_t reason, ret;
     uint8_t  table_ID;
 
 #ifdef POF_SHT_VXLAN
-    ret = pofdp_get_32value(&reason, p->code_type, &p->reason_code, dpp);
+    ret = POFDP_OPERAND_GET(&reason, op, 0, dpp);
     POF_CHECK_RETVALUE_RETURN_NO_UPWARD(ret);
 #else // POF_SHT_VXLAN
     reason = p->reason_code;
@@ -551,18 +713,20 @@ static uint32_t execute_PACKET_IN(POFDP_ARG)
 
 /***********************************************************************
  * Handle the action with POFAT_DROP type.
- * Form:     uint32_t execute_DROP(POFDP_ARG)
+ * Form:     uint32_t execute_DROP(POFDP_OP_ARG)
  * Input:    dpp->act, dpp->act_num
  * Return:   POF_OK or Error code
  * Discribe: This function drops the packet out of the switch.
  ***********************************************************************/
-static uint32_t execute_DROP(POFDP_ARG)
+static uint32_t execute_DROP(POFDP_OP_ARG)
 {
-    pof_action_drop *p = (pof_action_drop *)dpp->act->action_data;
+#ifndef POF_SHT_VXLAN
+    pof_action_drop *p = (pof_action_drop *)op->data;
+#endif // POF_SHT_VXLAN
     uint32_t reason = 0, ret;
 
 #ifdef POF_SHT_VXLAN
-    ret = pofdp_get_32value(&reason, p->code_type, &p->reason_code, dpp);
+    ret = POFDP_OPERAND_GET(&reason, op, 0, dpp);
     POF_CHECK_RETVALUE_RETURN_NO_UPWARD(ret);
 #else // POF_SHT_VXLAN
     reason = p->reason_code;
@@ -578,15 +742,15 @@ static uint32_t execute_DROP(POFDP_ARG)
 
 /***********************************************************************
  * Handle the action with POFAT_SET_FIELD type.
- * Form:     uint32_t execute_SET_FIELD(POFDP_ARG)
+ * Form:     uint32_t execute_SET_FIELD(POFDP_OP_ARG)
  * Input:    dpp->act, dpp->act_num, dpp->buf_offset, dpp->left_len,
  * Return:   POF_OK or Error code
  * Discribe: This function will set the field of the packet by the value
  *           given by action_data
  ***********************************************************************/
-static uint32_t execute_SET_FIELD(POFDP_ARG)
+static uint32_t execute_SET_FIELD(POFDP_OP_ARG)
 {
-    pof_action_set_field *p = (pof_action_set_field *)dpp->act->action_data;
+    pof_action_set_field *p = (pof_action_set_field *)op->data;
     uint32_t i, ret;
     uint16_t offset_b, len_b;
     uint8_t  value[POFDP_PACKET_RAW_MAX_LEN] = {0};
@@ -633,17 +797,17 @@ static uint32_t execute_SET_FIELD(POFDP_ARG)
 
 /***********************************************************************
  * Handle the action with POFAT_SET_FIELD_FROM_METADATA type.
- * Form:     uint32_t execute_SET_FIELD_FROM_METADATA(POFDP_ARG)
+ * Form:     uint32_t execute_SET_FIELD_FROM_METADATA(POFDP_OP_ARG)
  * Input:    dpp->act, dpp->act_num, dpp->buf_offset, dpp->left_len,
  *           dpp->metadata
  * Return:   POF_OK or Error code
  * Discribe: This function will set the field of the packet from the piece
  *           of metadata.
  ***********************************************************************/
-static uint32_t execute_SET_FIELD_FROM_METADATA(POFDP_ARG)
+static uint32_t execute_SET_FIELD_FROM_METADATA(POFDP_OP_ARG)
 {
     pof_action_set_field_from_metadata *p = \
-            (pof_action_set_field_from_metadata *)dpp->act->action_data;
+            (pof_action_set_field_from_metadata *)op->data;
     uint32_t ret;
     uint16_t offset_b, len_b, metadata_offset_b;
     uint8_t  value[POF_MAX_FIELD_LENGTH_IN_BYTE];
@@ -672,18 +836,18 @@ static uint32_t execute_SET_FIELD_FROM_METADATA(POFDP_ARG)
 #ifndef POF_SHT_VXLAN
 /***********************************************************************
  * Handle the action with POFAT_MODIFY_FIELD type.
- * Form:     uint32_t execute_MODIFY_FIELD(POFDP_ARG)
+ * Form:     uint32_t execute_MODIFY_FIELD(POFDP_OP_ARG)
  * Input:    dpp
  * Return:   POF_OK or Error code
  * Discribe: This function will modify the field of the packet. The value
  *           will be increase by the number given by action_data.
  ***********************************************************************/
-static uint32_t execute_MODIFY_FIELD(POFDP_ARG)
+static uint32_t execute_MODIFY_FIELD(POFDP_OP_ARG)
 {
-    pof_action_modify_field *p = (pof_action_modify_field *)dpp->act->action_data;
+    pof_action_modify_field *p = (pof_action_modify_field *)op->data;
     uint32_t value, ret;
 
-	ret = pofdp_get_32value(&value, POFVT_FIELD, &p->field, dpp);
+	ret = POFDP_OPERAND_GET(&value, op, 0, dpp);
 	POF_CHECK_RETVALUE_RETURN_NO_UPWARD(ret);
 
     value += p->increment;
@@ -702,17 +866,17 @@ static uint32_t execute_MODIFY_FIELD(POFDP_ARG)
 
 /***********************************************************************
  * Handle the action with POFAT_CALCULATE_CHECKSUM type.
- * Form:     uint32_t execute_CALCULATE_CHECKSUM(POFDP_ARG)
+ * Form:     uint32_t execute_CALCULATE_CHECKSUM(POFDP_OP_ARG)
  * Input:    dpp->act, dpp->act_num, dpp->buf_left
  * Return:   POF_OK or Error code
  * Discribe: This function will calculate the checksum of the piece of
  *           packet specified in action_data. The calculate result will be
  *           stored in the specified piece of packet.
  ***********************************************************************/
-static uint32_t execute_CALCULATE_CHECKSUM(POFDP_ARG)
+static uint32_t execute_CALCULATE_CHECKSUM(POFDP_OP_ARG)
 {
     pof_action_calculate_checksum *p = \
-            (pof_action_calculate_checksum *)dpp->act->action_data;
+            (pof_action_calculate_checksum *)op->data;
     uint32_t ret;
     uint16_t cal_pos_b, cal_len_b, cs_pos_b, cs_len_b = p->checksum_len;
 
@@ -756,7 +920,7 @@ static uint32_t execute_CALCULATE_CHECKSUM(POFDP_ARG)
 
 /***********************************************************************
  * Handle the action with POFAT_OUTPUT type.
- * Form:     uint32_t execute_OUTPUT(POFDP_ARG)
+ * Form:     uint32_t execute_OUTPUT(POFDP_OP_ARG)
  * Input:    dpp, dp->resource
  * Output:   dpp
  * Return:   POF_OK or Error code
@@ -765,13 +929,12 @@ static uint32_t execute_CALCULATE_CHECKSUM(POFDP_ARG)
  *           should be send before the packet. The metadata and packet
  *           consist a new packet.
  ***********************************************************************/
-static uint32_t execute_OUTPUT(POFDP_ARG)
+static uint32_t execute_OUTPUT(POFDP_OP_ARG)
 {
-    pof_action_output *p = (pof_action_output *)dpp->act->action_data;
+    pof_action_output *p = (pof_action_output *)op->data;
     struct pof_local_resource *lrPort = NULL;
     uint32_t ret, value = 0;
 
-    struct portInfo *port, *next;//add by wenjian 2015/12/01
     if(p->packet_offset > dpp->left_len){
         POF_ERROR_HANDLE_RETURN_NO_UPWARD(POFET_SOFTWARE_FAILED, POF_PACKET_LEN_ERROR);
     }
@@ -781,7 +944,7 @@ static uint32_t execute_OUTPUT(POFDP_ARG)
     }
 
 #ifdef POF_SD2N
-	ret = pofdp_get_32value(&value, p->portId_type, &p->outputPortId, dpp);
+	ret = POFDP_OPERAND_GET(&value, op, 0, dpp);
 	POF_CHECK_RETVALUE_RETURN_NO_UPWARD(ret);
 #else // POF_SD2N
     value = p->outputPortId;
@@ -789,7 +952,8 @@ static uint32_t execute_OUTPUT(POFDP_ARG)
     dpp->output_slot_id = value >> 16;
     dpp->output_port_id = value & 0xFFFF;
 
-    if((lrPort = pofdp_get_local_resource(dpp->output_slot_id, dpp->dp)) == NULL){
+    if((lrPort = POFLR_REF_GET(&op->ref)) == NULL && \
+            (lrPort = pofdp_get_local_resource(dpp->output_slot_id, dpp->dp)) == NULL){
         POF_ERROR_HANDLE_RETURN_NO_UPWARD(POFET_SOFTWARE_FAILED, POF_INVALID_SLOT_ID);
     }
 
@@ -809,31 +973,14 @@ static uint32_t execute_OUTPUT(POFDP_ARG)
     if(dpp->output_port_id==255)
     {
      	POF_DEBUG_CPRINT(1,BLUE,"yes it is a flood port");
-       //add by jelly
-       //get all the port id execept the input port id
-     	HMAP_NODES_IN_STRUCT_TRAVERSE(port, next, pofIndexNode, lrPort->portPofIndexMap){
-        	POF_DEBUG_CPRINT(1,BLUE,"sysIndex=%d,pofIndex=%d,ori_port_id=%d\n",port->sysIndex,port->pofIndex,dpp->ori_port_id);
-        	if(port->pofIndex!=dpp->ori_port_id&&port->pofIndex!=local_port_index){
-                if(port->config!=16)
-                {
-                	POF_DEBUG_CPRINT(1,BLUE,"config=%d",port->config);
-           	        dpp->output_port_id=port->pofIndex;
-                    ret = pofdp_send_raw(dpp, lrPort);
-                    POF_CHECK_RETVALUE_RETURN_NO_UPWARD(ret);
-                }
-        	}
-        }
-     }
-     else
-     {
-     //if(dpp->output_port_id!=pofsc_conn_desc.local_port_index)
-     //{
-       ret = pofdp_send_raw(dpp, lrPort);
-       POF_CHECK_RETVALUE_RETURN_NO_UPWARD(ret);
-      //}
-      }
-
-
+        ret = pofdp_send_raw_flood(dpp, lrPort);
+        POF_CHECK_RETVALUE_RETURN_NO_UPWARD(ret);
+    }
+    else
+    {
+        ret = pofdp_send_raw(dpp, lrPort);
+        POF_CHECK_RETVALUE_RETURN_NO_UPWARD(ret);
+    }
 
     //ret = pofdp_send_raw(dpp, lrPort);
     //POF_CHECK_RETVALUE_RETURN_NO_UPWARD(ret);
@@ -844,16 +991,16 @@ static uint32_t execute_OUTPUT(POFDP_ARG)
 
 /***********************************************************************
  * Handle the action with POFAT_ADD_TAG type.
- * Form:     execute_ADD_FIELD(POFDP_ARG)
+ * Form:     execute_ADD_FIELD(POFDP_OP_ARG)
  * Input:    dpp->buf_offset, dpp->left_len, dpp->act, dpp->act_num
  * Return:   POF_OK or Error code
  * Discribe: This function will add tag into the packet. The position and
  *           the value has been given by action_data. The length of packet
  *           will be changed after adding tag.
  ***********************************************************************/
-static uint32_t execute_ADD_FIELD(POFDP_ARG)
+static uint32_t execute_ADD_FIELD(POFDP_OP_ARG)
 {
-    pof_action_add_field *p = (pof_action_add_field *)dpp->act->action_data;
+    pof_action_add_field *p = (pof_action_add_field *)op->data;
     uint64_t value;
     uint32_t tag_len_b, ret;
     uint16_t tag_pos_b;
@@ -907,23 +1054,26 @@ static uint32_t execute_ADD_FIELD(POFDP_ARG)
 
 /***********************************************************************
  * Handle the action with POFAT_DELETE_TAG type.
- * Form:     uint32_t execute_DELETE_FIELD(POFDP_ARG)
+ * Form:     uint32_t execute_DELETE_FIELD(POFDP_OP_ARG)
  * Input:    dpp->act, dpp->act_num, dpp->buf_left, dpp->left_len
  * Return:   POF_OK or Error code
  * Discribe: This function will delete tag of packet. The position and the
  *           length of the tag has been given by action_data. The length
- *           of the packet will be changed after deleting tag.
+ *           of the packet will be changed after deleting tag. A tag of
+ *           whole bytes is closed by moving the shorter side of the packet.
  ***********************************************************************/
-static uint32_t execute_DELETE_FIELD(POFDP_ARG)
+static uint32_t execute_DELETE_FIELD(POFDP_OP_ARG)
 {
-    pof_action_delete_field *p = (pof_action_delete_field *)dpp->act->action_data;
+    pof_action_delete_field *p = (pof_action_delete_field *)op->data;
     uint32_t ret, tag_len_b;
     uint16_t tag_pos_b, tag_len_b_x, len_b_behindtag;
-    uint8_t  buf_temp[POFDP_PACKET_RAW_MAX_LEN] = {0};
+    uint8_t  buf_temp[POFDP_PACKET_RAW_MAX_LEN];
+    uint8_t  *head, *pos;
+    uint32_t tag_len_B;
 
     tag_pos_b = p->tag_pos;
 #ifdef POF_SD2N
-    ret = pofdp_get_32value(&tag_len_b, p->len_type, &p->tag_len, dpp);
+    ret = POFDP_OPERAND_GET(&tag_len_b, op, 0, dpp);
     POF_CHECK_RETVALUE_RETURN_NO_UPWARD(ret);
 #else // POF_SD2N
     tag_len_b = p->tag_len;
@@ -935,6 +1085,29 @@ static uint32_t execute_DELETE_FIELD(POFDP_ARG)
         POF_ERROR_HANDLE_RETURN_NO_UPWARD(POFET_SOFTWARE_FAILED, POF_PACKET_LEN_ERROR);
     }
 
+    if((tag_pos_b % POF_BITNUM_IN_BYTE == 0) && (tag_len_b_x == 0)){
+        /* Close the gap by moving the shorter side of the packet. */
+        head = PACKET_HEAD(dpp);
+        pos = dpp->buf_offset + tag_pos_b / POF_BITNUM_IN_BYTE;
+        tag_len_B = tag_len_b / POF_BITNUM_IN_BYTE;
+        if(pos - head < len_b_behindtag / POF_BITNUM_IN_BYTE){
+            memmove(head + tag_len_B, head, pos - head);
+            dpp->packetBuf  += tag_len_B;
+            dpp->buf_offset += tag_len_B;
+        }else{
+            memmove(pos, pos + tag_len_B, len_b_behindtag / POF_BITNUM_IN_BYTE);
+        }
+        dpp->left_len -= tag_len_B;
+        POF_PACKET_REL_LEN_DEC(dpp, (uint8_t)tag_len_B);
+
+        POF_DEBUG_CPRINT_FL(1,GREEN,"action_delete_field has been done!");
+        POF_DEBUG_CPRINT_FL_0X(1,GREEN,dpp->buf_offset,dpp->left_len,"The new packet = ");
+
+        action_update(dpp);
+        return POF_OK;
+    }
+
+    memset(buf_temp, 0, sizeof buf_temp);
     pofbf_copy_bit(dpp->buf_offset, buf_temp, tag_pos_b+tag_len_b, len_b_behindtag);
     pofbf_cover_bit(dpp->buf_offset, buf_temp, tag_pos_b, len_b_behindtag);
 
@@ -953,37 +1126,212 @@ static uint32_t execute_DELETE_FIELD(POFDP_ARG)
 }
 
 static uint32_t
-execute_EXPERIMENTER(POFDP_ARG)
+execute_EXPERIMENTER(POFDP_OP_ARG)
 {
 	// TODO
 	POF_ERROR_HANDLE_RETURN_NO_UPWARD(POFET_BAD_ACTION, POFBAC_BAD_TYPE);
 }
 
+static uint32_t
+execute_UNKNOWN(POFDP_OP_ARG)
+{
+	POF_ERROR_HANDLE_RETURN_NO_UPWARD(POFET_BAD_ACTION, POFBAC_BAD_TYPE);
+}
+
+/* Decode one action into op. */
+static void
+actDecode(struct pofdp_op *op, struct pof_action *act)
+{
+    memset(op, 0, sizeof *op);
+    op->type = act->type;
+    op->data = act->action_data;
+
+    switch(act->type){
+#define ACTION(NAME,VALUE) case POFAT_##NAME: op->exec = execute_##NAME; break;
+		ACTIONS
+#undef ACTION
+        default:
+            op->exec = execute_UNKNOWN;
+            break;
+    }
+
+    /* The operands. */
+    switch(act->type){
+#ifdef POF_SHT_VXLAN
+        case POFAT_COUNTER:
+        {
+            pof_action_counter *p = op->data;
+            pofdp_operand_build(&op->opnd[0], p->id_type, &p->counter_id);
+            break;
+        }
+        case POFAT_CALCULATE_FIELD:
+        {
+            struct pof_action_calc_field *p = op->data;
+            pofdp_operand_build(&op->opnd[0], POFVT_FIELD, &p->dst_field);
+            pofdp_operand_build(&op->opnd[1], p->src_type, &p->src_operand);
+            break;
+        }
+        case POFAT_PACKET_IN:
+        {
+            pof_action_packet_in *p = op->data;
+            pofdp_operand_build(&op->opnd[0], p->code_type, &p->reason_code);
+            break;
+        }
+        case POFAT_DROP:
+        {
+            pof_action_drop *p = op->data;
+            pofdp_operand_build(&op->opnd[0], p->code_type, &p->reason_code);
+            break;
+        }
+#else // POF_SHT_VXLAN
+        case POFAT_MODIFY_FIELD:
+        {
+            pof_action_modify_field *p = op->data;
+            pofdp_operand_build(&op->opnd[0], POFVT_FIELD, &p->field);
+            break;
+        }
+#endif // POF_SHT_VXLAN
+#ifdef POF_SD2N
+        case POFAT_OUTPUT:
+        {
+            pof_action_output *p = op->data;
+            pofdp_operand_build(&op->opnd[0], p->portId_type, &p->outputPortId);
+            break;
+        }
+        case POFAT_DELETE_FIELD:
+        {
+            pof_action_delete_field *p = op->data;
+            pofdp_operand_build(&op->opnd[0], p->len_type, &p->tag_len);
+            break;
+        }
+#endif // POF_SD2N
+        default:
+            break;
+    }
+    return;
+}
+
+/***********************************************************************
+ * Decode actions
+ * Form:     void pofdp_action_decode(struct pofdp_op *op, \
+ *                                    struct pof_action *act, \
+ *                                    uint8_t actNum)
+ * Input:    actions in the wire format, action number
+ * Output:   op
+ * Return:   VOID
+ * Discribe: This function decodes actNum actions into the ops from op.
+ *           The ops point into the actions, which should live as long as
+ *           the ops.
+ ***********************************************************************/
+void
+pofdp_action_decode(struct pofdp_op *op, struct pof_action *act, uint8_t actNum)
+{
+    uint8_t i;
+
+    for(i=0; i<actNum; i++, op++){
+        actDecode(op, act);
+#ifdef POF_SHT_VXLAN
+        act = (struct pof_action *)((uint8_t *)act + act->len);
+#else // POF_SHT_VXLAN
+        act++;
+#endif // POF_SHT_VXLAN
+    }
+    return;
+}
+
+/***********************************************************************
+ * Bind the action
+ * Form:     void pofdp_action_bind(struct pofdp_op *op, \
+ *                                  struct pof_local_resource *lr)
+ * Input:    decoded action, local resource
+ * Output:   op->ref
+ * Return:   VOID
+ * Discribe: This function binds the reference of the action to the
+ *           counter or the group with the immediate ID, or to the local
+ *           resource of the output slot, see pofdp_program_bind().
+ ***********************************************************************/
+void
+pofdp_action_bind(struct pofdp_op *op, struct pof_local_resource *lr)
+{
+    switch(op->type){
+        case POFAT_COUNTER:
+        {
+            pof_action_counter *p = op->data;
+#ifdef POF_SHT_VXLAN
+            if(p->id_type == POFVT_IMMEDIATE_NUM && op->opnd[0].u.value){
+                poflr_ref_bind(&op->ref, POFLR_REF_COUNTER, op->opnd[0].u.value, lr);
+            }
+#else // POF_SHT_VXLAN
+            if(p->counter_id){
+                poflr_ref_bind(&op->ref, POFLR_REF_COUNTER, p->counter_id, lr);
+            }
+#endif // POF_SHT_VXLAN
+            break;
+        }
+        case POFAT_GROUP:
+        {
+            pof_action_group *p = op->data;
+            poflr_ref_bind(&op->ref, POFLR_REF_GROUP, p->group_id, lr);
+            break;
+        }
+        case POFAT_OUTPUT:
+        {
+            pof_action_output *p = op->data;
+            /* The slots are never deleted, so the reference is not linked. */
+#ifdef POF_SD2N
+            if(p->portId_type == POFVT_IMMEDIATE_NUM){
+                op->ref.obj = pofdp_get_local_resource(op->opnd[0].u.value >> 16, &g_dp);
+            }
+#else // POF_SD2N
+            op->ref.obj = pofdp_get_local_resource(p->outputPortId >> 16, &g_dp);
+#endif // POF_SD2N
+            break;
+        }
+        default:
+            break;
+    }
+    return;
+}
+
+/* Size of the program of actNum actions, such as the actions of a group. */
+uint32_t
+pofdp_action_program_size(uint8_t actNum)
+{
+    return sizeof(struct pofdp_program) + actNum * sizeof(struct pofdp_op);
+}
+
+/* Build the program of the actions, which has no instruction. */
+void
+pofdp_action_program_build(struct pofdp_program *prog, struct pof_action *act, uint8_t actNum)
+{
+    prog->insNum = 0;
+    prog->opNum = actNum;
+    pofdp_action_decode(prog->op, act, actNum);
+    return;
+}
+
 /***********************************************************************
  * Execute actions
  * Form:     uint32_t pofdp_action_execute(POFDP_ARG)
  * Input:    dpp, dp
  * Return:   POF_OK or Error code
- * Discribe: This function executes the actions. 
+ * Discribe: This function executes the dpp->act_num actions from
+ *           dpp->act. Each op is dispatched by its own handler. The
+ *           outputs which refer to the packet are sent before an action
+ *           which may change it.
  ***********************************************************************/
 uint32_t pofdp_action_execute(POFDP_ARG)
 {
     uint32_t ret;
 
     while(dpp->packet_done == FALSE && dpp->act_num > 0){
-		/* Execute the actions. */
-        switch(dpp->act->type){
-#define ACTION(NAME,VALUE) case POFAT_##NAME: ret = execute_##NAME(dpp, lr); break;
-			ACTIONS
-#undef ACTION
-
-            default:
-                POF_ERROR_HANDLE_RETURN_NO_UPWARD(POFET_BAD_ACTION, POFBAC_BAD_TYPE);
-                break;
+        if(dpp->txHeld && dpp->act->type != POFAT_OUTPUT && \
+                dpp->act->type != POFAT_GROUP && dpp->act->type != POFAT_COUNTER){
+            pofdp_output_release(dpp);
         }
+        ret = dpp->act->exec(dpp, lr, dpp->act);
         POF_CHECK_RETVALUE_RETURN_NO_UPWARD(ret);
     }
 
     return POF_OK;
 }
-
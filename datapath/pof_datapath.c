@@ -23,6 +23,9 @@
  * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
 
+/* For sendmmsg(). */
+#define _GNU_SOURCE
+
 #include "../include/pof_common.h"
 #include "../include/pof_type.h"
 #include "../include/pof_global.h"
@@ -33,17 +36,77 @@
 #include "../include/pof_byte_transfer.h"
 #include "../include/pof_hmap.h"
 #include "../include/pof_memory.h"
+#include "../include/pof_epoch.h"
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <string.h>
 #include <linux/if_packet.h>
 #include <net/ethernet.h>
+#include <sys/mman.h>
+#include <poll.h>
+#include <unistd.h>
 
 /* Task id. */
 task_t g_pofdp_detect_port_task_id = 0;
 
-static uint32_t pofdp_forward(POFDP_ARG, struct pof_instruction *first_ins);
+/* The CPU which the next receive worker will be pinned to. */
+static uint32_t g_pofdp_rx_worker_cpu = 0;
+
+/* Argument of one receive worker. */
+struct rxWorkerArg{
+    struct portInfo *port;
+    uint16_t index;
+};
+
+/* Outputs waiting to be sent. Message i sends iov[i] out through the
+ * socket fd[i], which is the metadata copied into meta[i] and the packet
+ * data in place. Packet i of a recvmmsg() vector is received into buf[i]. */
+struct pofdp_tx_batch{
+    uint32_t msgNum;
+    uint8_t buf[POFDP_TX_BATCH_BUF_NUM][PFODP_PACKET_BUF_TOTAL_LEN];
+    int fd[POFDP_TX_BATCH_MSG_NUM];
+    struct sockaddr_ll sll[POFDP_TX_BATCH_MSG_NUM];
+    uint8_t meta[POFDP_TX_BATCH_MSG_NUM][POFDP_METADATA_MAX_LEN];
+    struct iovec iov[POFDP_TX_BATCH_MSG_NUM][2];
+    struct mmsghdr msg[POFDP_TX_BATCH_MSG_NUM];
+};
+
+/* One cached lookup. The entry is the result of looking up the key in the
+ * table tableID, and is valid only while the modification generation of
+ * the local resource is still gen. The entry may have been retired, so
+ * it is also used only in the epoch it was cached in. */
+struct flowCacheSlot{
+    uint64_t epoch;
+    uint32_t gen;
+    uint32_t hash;
+    struct entryInfo *entry;
+    uint8_t tableID;
+    uint8_t key[POFDP_FLOW_CACHE_KEY_LEN];
+};
+
+/* Cached lookups of one receive worker. A key can be cached in the two
+ * slots of the pair (hash & mask) and (hash & mask) ^ 1. */
+struct pofdp_flow_cache{
+    uint32_t mask;
+    const struct epochReader *reader;   /* The worker. */
+    struct flowCacheSlot slot[];
+};
+
+/* Key of the lookup in the table at the packet offset bufOffset, with its
+ * hash, extracted by flowCachePrepare() before the lookup. */
+struct pofdp_lookup{
+    const struct tableInfo *table;
+    const uint8_t *bufOffset;
+    uint32_t hash;
+    uint16_t len;
+    uint8_t key[POFDP_FLOW_CACHE_KEY_LEN];
+};
+
+static uint32_t pofdp_forward(POFDP_ARG);
 static uint32_t pofdp_recv_raw_task(void *arg_ptr);
+static struct pofdp_flow_cache *flowCacheCreate(uint32_t num);
+static void flowCachePrepare(struct pofdp_packet *dpp, const struct tableInfo *table, \
+                             struct pofdp_lookup *lookup);
 
 static uint32_t 
 init_packet_metadata(struct pofdp_packet *dpp, struct pofdp_metadata *metadata, size_t len)
@@ -62,6 +125,28 @@ init_packet_metadata(struct pofdp_packet *dpp, struct pofdp_metadata *metadata,
 	return POF_OK;
 }
 
+static void set_goto_first_table_instruction(struct pof_instruction *p);
+
+/* Build the program of a GOTO_TABLE to the first flow table, with the
+ * instruction in front of it, and bind it to the table. */
+static uint32_t
+first_program_build(struct pof_local_resource *lr)
+{
+    struct pof_instruction *ins;
+    uint32_t insSize;
+
+    insSize = POFDP_PROGRAM_OFFSET(sizeof(struct pof_instruction) + \
+            sizeof(pof_instruction_goto_table));
+    /* One op, as GOTO_TABLE has no action. */
+    POF_MALLOC_SAFE_RETURN_SIZE(ins, 1, POF_ERROR, \
+            insSize + sizeof(struct pofdp_program) + sizeof(struct pofdp_op));
+    set_goto_first_table_instruction(ins);
+    lr->first = (struct pofdp_program *)((uint8_t *)ins + insSize);
+    pofdp_program_build(lr->first, ins, 1);
+    pofdp_program_bind(lr->first, lr);
+    return POF_OK;
+}
+
 static void
 fill_localresource_param(struct pof_local_resource *lr, const struct pof_param *param)
 {
@@ -73,7 +158,11 @@ fill_localresource_param(struct pof_local_resource *lr, const struct pof_param *
     }
     lr->tableSizeMax = param->tableSizeMax;
     lr->groupNumMax = param->groupNumMax;
+    lr->selectHashFieldNum = param->selectHashFieldNum;
+    memcpy(lr->selectHashField, param->selectHashField, sizeof(lr->selectHashField));
     lr->meterNumMax = param->meterNumMax;
+    lr->meterBurstMs = param->meterBurstMs;
+    lr->meterPacketMode = param->meterPacketMode;
     lr->counterNumMax = param->counterNumMax;
     return;
 }
@@ -96,6 +185,8 @@ pofdp_slot_init(struct pof_datapath *dp)
         /* Initialize the resource. */
         ret = pof_localresource_init(lr);
         POF_CHECK_RETVALUE_RETURN_NO_UPWARD(ret);
+        ret = first_program_build(lr);
+        POF_CHECK_RETVALUE_RETURN_NO_UPWARD(ret);
 
         slotID ++;
     }
@@ -127,7 +218,7 @@ uint32_t pof_datapath_init(struct pof_datapath *dp){
     /* Create task to receive raw packet. */
     HMAP_NODES_IN_STRUCT_TRAVERSE(lr, lrNext, slotNode, dp->slotMap){
         HMAP_NODES_IN_STRUCT_TRAVERSE(port, next, pofIndexNode, lr->portPofIndexMap){
-            if(port->taskID == POF_INVALID_TASKID){
+            if(port->taskID[0] == POF_INVALID_TASKID){
                 if(pofdp_create_port_listen_task(port) != POF_OK){
                     POF_ERROR_HANDLE_RETURN_NO_UPWARD(POFET_SOFTWARE_FAILED, POF_TASK_CREATE_FAIL);
                 }
@@ -142,15 +233,40 @@ uint32_t pof_datapath_init(struct pof_datapath *dp){
     return POF_OK;
 }
 
+/***********************************************************************
+ * Create the receive tasks of the port
+ * Form:     uint32_t pofdp_create_port_listen_task(struct portInfo *port)
+ * Input:    port
+ * Output:   port->taskID
+ * Return:   POF_OK or Error code
+ * Discribe: This function creates g_dp.param.rxWorkerNum receive workers
+ *           for the port. Every worker has its own socket and its own
+ *           pofdp_packet, and is pinned to a CPU in turn.
+ ***********************************************************************/
 uint32_t 
 pofdp_create_port_listen_task(struct portInfo *port)
 {
+    struct rxWorkerArg *arg;
 	uint32_t ret = POF_OK;
-    task_t tid;
+    uint16_t i, num = g_dp.param.rxWorkerNum;
 
-	ret = pofbf_task_create(port, (void *)pofdp_recv_raw_task, &port->taskID);
-	POF_CHECK_RETVALUE_RETURN_NO_UPWARD(ret);
-    POF_DEBUG_CPRINT_FL(1,BLUE,"Port %s: Start recv_raw task!", port->name);
+    if(num < 1 || num > PORT_MAX_RX_WORKERS){
+        num = 1;
+    }
+
+    for(i=0; i<num; i++){
+        POF_MALLOC_SAFE_RETURN(arg, 1, POF_ERROR);
+        arg->port = port;
+        arg->index = i;
+
+        /* The worker frees the argument. */
+        ret = pofbf_task_create(arg, (void *)pofdp_recv_raw_task, &port->taskID[i]);
+        if(ret != POF_OK){
+            FREE(arg);
+        }
+        POF_CHECK_RETVALUE_RETURN_NO_UPWARD(ret);
+    }
+    POF_DEBUG_CPRINT_FL(1,BLUE,"Port %s: Start %u recv_raw task!", port->name, num);
 
 	return POF_OK;
 }
@@ -170,20 +286,19 @@ set_goto_first_table_instruction(struct pof_instruction *p)
 
 /***********************************************************************
  * Forward function
- * Form:     static uint32_t pofdp_forward(POFDP_ARG, \
- *                                  struct pof_instruction *first_ins)
- * Input:    dpp, dp, first_ins
+ * Form:     static uint32_t pofdp_forward(POFDP_ARG)
+ * Input:    dpp, dp
  * Return:   POF_OK or Error code
  * Discribe: This function forwards the packet between the flow tables.
- *           The new packet will be send into the MM0 table, which is
- *           head flow table. Then according to the matched flow entry,
+ *           The packet has been prepared by rxVectorPrepare(), and starts
+ *           from the first program, which sends it into the MM0 table,
+ *           the head flow table. Then according to the matched flow entry,
  *           the packet will be forwarded between the other flow tables
  *           or execute the instruction and action corresponding to the
  *           matched flow entry.
  ***********************************************************************/
-static uint32_t pofdp_forward(POFDP_ARG, struct pof_instruction *first_ins)
+static uint32_t pofdp_forward(POFDP_ARG)
 {
-	uint8_t metadata[POFDP_METADATA_MAX_LEN] = {0};
 	uint32_t ret;
 
 	POF_DEBUG_CPRINT(1,BLUE,"\n");
@@ -191,19 +306,299 @@ static uint32_t pofdp_forward(POFDP_ARG, struct pof_instruction *first_ins)
 			dpp->ori_len, dpp->ori_port_id);
 	POF_DEBUG_CPRINT_FL_0X(1,GREEN,dpp->packetBuf,dpp->left_len,"Input packet data is ");
 
-	/* Initialize the metadata. */
-	ret = init_packet_metadata(dpp, (struct pofdp_metadata *)metadata, sizeof(metadata));
+	ret = pofdp_instruction_execute(dpp, lr);
 	POF_CHECK_RETVALUE_RETURN_NO_UPWARD(ret);
+    return POF_OK;
+}
 
-	/* Set the first instruction to the Datapath packet. */
-	dpp->ins = first_ins;
-	dpp->ins_todo_num = 1;
+/* Mapped TPACKET_V3 receive ring of one port. */
+struct rxRing{
+    uint8_t *map;
+    size_t size;
+    uint32_t blockNum;
+    uint32_t blockIndex;
+};
 
-	ret = pofdp_instruction_execute(dpp, lr);
-	POF_CHECK_RETVALUE_RETURN_NO_UPWARD(ret);
+/* One frame of the receive ring. The descriptor is copied out of the ring
+ * before the previous frame is forwarded, because the previous packet may
+ * grow into the header of this frame. */
+struct rxFrame{
+    uint8_t *hdr;
+    uint8_t *data;
+    uint32_t len;
+    uint32_t nextOffset;
+    struct sockaddr_ll sll;
+};
+
+/* Vector of the received packets of one worker, with the metadata and
+ * the lookup of each packet. The messages are used by recvmmsg(), and
+ * receive packet i into the buffer i of the transmit batch. */
+struct rxVector{
+    uint32_t num;
+    struct pofdp_packet dpp[POFDP_VECTOR_SIZE];
+    uint64_t metadata[POFDP_VECTOR_SIZE][POFDP_METADATA_MAX_LEN / sizeof(uint64_t)];
+    struct pofdp_lookup lookup[POFDP_VECTOR_SIZE];
+    struct sockaddr_ll sll[POFDP_VECTOR_SIZE];
+    struct iovec iov[POFDP_VECTOR_SIZE];
+    struct mmsghdr msg[POFDP_VECTOR_SIZE];
+};
+
+/***********************************************************************
+ * Create the receive ring of the port
+ * Form:     static uint32_t rxRingCreate(int sock, uint32_t blockNum, \
+ *                                        struct rxRing *ring)
+ * Input:    socket, number of ring blocks
+ * Output:   ring
+ * Return:   POF_OK or POF_ERROR
+ * Discribe: This function switches the socket to TPACKET_V3 and maps a
+ *           block ring on it. Every frame reserves POFDP_RX_RING_TAILROOM
+ *           bytes in front of it, which are the tail room of the frame
+ *           before. It must be called before the socket is bound. If it
+ *           fails, the caller falls back to recvmmsg().
+ ***********************************************************************/
+static uint32_t
+rxRingCreate(int sock, uint32_t blockNum, struct rxRing *ring)
+{
+    struct tpacket_req3 req = {0};
+    int version = TPACKET_V3, reserve = POFDP_RX_RING_TAILROOM;
+
+    if(setsockopt(sock, SOL_PACKET, PACKET_VERSION, &version, sizeof version) != 0 || \
+            setsockopt(sock, SOL_PACKET, PACKET_RESERVE, &reserve, sizeof reserve) != 0){
+        return POF_ERROR;
+    }
+
+    req.tp_block_size = POFDP_RX_RING_BLOCK_SIZE;
+    req.tp_block_nr = blockNum;
+    req.tp_frame_size = POFDP_RX_RING_FRAME_SIZE;
+    req.tp_frame_nr = (POFDP_RX_RING_BLOCK_SIZE / POFDP_RX_RING_FRAME_SIZE) * blockNum;
+    req.tp_retire_blk_tov = POFDP_RX_RING_BLOCK_TIMEOUT;
+    if(setsockopt(sock, SOL_PACKET, PACKET_RX_RING, &req, sizeof req) != 0){
+        return POF_ERROR;
+    }
+
+    ring->size = (size_t)req.tp_block_size * req.tp_block_nr;
+    ring->map = mmap(NULL, ring->size, PROT_READ | PROT_WRITE, MAP_SHARED, sock, 0);
+    if(ring->map == MAP_FAILED){
+        ring->map = NULL;
+        return POF_ERROR;
+    }
+    ring->blockNum = blockNum;
+    ring->blockIndex = 0;
     return POF_OK;
 }
 
+static void
+rxFrameLoad(struct rxFrame *frame, uint8_t *hdr)
+{
+    struct tpacket3_hdr *tp = (struct tpacket3_hdr *)hdr;
+
+    frame->hdr = hdr;
+    frame->data = hdr + tp->tp_mac;
+    frame->len = tp->tp_snaplen;
+    frame->nextOffset = tp->tp_next_offset;
+    memcpy(&frame->sll, hdr + TPACKET_ALIGN(sizeof(struct tpacket3_hdr)), sizeof frame->sll);
+    return;
+}
+
+/* Check and filter one received packet which is in dpp->packetBuf. The
+ * packet which is not to be forwarded is marked as done. */
+static void
+rxPacketCheck(struct pofdp_packet *dpp, struct pof_local_resource *lr, \
+              struct portInfo *port_ptr, const struct pofdp_program *first, \
+              uint32_t len_B, struct sockaddr_ll *from)
+{
+    struct pof_datapath *dp = &g_dp;
+
+    dpp->packet_done = TRUE;
+
+    /* Check whether the OpenFlow-enabled of the port is on or not. */
+    if(port_ptr->of_enable == POFE_DISABLE || from->sll_pkttype == PACKET_OUTGOING){
+        return;
+    }
+
+    /* Check the packet length. */
+    if(len_B > POF_MTU_LENGTH){
+        POF_DEBUG_CPRINT_FL(1,RED,"The packet received is longer than MTU. DROP!");
+        return;
+    }
+
+    /* Filter the received raw packet by some rules. */
+    if(dp->filter(dpp->packetBuf, port_ptr, *from) != POF_OK){
+        return;
+    }
+
+    /* Store packet data, length, received port infomation into the message queue. */
+    dpp->ori_port_id = port_ptr->pofIndex;
+    dpp->ori_len = len_B;
+    dpp->left_len = dpp->ori_len;
+    dpp->buf_offset = dpp->packetBuf;
+
+    /* Check whether the first flow table exist. */
+    if(!POFLR_REF_GET(&first->op[0].ref) && \
+            !(poflr_get_table_with_ID(POFDP_FIRST_TABLE_ID, lr))){
+        POF_DEBUG_CPRINT_FL(1,RED,"Received a packet, but the first flow table does NOT exist.");
+        return;
+    }
+
+    dpp->packet_done = FALSE;
+    return;
+}
+
+/***********************************************************************
+ * Prepare the vector to be forwarded
+ * Form:     static uint32_t rxVectorPrepare(struct rxVector *vec, \
+ *                              struct pof_local_resource *lr, \
+ *                              const struct pofdp_program *first)
+ * Input:    vector, local resource, first program
+ * Output:   NONE
+ * Return:   The number of the packets to be forwarded
+ * Discribe: This function initializes the metadata of the checked packets
+ *           of the vector, and sets them to the first program. The first
+ *           program goes to the first flow table, so the key of the table
+ *           is extracted from all the packets in turn, and their cache
+ *           slots are prefetched. Then the lookups of the vector, which
+ *           come one by one in pofdp_forward(), do not wait for the
+ *           memory. The later tables are looked up packet by packet.
+ ***********************************************************************/
+static uint32_t
+rxVectorPrepare(struct rxVector *vec, struct pof_local_resource *lr, \
+                const struct pofdp_program *first)
+{
+    const struct pof_instruction_goto_table *p = first->op[0].data;
+    const struct tableInfo *table = NULL;
+    struct pofdp_packet *dpp;
+    uint32_t i, num = 0;
+
+    /* The packet offset of the first program is applied at the lookup. */
+    if(first->op[0].type == POFIT_GOTO_TABLE && p->packet_offset == 0 && \
+            !(table = POFLR_REF_GET(&first->op[0].ref))){
+        table = poflr_get_table_with_ID(POFDP_FIRST_TABLE_ID, lr);
+    }
+
+    for(i=0; i<vec->num; i++){
+        dpp = &vec->dpp[i];
+        if(dpp->packet_done){
+            continue;
+        }
+
+        /* Initialize the metadata. */
+        if(init_packet_metadata(dpp, (struct pofdp_metadata *)vec->metadata[i], \
+                sizeof vec->metadata[i]) != POF_OK){
+            dpp->packet_done = TRUE;
+            continue;
+        }
+
+        /* Set the first instruction to the Datapath packet. */
+        dpp->prog = first;
+        dpp->ins = first->op;
+
+        if(table != NULL){
+            flowCachePrepare(dpp, table, &vec->lookup[i]);
+        }
+        num++;
+    }
+    return num;
+}
+
+/***********************************************************************
+ * Forward the packets of one ring block
+ * Form:     static void rxRingBlockProcess(struct rxVector *vec, \
+ *                              struct pof_local_resource *lr, \
+ *                              struct portInfo *port_ptr, \
+ *                              const struct pofdp_program *first, \
+ *                              struct tpacket_block_desc *block)
+ * Input:    vector, local resource, port, first program, block
+ * Output:   NONE
+ * Return:   VOID
+ * Discribe: This function walks the frames of one block which has been
+ *           released to user space, and forwards the packets in place
+ *           vector by vector. Only a packet which does not have
+ *           POFDP_RX_RING_TAILROOM bytes behind it (the last one of the
+ *           block) is copied into a buffer of the transmit batch. The
+ *           outputs of each vector are sent together, and then the block
+ *           is given back to the kernel. The outputs refer to the frames,
+ *           so a packet never grows over the end of the packet before it.
+ ***********************************************************************/
+static void
+rxRingBlockProcess(struct rxVector *vec, struct pof_local_resource *lr, \
+                   struct portInfo *port_ptr, const struct pofdp_program *first, \
+                   struct tpacket_block_desc *block)
+{
+    uint8_t *blockEnd = (uint8_t *)block + POFDP_RX_RING_BLOCK_SIZE, *limit, *prevEnd = NULL;
+    struct pofdp_tx_batch *tx = vec->dpp[0].txBatch;
+    struct pofdp_packet *dpp;
+    struct rxFrame frame[POFDP_VECTOR_SIZE + 1];
+    uint32_t i, j, num = block->hdr.bh1.num_pkts, forwardNum = 0;
+    int inPlace;
+
+    if(num > 0){
+        rxFrameLoad(&frame[0], (uint8_t *)block + block->hdr.bh1.offset_to_first_pkt);
+    }
+
+    for(i=0; i<num; i+=vec->num){
+        vec->num = (num - i < POFDP_VECTOR_SIZE) ? num - i : POFDP_VECTOR_SIZE;
+
+        /* Load the frames of the vector and the one behind it before any
+         * packet of the vector is changed. */
+        for(j=1; j<=vec->num && i + j < num; j++){
+            rxFrameLoad(&frame[j], frame[j-1].hdr + frame[j-1].nextOffset);
+        }
+
+        for(j=0; j<vec->num; j++){
+            dpp = &vec->dpp[j];
+            limit = (i + j + 1 < num) ? frame[j+1].data : blockEnd;
+
+            /* Initialize the dpp. */
+            POFDP_PACKET_RESET(dpp);
+            if(limit - (frame[j].data + frame[j].len) >= POFDP_RX_RING_TAILROOM){
+                /* The frame header has been loaded, so the packet can grow
+                 * over it and over the reserved room in front of the data.
+                 * The start is moved behind the packet before it, once that
+                 * one has been forwarded. */
+                dpp->packetBuf = frame[j].data;
+                dpp->bufStart = frame[j].hdr;
+                dpp->bufEnd = limit;
+            }else{
+                /* The buffers of the batch are not used by the ring. */
+                dpp->bufStart = tx->buf[j];
+                dpp->bufEnd = dpp->bufStart + sizeof tx->buf[j];
+                dpp->packetBuf = dpp->bufStart + POFDP_PACKET_PREBUF_LEN;
+                memcpy(dpp->packetBuf, frame[j].data, \
+                        frame[j].len > POF_MTU_LENGTH ? POF_MTU_LENGTH : frame[j].len);
+            }
+
+            rxPacketCheck(dpp, lr, port_ptr, first, frame[j].len, &frame[j].sll);
+        }
+
+        forwardNum += rxVectorPrepare(vec, lr, first);
+
+        for(j=0; j<vec->num; j++){
+            dpp = &vec->dpp[j];
+            inPlace = (dpp->packetBuf == frame[j].data);
+            if(inPlace && prevEnd > dpp->bufStart){
+                dpp->bufStart = prevEnd;
+            }
+            if(!dpp->packet_done){
+                pofdp_forward(dpp, lr);
+            }
+            prevEnd = inPlace ? dpp->buf_offset + dpp->left_len : NULL;
+        }
+
+        /* Send the outputs of the vector before the buffers are reused. */
+        pofdp_tx_batch_flush(tx);
+        if(i + vec->num < num){
+            frame[0] = frame[vec->num];
+        }
+    }
+
+    __sync_fetch_and_add(&g_dp.pktCount, forwardNum);
+
+    /* Give the block back to the kernel. */
+    __sync_synchronize();
+    block->hdr.bh1.block_status = TP_STATUS_KERNEL;
+    return;
+}
+
 /***********************************************************************
  * The task function of receive task
  * Form:     static void pofdp_recv_raw_task(void *arg_ptr)
@@ -216,28 +611,76 @@ static uint32_t pofdp_forward(POFDP_ARG, struct pof_instruction *first_ins)
  *           After filtering, the packet data and port infomation will be
  *           assembled with format of struct pofdp_packet, and be send
  *           into the receive queue. The only parameter arg_ptr is the
- *           pointer of the local physical net port infomation which has
- *           been assembled with format of struct pof_port.
+ *           pointer of struct rxWorkerArg, which gives the port and the
+ *           index of this worker. If the port has more than one worker,
+ *           the socket joins the PACKET_FANOUT group of the port in hash
+ *           mode.
+ *           If the receive ring is configured, the packets are forwarded
+ *           in place block by block. Otherwise, or if the ring can not be
+ *           created, a vector of packets is received by each recvmmsg().
  * NOTE:     This task will be terminated if any ERRORs occur.
  *           If the openflow function of this physical port is disable,
  *           it will be still loop running but nothing will be received.
  ***********************************************************************/
 static uint32_t pofdp_recv_raw_task(void *arg_ptr){
-    struct portInfo *port_ptr = (struct portInfo *)arg_ptr;
+    struct rxWorkerArg arg = *(struct rxWorkerArg *)arg_ptr;
+    struct portInfo *port_ptr = arg.port;
     struct pof_datapath *dp = &g_dp;
     struct pof_local_resource *lr = NULL;
-    struct pofdp_packet dpp[1] = {0};
-    struct pof_instruction first_ins[1] = {0};
-    struct   sockaddr_ll sockadr = {0}, from = {0};
-    uint32_t from_len = sizeof(struct sockaddr_ll), len_B, ret;
-    int      sockRecv, sockSend;
+    struct rxVector *vec = NULL;
+    struct pofdp_packet *dpp;
+    const struct pofdp_program *first = NULL;
+    struct   sockaddr_ll sockadr = {0};
+    struct rxRing ring = {0};
+    struct tpacket_block_desc *block;
+    struct pollfd pfd = {0};
+    struct pofdp_tx_batch *tx = NULL;
+    struct pofdp_flow_cache *cache = NULL;
+    struct epochReader *reader;
+    uint32_t i, forwardNum;
+    int      sockRecv, sockSend, num, fanout;
+
+    FREE(arg_ptr);
+
+    /* Pin the worker to the next CPU. */
+    if(pofbf_task_set_cpu(__sync_fetch_and_add(&g_pofdp_rx_worker_cpu, 1)) != POF_OK){
+        POF_DEBUG_CPRINT_FL(1,RED,"Port %s: Worker %u can not be pinned to a CPU.", port_ptr->name, arg.index);
+    }
 
     if((lr = pofdp_get_local_resource(port_ptr->slotID, dp)) == NULL){
         POF_ERROR_HANDLE_RETURN_NO_UPWARD(POFET_SOFTWARE_FAILED, POF_INVALID_SLOT_ID);
     }
 
-	/* Set GOTO_TABLE instruction to go to the first flow table. */
-	set_goto_first_table_instruction(first_ins);
+    /* The worker counts in its own row of the counter shards. */
+    poflr_counter_worker_register();
+
+	/* Every packet starts from the GOTO_TABLE to the first flow table. */
+    first = lr->first;
+
+    /* Outputs of one vector are sent together. */
+    POF_MALLOC_SAFE_RETURN(tx, 1, POF_ERROR);
+    POF_MALLOC_SAFE_RETURN(vec, 1, POF_ERROR);
+
+    /* The worker looks up the tables through its own cache. */
+    if(dp->param.flowCacheEntryNum > 0){
+        if((cache = flowCacheCreate(dp->param.flowCacheEntryNum)) == NULL){
+            POF_DEBUG_CPRINT_FL(1,RED,"Port %s: Worker %u runs without the lookup cache.", port_ptr->name, arg.index);
+        }
+    }
+
+    for(i=0; i<POFDP_VECTOR_SIZE; i++){
+        dpp = &vec->dpp[i];
+        dpp->dp = dp;
+        dpp->txBatch = tx;
+        dpp->flowCache = cache;
+
+        /* Packet i of recvmmsg() is received into buffer i of the batch. */
+        vec->iov[i].iov_base = tx->buf[i] + POFDP_PACKET_PREBUF_LEN;
+        vec->iov[i].iov_len = POFDP_PACKET_RAW_MAX_LEN;
+        vec->msg[i].msg_hdr.msg_iov = &vec->iov[i];
+        vec->msg[i].msg_hdr.msg_iovlen = 1;
+        vec->msg[i].msg_hdr.msg_name = &vec->sll[i];
+    }
 
     /* Create socket, and bind it to the specific port. */
     if((sockRecv = socket(AF_PACKET, SOCK_RAW, POF_HTONS(ETH_P_ALL))) == -1){
@@ -254,6 +697,23 @@ static uint32_t pofdp_recv_raw_task(void *arg_ptr){
         pofbf_task_delay(100);
         terminate_handler();
     }
+    for(i=0; i<POFDP_VECTOR_SIZE; i++){
+        vec->dpp[i].sockSend = sockSend;
+    }
+
+    /* Map the receive ring before binding. */
+    if(dp->param.rxRingBlockNum > 0){
+        if(rxRingCreate(sockRecv, dp->param.rxRingBlockNum, &ring) != POF_OK){
+            POF_DEBUG_CPRINT_FL(1,RED,"Port %s: Receive ring is unavailable, use recvmmsg.", port_ptr->name);
+            /* The socket may be half configured. Start over with a new one. */
+            close(sockRecv);
+            if((sockRecv = socket(AF_PACKET, SOCK_RAW, POF_HTONS(ETH_P_ALL))) == -1){
+                POF_ERROR_HANDLE_NO_RETURN_NO_UPWARD(POFET_SOFTWARE_FAILED, POF_CREATE_SOCKET_FAILURE);
+                pofbf_task_delay(100);
+                terminate_handler();
+            }
+        }
+    }
 
     sockadr.sll_family = AF_PACKET;
     sockadr.sll_protocol = POF_HTONS(ETH_P_ALL);
@@ -266,87 +726,374 @@ static uint32_t pofdp_recv_raw_task(void *arg_ptr){
         terminate_handler();
     }
 
-    /* Receive the raw packet through the specific port. */
+    /* Share the packets of the port with the other workers. The group id
+     * only has to be unique among the ports. */
+    if(dp->param.rxWorkerNum > 1){
+        fanout = (port_ptr->sysIndex & 0xFFFF) | (PACKET_FANOUT_HASH << 16);
+        if(setsockopt(sockRecv, SOL_PACKET, PACKET_FANOUT, &fanout, sizeof fanout) != 0){
+            POF_ERROR_HANDLE_NO_RETURN_NO_UPWARD(POFET_SOFTWARE_FAILED, POF_BIND_SOCKET_FAILURE);
+            pofbf_task_delay(100);
+            terminate_handler();
+        }
+    }
+
+    /* The worker reads the local resource without any lock. The writers
+     * free nothing it may be on until it passes a quiescent point, which
+     * is between the blocks or the vectors, or while it is blocked. */
+    if((reader = epoch_readerRegister()) == NULL){
+        POF_DEBUG_CPRINT_FL(1,RED,"Port %s: Worker %u can not be registered to the epoch.", port_ptr->name, arg.index);
+        pofbf_task_delay(100);
+        terminate_handler();
+    }
+    pthread_cleanup_push(epoch_readerUnregister, reader);
+    if(cache){
+        cache->reader = reader;
+    }
+
+    /* Receive the raw packets block by block through the ring. */
+    if(ring.map != NULL){
+        pfd.fd = sockRecv;
+        pfd.events = POLLIN | POLLERR;
+        while(1){
+            pthread_testcancel();
+
+            block = (struct tpacket_block_desc *) \
+                    (ring.map + (size_t)ring.blockIndex * POFDP_RX_RING_BLOCK_SIZE);
+            if(!(block->hdr.bh1.block_status & TP_STATUS_USER)){
+                epoch_offline(reader);
+                poll(&pfd, 1, -1);
+                epoch_online(reader);
+                continue;
+            }
+
+            rxRingBlockProcess(vec, lr, port_ptr, first, block);
+            ring.blockIndex = (ring.blockIndex + 1) % ring.blockNum;
+            epoch_quiescent(reader);
+        }
+    }
+
+    /* Receive the raw packets through the specific port. A vector holds
+     * the packets which are waiting in the socket, up to its size. */
     while(1){
 		pthread_testcancel();
 
-        /* Initialize the dpp. */
-		memset(dpp, 0, sizeof *dpp);
-        dpp->packetBuf = &(dpp->buf[POFDP_PACKET_PREBUF_LEN]);
-		dpp->sockSend = sockSend;
+        for(i=0; i<POFDP_VECTOR_SIZE; i++){
+            vec->msg[i].msg_hdr.msg_namelen = sizeof vec->sll[i];
+        }
 
-        /* Receive the raw packet. */
-        if((len_B = recvfrom(sockRecv, dpp->packetBuf, POFDP_PACKET_RAW_MAX_LEN, 0, \
-                        (struct sockaddr *)&from, &from_len)) <=0){
+        /* Receive the raw packets. Nothing is held between the vectors,
+         * so the worker is offline while it waits for the first packet. */
+        epoch_offline(reader);
+        num = recvmmsg(sockRecv, vec->msg, POFDP_VECTOR_SIZE, MSG_WAITFORONE, NULL);
+        epoch_online(reader);
+        if(num <= 0){
             POF_ERROR_HANDLE_NO_RETURN_NO_UPWARD(POFET_SOFTWARE_FAILED, POF_RECEIVE_MSG_FAILURE);
             continue;
         }
 
-        /* Check whether the OpenFlow-enabled of the port is on or not. */
-        if(port_ptr->of_enable == POFE_DISABLE || from.sll_pkttype == PACKET_OUTGOING){
-            continue;
+        /* Initialize the dpps. The packets are kept in the batch until the
+         * end of the vector, as the outputs refer to them. */
+        vec->num = num;
+        for(i=0; i<vec->num; i++){
+            dpp = &vec->dpp[i];
+            POFDP_PACKET_RESET(dpp);
+            dpp->bufStart = tx->buf[i];
+            dpp->bufEnd = dpp->bufStart + sizeof tx->buf[i];
+            dpp->packetBuf = dpp->bufStart + POFDP_PACKET_PREBUF_LEN;
+            rxPacketCheck(dpp, lr, port_ptr, first, vec->msg[i].msg_len, &vec->sll[i]);
         }
 
-        /* Check the packet length. */
-        if(len_B > POF_MTU_LENGTH){
-            POF_DEBUG_CPRINT_FL(1,RED,"The packet received is longer than MTU. DROP!");
-            continue;
+        forwardNum = rxVectorPrepare(vec, lr, first);
+        for(i=0; i<vec->num; i++){
+            if(!vec->dpp[i].packet_done){
+                pofdp_forward(&vec->dpp[i], lr);
+            }
         }
+        __sync_fetch_and_add(&dp->pktCount, forwardNum);
 
-        /* Filter the received raw packet by some rules. */
-        if(dp->filter(dpp->packetBuf, port_ptr, from) != POF_OK){
-            continue;
+        pofdp_tx_batch_flush(tx);
+    }
+
+    pthread_cleanup_pop(1);
+    close(sockRecv);
+    close(sockSend);
+    FREE(vec);
+    FREE(tx);
+    FREE(cache);
+    return POF_OK;
+}
+
+/***********************************************************************
+ * Send the outputs of the transmit batch
+ * Form:     static uint32_t txBatchSend(struct pofdp_tx_batch *tx)
+ * Input:    transmit batch
+ * Output:   NONE
+ * Return:   POF_OK or Error code
+ * Discribe: This function sends all the messages of the batch. The
+ *           messages to the same socket in a row are sent by one
+ *           sendmmsg(). The received packets are kept, because the
+ *           packet being forwarded may be still being sent to the other
+ *           ports.
+ ***********************************************************************/
+static uint32_t
+txBatchSend(struct pofdp_tx_batch *tx)
+{
+    uint32_t i = 0, j, ret = POF_OK;
+    int sent;
+
+    while(i < tx->msgNum){
+        for(j=i+1; j<tx->msgNum && tx->fd[j]==tx->fd[i]; j++);
+        while(i < j){
+            if((sent = sendmmsg(tx->fd[i], &tx->msg[i], j - i, 0)) <= 0){
+                POF_ERROR_HANDLE_NO_RETURN_NO_UPWARD(POFET_SOFTWARE_FAILED, POF_SEND_MSG_FAILURE);
+                ret = POF_ERROR;
+                break;
+            }
+            i += sent;
         }
-		
-        /* Store packet data, length, received port infomation into the message queue. */
-        dpp->ori_port_id = port_ptr->pofIndex;
-        dpp->ori_len = len_B;
-        dpp->left_len = dpp->ori_len;
-        dpp->buf_offset = dpp->packetBuf;
+        i = j;
+    }
+    tx->msgNum = 0;
+    return ret;
+}
 
-        dpp->dp = dp;
+/***********************************************************************
+ * Flush the transmit batch
+ * Form:     uint32_t pofdp_tx_batch_flush(struct pofdp_tx_batch *tx)
+ * Input:    transmit batch
+ * Output:   NONE
+ * Return:   POF_OK or Error code
+ * Discribe: This function sends all the outputs collected in the batch.
+ *           The receive task calls it at the end of every vector,
+ *           and then the received packets can be reused.
+ ***********************************************************************/
+uint32_t
+pofdp_tx_batch_flush(struct pofdp_tx_batch *tx)
+{
+    return txBatchSend(tx);
+}
 
-		/* Check whether the first flow table exist. */
-		if(!(poflr_get_table_with_ID(POFDP_FIRST_TABLE_ID, lr))){
-			POF_DEBUG_CPRINT_FL(1,RED,"Received a packet, but the first flow table does NOT exist.");
-			continue;
-		}
+/***********************************************************************
+ * Release the packet from the outputs in the transmit batch
+ * Form:     uint32_t pofdp_output_release(struct pofdp_packet *dpp)
+ * Input:    dpp
+ * Output:   NONE
+ * Return:   POF_OK or Error code
+ * Discribe: The outputs in the transmit batch refer to the packet data
+ *           in place. This function sends them out, so that the packet
+ *           can be changed. The instructions and the actions which may
+ *           change the packet call it first if dpp->txHeld is set.
+ ***********************************************************************/
+uint32_t
+pofdp_output_release(struct pofdp_packet *dpp)
+{
+    dpp->txHeld = FALSE;
+    return txBatchSend(dpp->txBatch);
+}
 
-        /* Forward the packet. */
-        ret = pofdp_forward(dpp, lr, first_ins);
-        POF_CHECK_RETVALUE_NO_RETURN_NO_UPWARD(ret);
+/* Create the lookup cache with num slots. num should be a power of two. */
+static struct pofdp_flow_cache *
+flowCacheCreate(uint32_t num)
+{
+    struct pofdp_flow_cache *cache;
 
-		dp->pktCount ++;
-        POF_DEBUG_CPRINT_FL(1,GREEN,"one packet_raw has been processed!\n");
+    if(num < 2 || (num & (num - 1))){
+        return NULL;
+    }
+    POF_MALLOC_SAFE_RETURN_SIZE(cache, 1, NULL, \
+            sizeof *cache + num * sizeof cache->slot[0]);
+    cache->mask = num - 1;
+    return cache;
+}
+
+/* Extract the key of the table from the packet into lookup before the
+ * lookup, and prefetch the cache slots of the key. The lookup is used by
+ * the next pofdp_entry_lookup() of the dpp, if it is still in the table
+ * and at the packet offset. */
+static void
+flowCachePrepare(struct pofdp_packet *dpp, const struct tableInfo *table, \
+                 struct pofdp_lookup *lookup)
+{
+    const struct pofdp_flow_cache *cache = dpp->flowCache;
+    uint32_t index;
+
+    if(cache == NULL || cache->reader == NULL || \
+            POF_BITNUM_TO_BYTENUM_CEIL(table->keyLen) > POFDP_FLOW_CACHE_KEY_LEN){
+        return;
+    }
+
+    lookup->table = table;
+    lookup->bufOffset = dpp->buf_offset;
+    lookup->len = poflr_entry_key_extract(lookup->key, dpp->buf_offset, (uint8_t *)dpp->metadata, table);
+    lookup->hash = hmap_hashForBytes(lookup->key, lookup->len) ^ hmap_hashForUint32(table->id);
+    index = lookup->hash & cache->mask;
+    __builtin_prefetch(&cache->slot[index]);
+    __builtin_prefetch(&cache->slot[index ^ 1]);
+    dpp->lookup = lookup;
+    return;
+}
+
+/***********************************************************************
+ * Look up the flow table for the packet
+ * Form:     struct entryInfo *pofdp_entry_lookup(struct pofdp_packet *dpp, \
+ *                                                const struct pof_local_resource *lr, \
+ *                                                const struct tableInfo *table)
+ * Input:    dpp, local resource, table
+ * Output:   NONE
+ * Return:   The matched entry, or NULL
+ * Discribe: This function finds the entry of the table which matches the
+ *           packet. If the dpp has a lookup cache, the key extracted
+ *           from the packet, or the one of dpp->lookup which has been
+ *           extracted ahead, is looked for in the cache first. A cached
+ *           entry is used only if the local resource has not been
+ *           modified and no epoch has passed since it was cached.
+ *           Otherwise the table is looked up, and the matched entry is
+ *           cached in the free or out of date slot of the pair, or in
+ *           one of them chosen by the hash.
+ ***********************************************************************/
+struct entryInfo *
+pofdp_entry_lookup(struct pofdp_packet *dpp, const struct pof_local_resource *lr, \
+                   const struct tableInfo *table)
+{
+    struct pofdp_flow_cache *cache = dpp->flowCache;
+    const struct pofdp_lookup *ahead = dpp->lookup;
+    struct flowCacheSlot *slot[2];
+    struct entryInfo *entry;
+    uint8_t key[POF_MAX_FIELD_LENGTH_IN_BYTE * POF_MAX_MATCH_FIELD_NUM];
+    const uint8_t *k = key;
+    uint64_t epoch;
+    uint32_t gen, hash, i;
+    uint16_t len;
+
+    /* The key extracted ahead is used only once. */
+    dpp->lookup = NULL;
+
+    if(cache == NULL || cache->reader == NULL){
+        return poflr_entry_lookup(dpp->buf_offset, (uint8_t *)dpp->metadata, table);
+    }
+
+    /* Read the generation before the lookup. An entry found while the
+     * resource is being modified will be out of date at once. */
+    gen = *(volatile uint32_t *)&lr->modGen;
+    epoch = cache->reader->epoch;
+    if(ahead != NULL && ahead->table == table && ahead->bufOffset == dpp->buf_offset){
+        k = ahead->key;
+        len = ahead->len;
+        hash = ahead->hash;
+    }else{
+        len = poflr_entry_key_extract(key, dpp->buf_offset, (uint8_t *)dpp->metadata, table);
+        if(len > POFDP_FLOW_CACHE_KEY_LEN){
+            return poflr_entry_lookup_with_key(key, table);
+        }
+        hash = hmap_hashForBytes(key, len) ^ hmap_hashForUint32(table->id);
+    }
+
+    slot[0] = &cache->slot[hash & cache->mask];
+    slot[1] = &cache->slot[(hash & cache->mask) ^ 1];
+    for(i=0; i<2; i++){
+        if(slot[i]->gen == gen && slot[i]->epoch == epoch && slot[i]->entry != NULL && \
+                slot[i]->hash == hash && slot[i]->tableID == table->id && \
+                memcmp(slot[i]->key, k, len) == 0){
+            return slot[i]->entry;
+        }
+    }
+
+    if((entry = poflr_entry_lookup_with_key(k, table)) == NULL){
+        return NULL;
+    }
+
+    if(slot[0]->gen != gen || slot[0]->epoch != epoch || slot[0]->entry == NULL){
+        i = 0;
+    }else if(slot[1]->gen != gen || slot[1]->epoch != epoch || slot[1]->entry == NULL){
+        i = 1;
+    }else{
+        i = hash >> 31;
+    }
+    slot[i]->epoch = epoch;
+    slot[i]->gen = gen;
+    slot[i]->hash = hash;
+    slot[i]->entry = entry;
+    slot[i]->tableID = table->id;
+    memcpy(slot[i]->key, k, len);
+    return entry;
+}
+
+/* Check the output of the dpp. */
+static uint32_t
+outputCheck(const struct pofdp_packet *dpp)
+{
+    POF_DEBUG_CPRINT_FL(1,GREEN,"One packet is about to be sent out! port_id = %d, slot_id = %u, packet_len = %u, metadata_len = %u, total_len = %u", \
+			            dpp->output_port_id, dpp->output_slot_id, dpp->output_packet_len, \
+                        dpp->output_metadata_len, dpp->output_whole_len);
+    POF_DEBUG_CPRINT_FL_0X(1,GREEN,dpp->output_packet_buf + dpp->output_packet_offset, dpp->output_packet_len, \
+			"The packet is ");
+
+    /* Check the packet lenght. */
+    if(dpp->output_whole_len > POF_MTU_LENGTH){
+        POF_ERROR_HANDLE_RETURN_NO_UPWARD(POFET_SOFTWARE_FAILED, POF_PACKET_LEN_ERROR);
     }
 
-    close(sockRecv);
-    close(sockSend);
     return POF_OK;
 }
 
+/* Build the output of the dpp in iov as the metadata and the packet data,
+ * and return the number of the pieces. The packet data is output in place.
+ * The metadata is copied into meta if it does not start at a byte, or if
+ * copy is TRUE because the metadata will be gone when it is sent. */
+static int
+outputIovBuild(const struct pofdp_packet *dpp, struct iovec *iov, uint8_t *meta, uint8_t copy)
+{
+    uint8_t *src;
+    int num = 0;
+
+    if(dpp->output_metadata_len > 0){
+        if(dpp->output_metadata_offset % POF_BITNUM_IN_BYTE != 0){
+            pofbf_copy_bit((uint8_t *)dpp->metadata, meta, dpp->output_metadata_offset, \
+                    dpp->output_metadata_len * POF_BITNUM_IN_BYTE);
+        }else{
+            src = (uint8_t *)dpp->metadata + dpp->output_metadata_offset / POF_BITNUM_IN_BYTE;
+            if(copy){
+                memcpy(meta, src, dpp->output_metadata_len);
+            }else{
+                meta = src;
+            }
+        }
+        POF_DEBUG_CPRINT_FL_0X(1,GREEN,meta,dpp->output_metadata_len,"The metatada is ");
+        iov[num].iov_base = meta;
+        iov[num].iov_len = dpp->output_metadata_len;
+        num ++;
+    }
+    iov[num].iov_base = dpp->output_packet_buf + dpp->output_packet_offset;
+    iov[num].iov_len = dpp->output_packet_len;
+    return num + 1;
+}
+
 /***********************************************************************
- * The task function of send task
- * Form:     send_raw(struct pofdp_packet *dpp, struct pof_local_resource *lr)
- * Input:    NONE
+ * Send the output out through one port
+ * Form:     static uint32_t send_raw(struct pofdp_packet *dpp, \
+ *                                    const struct pof_local_resource *lr, \
+ *                                    uint16_t port_id)
+ * Input:    dpp, local resource, output port index
  * Output:   NONE
- * Return:   VOID
- * Discribe: This is the task function of send task, which is infinite
- *           loop running. It reads the send queue to get the packet data
- *           and the sending port infomation. Then it sends the packet
- *           out by binding the socket to the local physical net port
- *           spicified in the port infomation.
- * NOTE:     This task will be terminated if any ERRORs occur.
+ * Return:   POF_OK or Error code
+ * Discribe: This function sends the metadata and the packet data to be
+ *           output out through the port by one sendmsg(), without
+ *           assembling them. If the dpp has a transmit batch, the output
+ *           is only added into the batch, and will be sent when the batch
+ *           is flushed or the packet is released.
  ***********************************************************************/
 static uint32_t 
-send_raw(const struct pofdp_packet *dpp, const struct pof_local_resource *lr)
+send_raw(struct pofdp_packet *dpp, const struct pof_local_resource *lr, uint16_t port_id)
 {
+    struct pofdp_tx_batch *tx = dpp->txBatch;
     struct portInfo *port = NULL;
     struct   sockaddr_ll sll = {0};
-    //int      sock = dpp->sockSend;
-    uint32_t sysIndex = 0;
+    struct iovec iov[2];
+    struct msghdr msg = {0};
+    uint8_t meta[POFDP_METADATA_MAX_LEN];
+    uint32_t i;
 
-    if((port = poflr_get_port_with_pofindex(dpp->output_port_id, lr)) == NULL){
+    if((port = poflr_get_port_with_pofindex(port_id, lr)) == NULL){
         POF_ERROR_HANDLE_RETURN_NO_UPWARD(POFET_SOFTWARE_FAILED, POF_PTR_NULL);
     }
 
@@ -355,12 +1102,29 @@ send_raw(const struct pofdp_packet *dpp, const struct pof_local_resource *lr)
     sll.sll_ifindex = port->sysIndex;
     sll.sll_protocol = POF_HTONS(ETH_P_ALL);
 
-    if(sendto(port->queue_fd[1], dpp->buf_out, dpp->output_whole_len, 0, (struct sockaddr *)&sll, sizeof(sll)) == -1){
-    //if(sendto(sock, dpp->buf_out, dpp->output_whole_len, 0, (struct sockaddr *)&sll, sizeof(sll)) == -1){
-    	printf("here error!!\n");
-        POF_ERROR_HANDLE_RETURN_NO_UPWARD(POFET_SOFTWARE_FAILED, POF_SEND_MSG_FAILURE);
+    if(tx == NULL){
+        msg.msg_name = &sll;
+        msg.msg_namelen = sizeof(sll);
+        msg.msg_iov = iov;
+        msg.msg_iovlen = outputIovBuild(dpp, iov, meta, FALSE);
+        if(sendmsg(port->queue_fd[1], &msg, 0) == -1){
+            POF_ERROR_HANDLE_RETURN_NO_UPWARD(POFET_SOFTWARE_FAILED, POF_SEND_MSG_FAILURE);
+        }
+        return POF_OK;
     }
 
+    if(tx->msgNum == POFDP_TX_BATCH_MSG_NUM){
+        txBatchSend(tx);
+    }
+    i = tx->msgNum ++;
+    tx->fd[i] = port->queue_fd[1];
+    tx->sll[i] = sll;
+    memset(&tx->msg[i], 0, sizeof tx->msg[i]);
+    tx->msg[i].msg_hdr.msg_name = &tx->sll[i];
+    tx->msg[i].msg_hdr.msg_namelen = sizeof tx->sll[i];
+    tx->msg[i].msg_hdr.msg_iov = tx->iov[i];
+    tx->msg[i].msg_hdr.msg_iovlen = outputIovBuild(dpp, tx->iov[i], tx->meta[i], TRUE);
+    dpp->txHeld = TRUE;
     return POF_OK;
 }
 
@@ -372,36 +1136,56 @@ send_raw(const struct pofdp_packet *dpp, const struct pof_local_resource *lr)
  * Return:   POF_OK or Error code
  * Discribe: This function send the packet data out through the port
  *           corresponding the port_id. The length of packet data is len.
- *           It assembles the packet data, the packet length
- *           and the output port id with format of struct pofdp_packet,
- *           and write it to the send queue. Caller should make sure that
+ *           It sends the metadata and the packet data out, or adds them
+ *           into the transmit batch of the dpp. Caller
+ *           should make sure that
  *           output_packet_offset plus output_packet_len is less than the
  *           whole packet_len, and that output_metadata_offset plus 
  *           output_metadata_len is less than the whole metadata_len.
  ***********************************************************************/
 uint32_t pofdp_send_raw(struct pofdp_packet *dpp, const struct pof_local_resource *lr){
-	/* Copy metadata to output buffer. */
-    pofbf_copy_bit((uint8_t *)dpp->metadata, dpp->buf_out, dpp->output_metadata_offset, \
-			dpp->output_metadata_len * POF_BITNUM_IN_BYTE);
-	/* Copy packet to output buffer right behind metadata. */
-    memcpy(dpp->buf_out + dpp->output_metadata_len, dpp->output_packet_buf + dpp->output_packet_offset, \
-            dpp->output_packet_len);
+    uint32_t ret;
 
-    POF_DEBUG_CPRINT_FL(1,GREEN,"One packet is about to be sent out! port_id = %d, slot_id = %u, packet_len = %u, metadata_len = %u, total_len = %u", \
-			            dpp->output_port_id, dpp->output_slot_id, dpp->output_packet_len, \
-                        dpp->output_metadata_len, dpp->output_whole_len);
-    POF_DEBUG_CPRINT_FL_0X(1,GREEN,dpp->output_packet_buf + dpp->output_packet_offset, dpp->output_packet_len, \
-			"The packet is ");
-    POF_DEBUG_CPRINT_FL_0X(1,GREEN,dpp->buf_out,dpp->output_metadata_len,"The metatada is ");
-    POF_DEBUG_CPRINT_FL_0X(1,BLUE,dpp->buf_out, dpp->output_whole_len,"The whole output packet is ");
+    ret = outputCheck(dpp);
+    POF_CHECK_RETVALUE_RETURN_NO_UPWARD(ret);
 
-    /* Check the packet lenght. */
-    if(dpp->output_whole_len > POF_MTU_LENGTH){
-        POF_ERROR_HANDLE_RETURN_NO_UPWARD(POFET_SOFTWARE_FAILED, POF_PACKET_LEN_ERROR);
+    if(send_raw(dpp, lr, dpp->output_port_id) != POF_OK){
+        POF_ERROR_HANDLE_RETURN_NO_UPWARD(POFET_SOFTWARE_FAILED, POF_SEND_MSG_FAILURE);
     }
 
-    if(send_raw(dpp, lr) != POF_OK){
-        POF_ERROR_HANDLE_RETURN_NO_UPWARD(POFET_SOFTWARE_FAILED, POF_SEND_MSG_FAILURE);
+    return POF_OK;
+}
+
+/***********************************************************************
+ * Flood packet out function
+ * Form:     uint32_t pofdp_send_raw_flood(dpp, lr)
+ * Input:    dpp, local resource of the output slot
+ * Output:   NONE
+ * Return:   POF_OK or Error code
+ * Discribe: This function sends the packet out through all the ports of
+ *           the slot except the input port, the local port and the ports
+ *           which are down. The same packet data is sent through every
+ *           port.
+ ***********************************************************************/
+uint32_t pofdp_send_raw_flood(struct pofdp_packet *dpp, const struct pof_local_resource *lr){
+    struct portInfo *port, *next;
+    uint32_t ret;
+
+    ret = outputCheck(dpp);
+    POF_CHECK_RETVALUE_RETURN_NO_UPWARD(ret);
+
+    HMAP_NODES_IN_STRUCT_TRAVERSE(port, next, pofIndexNode, lr->portPofIndexMap){
+        POF_DEBUG_CPRINT(1,BLUE,"sysIndex=%d,pofIndex=%d,ori_port_id=%d\n",port->sysIndex,port->pofIndex,dpp->ori_port_id);
+        if(port->pofIndex == dpp->ori_port_id || port->pofIndex == local_port_index){
+            continue;
+        }
+        if(port->config == 16){
+            continue;
+        }
+        POF_DEBUG_CPRINT(1,BLUE,"config=%d",port->config);
+        if(send_raw(dpp, lr, port->pofIndex) != POF_OK){
+            POF_ERROR_HANDLE_RETURN_NO_UPWARD(POFET_SOFTWARE_FAILED, POF_SEND_MSG_FAILURE);
+        }
     }
 
     return POF_OK;
@@ -465,7 +1249,7 @@ uint32_t pofdp_send_packet_in_to_controller(uint16_t len,       \
     pof_NtoH_transfer_packet_in(&packetin);
     if (master_controller>=0){
 
-    if(POF_OK != pofec_reply_msg(master_controller,POFT_PACKET_IN, g_upward_xid++, packet_in_len, (uint8_t *)&packetin)){
+    if(POF_OK != pofec_reply_msg(master_controller,POFT_PACKET_IN, __sync_fetch_and_add(&g_upward_xid, 1), packet_in_len, (uint8_t *)&packetin)){
         POF_ERROR_HANDLE_RETURN_NO_UPWARD(POFET_SOFTWARE_FAILED, POF_WRITE_MSG_QUEUE_FAILURE);
     }
     }
@@ -564,6 +1348,16 @@ struct pof_datapath g_dp = {
          POFLR_EM_TBL_NUM, POFLR_DT_TBL_NUM},POFLR_FLOW_TABLE_SIZE,
         /* Group, Meter, Counter. */
         POFLR_GROUP_NUMBER, POFLR_METER_NUMBER, POFLR_COUNTER_NUMBER,
+        /* Receive ring and workers. */
+        POFDP_RX_RING_BLOCK_NUM, POFDP_RX_WORKER_NUM,
+        /* Lookup cache. */
+        POFDP_FLOW_CACHE_ENTRY_NUM,
+        /* JIT. */
+        POFDP_JIT,
+        /* Meter bucket. */
+        POFLR_METER_BURST_MS, POFLR_METER_PACKET_MODE,
+        /* Select hash. */
+        POFDP_SELECT_HASH_FIELD_NUM, POFDP_SELECT_HASH_FIELDS,
     },
     /* Slot Hash Map. */
     NULL, POF_SLOT_NUM, POF_SLOT_MAX,
@@ -35,13 +35,13 @@
 
 /* Move the packet data pointer buf_offset. 
  * buf_offset = buf_offset + offset 
- * The offset can be negative. */
+ * The offset can be negative, as far as the headroom allows. */
 static uint32_t
 movePacketBufOffset(int16_t offset, struct pofdp_packet *dpp)
 {
     /* Check offset. */
 	if((offset > dpp->left_len) || \
-            (offset < (0 - (int32_t)(POFDP_PACKET_PREBUF_LEN + dpp->offset)))){
+            (offset < (int32_t)(dpp->bufStart - dpp->buf_offset))){
 		POF_ERROR_HANDLE_RETURN_NO_UPWARD(POFET_SOFTWARE_FAILED, POF_PACKET_LEN_ERROR);
 	}
     dpp->offset     += offset;
@@ -50,53 +50,28 @@ movePacketBufOffset(int16_t offset, struct pofdp_packet *dpp)
     return POF_OK;
 }
 
-/* Move the instruction forward.
- * Caller needs to ensure that the forward offset is valid, less than todo number. */
-static void
-insJumpForward(uint32_t insNum, struct pofdp_packet *dpp)
-{
-    uint32_t i;
-    /* Forward one by one. */
-    for(i=0; i<insNum; i++){
-#ifdef POF_SHT_VXLAN
-        dpp->ins = (struct pof_instruction *)( \
-                (uint8_t *)dpp->ins + dpp->ins->len );
-#else // POF_SHT_VXLAN
-        dpp->ins ++;
-#endif // POF_SHT_VXLAN
-    }
-    dpp->ins_todo_num -= insNum;
-    dpp->ins_done_num += insNum;
-}
-
-/* Move the instruction forward or backword. */
+/* Move the instruction forward or backword. The instructions are the ops
+ * in one array, so a jump of any direction is only a pointer move. */
 static uint32_t
 insJump(uint8_t direction, uint32_t insNum, struct pofdp_packet *dpp)
 {
+    uint32_t insTodo = dpp->prog->op + dpp->prog->insNum - dpp->ins;
+    uint32_t insDone = dpp->ins - dpp->prog->op;
+
 	if(direction == POFD_FORWARD){
-		if(insNum > dpp->ins_todo_num){
+		if(insNum > insTodo){
 			POF_DEBUG_CPRINT_FL(1,RED,"The number of instruction to jump forward is more than the instructions left. " \
-					"insNum = %u, insLeft=%u", insNum, dpp->ins_todo_num);
+					"insNum = %u, insLeft=%u", insNum, insTodo);
 			POF_ERROR_HANDLE_RETURN_NO_UPWARD(POFET_BAD_INSTRUCTION,POFBIC_JUM_TO_INVALID_INST);
 		}
-        insJumpForward(insNum, dpp);
+        dpp->ins += insNum;
 	}else{
-		if(insNum > dpp->ins_done_num){
+		if(insNum > insDone){
 			POF_DEBUG_CPRINT_FL(1,RED,"The number of instruction to jump backward is more than the instructions reserved. " \
-					"insNum = %u, insDone = %u", insNum, dpp->ins_done_num);
+					"insNum = %u, insDone = %u", insNum, insDone);
 			POF_ERROR_HANDLE_RETURN_NO_UPWARD(POFET_BAD_INSTRUCTION,POFBIC_JUM_TO_INVALID_INST);
 		}
-#ifdef POF_SHT_VXLAN
-        insNum = dpp->ins_done_num - insNum;
-        dpp->ins_done_num = 0;
-        dpp->ins_todo_num = dpp->insBlock->insNum;
-        dpp->ins = (struct pof_instruction *)dpp->insBlock->insData;
-        insJumpForward(insNum, dpp);
-#else // POF_SHT_VXLAN
-        dpp->ins            -= insNum;
-        dpp->ins_done_num   -= insNum;
-        dpp->ins_todo_num   += insNum;
-#endif // POF_SHT_VXLAN
+        dpp->ins -= insNum;
 	}
     return POF_OK;
 }
@@ -141,11 +116,9 @@ static void pofdp_find_key(uint8_t *packet, uint8_t *metadata, uint8_t **key_ptr
 static void 
 instruction_update(struct pofdp_packet *dpp)
 {
-	if(dpp->ins_todo_num == 1){
+	if(++dpp->ins == dpp->prog->op + dpp->prog->insNum){
 		dpp->packet_done = TRUE;
-		return;
 	}
-    insJumpForward(1, dpp);
 	return;
 }
 
@@ -201,7 +174,7 @@ static uint32_t pofdp_entry_nomatch(const struct pofdp_packet *dpp, const struct
     //POF_DEBUG_CPRINT_FL_0X(1,GREEN,dpp->packetBuf, dpp->offset + dpp->left_len, "The no match packet is ");
 
     //ret = pofdp_send_packet_in_to_controller(dpp->offset + dpp->left_len, \
-			POFR_NO_MATCH, table_ID, POF_FE_ID, dpp->ori_port_id, lr->slotID, dpp->buf);
+			POFR_NO_MATCH, table_ID, POF_FE_ID, dpp->ori_port_id, lr->slotID, dpp->packetBuf);
 
     ret = pofdp_send_packet_in_to_controller(dpp->offset + dpp->left_len, \
 			POFR_NO_MATCH, table_ID, POF_FE_ID, dpp->ori_port_id, lr->slotID, dpp->packetBuf);
@@ -216,25 +189,35 @@ static uint32_t pofdp_entry_nomatch(const struct pofdp_packet *dpp, const struct
     return POF_OK;
 }
 
-static uint32_t execute_METER(POFDP_ARG)
+static uint32_t execute_METER(POFDP_OP_ARG)
 {
-    pof_instruction_meter *p = (pof_instruction_meter *)dpp->ins->instruction_data;
+#ifndef POF_SHT_VXLAN
+    pof_instruction_meter *p = (pof_instruction_meter *)op->data;
+#endif // POF_SHT_VXLAN
     struct meterInfo *meter;
     uint32_t meterID = 0, ret;
 
+    /* The meter bound when the instruction was installed. */
+    if((meter = POFLR_REF_GET(&op->ref)) == NULL){
 #ifdef POF_SHT_VXLAN
-	ret = pofdp_get_32value(&meterID, p->id_type, &p->meter_id, dpp);
-	POF_CHECK_RETVALUE_RETURN_NO_UPWARD(ret);
+        ret = POFDP_OPERAND_GET(&meterID, op, 0, dpp);
+        POF_CHECK_RETVALUE_RETURN_NO_UPWARD(ret);
 #else // POF_SHT_VXLAN
-    meterID = p->meter_id;
+        meterID = p->meter_id;
 #endif // POF_SHT_VXLAN
 
-    /* Check the meter id. */
-    if(!(meter = poflr_get_meter_with_ID(meterID, lr))){
-        POF_ERROR_HANDLE_RETURN_NO_UPWARD(POFET_METER_MOD_FAILED, POFMMFC_UNKNOWN_METER);
+        /* Check the meter id. */
+        if(!(meter = poflr_get_meter_with_ID(meterID, lr))){
+            POF_ERROR_HANDLE_RETURN_NO_UPWARD(POFET_METER_MOD_FAILED, POFMMFC_UNKNOWN_METER);
+        }
     }
 
 	dpp->rate = meter->rate;
+    if(!poflr_meter_police(meter, POF_PACKET_REL_LEN_GET(dpp))){
+        POF_DEBUG_CPRINT_FL(1,BLUE,"Drop the packet beyond the rate of meter[%u].", meter->id);
+        dpp->packet_done = TRUE;
+        return POF_OK;
+    }
     POF_DEBUG_CPRINT_FL(1,GREEN,"instruction_meter has been DONE! meter_id = %u, rate = %u", \
 			meter->id, meter->rate);
 
@@ -243,15 +226,13 @@ static uint32_t execute_METER(POFDP_ARG)
 }
 
 #ifdef POF_SHT_VXLAN
-static uint32_t execute_SET_PACKET_OFFSET(POFDP_ARG)
+static uint32_t execute_SET_PACKET_OFFSET(POFDP_OP_ARG)
 {
-    struct pof_instruction_set_packet_offset *p = \
-            (struct pof_instruction_set_packet_offset *)dpp->ins->instruction_data;
     int32_t offset = 0, offsetMove = 0;
     uint32_t ret;
 
     /* Get offset. */
-	ret = pofdp_get_32value((uint32_t *)&offset, p->offset_type, &p->offset, dpp);
+	ret = POFDP_OPERAND_GET((uint32_t *)&offset, op, 0, dpp);
 	POF_CHECK_RETVALUE_RETURN_NO_UPWARD(ret);
 
     /* Convert to the move offset. */
@@ -266,10 +247,10 @@ static uint32_t execute_SET_PACKET_OFFSET(POFDP_ARG)
     return POF_OK;
 }
 
-static uint32_t execute_COMPARE(POFDP_ARG)
+static uint32_t execute_COMPARE(POFDP_OP_ARG)
 {
     struct pof_instruction_compare *p = \
-            (struct pof_instruction_compare *)dpp->ins->instruction_data;
+            (struct pof_instruction_compare *)op->data;
     uint32_t value1 = 0, value2 = 0, ret;
     uint8_t resNum = 0, compRes = 0, *resAddr = NULL, mask = 0, mov_b = 0;
 
@@ -277,10 +258,10 @@ static uint32_t execute_COMPARE(POFDP_ARG)
     resAddr = &(dpp->metadata->compRes);
 
 	/* Get value1 and value2. */
-	ret = pofdp_get_32value(&value1, POFVT_FIELD, &p->operand1, dpp);
+	ret = POFDP_OPERAND_GET(&value1, op, 0, dpp);
 	POF_CHECK_RETVALUE_RETURN_NO_UPWARD(ret);
 
-	ret = pofdp_get_32value(&value2, p->operand2_type, &p->operand2, dpp);
+	ret = POFDP_OPERAND_GET(&value2, op, 1, dpp);
 	POF_CHECK_RETVALUE_RETURN_NO_UPWARD(ret);
 
     /* Compare. */
@@ -310,17 +291,17 @@ static uint32_t execute_COMPARE(POFDP_ARG)
     return POF_OK;
 }
 
-static uint32_t execute_BRANCH(POFDP_ARG)
+static uint32_t execute_BRANCH(POFDP_OP_ARG)
 {
     struct pof_instruction_branch *p = \
-            (struct pof_instruction_branch *)dpp->ins->instruction_data;
+            (struct pof_instruction_branch *)op->data;
     uint32_t ret = POF_OK, value1 = 0, value2 = 0;
 
 	/* Get value1 and value2. */
-	ret = pofdp_get_32value(&value1, POFVT_FIELD, &p->operand1, dpp);
+	ret = POFDP_OPERAND_GET(&value1, op, 0, dpp);
 	POF_CHECK_RETVALUE_RETURN_NO_UPWARD(ret);
 
-	ret = pofdp_get_32value(&value2, p->operand2_type, &p->operand2, dpp);
+	ret = POFDP_OPERAND_GET(&value2, op, 1, dpp);
 	POF_CHECK_RETVALUE_RETURN_NO_UPWARD(ret);
 
     if(value1 != value2){
@@ -340,10 +321,10 @@ static uint32_t execute_BRANCH(POFDP_ARG)
     return POF_OK;
 }
 
-static uint32_t execute_JMP(POFDP_ARG)
+static uint32_t execute_JMP(POFDP_OP_ARG)
 {
     struct pof_instruction_jmp *p = \
-            (struct pof_instruction_jmp *)dpp->ins->instruction_data;
+            (struct pof_instruction_jmp *)op->data;
     uint32_t ret;
 
     ret = insJump(p->direction, p->instruction_num, dpp);
@@ -357,10 +338,10 @@ static uint32_t execute_JMP(POFDP_ARG)
 }
 #endif // POF_SHT_VXLAN
 
-static uint32_t execute_WRITE_METADATA(POFDP_ARG)
+static uint32_t execute_WRITE_METADATA(POFDP_OP_ARG)
 {
     pof_instruction_write_metadata *p = \
-			(pof_instruction_write_metadata *)dpp->ins->instruction_data;
+			(pof_instruction_write_metadata *)op->data;
 #ifdef POF_SD2N_AFTER1015
 #else // POF_SD2N_AFTER1015
     uint32_t value = p->value;
@@ -381,10 +362,10 @@ static uint32_t execute_WRITE_METADATA(POFDP_ARG)
     return POF_OK;
 }
 
-static uint32_t execute_WRITE_METADATA_FROM_PACKET(POFDP_ARG)
+static uint32_t execute_WRITE_METADATA_FROM_PACKET(POFDP_OP_ARG)
 {
     pof_instruction_write_metadata_from_packet *p = \
-                (pof_instruction_write_metadata_from_packet *)dpp->ins->instruction_data;
+                (pof_instruction_write_metadata_from_packet *)op->data;
 	struct pofdp_metadata *metadata = dpp->metadata;
     uint8_t  value[POFDP_METADATA_MAX_LEN];
 
@@ -403,18 +384,16 @@ static uint32_t execute_WRITE_METADATA_FROM_PACKET(POFDP_ARG)
     return POF_OK;
 }
 
-static uint32_t execute_GOTO_DIRECT_TABLE(POFDP_ARG)
+static uint32_t execute_GOTO_DIRECT_TABLE(POFDP_OP_ARG)
 {
     pof_instruction_goto_direct_table *p = \
-			(pof_instruction_goto_direct_table *)dpp->ins->instruction_data;
+			(pof_instruction_goto_direct_table *)op->data;
     struct entryInfo *entry;
     struct tableInfo *table;
     uint8_t *table_type = &dpp->table_type;
     uint8_t *table_id = &dpp->table_id;
     uint32_t i, ret, entry_index;
 
-    p = (pof_instruction_goto_direct_table *)dpp->ins->instruction_data;
-
     /* The packet forward to the next table. */
 	ret = movePacketBufOffset((int16_t)p->packet_offset, dpp);
 	POF_CHECK_RETVALUE_RETURN_NO_UPWARD(ret);
@@ -424,14 +403,14 @@ static uint32_t execute_GOTO_DIRECT_TABLE(POFDP_ARG)
     POF_CHECK_RETVALUE_RETURN_NO_UPWARD(ret);
 
 #ifdef POF_SD2N
-	ret = pofdp_get_32value(&entry_index, p->index_type, &p->table_entry_index, dpp);
+	ret = POFDP_OPERAND_GET(&entry_index, op, 0, dpp);
 	POF_CHECK_RETVALUE_RETURN_NO_UPWARD(ret);
 #else // POF_SD2N
 	entry_index = p->table_entry_index;
 #endif // POF_SD2N
 
-    table = poflr_get_table_with_ID(p->next_table_id, lr);
-    if(!(table)){
+    if(!(table = POFLR_REF_GET(&op->ref)) && \
+            !(table = poflr_get_table_with_ID(p->next_table_id, lr))){
         POF_ERROR_HANDLE_RETURN_NO_UPWARD(POFET_BAD_ACTION, POFBIC_BAD_TABLE_ID);
     }
     POF_DEBUG_CPRINT_FL(1,BLUE,"Go to DT table[%d][%d][%d]!", *table_type, *table_id, entry_index);
@@ -448,9 +427,9 @@ static uint32_t execute_GOTO_DIRECT_TABLE(POFDP_ARG)
 
     /* Increase the counter value. */
 #ifdef POF_SD2N
-    ret = poflr_counter_increace(dpp->flow_entry->counter_id, POF_PACKET_REL_LEN_GET(dpp), lr);
+    ret = poflr_counter_increace_ref(&dpp->flow_entry->counterRef, POF_PACKET_REL_LEN_GET(dpp), lr);
 #else // POF_SD2N
-    ret = poflr_counter_increace(dpp->flow_entry->counter_id, lr);
+    ret = poflr_counter_increace_ref(&dpp->flow_entry->counterRef, lr);
 #endif // POF_SD2N
     POF_CHECK_RETVALUE_RETURN_NO_UPWARD(ret);
 
@@ -461,40 +440,36 @@ static uint32_t execute_GOTO_DIRECT_TABLE(POFDP_ARG)
     struct insBlockInfo *insBlock = NULL;
 
     /* Get the insBlock. */
-    if(!(insBlock = poflr_get_insBlock_with_ID(blockID, lr))){
+    if(!(insBlock = POFLR_REF_GET(&dpp->flow_entry->insBlockRef)) && \
+            !(insBlock = poflr_get_insBlock_with_ID(blockID, lr))){
         POF_ERROR_HANDLE_NO_RETURN_NO_UPWARD(POFET_SOFTWARE_FAILED, POF_BAD_INS_BLOCK_ID);
         dpp->packet_done = TRUE;
         return ret;
     }
     POF_DEBUG_CPRINT_FL(1,BLUE,"Execute the insBlock [%u]", blockID);
 
-    dpp->insBlock = insBlock;
-    dpp->ins = (struct pof_instruction *)insBlock->insData;
-    dpp->ins_todo_num = insBlock->insNum;
+    dpp->prog = insBlock->prog;
     dpp->paraLen = dpp->flow_entry->paraLen;
     dpp->para = dpp->flow_entry->para;
 #else // POF_SHT_VXLAN
-    dpp->ins = dpp->flow_entry->instruction;
-    dpp->ins_todo_num = dpp->flow_entry->instruction_num;
+    dpp->prog = dpp->flow_entry->prog;
 #endif // POF_SHT_VXLAN
-	dpp->ins_done_num = 0;
+    dpp->ins = dpp->prog->op;
 
     POF_DEBUG_CPRINT_FL(1,GREEN,"Match entry! ");
 
     return POF_OK;
 }
 
-static uint32_t execute_GOTO_TABLE(POFDP_ARG)
+static uint32_t execute_GOTO_TABLE(POFDP_OP_ARG)
 {
     struct pof_instruction_goto_table *p = \
-				(pof_instruction_goto_table *)dpp->ins->instruction_data;
+				(pof_instruction_goto_table *)op->data;
     struct tableInfo *table;
     uint32_t i, j, ret = POF_OK;
     uint8_t *table_type = &dpp->table_type;
     uint8_t *table_id = &dpp->table_id;
 
-    p = (pof_instruction_goto_table *)dpp->ins->instruction_data;
-
     /* The packet forward to the next table. */
 	ret = movePacketBufOffset((int16_t)p->packet_offset, dpp);
 	POF_CHECK_RETVALUE_RETURN_NO_UPWARD(ret);
@@ -505,11 +480,12 @@ static uint32_t execute_GOTO_TABLE(POFDP_ARG)
 
     POF_DEBUG_CPRINT_FL(1,BLUE,"Go to table[%d][%d]!", *table_type, *table_id);
 
-    if(!(table = poflr_get_table_with_ID(p->next_table_id, lr))){
+    if(!(table = POFLR_REF_GET(&op->ref)) && \
+            !(table = poflr_get_table_with_ID(p->next_table_id, lr))){
         POF_ERROR_HANDLE_RETURN_NO_UPWARD(POFET_BAD_ACTION, POFBIC_BAD_TABLE_ID);
     }
 
-    if(!(dpp->flow_entry = poflr_entry_lookup(dpp->buf_offset, (uint8_t *)dpp->metadata, table))){
+    if(!(dpp->flow_entry = pofdp_entry_lookup(dpp, lr, table))){
         /* No match. */
         POF_DEBUG_CPRINT_FL(1,RED,"Cannot find the right entry in table[%d][%d]!",*table_type,*table_id);
 
@@ -521,9 +497,9 @@ static uint32_t execute_GOTO_TABLE(POFDP_ARG)
         POF_DEBUG_CPRINT_FL(1,GREEN,"Match entry[%u]", dpp->flow_entry->index);
         /* Match. Increace the counter value. */
 #ifdef POF_SD2N
-        ret = poflr_counter_increace(dpp->flow_entry->counter_id, POF_PACKET_REL_LEN_GET(dpp), lr);
+        ret = poflr_counter_increace_ref(&dpp->flow_entry->counterRef, POF_PACKET_REL_LEN_GET(dpp), lr);
 #else // POF_SD2N
-        ret = poflr_counter_increace(dpp->flow_entry->counter_id, lr);
+        ret = poflr_counter_increace_ref(&dpp->flow_entry->counterRef, lr);
 #endif // POF_SD2N
         POF_CHECK_RETVALUE_NO_RETURN_NO_UPWARD(ret);
 
@@ -534,35 +510,31 @@ static uint32_t execute_GOTO_TABLE(POFDP_ARG)
         struct insBlockInfo *insBlock = NULL;
 
         /* Get the insBlock. */
-        if(!(insBlock = poflr_get_insBlock_with_ID(blockID, lr))){
+        if(!(insBlock = POFLR_REF_GET(&dpp->flow_entry->insBlockRef)) && \
+                !(insBlock = poflr_get_insBlock_with_ID(blockID, lr))){
             POF_ERROR_HANDLE_NO_RETURN_NO_UPWARD(POFET_SOFTWARE_FAILED, POF_BAD_INS_BLOCK_ID);
             dpp->packet_done = TRUE;
             return ret;
         }
         POF_DEBUG_CPRINT_FL(1,BLUE,"Execute the insBlock [%u]", blockID);
-        dpp->insBlock = insBlock;
-        dpp->ins = (struct pof_instruction *)insBlock->insData;
-        dpp->ins_todo_num = insBlock->insNum;
+        dpp->prog = insBlock->prog;
         dpp->paraLen = dpp->flow_entry->paraLen;
         dpp->para = dpp->flow_entry->para;
 #else // POF_SHT_VXLAN
-        dpp->ins = dpp->flow_entry->instruction;
-        dpp->ins_todo_num = dpp->flow_entry->instruction_num;
+        dpp->prog = dpp->flow_entry->prog;
 #endif // POF_SHT_VXLAN
-		dpp->ins_done_num = 0;
+        dpp->ins = dpp->prog->op;
     }
 
     return ret;
 }
 
-static uint32_t execute_APPLY_ACTIONS(POFDP_ARG)
+static uint32_t execute_APPLY_ACTIONS(POFDP_OP_ARG)
 {
-    pof_instruction_apply_actions *p = \
-			(pof_instruction_apply_actions *)dpp->ins->instruction_data;
     uint32_t    ret;
 
-    dpp->act = (pof_action *)p->action;
-    dpp->act_num = p->action_num;
+    dpp->act = op->sub;
+    dpp->act_num = op->subNum;
 
     ret = pofdp_action_execute(dpp, lr);
     POF_CHECK_RETVALUE_RETURN_NO_UPWARD(ret);
@@ -768,31 +740,172 @@ pofdp_get_16value(uint16_t *value, uint8_t type, void *u_, const struct pofdp_pa
 	return POF_OK;
 }
 
+/* Operand accessors, chosen by pofdp_operand_build(). */
+static uint32_t
+operandImmediate(uint32_t *value, const struct pofdp_operand *o, \
+                 const struct pofdp_packet *dpp)
+{
+    *value = o->u.value;
+    return POF_OK;
+}
+
+/* Any field. The buf is chosen by the field id in packet time. */
+static uint32_t
+operandField(uint32_t *value, const struct pofdp_operand *o, \
+             const struct pofdp_packet *dpp)
+{
+    return get_32value_from_field(value, &o->u.field, dpp);
+}
+
+static uint32_t
+operandMetadata(uint32_t *value, const struct pofdp_operand *o, \
+                const struct pofdp_packet *dpp)
+{
+    const struct pof_match *pm = &o->u.field;
+
+    if(pm->len + pm->offset > dpp->metadata_len * POF_BITNUM_IN_BYTE){
+        POF_ERROR_HANDLE_RETURN_NO_UPWARD(POFET_SOFTWARE_FAILED, POF_METADATA_LEN_ERROR);
+    }
+	pofdp_get_32value_from_buf((uint8_t *)dpp->metadata, value, pm->offset, pm->len);
+    return POF_OK;
+}
+
+static uint32_t
+operandPacket(uint32_t *value, const struct pofdp_operand *o, \
+              const struct pofdp_packet *dpp)
+{
+    const struct pof_match *pm = &o->u.field;
+
+    if(pm->len + pm->offset > dpp->left_len * POF_BITNUM_IN_BYTE){
+        POF_ERROR_HANDLE_RETURN_NO_UPWARD(POFET_SOFTWARE_FAILED, POF_PACKET_LEN_ERROR);
+    }
+	pofdp_get_32value_from_buf(dpp->buf_offset, value, pm->offset, pm->len);
+    return POF_OK;
+}
+
+/* Byte aligned packet fields of 8, 16 and 32 bits are loaded directly. */
+static uint32_t
+operandPacket8(uint32_t *value, const struct pofdp_operand *o, \
+               const struct pofdp_packet *dpp)
+{
+    const struct pof_match *pm = &o->u.field;
+    const uint8_t *p;
+
+    if(pm->offset + 8 > dpp->left_len * POF_BITNUM_IN_BYTE){
+        POF_ERROR_HANDLE_RETURN_NO_UPWARD(POFET_SOFTWARE_FAILED, POF_PACKET_LEN_ERROR);
+    }
+    p = dpp->buf_offset + pm->offset / POF_BITNUM_IN_BYTE;
+    *value = p[0];
+    return POF_OK;
+}
+
+static uint32_t
+operandPacket16(uint32_t *value, const struct pofdp_operand *o, \
+                const struct pofdp_packet *dpp)
+{
+    const struct pof_match *pm = &o->u.field;
+    const uint8_t *p;
+
+    if(pm->offset + 16 > dpp->left_len * POF_BITNUM_IN_BYTE){
+        POF_ERROR_HANDLE_RETURN_NO_UPWARD(POFET_SOFTWARE_FAILED, POF_PACKET_LEN_ERROR);
+    }
+    p = dpp->buf_offset + pm->offset / POF_BITNUM_IN_BYTE;
+    *value = ((uint32_t)p[0] << 8) | p[1];
+    return POF_OK;
+}
+
+static uint32_t
+operandPacket32(uint32_t *value, const struct pofdp_operand *o, \
+                const struct pofdp_packet *dpp)
+{
+    const struct pof_match *pm = &o->u.field;
+    const uint8_t *p;
+
+    if(pm->offset + 32 > dpp->left_len * POF_BITNUM_IN_BYTE){
+        POF_ERROR_HANDLE_RETURN_NO_UPWARD(POFET_SOFTWARE_FAILED, POF_PACKET_LEN_ERROR);
+    }
+    p = dpp->buf_offset + pm->offset / POF_BITNUM_IN_BYTE;
+    *value = ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | \
+             ((uint32_t)p[2] << 8) | p[3];
+    return POF_OK;
+}
+
+/***********************************************************************
+ * Build the operand
+ * Form:     void pofdp_operand_build(struct pofdp_operand *o, \
+ *                                    uint8_t type, const void *u_)
+ * Input:    value type, the value or field in the instruction or action
+ * Output:   o
+ * Return:   VOID
+ * Discribe: This function decodes one 32 bits operand, which is read by
+ *           pofdp_get_32value() before, and chooses the accessor of it.
+ *           The field length is checked by the accessor, so a bad length
+ *           is still reported when the packet uses it.
+ ***********************************************************************/
+void
+pofdp_operand_build(struct pofdp_operand *o, uint8_t type, const void *u_)
+{
+	const union {
+		uint32_t value;
+		struct pof_match field;
+	} *u = u_;
+    const struct pof_match *pm = &u->field;
+
+    memset(o, 0, sizeof *o);
+	if(type == POFVT_IMMEDIATE_NUM){
+        o->u.value = u->value;
+        o->get = operandImmediate;
+		return;
+	}
+
+    o->u.field = *pm;
+    if(pm->len > 32){
+        o->get = operandField;
+    }else if(pm->field_id == POFDP_METADATA_FIELD_ID){
+        o->get = operandMetadata;
+#ifdef POF_SHT_VXLAN
+    }else if((pm->field_id & 0xF000) == POFDP_PARA_FIELD_ID){
+        o->get = operandField;
+#endif // POF_SHT_VXLAN
+    }else if(pm->offset % POF_BITNUM_IN_BYTE != 0){
+        o->get = operandPacket;
+    }else if(pm->len == 8){
+        o->get = operandPacket8;
+    }else if(pm->len == 16){
+        o->get = operandPacket16;
+    }else if(pm->len == 32){
+        o->get = operandPacket32;
+    }else{
+        o->get = operandPacket;
+    }
+    return;
+}
+
 #ifdef POF_SD2N
 static uint32_t
-execute_CONDITIONAL_JMP(POFDP_ARG)
+execute_CONDITIONAL_JMP(POFDP_OP_ARG)
 {
 	struct pof_instruction_conditional_jump *p = \
-			(struct pof_instruction_conditional_jump *)dpp->ins->instruction_data;
+			(struct pof_instruction_conditional_jump *)op->data;
 	uint32_t value1, value2, offset, ret;
 	uint8_t direction;
 
 	/* Get value1 and value2. */
-	ret = pofdp_get_32value(&value1, POFVT_FIELD, &p->compare_field1, dpp);
+	ret = POFDP_OPERAND_GET(&value1, op, 0, dpp);
 	POF_CHECK_RETVALUE_RETURN_NO_UPWARD(ret);
 
-	ret = pofdp_get_32value(&value2, p->field2_type, &p->compare_field2, dpp);
+	ret = POFDP_OPERAND_GET(&value2, op, 1, dpp);
 	POF_CHECK_RETVALUE_RETURN_NO_UPWARD(ret);
 
 	/* Compare value1 and value2. */
 	if(value1 < value2){
-		ret = pofdp_get_32value(&offset, p->offset1_type, &p->offset1, dpp);
+		ret = POFDP_OPERAND_GET(&offset, op, 2, dpp);
 		direction = p->offset1_direction;
 	}else if(value1 == value2){
-		ret = pofdp_get_32value(&offset, p->offset2_type, &p->offset2, dpp);
+		ret = POFDP_OPERAND_GET(&offset, op, 3, dpp);
 		direction = p->offset2_direction;
 	}else if(value1 > value2){
-		ret = pofdp_get_32value(&offset, p->offset3_type, &p->offset3, dpp);
+		ret = POFDP_OPERAND_GET(&offset, op, 4, dpp);
 		direction = p->offset3_direction;
 	}
 	POF_CHECK_RETVALUE_RETURN_NO_UPWARD(ret);
@@ -855,16 +968,16 @@ calculate_BITWISE_NOR(uint32_t value, uint32_t operand)
 }
 
 static uint32_t
-execute_CALCULATE_FIELD(POFDP_ARG)
+execute_CALCULATE_FIELD(POFDP_OP_ARG)
 {
 	struct pof_instruction_calc_field *p = \
-			(struct pof_instruction_calc_field *)dpp->ins->instruction_data;
+			(struct pof_instruction_calc_field *)op->data;
 	uint32_t value1, operand, result, ret;
 
-	ret = pofdp_get_32value(&value1, POFVT_FIELD, &p->dst_field, dpp);
+	ret = POFDP_OPERAND_GET(&value1, op, 0, dpp);
 	POF_CHECK_RETVALUE_RETURN_NO_UPWARD(ret);
 
-	ret = pofdp_get_32value(&operand, p->src_type, &p->src_operand, dpp);
+	ret = POFDP_OPERAND_GET(&operand, op, 1, dpp);
 	POF_CHECK_RETVALUE_RETURN_NO_UPWARD(ret);
 
 	switch(p->calc_type){
@@ -892,13 +1005,13 @@ execute_CALCULATE_FIELD(POFDP_ARG)
 }
 
 static uint32_t
-execute_MOVE_PACKET_OFFSET(POFDP_ARG)
+execute_MOVE_PACKET_OFFSET(POFDP_OP_ARG)
 {
 	struct pof_instruction_mov_packet_offset *p = \
-			(struct pof_instruction_mov_packet_offset *)dpp->ins->instruction_data;
+			(struct pof_instruction_mov_packet_offset *)op->data;
 	uint32_t value, ret;
 
-	ret = pofdp_get_32value(&value, p->value_type, &p->movement, dpp);
+	ret = POFDP_OPERAND_GET(&value, op, 0, dpp);
 	POF_CHECK_RETVALUE_RETURN_NO_UPWARD(ret);
 
 	if(p->direction == POFD_FORWARD){
@@ -918,48 +1031,293 @@ execute_MOVE_PACKET_OFFSET(POFDP_ARG)
 #endif // POF_SD2N
 
 static uint32_t 
-execute_WRITE_ACTIONS(POFDP_ARG)
+execute_WRITE_ACTIONS(POFDP_OP_ARG)
 {
 	// TODO
     POF_ERROR_HANDLE_RETURN_NO_UPWARD(POFET_BAD_INSTRUCTION, POFBIC_UNSUP_INST);
 }
 
 static uint32_t 
-execute_CLEAR_ACTIONS(POFDP_ARG)
+execute_CLEAR_ACTIONS(POFDP_OP_ARG)
 {
 	// TODO
     POF_ERROR_HANDLE_RETURN_NO_UPWARD(POFET_BAD_INSTRUCTION, POFBIC_UNSUP_INST);
 }
 
 static uint32_t 
-execute_EXPERIMENTER(POFDP_ARG)
+execute_EXPERIMENTER(POFDP_OP_ARG)
 {
 	// TODO
     POF_ERROR_HANDLE_RETURN_NO_UPWARD(POFET_BAD_INSTRUCTION, POFBIC_UNSUP_INST);
 }
 
+static uint32_t 
+execute_UNKNOWN(POFDP_OP_ARG)
+{
+    POF_ERROR_HANDLE_RETURN_NO_UPWARD(POFET_BAD_INSTRUCTION, POFBIC_UNKNOWN_INST);
+}
+
+/* The next instruction in the wire format. */
+static struct pof_instruction *
+insNext(const struct pof_instruction *ins)
+{
+#ifdef POF_SHT_VXLAN
+    return (struct pof_instruction *)((uint8_t *)ins + ins->len);
+#else // POF_SHT_VXLAN
+    return (struct pof_instruction *)(ins + 1);
+#endif // POF_SHT_VXLAN
+}
+
+/* Decode one instruction into op, except the actions of APPLY_ACTIONS. */
+static void
+insDecode(struct pofdp_op *op, struct pof_instruction *ins)
+{
+    memset(op, 0, sizeof *op);
+    op->type = ins->type;
+    op->data = ins->instruction_data;
+
+    switch(ins->type){
+#define INSTRUCTION(NAME,VALUE) case POFIT_##NAME: op->exec = execute_##NAME; break;
+		INSTRUCTIONS
+#undef INSTRUCTION
+        default:
+            op->exec = execute_UNKNOWN;
+            break;
+    }
+
+    /* The operands. */
+    switch(ins->type){
+#ifdef POF_SHT_VXLAN
+        case POFIT_METER:
+        {
+            pof_instruction_meter *p = op->data;
+            pofdp_operand_build(&op->opnd[0], p->id_type, &p->meter_id);
+            break;
+        }
+        case POFIT_SET_PACKET_OFFSET:
+        {
+            struct pof_instruction_set_packet_offset *p = op->data;
+            pofdp_operand_build(&op->opnd[0], p->offset_type, &p->offset);
+            break;
+        }
+        case POFIT_COMPARE:
+        {
+            struct pof_instruction_compare *p = op->data;
+            pofdp_operand_build(&op->opnd[0], POFVT_FIELD, &p->operand1);
+            pofdp_operand_build(&op->opnd[1], p->operand2_type, &p->operand2);
+            break;
+        }
+        case POFIT_BRANCH:
+        {
+            struct pof_instruction_branch *p = op->data;
+            pofdp_operand_build(&op->opnd[0], POFVT_FIELD, &p->operand1);
+            pofdp_operand_build(&op->opnd[1], p->operand2_type, &p->operand2);
+            break;
+        }
+#endif // POF_SHT_VXLAN
+#ifdef POF_SD2N
+        case POFIT_GOTO_DIRECT_TABLE:
+        {
+            pof_instruction_goto_direct_table *p = op->data;
+            pofdp_operand_build(&op->opnd[0], p->index_type, &p->table_entry_index);
+            break;
+        }
+        case POFIT_CONDITIONAL_JMP:
+        {
+            struct pof_instruction_conditional_jump *p = op->data;
+            pofdp_operand_build(&op->opnd[0], POFVT_FIELD, &p->compare_field1);
+            pofdp_operand_build(&op->opnd[1], p->field2_type, &p->compare_field2);
+            pofdp_operand_build(&op->opnd[2], p->offset1_type, &p->offset1);
+            pofdp_operand_build(&op->opnd[3], p->offset2_type, &p->offset2);
+            pofdp_operand_build(&op->opnd[4], p->offset3_type, &p->offset3);
+            break;
+        }
+        case POFIT_CALCULATE_FIELD:
+        {
+            struct pof_instruction_calc_field *p = op->data;
+            pofdp_operand_build(&op->opnd[0], POFVT_FIELD, &p->dst_field);
+            pofdp_operand_build(&op->opnd[1], p->src_type, &p->src_operand);
+            break;
+        }
+        case POFIT_MOVE_PACKET_OFFSET:
+        {
+            struct pof_instruction_mov_packet_offset *p = op->data;
+            pofdp_operand_build(&op->opnd[0], p->value_type, &p->movement);
+            break;
+        }
+#endif // POF_SD2N
+        default:
+            break;
+    }
+    return;
+}
+
+/***********************************************************************
+ * Get the size of the program
+ * Form:     uint32_t pofdp_program_size(const struct pof_instruction *ins, \
+ *                                       uint8_t insNum)
+ * Input:    instructions in the wire format, instruction number
+ * Output:   NONE
+ * Return:   Size of the program in byte
+ * Discribe: This function counts the ops of the instructions, including
+ *           the actions of all the APPLY_ACTIONS instructions.
+ ***********************************************************************/
+uint32_t
+pofdp_program_size(const struct pof_instruction *ins, uint8_t insNum)
+{
+    const pof_instruction_apply_actions *p;
+    uint32_t opNum = insNum;
+    uint8_t i;
+
+    for(i=0; i<insNum; i++, ins=insNext(ins)){
+        if(ins->type == POFIT_APPLY_ACTIONS){
+            p = (const pof_instruction_apply_actions *)ins->instruction_data;
+            opNum += p->action_num;
+        }
+    }
+    return sizeof(struct pofdp_program) + opNum * sizeof(struct pofdp_op);
+}
+
+/***********************************************************************
+ * Build the program
+ * Form:     void pofdp_program_build(struct pofdp_program *prog, \
+ *                                    struct pof_instruction *ins, \
+ *                                    uint8_t insNum)
+ * Input:    instructions in the wire format, instruction number
+ * Output:   prog
+ * Return:   VOID
+ * Discribe: This function decodes the instructions into the program,
+ *           which has pofdp_program_size() bytes. The ops point into
+ *           the instructions, which should live as long as the program.
+ *           The unknown types are reported when a packet reaches them,
+ *           as they were before. The instructions are compiled if the
+ *           JIT is on, and pofdp_program_release() should be called
+ *           before the program is freed.
+ ***********************************************************************/
+void
+pofdp_program_build(struct pofdp_program *prog, struct pof_instruction *ins, uint8_t insNum)
+{
+    pof_instruction_apply_actions *p;
+    struct pofdp_op *op, *act = prog->op + insNum;
+    uint8_t i;
+
+    prog->insNum = insNum;
+    for(i=0, op=prog->op; i<insNum; i++, op++, ins=insNext(ins)){
+        insDecode(op, ins);
+        if(ins->type != POFIT_APPLY_ACTIONS){
+            continue;
+        }
+        p = op->data;
+        pofdp_action_decode(act, (struct pof_action *)p->action, p->action_num);
+        op->sub = act;
+        op->subNum = p->action_num;
+        act += p->action_num;
+    }
+    prog->opNum = act - prog->op;
+    pofdp_program_jit(prog);
+    return;
+}
+
+/* Bind the reference of the instruction to the object it uses. */
+static void
+insBind(struct pofdp_op *op, struct pof_local_resource *lr)
+{
+    switch(op->type){
+        case POFIT_METER:
+        {
+            pof_instruction_meter *p = op->data;
+#ifdef POF_SHT_VXLAN
+            if(p->id_type == POFVT_IMMEDIATE_NUM){
+                poflr_ref_bind(&op->ref, POFLR_REF_METER, op->opnd[0].u.value, lr);
+            }
+#else // POF_SHT_VXLAN
+            poflr_ref_bind(&op->ref, POFLR_REF_METER, p->meter_id, lr);
+#endif // POF_SHT_VXLAN
+            break;
+        }
+        case POFIT_GOTO_TABLE:
+        {
+            pof_instruction_goto_table *p = op->data;
+            poflr_ref_bind(&op->ref, POFLR_REF_TABLE, p->next_table_id, lr);
+            break;
+        }
+        case POFIT_GOTO_DIRECT_TABLE:
+        {
+            pof_instruction_goto_direct_table *p = op->data;
+            poflr_ref_bind(&op->ref, POFLR_REF_TABLE, p->next_table_id, lr);
+            break;
+        }
+        default:
+            break;
+    }
+    return;
+}
+
+/***********************************************************************
+ * Bind the program
+ * Form:     void pofdp_program_bind(struct pofdp_program *prog, \
+ *                                   struct pof_local_resource *lr)
+ * Input:    program, local resource
+ * Output:   prog
+ * Return:   VOID
+ * Discribe: This function binds the references of the ops to the
+ *           counters, meters, groups and tables with the immediate IDs,
+ *           so the packets do not look them up. It is called when the
+ *           program is installed into the local resource, and
+ *           pofdp_program_unbind() should be called before the program
+ *           is freed.
+ ***********************************************************************/
+void
+pofdp_program_bind(struct pofdp_program *prog, struct pof_local_resource *lr)
+{
+    uint16_t i;
+
+    for(i=0; i<prog->opNum; i++){
+        if(i < prog->insNum){
+            insBind(&prog->op[i], lr);
+        }else{
+            pofdp_action_bind(&prog->op[i], lr);
+        }
+    }
+    return;
+}
+
+/* Unlink the references of the ops bound by pofdp_program_bind(). */
+void
+pofdp_program_unbind(struct pofdp_program *prog)
+{
+    uint16_t i;
+
+    for(i=0; i<prog->opNum; i++){
+        poflr_ref_unbind(&prog->op[i].ref);
+    }
+    return;
+}
+
 /***********************************************************************
  * Execute instructions
  * Form:     uint32_t pofdp_instruction_execute(POFDP_ARG)
  * Input:    dpp, dp
  * Return:   POF_OK or Error code
- * Discribe: This function executes the actions. 
+ * Discribe: This function executes the instructions of dpp->prog from
+ *           dpp->ins. Each op is dispatched by its own handler. The
+ *           outputs which refer to the packet are sent before an
+ *           instruction which may change it. The compiled code runs on
+ *           from an instruction, so only APPLY_ACTIONS and GOTO_TABLE,
+ *           which are never compiled, are let go.
  ***********************************************************************/
 uint32_t pofdp_instruction_execute(POFDP_ARG)
 {
 	uint32_t ret = POF_OK;
     /* Forward the packet via executing the instructions until packet_over is TRUE or all
      * instructions have been done. */
-    while(dpp->packet_done == FALSE){
-        /* Execute the instructions. */
-        switch(dpp->ins->type){
-#define INSTRUCTION(NAME,VALUE) case POFIT_##NAME: ret = execute_##NAME(dpp,lr); break;
-			INSTRUCTIONS
-#undef INSTRUCTION
-            default:
-                POF_ERROR_HANDLE_RETURN_NO_UPWARD(POFET_BAD_INSTRUCTION, POFBIC_UNKNOWN_INST);
-				break;
+    while(dpp->packet_done == FALSE && \
+            dpp->ins < dpp->prog->op + dpp->prog->insNum){
+        if(dpp->txHeld && dpp->ins->type != POFIT_APPLY_ACTIONS && \
+                dpp->ins->type != POFIT_GOTO_TABLE){
+            pofdp_output_release(dpp);
         }
+        ret = dpp->ins->exec(dpp, lr, dpp->ins);
         POF_CHECK_RETVALUE_RETURN_NO_UPWARD(ret);
     }
 	return POF_OK;
@@ -0,0 +1,742 @@
+/**
+ * Copyright (c) 2012, 2013, Huawei Technologies Co., Ltd.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "../include/pof_common.h"
+#include "../include/pof_type.h"
+#include "../include/pof_global.h"
+#include "../include/pof_local_resource.h"
+#include "../include/pof_log_print.h"
+#include "../include/pof_conn.h"
+#include "../include/pof_datapath.h"
+#include "../include/pof_memory.h"
+#include <string.h>
+#include <stddef.h>
+
+/* Native code of the instruction programs.
+ *
+ * Each instruction the JIT knows gets a native handler in place of its
+ * op->exec, with the same arguments (rdi = dpp, rsi = lr, rdx = op). The
+ * handler runs the instruction and the JIT-able instructions behind it in
+ * one piece of straight code, with the field offsets and the immediate
+ * numbers of the instructions as constants. The instructions in between
+ * are not dispatched, and the operands are not read by their accessors.
+ *
+ * Before an instruction touches the packet or the metadata, the lengths
+ * the interpreter would check are compared with constants. If the check
+ * fails, dpp->ins is set to the instruction and its C handler is jumped
+ * to, which reports the error just as before. The instructions the JIT
+ * does not know keep their C handlers, so the interpreter loop is still
+ * the driver, and the native code returns to it on those.
+ *
+ * The JIT-able instructions are the byte aligned WRITE_METADATA,
+ * WRITE_METADATA_FROM_PACKET, and, with 8, 16 or 32 bits packet or
+ * metadata fields, CALCULATE_FIELD, COMPARE, BRANCH and JMP. */
+
+#if defined(__x86_64__)
+
+#include <sys/mman.h>
+
+/* Bytes reserved for the native code of one op. */
+#define JIT_OP_CODE_MAX     (320)
+
+/* Registers. */
+#define JIT_RAX     (0)
+#define JIT_RCX     (1)
+#define JIT_RDX     (2)
+#define JIT_RDI     (7)
+#define JIT_R8      (8)     /* dpp->buf_offset. */
+#define JIT_R9      (9)     /* dpp->metadata. */
+
+#define JIT_DPP_OFFSET(MEMBER)  ((int32_t)offsetof(struct pofdp_packet, MEMBER))
+
+/* The code being emitted. */
+struct jit{
+    uint8_t *code;
+    uint32_t len;
+};
+
+static void
+emit1(struct jit *j, uint8_t byte)
+{
+    j->code[j->len++] = byte;
+}
+
+static void
+emit4(struct jit *j, uint32_t value)
+{
+    memcpy(j->code + j->len, &value, sizeof value);
+    j->len += sizeof value;
+}
+
+static void
+emit8(struct jit *j, uint64_t value)
+{
+    memcpy(j->code + j->len, &value, sizeof value);
+    j->len += sizeof value;
+}
+
+/* REX prefix, if any bit is needed. */
+static void
+emitRex(struct jit *j, uint8_t w, uint8_t reg, uint8_t base)
+{
+    uint8_t rex = 0x40 | (w << 3) | ((reg >> 3) << 2) | (base >> 3);
+    if(rex != 0x40){
+        emit1(j, rex);
+    }
+}
+
+/* ModRM of [base + disp32]. The bases are never rsp, rbp, r12 or r13. */
+static void
+emitMem(struct jit *j, uint8_t reg, uint8_t base, int32_t disp)
+{
+    emit1(j, 0x80 | ((reg & 7) << 3) | (base & 7));
+    emit4(j, (uint32_t)disp);
+}
+
+/* mov reg64, [base + disp]. */
+static void
+emitLoadPtr(struct jit *j, uint8_t reg, uint8_t base, int32_t disp)
+{
+    emitRex(j, 1, reg, base);
+    emit1(j, 0x8B);
+    emitMem(j, reg, base, disp);
+}
+
+#if defined(POF_SHT_VXLAN) || defined(POF_SD2N)
+/* Load a byte aligned field of len bits in the network order to the
+ * 32 bits reg, as pofdp_get_32value_from_buf() does. */
+static void
+emitLoadField(struct jit *j, uint8_t reg, uint8_t base, int32_t disp, uint16_t len)
+{
+    if(len == 8){
+        emitRex(j, 0, reg, base);               /* movzx reg, byte */
+        emit1(j, 0x0F); emit1(j, 0xB6);
+        emitMem(j, reg, base, disp);
+    }else if(len == 16){
+        emitRex(j, 0, reg, base);               /* movzx reg, word */
+        emit1(j, 0x0F); emit1(j, 0xB7);
+        emitMem(j, reg, base, disp);
+        emit1(j, 0x66); emit1(j, 0xC1);         /* rol reg16, 8 */
+        emit1(j, 0xC0 | reg); emit1(j, 8);
+    }else{
+        emitRex(j, 0, reg, base);               /* mov reg, dword */
+        emit1(j, 0x8B);
+        emitMem(j, reg, base, disp);
+        emit1(j, 0x0F); emit1(j, 0xC8 | reg);   /* bswap reg */
+    }
+}
+#endif // POF_SHT_VXLAN || POF_SD2N
+
+/* Store the low len bits of eax to a byte aligned field in the network
+ * order, as write_32value_to_buf() does. */
+static void
+emitStoreField(struct jit *j, uint8_t base, int32_t disp, uint16_t len)
+{
+    if(len == 8){
+        emitRex(j, 0, JIT_RAX, base);           /* mov byte, al */
+        emit1(j, 0x88);
+    }else if(len == 16){
+        emit1(j, 0x66); emit1(j, 0xC1);         /* rol ax, 8 */
+        emit1(j, 0xC0); emit1(j, 8);
+        emit1(j, 0x66);                         /* mov word, ax */
+        emitRex(j, 0, JIT_RAX, base);
+        emit1(j, 0x89);
+    }else{
+        emit1(j, 0x0F); emit1(j, 0xC8);         /* bswap eax */
+        emitRex(j, 0, JIT_RAX, base);           /* mov dword, eax */
+        emit1(j, 0x89);
+    }
+    emitMem(j, JIT_RAX, base, disp);
+}
+
+/* Go back to the C handler of op, with dpp->ins on op. 29 bytes. */
+#define JIT_FALLBACK_LEN    (29)
+static void
+emitFallback(struct jit *j, const struct pofdp_op *op)
+{
+    emit1(j, 0x48); emit1(j, 0xBA);             /* mov rdx, op */
+    emit8(j, (uintptr_t)op);
+    emit1(j, 0x48); emit1(j, 0x89);             /* mov [rdi + ins], rdx */
+    emitMem(j, JIT_RDX, JIT_RDI, JIT_DPP_OFFSET(ins));
+    emit1(j, 0x48); emit1(j, 0xB8);             /* mov rax, op->exec */
+    emit8(j, (uintptr_t)op->exec);
+    emit1(j, 0xFF); emit1(j, 0xE0);             /* jmp rax */
+}
+
+/* Fall back to the C handler unless dpp->left_len >= end. */
+static void
+emitGuardPacket(struct jit *j, const struct pofdp_op *op, uint32_t end)
+{
+    emit1(j, 0x81);                             /* cmp dword [rdi + left_len], end */
+    emitMem(j, 7, JIT_RDI, JIT_DPP_OFFSET(left_len));
+    emit4(j, end);
+    emit1(j, 0x7D); emit1(j, JIT_FALLBACK_LEN); /* jge */
+    emitFallback(j, op);
+}
+
+/* Fall back to the C handler unless dpp->metadata_len >= end. */
+static void
+emitGuardMetadata(struct jit *j, const struct pofdp_op *op, uint32_t end)
+{
+    emit1(j, 0x0F); emit1(j, 0xB7);             /* movzx eax, word [rdi + metadata_len] */
+    emitMem(j, JIT_RAX, JIT_RDI, JIT_DPP_OFFSET(metadata_len));
+    emit1(j, 0x3D); emit4(j, end);              /* cmp eax, end */
+    emit1(j, 0x73); emit1(j, JIT_FALLBACK_LEN); /* jae */
+    emitFallback(j, op);
+}
+
+/* Set dpp->ins to ins, and packet_done if the instructions are all done,
+ * then return POF_OK to the interpreter loop. */
+static void
+emitReturn(struct jit *j, const struct pofdp_op *ins, uint8_t done)
+{
+    emit1(j, 0x48); emit1(j, 0xB8);             /* mov rax, ins */
+    emit8(j, (uintptr_t)ins);
+    emit1(j, 0x48); emit1(j, 0x89);             /* mov [rdi + ins], rax */
+    emitMem(j, JIT_RAX, JIT_RDI, JIT_DPP_OFFSET(ins));
+    if(done){
+        emit1(j, 0xC6);                         /* mov byte [rdi + packet_done], TRUE */
+        emitMem(j, 0, JIT_RDI, JIT_DPP_OFFSET(packet_done));
+        emit1(j, TRUE);
+    }
+    emit1(j, 0x31); emit1(j, 0xC0);             /* xor eax, eax */
+    emit1(j, 0xC3);                             /* ret */
+}
+
+/* Copy len bytes from [src + srcDisp] to [dst + dstDisp] through rax. */
+static void
+emitCopy(struct jit *j, uint8_t dst, int32_t dstDisp, \
+         uint8_t src, int32_t srcDisp, uint16_t len)
+{
+    uint16_t n;
+
+    while(len > 0){
+        n = (len >= 8) ? 8 : (len >= 4) ? 4 : (len >= 2) ? 2 : 1;
+        if(n == 2){
+            emit1(j, 0x66);
+        }
+        emitRex(j, n == 8, JIT_RAX, src);       /* mov rax/eax/ax/al, [src] */
+        emit1(j, (n == 1) ? 0x8A : 0x8B);
+        emitMem(j, JIT_RAX, src, srcDisp);
+        if(n == 2){
+            emit1(j, 0x66);
+        }
+        emitRex(j, n == 8, JIT_RAX, dst);       /* mov [dst], rax/eax/ax/al */
+        emit1(j, (n == 1) ? 0x88 : 0x89);
+        emitMem(j, JIT_RAX, dst, dstDisp);
+        srcDisp += n;
+        dstDisp += n;
+        len -= n;
+    }
+}
+
+#ifdef POF_SD2N_AFTER1015
+/* Store len bytes of value to [dst + disp]. */
+static void
+emitStoreBytes(struct jit *j, uint8_t dst, int32_t disp, \
+               const uint8_t *value, uint16_t len)
+{
+    uint64_t v8;
+    uint32_t v4;
+    uint16_t v2;
+
+    while(len > 0){
+        if(len >= 8){
+            memcpy(&v8, value, 8);
+            emit1(j, 0x48); emit1(j, 0xB8);     /* mov rax, imm64 */
+            emit8(j, v8);
+            emitRex(j, 1, JIT_RAX, dst);        /* mov [dst], rax */
+            emit1(j, 0x89);
+            emitMem(j, JIT_RAX, dst, disp);
+            disp += 8; value += 8; len -= 8;
+        }else if(len >= 4){
+            memcpy(&v4, value, 4);
+            emitRex(j, 0, 0, dst);              /* mov dword [dst], imm32 */
+            emit1(j, 0xC7);
+            emitMem(j, 0, dst, disp);
+            emit4(j, v4);
+            disp += 4; value += 4; len -= 4;
+        }else if(len >= 2){
+            memcpy(&v2, value, 2);
+            emit1(j, 0x66);                     /* mov word [dst], imm16 */
+            emitRex(j, 0, 0, dst);
+            emit1(j, 0xC7);
+            emitMem(j, 0, dst, disp);
+            emit1(j, v2 & 0xFF); emit1(j, v2 >> 8);
+            disp += 2; value += 2; len -= 2;
+        }else{
+            emitRex(j, 0, 0, dst);              /* mov byte [dst], imm8 */
+            emit1(j, 0xC6);
+            emitMem(j, 0, dst, disp);
+            emit1(j, *value);
+            disp += 1; value += 1; len -= 1;
+        }
+    }
+}
+#endif // POF_SD2N_AFTER1015
+
+#if defined(POF_SHT_VXLAN) || defined(POF_SD2N)
+/* The register of the buf a field is in, or 0 if the field is not
+ * JIT-able. */
+static uint8_t
+jitFieldBase(const struct pof_match *pm)
+{
+    if(pm->offset % POF_BITNUM_IN_BYTE != 0 || \
+            (pm->len != 8 && pm->len != 16 && pm->len != 32)){
+        return 0;
+    }
+    if(pm->field_id == POFDP_METADATA_FIELD_ID){
+        return JIT_R9;
+    }
+#ifdef POF_SHT_VXLAN
+    if((pm->field_id & 0xF000) == POFDP_PARA_FIELD_ID){
+        return 0;
+    }
+#endif // POF_SHT_VXLAN
+    return JIT_R8;
+}
+
+/* Guard the field of op. */
+static void
+emitGuardField(struct jit *j, const struct pofdp_op *op, const struct pof_match *pm)
+{
+    uint32_t end = (pm->offset + pm->len) / POF_BITNUM_IN_BYTE;
+
+    if(jitFieldBase(pm) == JIT_R9){
+        emitGuardMetadata(j, op, end);
+    }else{
+        emitGuardPacket(j, op, end);
+    }
+}
+
+/* Load the field to reg. */
+static void
+emitLoadMatch(struct jit *j, uint8_t reg, const struct pof_match *pm)
+{
+    emitLoadField(j, reg, jitFieldBase(pm), \
+            pm->offset / POF_BITNUM_IN_BYTE, pm->len);
+}
+
+/* Whether operand2 is an immediate number or a JIT-able field. */
+static uint8_t
+jitOperandOK(uint8_t type, const struct pofdp_operand *o)
+{
+    return (type == POFVT_IMMEDIATE_NUM) || jitFieldBase(&o->u.field);
+}
+#endif // POF_SHT_VXLAN || POF_SD2N
+
+#ifdef POF_SHT_VXLAN
+/* Compare the field with operand2, leaving the flags of "cmp eax, operand2". */
+static void
+emitCompare(struct jit *j, const struct pof_match *pm1, \
+            uint8_t type2, const struct pofdp_operand *o2)
+{
+    emitLoadMatch(j, JIT_RAX, pm1);
+    if(type2 == POFVT_IMMEDIATE_NUM){
+        emit1(j, 0x3D); emit4(j, o2->u.value);  /* cmp eax, imm32 */
+    }else{
+        emitLoadMatch(j, JIT_RDX, &o2->u.field);
+        emit1(j, 0x39); emit1(j, 0xD0);         /* cmp eax, edx */
+    }
+}
+#endif // POF_SHT_VXLAN
+
+/* The kind of an op for the JIT. */
+enum jitKind{
+    JIT_NONE = 0,
+    JIT_STRAIGHT,       /* Goes on to the next instruction. */
+    JIT_CONTROL,        /* Sets dpp->ins itself. */
+};
+
+static enum jitKind
+jitKind(const struct pofdp_op *op, const struct pofdp_program *prog)
+{
+#ifdef POF_SHT_VXLAN
+    const struct pofdp_op *end = prog->op + prog->insNum;
+#endif // POF_SHT_VXLAN
+
+    switch(op->type){
+        case POFIT_WRITE_METADATA:
+        {
+            const pof_instruction_write_metadata *p = op->data;
+            if(p->metadata_offset % POF_BITNUM_IN_BYTE != 0){
+                return JIT_NONE;
+            }
+#ifdef POF_SD2N_AFTER1015
+            if(p->len % POF_BITNUM_IN_BYTE != 0 || \
+                    p->len > POF_MAX_FIELD_LENGTH_IN_BYTE * POF_BITNUM_IN_BYTE){
+                return JIT_NONE;
+            }
+#else // POF_SD2N_AFTER1015
+            if(p->len != 8 && p->len != 16 && p->len != 32){
+                return JIT_NONE;
+            }
+#endif // POF_SD2N_AFTER1015
+            return JIT_STRAIGHT;
+        }
+        case POFIT_WRITE_METADATA_FROM_PACKET:
+        {
+            const pof_instruction_write_metadata_from_packet *p = op->data;
+            if(p->metadata_offset % POF_BITNUM_IN_BYTE != 0 || \
+                    p->packet_offset % POF_BITNUM_IN_BYTE != 0 || \
+                    p->len % POF_BITNUM_IN_BYTE != 0 || \
+                    p->len > POF_MAX_FIELD_LENGTH_IN_BYTE * POF_BITNUM_IN_BYTE){
+                return JIT_NONE;
+            }
+            return JIT_STRAIGHT;
+        }
+#ifdef POF_SHT_VXLAN
+        case POFIT_COMPARE:
+        {
+            const struct pof_instruction_compare *p = op->data;
+            if(p->comp_result_field_num > 3 || !jitFieldBase(&op->opnd[0].u.field) || \
+                    !jitOperandOK(p->operand2_type, &op->opnd[1])){
+                return JIT_NONE;
+            }
+            return JIT_STRAIGHT;
+        }
+        case POFIT_BRANCH:
+        {
+            const struct pof_instruction_branch *p = op->data;
+            if(p->skip_instruction_num > (uint32_t)(end - op) || \
+                    !jitFieldBase(&op->opnd[0].u.field) || \
+                    !jitOperandOK(p->operand2_type, &op->opnd[1])){
+                return JIT_NONE;
+            }
+            return JIT_CONTROL;
+        }
+        case POFIT_JMP:
+        {
+            const struct pof_instruction_jmp *p = op->data;
+            if(p->direction == POFD_FORWARD){
+                if(p->instruction_num > (uint32_t)(end - op)){
+                    return JIT_NONE;
+                }
+            }else if(p->instruction_num > (uint32_t)(op - prog->op)){
+                return JIT_NONE;
+            }
+            return JIT_CONTROL;
+        }
+#endif // POF_SHT_VXLAN
+#ifdef POF_SD2N
+        case POFIT_CALCULATE_FIELD:
+        {
+            const struct pof_instruction_calc_field *p = op->data;
+            if(p->calc_type > POFCT_BITWISE_NOR || \
+                    !jitFieldBase(&op->opnd[0].u.field) || \
+                    !jitOperandOK(p->src_type, &op->opnd[1])){
+                return JIT_NONE;
+            }
+            return JIT_STRAIGHT;
+        }
+#endif // POF_SD2N
+        default:
+            return JIT_NONE;
+    }
+}
+
+/* Emit the code of op. A JIT_CONTROL op ends with a return. */
+static void
+jitEmitOp(struct jit *j, const struct pofdp_op *op, const struct pofdp_program *prog)
+{
+#ifdef POF_SHT_VXLAN
+    const struct pofdp_op *end = prog->op + prog->insNum;
+#endif // POF_SHT_VXLAN
+
+    switch(op->type){
+        case POFIT_WRITE_METADATA:
+        {
+            const pof_instruction_write_metadata *p = op->data;
+            int32_t disp = p->metadata_offset / POF_BITNUM_IN_BYTE;
+#ifdef POF_SD2N_AFTER1015
+            /* No check, as pofbf_cover_bit() in the interpreter. */
+            emitStoreBytes(j, JIT_R9, disp, p->value, p->len / POF_BITNUM_IN_BYTE);
+#else // POF_SD2N_AFTER1015
+            emitGuardMetadata(j, op, disp + p->len / POF_BITNUM_IN_BYTE);
+            emit1(j, 0xB8); emit4(j, p->value); /* mov eax, imm32 */
+            emitStoreField(j, JIT_R9, disp, p->len);
+#endif // POF_SD2N_AFTER1015
+            break;
+        }
+        case POFIT_WRITE_METADATA_FROM_PACKET:
+        {
+            const pof_instruction_write_metadata_from_packet *p = op->data;
+            emitGuardPacket(j, op, (p->packet_offset + p->len) / POF_BITNUM_IN_BYTE);
+            emitCopy(j, JIT_R9, p->metadata_offset / POF_BITNUM_IN_BYTE, \
+                     JIT_R8, p->packet_offset / POF_BITNUM_IN_BYTE, \
+                     p->len / POF_BITNUM_IN_BYTE);
+            break;
+        }
+#ifdef POF_SHT_VXLAN
+        case POFIT_COMPARE:
+        {
+            const struct pof_instruction_compare *p = op->data;
+            uint8_t mov_b = POF_BITNUM_IN_BYTE - \
+                    (p->comp_result_field_num + 1) * POF_COMP_RES_FIELD_BITNUM;
+            int32_t disp = offsetof(struct pofdp_metadata, compRes);
+
+            emitGuardField(j, op, &op->opnd[0].u.field);
+            if(p->operand2_type != POFVT_IMMEDIATE_NUM){
+                emitGuardField(j, op, &op->opnd[1].u.field);
+            }
+            emitCompare(j, &op->opnd[0].u.field, p->operand2_type, &op->opnd[1]);
+            emit1(j, 0xB9); emit4(j, POFCR_EQUAL << mov_b);     /* mov ecx, EQUAL */
+            emit1(j, 0x74); emit1(j, 12);                       /* je */
+            emit1(j, 0xB9); emit4(j, POFCR_BIGER << mov_b);     /* mov ecx, BIGER */
+            emit1(j, 0x77); emit1(j, 5);                        /* ja */
+            emit1(j, 0xB9); emit4(j, POFCR_SMALLER << mov_b);   /* mov ecx, SMALLER */
+            emitRex(j, 0, JIT_RAX, JIT_R9);     /* movzx eax, byte [r9 + compRes] */
+            emit1(j, 0x0F); emit1(j, 0xB6);
+            emitMem(j, JIT_RAX, JIT_R9, disp);
+            emit1(j, 0x25);                     /* and eax, ~mask */
+            emit4(j, (uint8_t)~(3 << mov_b));
+            emit1(j, 0x09); emit1(j, 0xC8);     /* or eax, ecx */
+            emitRex(j, 0, JIT_RAX, JIT_R9);     /* mov [r9 + compRes], al */
+            emit1(j, 0x88);
+            emitMem(j, JIT_RAX, JIT_R9, disp);
+            break;
+        }
+        case POFIT_BRANCH:
+        {
+            const struct pof_instruction_branch *p = op->data;
+            uint32_t pos;
+
+            emitGuardField(j, op, &op->opnd[0].u.field);
+            if(p->operand2_type != POFVT_IMMEDIATE_NUM){
+                emitGuardField(j, op, &op->opnd[1].u.field);
+            }
+            emitCompare(j, &op->opnd[0].u.field, p->operand2_type, &op->opnd[1]);
+            emit1(j, 0x74); emit1(j, 0);        /* je */
+            pos = j->len;
+            /* Skip as insJump(), which does not set packet_done. */
+            emitReturn(j, op + p->skip_instruction_num, FALSE);
+            j->code[pos - 1] = j->len - pos;
+            emitReturn(j, op + 1, op + 1 == end);
+            break;
+        }
+        case POFIT_JMP:
+        {
+            const struct pof_instruction_jmp *p = op->data;
+            const struct pofdp_op *to;
+
+            /* insJump() and then instruction_update(). */
+            if(p->direction == POFD_FORWARD){
+                to = op + p->instruction_num + 1;
+            }else{
+                to = op - p->instruction_num + 1;
+            }
+            emitReturn(j, to, to == end);
+            break;
+        }
+#endif // POF_SHT_VXLAN
+#ifdef POF_SD2N
+        case POFIT_CALCULATE_FIELD:
+        {
+            const struct pof_instruction_calc_field *p = op->data;
+            const struct pof_match *dst = &op->opnd[0].u.field;
+            uint8_t reg, shift;
+
+            emitGuardField(j, op, dst);
+            if(p->src_type != POFVT_IMMEDIATE_NUM){
+                emitGuardField(j, op, &op->opnd[1].u.field);
+            }
+            emitLoadMatch(j, JIT_RAX, dst);
+            shift = (p->calc_type == POFCT_LEFT_SHIFT) || (p->calc_type == POFCT_RIGHT_SHIFT);
+
+            if(p->src_type == POFVT_IMMEDIATE_NUM){
+                static const uint8_t aluImm[] = {
+                    [POFCT_ADD] = 0x05, [POFCT_SUBTRACT] = 0x2D,
+                    [POFCT_BITWISE_ADD] = 0x25, [POFCT_BITWISE_OR] = 0x0D,
+                    [POFCT_BITWISE_XOR] = 0x35, [POFCT_BITWISE_NOR] = 0x0D,
+                };
+                if(shift){
+                    /* The count is masked by the CPU in the C handler too. */
+                    emit1(j, 0xC1);             /* shl/shr eax, imm8 */
+                    emit1(j, (p->calc_type == POFCT_LEFT_SHIFT) ? 0xE0 : 0xE8);
+                    emit1(j, op->opnd[1].u.value & 31);
+                }else{
+                    emit1(j, aluImm[p->calc_type]);
+                    emit4(j, op->opnd[1].u.value);
+                }
+            }else{
+                static const uint8_t aluReg[] = {
+                    [POFCT_ADD] = 0x01, [POFCT_SUBTRACT] = 0x29,
+                    [POFCT_BITWISE_ADD] = 0x21, [POFCT_BITWISE_OR] = 0x09,
+                    [POFCT_BITWISE_XOR] = 0x31, [POFCT_BITWISE_NOR] = 0x09,
+                };
+                reg = shift ? JIT_RCX : JIT_RDX;
+                emitLoadMatch(j, reg, &op->opnd[1].u.field);
+                if(shift){
+                    emit1(j, 0xD3);             /* shl/shr eax, cl */
+                    emit1(j, (p->calc_type == POFCT_LEFT_SHIFT) ? 0xE0 : 0xE8);
+                }else{
+                    emit1(j, aluReg[p->calc_type]);
+                    emit1(j, 0xD0);             /* op eax, edx */
+                }
+            }
+            if(p->calc_type == POFCT_BITWISE_NOR){
+                emit1(j, 0xF7); emit1(j, 0xD0); /* not eax */
+            }
+            emitStoreField(j, jitFieldBase(dst), dst->offset / POF_BITNUM_IN_BYTE, dst->len);
+            break;
+        }
+#endif // POF_SD2N
+        default:
+            break;
+    }
+    return;
+}
+
+/***********************************************************************
+ * Compile the program to native code
+ * Form:     void pofdp_program_jit(struct pofdp_program *prog)
+ * Input:    program built by pofdp_program_build()
+ * Output:   prog
+ * Return:   VOID
+ * Discribe: This function compiles the JIT-able instructions of the
+ *           program, and replaces their exec by the native handlers.
+ *           It should be called before the program is visible to the
+ *           datapath. The program runs in the interpreter if it fails.
+ *           The code should be freed by pofdp_program_release().
+ ***********************************************************************/
+void
+pofdp_program_jit(struct pofdp_program *prog)
+{
+    const struct pofdp_op *end = prog->op + prog->insNum;
+    struct pofdp_op *op;
+    uint32_t *body = NULL, *entry = NULL, size, pos;
+    struct jit j = {NULL, 0};
+    enum jitKind kind;
+    uint8_t *code;
+    uint8_t i, num = 0;
+
+    prog->jit = NULL;
+    prog->jitSize = 0;
+    if(!g_dp.param.jit || prog->insNum == 0){
+        return;
+    }
+
+    body = MALLOC(prog->insNum * sizeof *body * 2);
+    j.code = MALLOC(prog->insNum * JIT_OP_CODE_MAX);
+    if(body == NULL || j.code == NULL){
+        goto out;
+    }
+    entry = body + prog->insNum;
+
+    /* The bodies. A run of straight ops falls through from one to the
+     * next, and goes back to the interpreter at its end. */
+    for(i=0, op=prog->op; op<end; i++, op++){
+        if((kind = jitKind(op, prog)) == JIT_NONE){
+            body[i] = UINT32_MAX;
+            continue;
+        }
+        body[i] = j.len;
+        jitEmitOp(&j, op, prog);
+        if(kind == JIT_STRAIGHT && \
+                (op + 1 == end || jitKind(op + 1, prog) == JIT_NONE)){
+            emitReturn(&j, op + 1, op + 1 == end);
+        }
+        num ++;
+    }
+    if(num == 0){
+        goto out;
+    }
+
+    /* The handlers. Each loads the bufs and jumps into the run. */
+    for(i=0; i<prog->insNum; i++){
+        if(body[i] == UINT32_MAX){
+            continue;
+        }
+        entry[i] = j.len;
+        emitLoadPtr(&j, JIT_R8, JIT_RDI, JIT_DPP_OFFSET(buf_offset));
+        emitLoadPtr(&j, JIT_R9, JIT_RDI, JIT_DPP_OFFSET(metadata));
+        emit1(&j, 0xE9);                        /* jmp rel32 */
+        pos = j.len + 4;
+        emit4(&j, body[i] - pos);
+    }
+
+    /* Copy the code to executable memory. */
+    size = (j.len + 4095) & ~4095;
+    code = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if(code == MAP_FAILED){
+        POF_DEBUG_CPRINT_FL(1,RED,"JIT memory mmap failed, the program is interpreted.");
+        goto out;
+    }
+    memcpy(code, j.code, j.len);
+    if(mprotect(code, size, PROT_READ | PROT_EXEC) != 0){
+        POF_DEBUG_CPRINT_FL(1,RED,"JIT memory mprotect failed, the program is interpreted.");
+        munmap(code, size);
+        goto out;
+    }
+
+    for(i=0; i<prog->insNum; i++){
+        if(body[i] != UINT32_MAX){
+            prog->op[i].exec = (uint32_t (*)(POFDP_OP_ARG))(code + entry[i]);
+        }
+    }
+    prog->jit = code;
+    prog->jitSize = size;
+    POF_DEBUG_CPRINT_FL(1,GREEN,"%u of %u instructions are compiled to %u bytes.", \
+            num, prog->insNum, j.len);
+
+out:
+    if(j.code){
+        FREE(j.code);
+    }
+    if(body){
+        FREE(body);
+    }
+    return;
+}
+
+/* Free the native code of the program. */
+void
+pofdp_program_release(struct pofdp_program *prog)
+{
+    if(prog->jit){
+        munmap(prog->jit, prog->jitSize);
+        prog->jit = NULL;
+    }
+    return;
+}
+
+#else // __x86_64__
+
+/* The instructions are always interpreted. */
+void
+pofdp_program_jit(struct pofdp_program *prog)
+{
+    prog->jit = NULL;
+    prog->jitSize = 0;
+    return;
+}
+
+void
+pofdp_program_release(struct pofdp_program *prog)
+{
+    return;
+}
+
+#endif // __x86_64__
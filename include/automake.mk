@@ -10,6 +10,8 @@ EXTRA_DIST += \
 	include/pof_log_print.h \
 	include/pof_hmap.h \
 	include/pof_tree.h \
+	include/pof_emtable.h \
+	include/pof_epoch.h \
 	include/pof_list.h \
 	include/pof_memory.h \
 	include/pof_protocol_header.h \
@@ -96,6 +96,9 @@ extern uint32_t pof_HtoN_transfer_flow_table_resource(void *ptr);
 extern uint32_t pof_HtoN_transfer_port_status(void *ptr);
 extern uint32_t pof_HtoN_transfer_switch_config(void * ptr);
 extern uint32_t pof_HtoN_transfer_queryall_request(void * ptr);
+extern uint32_t pof_NtoH_transfer_bundle_ctrl(void *ptr);
+extern uint32_t pof_HtoN_transfer_bundle_ctrl(void *ptr);
+extern uint32_t pof_NtoH_transfer_bundle_add(void *ptr);
 extern uint32_t pof_NtoH_transfer_packet_in(void *ptr);
 extern uint32_t pof_NtoH_transfer_error(void *ptr);
 
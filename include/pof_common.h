@@ -128,15 +128,15 @@
 #define POF_INVALID_TASKID (0)
 
 /* Define waiting mode. */
-#define POF_NO_WAIT IPC_NOWAIT
+#define POF_NO_WAIT (1)
 #define POF_WAIT_FOREVER (0)
 
 /* Define message size. */
 #define POF_MESSAGE_SIZE (2560)
 
-/* Define message type. */
-#define POF_MSGTYPE_ANY (0)
-#define POF_MSGTYPE     (1)
+/* Define message queue. The slot number should be a power of 2. */
+#define POF_QUEUE_NUM_MAX  (16)
+#define POF_QUEUE_SLOT_NUM (256)
 
 /* Initialize the Xid value. */
 #define POF_INITIAL_XID (0)
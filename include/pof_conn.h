@@ -46,12 +46,22 @@
 /* Define max size of receiving buffer. */
 #define POF_RECV_BUF_MAX_SIZE (POF_MESSAGE_SIZE)
 
+/* Define size of receiving ring, which is a multiple of the page size. */
+#define POFSC_RECV_RING_SIZE (16384)
+
 /* Define echo interval .*/
 #define POF_ECHO_INTERVAL (2000)  /* Unit is millisecond. */
 
 /* Message queue attributes. */
 #define POF_QUEUE_MESSAGE_LEN (POF_MESSAGE_SIZE)
 
+/* Event loop of the connections. */
+#define POFSC_EPOLL_EVENT_NUM (32)
+#define POFSC_EPOLL_TIMEOUT (100)   /* Unit is millisecond. */
+#define POFSC_DRAIN_TIMEOUT (100)   /* Unit is millisecond. */
+#define POFSC_EVENT_QUEUE (0x100)   /* Event tag of the send queues. */
+#define POFSC_INVALID_SFD (-1)
+
 extern char pofsc_controller_ip_addr[POF_IP_ADDRESS_STRING_LEN];
 extern uint16_t pofsc_controller_port;
 extern uint8_t local_port_index;
@@ -67,8 +77,13 @@ typedef struct pofsc_dev_conn_desc{
     int role;
     int sfd; /* Scket id. */
     char send_buf[POF_SEND_BUF_MAX_SIZE];
-    char recv_buf[POF_RECV_BUF_MAX_SIZE];
+    char *recv_buf;         /* Mirrored ring of POFSC_RECV_RING_SIZE. */
     char msg_buf[POF_QUEUE_MESSAGE_LEN];
+    uint32_t recv_head;     /* Start of the first unhandled message. */
+    uint32_t recv_tail;     /* End of the received data. */
+    uint32_t send_len;      /* Length of the message in msg_buf to be sent. */
+    uint32_t send_offset;   /* Sent length of the message in msg_buf. */
+    uint32_t events;        /* Polled events of the socket. */
 
     /* Connection retry count and connection state. */
     uint32_t conn_retry_interval; /* Unit is second. */
@@ -79,6 +94,10 @@ typedef struct pofsc_dev_conn_desc{
     /* Last echo reply time. */
     time_t last_echo_time;
 
+    /* Time of the next connecting and echo request. Unit is millisecond. */
+    uint64_t retry_time;
+    uint64_t echo_time;
+
     //add by wenjian 2015/12/02
     uint8_t local_port_index;
 }  pofsc_dev_conn_desc;
@@ -37,6 +37,56 @@
 #define PFODP_PACKET_BUF_TOTAL_LEN  (POFDP_PACKET_RAW_MAX_LEN + POFDP_PACKET_PREBUF_LEN)
 /* Max length of the metadata. */
 #define POFDP_METADATA_MAX_LEN (128)
+
+/* PACKET_MMAP (TPACKET_V3) receive ring of each port. The block number
+ * is set by "Rx_ring_block_number" in the config file. 0 means the ring
+ * is disabled and the packets are received by recvmmsg(). */
+#define POFDP_RX_RING_BLOCK_NUM     (0)
+#define POFDP_RX_RING_BLOCK_SIZE    (1 << 18)
+#define POFDP_RX_RING_FRAME_SIZE    (POFDP_PACKET_RAW_MAX_LEN)
+#define POFDP_RX_RING_BLOCK_TIMEOUT (10)    /* Unit is millisecond. */
+/* Room kept behind each frame in the ring, so that the packet can grow in
+ * place as much as it can in a packet buffer. Frames with less room will be
+ * copied into a packet buffer. */
+#define POFDP_RX_RING_TAILROOM      (POFDP_PACKET_RAW_MAX_LEN - POFDP_PACKET_PREBUF_LEN - POF_MTU_LENGTH)
+
+/* Receive workers of each port. The number is set by "Rx_worker_number" in
+ * the config file. With more than one worker, the packets of the port are
+ * spread over the workers by PACKET_FANOUT in hash mode, so the packets of
+ * one flow are always handled by the same worker. */
+#define POFDP_RX_WORKER_NUM         (1)
+
+/* Received packets are forwarded in vectors of up to POFDP_VECTOR_SIZE
+ * packets. Each stage of the forwarding is done for the whole vector
+ * before the next one, see rxVectorPrepare(). */
+#define POFDP_VECTOR_SIZE           (32)
+
+/* Transmit batch of one receive task. The outputs of one vector are
+ * collected, and sent by sendmmsg() at the end of the vector. The packet
+ * data is sent in place, so the batch also holds the packet buffers of the
+ * worker, which are allocated once. A packet received by recvmmsg() is
+ * kept in its buffer until the batch is flushed. */
+#define POFDP_TX_BATCH_BUF_NUM      (POFDP_VECTOR_SIZE) /* Received packets of a vector. */
+#define POFDP_TX_BATCH_MSG_NUM      (64)    /* Outputs. A flooded packet takes
+                                             * one message for each port. */
+
+/* Lookup cache of each receive worker. The entry number is set by
+ * "Flow_cache_entry_number" in the config file, and should be a power of
+ * two. 0 means the cache is disabled. Tables with keys longer than
+ * POFDP_FLOW_CACHE_KEY_LEN bytes are always looked up. */
+#define POFDP_FLOW_CACHE_ENTRY_NUM  (4096)
+#define POFDP_FLOW_CACHE_KEY_LEN    (48)
+
+/* Compile the instruction programs to native code on x86-64. Set by "Jit"
+ * in the config file. 0 means the instructions are interpreted. */
+#define POFDP_JIT                   (0)
+
+/* Packet fields hashed by the SELECT groups to choose the bucket, in bit
+ * offsets from the start of the packet. Set by "Select_hash_field <offset>
+ * <length>" lines in the config file. The default is the IPv4 protocol,
+ * the IPv4 addresses and the L4 ports behind an Ethernet header. */
+#define POFDP_SELECT_HASH_FIELD_NUM (3)
+#define POFDP_SELECT_HASH_FIELDS    {{0, 184, 8}, {0, 208, 64}, {0, 272, 32}}
 /* The field offset of packet received port's ID infomation in metadata. */
 #define POFDP_PORT_ID_FIELD_OFFSET_IN_METADATA_B (0)
 /* The field length of packet received port's ID infomation in metadata. */
@@ -85,9 +135,31 @@
 #define POF_COMP_RES_FIELD_BITNUM     (2)
 
 
-/* Packet infomation including data, length, received port. */
+/* Pre-decoded program, see struct pofdp_program. */
+struct pofdp_op;
+struct pofdp_program;
+/* Outputs waiting to be sent, defined in pof_datapath.c. */
+struct pofdp_tx_batch;
+/* Cached lookups of one receive worker, defined in pof_datapath.c. */
+struct pofdp_flow_cache;
+/* Key of a lookup extracted ahead, defined in pof_datapath.c. */
+struct pofdp_lookup;
+
+/* Packet infomation including data, length, received port. The packet
+ * data is not kept in the dpp, but in a buffer of the receive worker or
+ * in the receive ring. The fields in front of ori_port_id belong to the
+ * receive worker and are set once. The others describe one packet, and
+ * are cleared by POFDP_PACKET_RESET() for every packet. The fields used
+ * by every packet come first, so a packet touches a few cache lines. */
 struct pofdp_packet{
+    /* Receive worker. */
     struct pof_datapath *dp;
+	int sockSend;
+    /* Transmit batch of the receive task. NULL means sending immediately. */
+    struct pofdp_tx_batch *txBatch;
+    /* Lookup cache of the receive task. NULL means no cache. */
+    struct pofdp_flow_cache *flowCache;
+
     /* Input information. */
     uint32_t ori_port_id;       /* The original packet input port index. */
     uint32_t ori_len;           /* The original packet length.
@@ -95,71 +167,78 @@ struct pofdp_packet{
                                  * in add field action, the ori_len will NOT
                                  * change. The len in metadata will update
                                  * immediatley in this situation. */
-    uint8_t buf[POFDP_PACKET_RAW_MAX_LEN];  /* The memery which stores the whole packet. */
     uint8_t *packetBuf;         /* Points to the original packet buffer.
-                                 * packetBuf = buf + POFDP_PACKET_PREBUF_LEN */
-
-    /* Output. */
-    uint16_t output_port_id;    /* The output port index. */
-    uint16_t output_slot_id;
-	uint16_t output_packet_len;			/* Byte unit. */
-								/* The length of output packet. */
-    uint16_t output_packet_offset;		/* Byte unit. */
-								/* The start position of output. */
-	uint16_t output_metadata_len;		/* Byte unit. */
-	uint16_t output_metadata_offset;	/* Bit unit. */
-								/* The output metadata length and offset. 
-								 * Packet data output right behind the metadata. */
-	uint16_t output_whole_len;  /* = output_packet_len + output_metadata_len. */
-	uint8_t buf_out[POFDP_PACKET_RAW_MAX_LEN];	/* The memery which store the whole output data. 
-                                                 * Including the metadata and
-                                                 * the packet.*/
-    uint8_t *output_packet_buf;      /* Points to the first byte of packet to output. */
+                                 * packetBuf = bufStart + POFDP_PACKET_PREBUF_LEN
+                                 * if the packet is in a buffer. */
+    uint8_t *bufStart;          /* The memery around the packet which can be */
+    uint8_t *bufEnd;            /* used by it, [bufStart, bufEnd). It is a
+                                 * buffer of PFODP_PACKET_BUF_TOTAL_LEN bytes,
+                                 * or the ring frame when the packet is
+                                 * forwarded in place. The headroom and the
+                                 * tailroom are the gaps to the packet. */
 
     /* Offset. */
-    int16_t offset;				/* Byte unit. Can be negative.*/
-								/* The base offset of table field and actions. */
     uint8_t *buf_offset;        /* The packet pointer shift offset. 
                                  * buf_offset = packetBuf + offset */
     int32_t left_len;           /* Length of left packet after shifting offset. */
+    int16_t offset;				/* Byte unit. Can be negative.*/
+								/* The base offset of table field and actions. */
+    uint16_t metadata_len;      /* The length of packet metadata in byte. */
 
     /* Metadata. */
     struct pofdp_metadata *metadata;
                                 /* The memery which stores the packet metadata. 
 								 * The packet WHOLE length and input port index 
 								 * has been stored in metadata. */
-    uint16_t metadata_len;      /* The length of packet metadata in byte. */
+
+    /* Instruction & Actions. */
+    const struct pofdp_program *prog;
+                                /* Program of the instructions in execution. */
+    const struct pofdp_op *ins; /* The instruction to be implemented in prog. */
+    const struct pofdp_op *act; /* The action to be implemented. */
+    uint8_t act_num;            /* Number of actions need to be implemented. */
+    uint8_t packet_done;        /* Indicate whether the packet processing is */
+                                /* already done. 1 means done, 0 means not. */
+    uint8_t txHeld;             /* Outputs in the batch refer to the packet
+                                 * data. They are sent before the packet
+                                 * is changed, see pofdp_output_release(). */
 
     /* Flow. */
     uint8_t table_type;         /* Type of table which contains the packet now. */
     uint8_t table_id;           /* Index of table which contains the packet now. */
     struct entryInfo *flow_entry; /* The flow entry which match the packet. */
-
-    /* Instruction & Actions. */
-#ifdef POF_SHT_VXLAN
-    struct insBlockInfo *insBlock;  /* Points to instruction block to be execute. */
-#endif // POF_SHT_VXLAN
-    struct pof_instruction *ins;/* The memery which stores the instructions need
-                                 * to be implemented. */
-    uint8_t ins_todo_num;       /* Number of instructions need to be implemented. */
-	uint8_t ins_done_num;       /* Number of instructions have been done. */
-    struct pof_action *act;     /* Memery which stores the actions need to be
-                                 * implemented. */
-    uint8_t act_num;            /* Number of actions need to be implemented. */
+    const struct pofdp_lookup *lookup;
+                                /* The key of the next lookup, extracted
+                                 * with the other packets of the vector.
+                                 * NULL means it is extracted at the lookup. */
 #ifdef POF_SHT_VXLAN
     uint8_t *para;              /* Parameter of the entry. */
     uint16_t paraLen;           /* The length of the parameter. */
 #endif // POF_SHT_VXLAN
-    uint8_t packet_done;        /* Indicate whether the packet processing is */
-                                /* already done. 1 means done, 0 means not. */
 
 	/* Meter. */
 	uint16_t rate;				/* Rate. 0 means no limitation. */
 
-	/* Socket. */
-	int sockSend;
+    /* Output. The output is not assembled, see pofdp_send_raw(). */
+    uint16_t output_port_id;    /* The output port index. */
+    uint16_t output_slot_id;
+	uint16_t output_packet_len;			/* Byte unit. */
+								/* The length of output packet. */
+    uint16_t output_packet_offset;		/* Byte unit. */
+								/* The start position of output. */
+	uint16_t output_metadata_len;		/* Byte unit. */
+	uint16_t output_metadata_offset;	/* Bit unit. */
+								/* The output metadata length and offset. 
+								 * Packet data output right behind the metadata. */
+	uint16_t output_whole_len;  /* = output_packet_len + output_metadata_len. */
+    uint8_t *output_packet_buf;      /* Points to the first byte of packet to output. */
 };
 
+/* Clear the packet fields of the dpp, and keep the receive worker ones. */
+#define POFDP_PACKET_RESET(DPP) \
+            memset(&(DPP)->ori_port_id, 0, \
+                   sizeof(struct pofdp_packet) - offsetof(struct pofdp_packet, ori_port_id))
+
 /* Define Metadata structure. */
 struct pofdp_metadata{
     uint16_t len;
@@ -182,6 +261,19 @@ struct pof_param {
     uint32_t groupNumMax;
     uint32_t meterNumMax;
     uint32_t counterNumMax;
+    /* Receive ring and workers. */
+    uint32_t rxRingBlockNum;
+    uint16_t rxWorkerNum;
+    /* Lookup cache of each receive worker. */
+    uint32_t flowCacheEntryNum;
+    /* Compile the instructions to native code. */
+    uint8_t jit;
+    /* Token bucket of the meters. */
+    uint32_t meterBurstMs;
+    uint8_t meterPacketMode;
+    /* Packet fields hashed by the SELECT groups. */
+    uint8_t selectHashFieldNum;
+    pof_match selectHashField[POF_MAX_MATCH_FIELD_NUM];
 };
 
 /* Define datapath struction. */
@@ -212,6 +304,56 @@ struct pof_datapath{
 extern struct pof_datapath g_dp;
 
 #define POFDP_ARG	struct pofdp_packet *dpp, struct pof_local_resource *lr
+#define POFDP_OP_ARG    POFDP_ARG, const struct pofdp_op *op
+
+/* Max number of the operands of one instruction or action. */
+#define POFDP_OP_OPERAND_NUM (5)
+
+/* One operand of an instruction or action. The accessor is chosen by the
+ * value type and the field when the program is built. */
+struct pofdp_operand{
+    uint32_t (*get)(uint32_t *value, const struct pofdp_operand *o, \
+                    const struct pofdp_packet *dpp);
+    union{
+        uint32_t value;         /* Immediate number. */
+        struct pof_match field; /* Field in packet, metadata or parameter. */
+    } u;
+};
+
+#define POFDP_OPERAND_GET(VALUE, OP, I, DPP) \
+            ((OP)->opnd[I].get((VALUE), &(OP)->opnd[I], (DPP)))
+
+/* One pre-decoded instruction or action. */
+struct pofdp_op{
+    uint32_t (*exec)(POFDP_OP_ARG);
+    void *data;                 /* The instruction_data or action_data. */
+    const struct pofdp_op *sub; /* APPLY_ACTIONS: The first action. */
+    uint8_t subNum;             /* APPLY_ACTIONS: Number of the actions. */
+    uint8_t type;
+    struct pofdp_operand opnd[POFDP_OP_OPERAND_NUM];
+    struct poflr_ref ref;       /* The counter, meter, group, table or slot
+                                 * used, bound by pofdp_program_bind(). */
+};
+
+/* The instructions of an instruction block (or a flow entry) and the
+ * actions of a group are decoded once when they are installed. Each op
+ * carries its handler and the accessors of its operands, so the packets
+ * neither switch on the type nor parse the value type. The ops point to
+ * the instruction and action data they are built from, which are kept
+ * in the wire format for the replies to the Controller, so the program
+ * lives in the same memory with them. The first insNum ops are the
+ * instructions, followed by the actions of all the APPLY_ACTIONS. */
+struct pofdp_program{
+    uint8_t insNum;
+    uint16_t opNum;
+    void *jit;                  /* Native code of the instructions, see
+                                 * pofdp_program_jit(). NULL means none. */
+    uint32_t jitSize;
+    struct pofdp_op op[0];
+};
+
+/* Offset of the program behind LEN bytes of data. */
+#define POFDP_PROGRAM_OFFSET(LEN) (((LEN) + 7) & ~7)
 
 extern uint32_t pof_datapath_init(struct pof_datapath *dp);
 extern uint32_t pofdp_slot_init(struct pof_datapath *dp);
@@ -219,6 +361,12 @@ extern struct pof_local_resource * \
            pofdp_get_local_resource(uint16_t slot, const struct pof_datapath *dp);
 extern uint32_t pofdp_create_port_listen_task(struct portInfo *);
 extern uint32_t pofdp_send_raw(struct pofdp_packet *dpp, const struct pof_local_resource *lr);
+extern uint32_t pofdp_send_raw_flood(struct pofdp_packet *dpp, const struct pof_local_resource *lr);
+extern uint32_t pofdp_tx_batch_flush(struct pofdp_tx_batch *tx);
+extern uint32_t pofdp_output_release(struct pofdp_packet *dpp);
+extern struct entryInfo *pofdp_entry_lookup(struct pofdp_packet *dpp,               \
+                                            const struct pof_local_resource *lr,    \
+                                            const struct tableInfo *table);
 extern uint32_t pofdp_send_packet_in_to_controller(uint16_t len,        \
                                                    uint8_t reason,      \
                                                    uint8_t table_id,    \
@@ -228,6 +376,17 @@ extern uint32_t pofdp_send_packet_in_to_controller(uint16_t len,        \
                                                    uint8_t *packet);
 extern uint32_t pofdp_instruction_execute(POFDP_ARG);
 extern uint32_t pofdp_action_execute(POFDP_ARG);
+extern uint32_t pofdp_program_size(const struct pof_instruction *ins, uint8_t insNum);
+extern void pofdp_program_build(struct pofdp_program *prog, struct pof_instruction *ins, uint8_t insNum);
+extern uint32_t pofdp_action_program_size(uint8_t actNum);
+extern void pofdp_action_program_build(struct pofdp_program *prog, struct pof_action *act, uint8_t actNum);
+extern void pofdp_action_decode(struct pofdp_op *op, struct pof_action *act, uint8_t actNum);
+extern void pofdp_operand_build(struct pofdp_operand *o, uint8_t type, const void *u_);
+extern void pofdp_program_jit(struct pofdp_program *prog);
+extern void pofdp_program_release(struct pofdp_program *prog);
+extern void pofdp_program_bind(struct pofdp_program *prog, struct pof_local_resource *lr);
+extern void pofdp_program_unbind(struct pofdp_program *prog);
+extern void pofdp_action_bind(struct pofdp_op *op, struct pof_local_resource *lr);
 
 extern uint32_t pofdp_write_32value_to_field(uint32_t value, const struct pof_match *pm, \
 											 struct pofdp_packet *dpp);
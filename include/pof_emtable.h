@@ -0,0 +1,68 @@
+
+/**
+ * Copyright (c) 2012, 2013, Huawei Technologies Co., Ltd.
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met: 
+ * 
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer. 
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution. 
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef _POF_EMTABLE_H_
+#define _POF_EMTABLE_H_
+
+#include "pof_type.h"
+
+/* Exact match table with open addressing and linear probing. Every slot
+ * keeps the full hash as the fingerprint, and the key is verified before
+ * a match is returned. The table grows incrementally: after the slots are
+ * doubled, every insert and delete moves a few slots from the old array
+ * to the new one, and the lookup searches both until it is done. The
+ * lookup takes no lock. An array is published by one pointer with its
+ * mask, and the old array is freed through the epoch. */
+
+#define EMTABLE_TOMBSTONE ((const uint8_t *)1)
+
+struct emSlot {
+    hash_t hash;
+    const uint8_t *key;         /* NULL if empty, EMTABLE_TOMBSTONE if deleted. */
+    void *ptr;
+};
+
+struct emArray {
+    hash_t mask;
+    hash_t used;                /* Including tombstones. */
+    struct emSlot slots[];
+};
+
+struct emTable {
+    struct emArray *cur;
+    struct emArray *old;        /* Being moved to cur if not NULL. */
+    hash_t oldPos;              /* Next slot in old to be moved. */
+    hash_t n;
+    uint16_t keyLen;            /* In byte. */
+};
+
+struct emTable * emtable_create(uint16_t keyLen);
+struct emTable * emtable_destroy(struct emTable *);
+uint32_t emtable_insert(struct emTable *, const uint8_t *key, const void *ptr);
+uint32_t emtable_delete(struct emTable *, const uint8_t *key, const void *ptr);
+void * emtable_lookup(const struct emTable *, const uint8_t *key);
+
+#endif // _POF_EMTABLE_H_
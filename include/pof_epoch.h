@@ -0,0 +1,59 @@
+
+/**
+ * Copyright (c) 2012, 2013, Huawei Technologies Co., Ltd.
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met: 
+ * 
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer. 
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution. 
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef _POF_EPOCH_H_
+#define _POF_EPOCH_H_
+
+#include "pof_type.h"
+
+/* Epoch based reclamation between the datapath and the writers of the
+ * local resources. A reader takes no lock. It only reports a quiescent
+ * point when it holds no pointer into the shared structures, or goes
+ * offline before it blocks. A writer unlinks an object first, and then
+ * retires it instead of freeing it. epoch_reclaim() starts a new epoch,
+ * and frees the objects retired before every online reader has passed a
+ * quiescent point in a later epoch. */
+
+/* Epoch of an offline reader. */
+#define EPOCH_OFFLINE (0)
+
+struct epochReader {
+    uint64_t epoch;             /* Epoch at the last quiescent point. */
+    struct epochReader *next;
+};
+
+typedef void (*EPOCH_FREE_FUNC)(void *ptr);
+
+struct epochReader * epoch_readerRegister();
+void epoch_readerUnregister(void *reader);
+void epoch_quiescent(struct epochReader *);
+void epoch_offline(struct epochReader *);
+void epoch_online(struct epochReader *);
+void epoch_retire(void *ptr, EPOCH_FREE_FUNC func);
+void epoch_free(void *ptr);
+void epoch_reclaim();
+
+#endif // _POF_EPOCH_H_
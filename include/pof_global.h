@@ -198,6 +198,10 @@ typedef enum pof_type {
             POFT_QUERYALL_REQUEST = 34, /* Controller to switch message. */
     POFT_QUERYALL_FIN = 35,     /* Switch to controller message when finished sending all 
                                  * queried message. */
+
+    /* Bundle messages. */
+            POFT_BUNDLE_CONTROL = 37, /* Controller/switch message */
+    POFT_BUNDLE_ADD_MESSAGE = 38, /* Controller/switch message */
 #ifdef POF_SHT_VXLAN
     /* Instruction Block Message. */
     POFT_INSTRUCTION_BLOCK_MOD = 36,
@@ -237,6 +241,15 @@ typedef enum pof_group_mod_command {
     POFGC_QUERY_RESULT = 4,
 } pof_group_mod_command;
 
+/* Group types. The actions of a SELECT or a FAST_FAILOVER group are its
+ * buckets, and only one of them is executed. */
+typedef enum pof_group_type {
+    POFGT_ALL = 0, /* All actions. */
+    POFGT_SELECT = 1, /* One action chosen by the hash of the packet. */
+    POFGT_INDIRECT = 2, /* All actions. */
+    POFGT_FF = 3, /* The first action whose output port is live. */
+} pof_group_type;
+
 /* Counter commands */
 typedef enum pof_counter_mod_command {
     POFCC_ADD = 0, /* New counter. */
@@ -246,6 +259,18 @@ typedef enum pof_counter_mod_command {
     POFCC_QUERY_RESULT = 4,
 } pof_counter_mod_command;
 
+/* Bundle control types. */
+typedef enum pof_bundle_ctrl_type {
+    POFBCT_OPEN_REQUEST = 0,
+    POFBCT_OPEN_REPLY = 1,
+    POFBCT_CLOSE_REQUEST = 2,
+    POFBCT_CLOSE_REPLY = 3,
+    POFBCT_COMMIT_REQUEST = 4,
+    POFBCT_COMMIT_REPLY = 5,
+    POFBCT_DISCARD_REQUEST = 6,
+    POFBCT_DISCARD_REPLY = 7,
+} pof_bundle_ctrl_type;
+
 /* flow commands */
 typedef enum pof_flow_mod_command {
     POFFC_ADD = 0, /* New flow. */
@@ -447,6 +472,22 @@ typedef struct pof_queryall_request {
     uint8_t pad[6];    /* 8 bytes aligned. */
 } pof_queryall_request; //sizeof = 8
 
+/* Open, close, commit or discard a bundle. The reply has the same body
+ * with the reply type. */
+typedef struct pof_bundle_ctrl_msg {
+    uint32_t bundle_id;
+    uint16_t type;     /* POFBCT_*. */
+    uint16_t flags;
+} pof_bundle_ctrl_msg; //sizeof = 8
+
+/* Add one message to an open bundle. Only POFT_FLOW_MOD is supported. */
+typedef struct pof_bundle_add_msg {
+    uint32_t bundle_id;
+    uint16_t pad;
+    uint16_t flags;
+    pof_header message; /* Followed by the body of the message. */
+} pof_bundle_add_msg; //sizeof = 16
+
 /*Upon session establishment, the controller sends an POFT_FEATURES_REQUEST message.
 This message does not contain a body beyond the OpenFlow header.*/
 typedef struct pof_switch_features {
@@ -1424,6 +1465,7 @@ typedef enum pof_error_type {
 #ifdef POF_SHT_VXLAN
     POFET_INSBLOCK_MOD_FAILED = 16, /* Error in instruction block. */
 #endif // POF_SHT_VXLAN
+    POFET_BUNDLE_FAILED = 17, /* Error in bundle. */
     POFET_EXPERIMENTER = 0xffff /* Experimenter error messages. */
 } pof_error_type;
 
@@ -1618,6 +1660,19 @@ enum pof_counter_mod_failed_code {
     POFCMFC_COUNTER_EXIST, /* The specified counter has existed. */
 };
 
+/* pof_error_msg 'code' values for POFET_BUNDLE_FAILED. */
+enum pof_bundle_failed_code {
+    POFBFC_UNKNOWN = 0, /* Unspecified error. */
+    POFBFC_BAD_ID = 1, /* Bundle id does not exist. */
+    POFBFC_BUNDLE_EXIST, /* Bundle id is already open. */
+    POFBFC_BUNDLE_CLOSED, /* Bundle is closed. */
+    POFBFC_OUT_OF_BUNDLES, /* Too many bundles are open. */
+    POFBFC_BAD_TYPE, /* Unknown bundle control type. */
+    POFBFC_MSG_UNSUP, /* Message type is not supported in a bundle. */
+    POFBFC_MSG_TOO_MANY, /* Too many messages in the bundle. */
+    POFBFC_BAD_LEN, /* Wrong length of the message in the bundle. */
+};
+
 #ifdef POF_SHT_VXLAN
 enum pof_insBlock_mod_failed_code{
     POFIMFC_UNKNOWN = 0,
@@ -1766,14 +1821,21 @@ typedef void (*POF_TASK_FUNC)(void *arg_ptr);
 /* Timer routine. */
 typedef void (*POF_TIMER_FUNC)(uint32_t timerid, int arg);
 
+/* Routine to drain a full message queue. */
+typedef void (*POF_QUEUE_DRAIN_FUNC)(void *arg);
+
 /* Basic function interface. */
 extern uint32_t pofbf_task_create(void *arg, POF_TASK_FUNC task_func, task_t *task_id_ptr0);
 
+extern uint32_t pofbf_task_set_cpu(uint32_t cpu);
+
 extern uint32_t pofbf_task_delay(uint32_t delay);
 
+extern uint64_t pofbf_time_ns();
+
 extern uint32_t pofbf_task_delete(task_t *task_id_ptr);
 
-extern uint32_t pofbf_queue_create(uint32_t *queue_id_ptr, int j);
+extern uint32_t pofbf_queue_create(uint32_t *queue_id_ptr);
 
 extern uint32_t pofbf_queue_delete(uint32_t *queue_id_ptr);
 
@@ -1781,6 +1843,8 @@ extern uint32_t pofbf_queue_read(uint32_t queue_id, void *buf, uint32_t max_len,
 
 extern uint32_t pofbf_queue_write(uint32_t queue_id, const void *message, uint32_t msg_len, int timeout);
 
+extern uint32_t pofbf_queue_poll_fd(uint32_t queue_id, POF_QUEUE_DRAIN_FUNC drain, void *arg, int *fd_ptr);
+
 extern uint32_t pofbf_timer_create(uint32_t delay, \
                               uint32_t interval, \
                               POF_TIMER_FUNC timer_handler, \
@@ -1788,6 +1852,12 @@ extern uint32_t pofbf_timer_create(uint32_t delay, \
 
 extern uint32_t pofbf_timer_delete(uint32_t *task_id_ptr);
 
+extern uint32_t pofbf_ring_map(uint32_t size, char **ring_ptr);
+
+extern uint32_t pofbf_ring_unmap(char **ring_ptr, uint32_t size);
+
+extern void pofbf_move_bit(uint8_t *data_dst, uint16_t dst_b, const uint8_t *data_src, uint16_t src_b, uint16_t len_b);
+
 extern void pofbf_cover_bit(uint8_t *data_ori, const uint8_t *value, uint16_t pos_b, uint16_t len_b);
 
 extern void pofbf_copy_bit(const uint8_t *data_ori, uint8_t *data_res, uint16_t offset_b, uint16_t len_b);
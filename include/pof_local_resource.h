@@ -29,6 +29,7 @@
 #include "pof_common.h"
 #include "pof_hmap.h"
 #include "pof_tree.h"
+#include "pof_emtable.h"
 #include "pof_list.h"
 
 /* The table numbers of each type. */
@@ -45,6 +46,24 @@
 #define POFLR_COUNTER_NUMBER (512)
 #define POFLR_GROUP_NUMBER (128)
 
+/* Lookup table of a SELECT group, which should be a prime. The buckets
+ * fill the table by Maglev hashing. A packet whose bucket is not live
+ * probes POFLR_GROUP_SELECT_PROBE_NUM more entries. */
+#define POFLR_GROUP_SELECT_TABLE_SIZE (251)
+#define POFLR_GROUP_SELECT_PROBE_NUM (8)
+
+/* Meters police the packets by a token bucket. The bucket holds the
+ * tokens of the rate in POFLR_METER_BURST_MS milli-seconds. The rate is
+ * in kbps, or in packets per second in the packet mode. */
+#define POFLR_METER_BURST_MS (10)
+#define POFLR_METER_PACKET_MODE (0)
+
+/* Rows of the counter shards. Row 0 is shared by the threads which are
+ * not receive workers, and every receive worker owns one of the others
+ * until they run out. */
+#define POFLR_COUNTER_ROW_NUM (32)
+#define POFLR_CACHE_LINE_SIZE (64)
+
 /* Max number of local physical port. */
 #define POFLR_DEVICE_PORT_NUM_MAX (100)
 
@@ -54,14 +73,56 @@
 /* Max instruction block number. */
 #define POFLR_INS_BLOCK_NUM     (64)
 
+/* Max number of open bundles, and max flow mods in one bundle. */
+#define POFLR_BUNDLE_NUM        (16)
+#define POFLR_BUNDLE_MSG_NUM    (65536)
+
 //add by wenjian
 //date 2015/12/02
 /* Max queues per port*/
 #define PORT_MAX_QUEUES (8)
 
+/* Max receive workers per port. */
+#define PORT_MAX_RX_WORKERS (16)
+
 #define PORT_NAME_LEN   POF_NAME_MAX_LENGTH
 #define TABLE_NAME_LEN  POF_NAME_MAX_LENGTH
 
+/* Pre-decoded instructions and actions, defined in pof_datapath.h. */
+struct pofdp_program;
+
+/* Types of the objects which can be referred by ID. */
+enum poflr_ref_type{
+    POFLR_REF_COUNTER = 0,
+    POFLR_REF_METER,
+    POFLR_REF_GROUP,
+    POFLR_REF_TABLE,
+#ifdef POF_SHT_VXLAN
+    POFLR_REF_INS_BLOCK,
+#endif // POF_SHT_VXLAN
+    POFLR_REF_TYPE_NUM,
+};
+
+/* Reference to a counter, meter, group, table or instruction block by
+ * its ID, bound to the object when the flow entry, group or instruction
+ * block holding it is installed, so the datapath needs no lookup. All of
+ * the references to an object are linked in its refs, whose count is
+ * the reference count of the object. When the object is deleted, its
+ * references are bound to the object which replaces it, or set to NULL
+ * and linked in pof_local_resource.unboundRefs until an object with the
+ * ID is added. The datapath looks up the ID if the reference is NULL.
+ * The references are only changed by the writers of the resource. */
+struct poflr_ref{
+    void *obj;                  /* Read by POFLR_REF_GET(). NULL if unbound. */
+    struct list *list;          /* The refs of obj, or the unbound list. NULL
+                                 * if not linked. */
+    struct listNode node;
+    uint32_t id;
+    uint8_t type;               /* POFLR_REF_*. */
+};
+
+#define POFLR_REF_GET(ref) __atomic_load_n(&(ref)->obj, __ATOMIC_ACQUIRE)
+
 #ifdef POF_SHT_VXLAN
 struct insBlockInfo{
     uint16_t blockID;
@@ -70,6 +131,8 @@ struct insBlockInfo{
     uint8_t insNum;
     uint8_t tableID;
     struct pof_local_resource *lr;
+    struct list refs;               /* References to the block. */
+    struct pofdp_program *prog;     /* Built from insData, behind it. */
     struct pof_instruction insData[0];
 };
 #endif 
@@ -78,11 +141,23 @@ struct entryInfo{
     uint32_t  index;
     struct hnode node;
     uint32_t counter_id;
+    struct poflr_ref counterRef;    /* Bound to the counter of counter_id. */
+
+    /* The entry is visible to the lookups in the table versions from
+     * addVersion to removeVersion - 1. See poflr_bundle_commit. */
+    uint32_t addVersion;
+    uint32_t removeVersion;
+
+    /* Only For MM. */
+    struct hnode maskNode;          /* One node in mmSubtable.entryMap. */
+    struct mmSubtable *subtable;
 #ifdef POF_SHT_VXLAN
     uint16_t insBlockID;
+    struct poflr_ref insBlockRef;   /* Bound to the block of insBlockID. */
 #else // POF_SHT_VXLAN
     uint8_t instruction_num;
     pof_instruction instruction[POF_MAX_INSTRUCTION_NUM]; /*The instructions*/
+    struct pofdp_program *prog;     /* Built from instruction, behind the entry. */
 #endif // POF_SHT_VXLAN
 
     uint16_t priority;
@@ -98,9 +173,45 @@ struct entryInfo{
 #endif // POF_SHT_VXLAN
 };
 
+/* Subtable of a MM table. All the entries in one subtable have the same
+ * mask, and are hashed by the masked value. */
+struct mmSubtable{
+    struct hmap *entryMap;
+    uint32_t entryNum;
+    uint16_t maxPriority;           /* Highest priority of the entries. */
+    uint8_t mask[POF_MAX_FIELD_LENGTH_IN_BYTE * POF_MAX_MATCH_FIELD_NUM];
+};
+
+/* The subtables of a MM table, sorted by maxPriority, highest first. The
+ * lookups read it without a lock, so it is never changed. A new list is
+ * published in its place. */
+struct mmSubtableList{
+    uint32_t num;
+    struct mmSubtableItem{
+        struct mmSubtable *st;
+        uint16_t maxPriority;
+    } item[0];
+};
+
+/* One step of the key extraction of a table. Built from the match fields
+ * when the table is created. */
+struct keyOp{
+    uint8_t type;                   /* KEY_OP_COPY or KEY_OP_SHIFT. */
+    uint8_t fromMetadata;
+    uint16_t srcOffset_b;
+    uint16_t dstOffset_b;
+    uint16_t len_b;
+};
+
+enum keyOpType{
+    KEY_OP_COPY = 0,                /* Byte aligned on both sides. */
+    KEY_OP_SHIFT,                   /* Not aligned. Shift and mask. */
+};
+
 struct tableInfo{
     uint8_t id;         /* Global value. */
     struct hnode idNode;
+    struct list refs;   /* References to the table. */
     uint8_t type;
 //    struct hnode typeNode;
     char name[TABLE_NAME_LEN];
@@ -112,30 +223,74 @@ struct tableInfo{
 
     /* Only For LPM. */
     struct tree *tree;
+    /* Only For MM. */
+    struct mmSubtableList *subtables;
+    /* Only For EM. */
+    struct emTable *emTable;
 
     uint8_t match_field_num;
     pof_match match[POF_MAX_MATCH_FIELD_NUM];
+
+    /* Key extraction steps from match[]. */
+    uint8_t keyOpNum;
+    struct keyOp keyOps[POF_MAX_MATCH_FIELD_NUM];
+
+    /* Version of the tables visible to the lookups. Points to
+     * pof_local_resource.version. */
+    const uint32_t *version;
 };
 
+#define POFLR_VERSION_MAX (0xFFFFFFFF)
+#define POFLR_ENTRY_VISIBLE(entry, ver) \
+            ((entry)->addVersion <= (ver) && (ver) < (entry)->removeVersion)
+
 struct groupInfo{
     uint8_t type;
     uint8_t action_number;
     uint32_t id;
     struct hnode idNode;
+    struct list refs;               /* References to the group. */
 
     uint32_t counter_id;
+    struct poflr_ref counterRef;    /* Bound to the counter of counter_id. */
     pof_action action[POF_MAX_ACTION_NUMBER_PER_GROUP];
+    struct pofdp_program *prog;     /* Built from action, behind the group. */
+    uint8_t selectTable[POFLR_GROUP_SELECT_TABLE_SIZE];
+                                    /* Buckets of a SELECT group. */
 };
 
 struct meterInfo{
-    uint32_t rate;
+    uint32_t rate;                  /* 0 means no limitation. */
     uint32_t id;
     struct hnode idNode;
+    struct list refs;               /* References to the meter. */
+
+    /* Token bucket. It is kept as the time when the bucket will be
+     * full again, so the workers update it with one compare and swap. */
+    uint64_t full;                  /* Monotonic time in ns. */
+    uint64_t burst;                 /* Depth of the bucket in ns. */
+    uint8_t packetMode;             /* Count packets instead of bytes. */
+    uint64_t dropPackets;           /* Packets beyond the rate. */
+    uint64_t dropBytes;
 };
 
+/* The values are kept in the counter shards of the local resource. The
+ * base is the sum of the shards when the counter is created or cleared,
+ * and value is filled only by poflr_counter_read(). */
 struct counterInfo{
     uint32_t id;
     struct hnode idNode;
+    struct list refs;               /* References to the counter. */
+    uint64_t value;
+    uint64_t base;
+#ifdef POF_SD2N
+    uint64_t byte_value;
+    uint64_t byte_base;
+#endif // POF_SD2N
+};
+
+/* One shard of a counter. */
+struct counterShard{
     uint64_t value;
 #ifdef POF_SD2N
     uint64_t byte_value;
@@ -162,7 +317,8 @@ struct portInfo {
     uint32_t    pofState;       /* Bitmap of POFPS_*.  */
     uint16_t    slotID;
     uint8_t     of_enable;
-    task_t      taskID;
+    task_t      taskID[PORT_MAX_RX_WORKERS];
+                                /* Receive workers of the port. */
 
     //add by wenjian 2015/12/02
     int queue_fd[PORT_MAX_QUEUES+1];
@@ -185,6 +341,8 @@ struct pof_local_resource {
     uint16_t portNumMax;
     uint16_t portNum;
     uint32_t portFlag;   /* POFLRPF_*. */
+    uint64_t portLive[256 / 64];    /* Bit map of the live ports by pofIndex,
+                                     * see poflr_port_live(). */
 
     /* Table. */
     struct hmap *tableIdMap;        /* Hash map with tableInfo.idNode. */
@@ -200,18 +358,27 @@ struct pof_local_resource {
     uint32_t groupNumMax;
     uint32_t groupNum;
 //    uint32_t groupFlag;
+    uint8_t selectHashFieldNum;     /* Packet fields hashed by SELECT groups. */
+    pof_match selectHashField[POF_MAX_MATCH_FIELD_NUM];
 
     /* Meter. */
     struct hmap *meterMap;          /* Hash map with meterInfo.idNode. */
     uint32_t meterNumMax;
     uint32_t meterNum;
 //    uint32_t meterFlag;
+    uint32_t meterBurstMs;          /* Bucket depth of new meters. */
+    uint8_t meterPacketMode;        /* Mode of new meters. */
 
     /* Counter. */
     struct hmap *counterMap;        /* Hash map with counterInfo.idNode. */
     uint32_t counterNumMax;
     uint32_t counterNum;
 //    uint32_t counterFlag;
+    struct counterShard *counterShards;
+                                    /* POFLR_COUNTER_ROW_NUM rows indexed
+                                     * by the counter id. Every row starts
+                                     * at a cache line. */
+    uint32_t counterRowSize;        /* Shards in one row. */
 
 #ifdef POF_SHT_VXLAN
     /* Instruction Block. */
@@ -219,8 +386,26 @@ struct pof_local_resource {
     uint32_t insBlockNumMax;
     uint32_t insBlockNum;
 #endif // POF_SHT_VXLAN
+
+    /* Modification generation. Increased by every table, flow, group and
+     * meter modification, and by clearing the resource. The lookups cached
+     * by the datapath are valid only in the generation they were made. */
+    uint32_t modGen;
+
+    /* Version of all of the flow tables. Committing a bundle increases it
+     * once, so all of the flow mods in the bundle show up together. */
+    uint32_t version;
+
+    /* References whose object does not exist, by POFLR_REF_*. */
+    struct list unboundRefs[POFLR_REF_TYPE_NUM];
+
+    /* Program of a GOTO_TABLE to the first flow table, where every
+     * received packet starts from. Built by pofdp_slot_init(). */
+    struct pofdp_program *first;
 };
 
+#define POFLR_MOD_GEN_INC(lr) __sync_fetch_and_add(&(lr)->modGen, 1)
+
 /* Switch ID. */
 extern uint32_t g_poflr_dev_id;
 
@@ -244,6 +429,15 @@ extern uint32_t poflr_get_flow_table_resource(pof_flow_table_resource **flow_tab
 extern uint32_t poflr_init_table_resource(struct pof_local_resource *);
 extern uint32_t poflr_reset_dev_id();
 
+/* Reference. */
+extern void poflr_ref_bind(struct poflr_ref *ref, uint8_t type, uint32_t id, \
+                           struct pof_local_resource *lr);
+extern void poflr_ref_unbind(struct poflr_ref *ref);
+extern void poflr_ref_object_add(struct list *refs, void *obj, uint8_t type, \
+                                 uint32_t id, struct pof_local_resource *lr);
+extern void poflr_ref_object_delete(struct list *refs, uint8_t type, uint32_t id, \
+                                    struct pof_local_resource *lr);
+
 /* Port. */
 extern uint32_t poflr_init_port(struct pof_local_resource *);
 extern uint32_t poflr_port_detect_task();
@@ -253,6 +447,7 @@ extern uint32_t poflr_port_openflow_enable(uint32_t port_id, uint8_t ulFlowEnabl
                                            struct pof_local_resource *);
 extern uint32_t poflr_disable_all_port(struct pof_local_resource *);
 extern uint32_t poflr_del_port(const char *ethName, struct pof_local_resource *);
+extern uint8_t poflr_port_live(uint32_t port_id, const struct pof_local_resource *);
 extern struct portInfo *poflr_get_port_with_pofindex(uint8_t pofIndex, const struct pof_local_resource *);
 extern uint32_t poflr_ports_task_delete(struct pof_local_resource *);
 extern uint32_t poflr_add_port(const char *name, struct pof_local_resource *lr);
@@ -293,10 +488,25 @@ extern struct entryInfo *poflr_entry_lookup_Linear(uint32_t index, const struct
 extern struct entryInfo *poflr_entry_lookup(const uint8_t *packet,          \
                                             const uint8_t *metadata,        \
                                             const struct tableInfo *table);
+extern uint16_t poflr_entry_key_extract(uint8_t *key, const uint8_t *packet, \
+                                        const uint8_t *metadata,            \
+                                        const struct tableInfo *table);
+extern struct entryInfo *poflr_entry_lookup_with_key(const uint8_t *key,    \
+                                                     const struct tableInfo *table);
+
+/* Bundle. */
+extern uint32_t poflr_bundle_open(uint32_t bundle_id, int controller);
+extern uint32_t poflr_bundle_close(uint32_t bundle_id, int controller);
+extern uint32_t poflr_bundle_add(uint32_t bundle_id, const pof_flow_entry *flow_ptr, \
+                                 uint16_t len, int controller);
+extern uint32_t poflr_bundle_commit(uint32_t bundle_id, struct hmap *slotMap, \
+                                    int controller);
+extern uint32_t poflr_bundle_discard(uint32_t bundle_id, int controller);
 
 /* Meter. */
 extern uint32_t poflr_add_meter_entry(uint32_t meter_id, uint32_t rate, struct pof_local_resource *);
 extern uint32_t poflr_modify_meter_entry(uint32_t meter_id, uint32_t rate, struct pof_local_resource *);
+extern uint8_t poflr_meter_police(struct meterInfo *meter, uint32_t byte_len);
 extern uint32_t poflr_delete_meter_entry(uint32_t meter_id, uint32_t rate, struct pof_local_resource *);
 extern uint32_t poflr_init_meter(struct pof_local_resource *);
 extern uint32_t poflr_empty_meter(struct pof_local_resource *);
@@ -319,9 +529,16 @@ extern uint32_t poflr_counter_clear(uint32_t counter_id, struct pof_local_resour
 extern uint32_t poflr_get_counter_value(uint32_t counter_id, struct pof_local_resource *,int controller);
 #ifdef POF_SD2N
 extern uint32_t poflr_counter_increace(uint32_t counter_id, uint16_t byte_len, struct pof_local_resource *);
+extern uint32_t poflr_counter_increace_ref(const struct poflr_ref *ref, uint16_t byte_len, \
+                                           struct pof_local_resource *);
 #else // POF_SD2N
 extern uint32_t poflr_counter_increace(uint32_t counter_id, struct pof_local_resource *);
+extern uint32_t poflr_counter_increace_ref(const struct poflr_ref *ref, struct pof_local_resource *);
 #endif // POF_SD2N
+extern void poflr_counter_read(const struct counterInfo *counter, \
+                               const struct pof_local_resource *lr, \
+                               struct counterInfo *copy);
+extern void poflr_counter_worker_register();
 extern uint32_t poflr_init_counter(struct pof_local_resource *);
 extern uint32_t poflr_empty_counter(struct pof_local_resource *);
 extern struct counterInfo *poflr_get_counter_with_ID(uint32_t id, \
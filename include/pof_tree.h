@@ -29,10 +29,20 @@
 
 #include "pof_type.h"
 
+/* Multibit trie with a fixed stride of TREE_STRIDE bits. A prefix of
+ * length len (len > 0) is stored in the node at depth (len-1)/TREE_STRIDE,
+ * and expanded to all the slots it covers in that node. */
+#define TREE_STRIDE (4)
+#define TREE_SLOT_NUM (1 << TREE_STRIDE)
+
 struct treeNode {
-    void *ptr;
-    struct treeNode *leftSon;
-    struct treeNode *rightSon;
+    /* Prefixes ending in this node, indexed by (1 << r) | bits, where r
+     * is the prefix length inside this node. */
+    void *prefix[TREE_SLOT_NUM * 2];
+    /* The longest prefix in this node covering each slot. */
+    void *best[TREE_SLOT_NUM];
+    struct treeNode *son[TREE_SLOT_NUM];
+    uint32_t count;             /* Number of prefixes and sons. */
 };
 
 struct tree {
@@ -45,9 +55,9 @@ uint32_t tree_destroy(struct tree *);
 uint32_t tree_clear(struct tree *tree);
 struct treeNode * tree_nodeCreate();
 void tree_nodeDestroy(struct treeNode **);
-uint32_t tree_nodeInsert(struct tree *, const void *ptr, uint8_t *value, uint32_t bitNum);
-uint32_t tree_nodeDelete(struct tree *, uint8_t *value, uint32_t bitNum);
-void * tree_nodeLookup(const struct tree *, uint8_t *value, uint32_t bitNum);
+uint32_t tree_nodeInsert(struct tree *, const void *ptr, const uint8_t *value, uint32_t bitNum);
+uint32_t tree_nodeDelete(struct tree *, const void *ptr, const uint8_t *value, uint32_t bitNum);
+void * tree_nodeLookup(const struct tree *, const uint8_t *value, uint32_t bitNum);
 uint32_t tree_nodeTrav(const struct tree *, uint32_t func(void *), void *);
 
 #endif // _POF_TREE_H_
@@ -31,6 +31,7 @@
 #include "../include/pof_byte_transfer.h"
 #include "../include/pof_log_print.h"
 #include "../include/pof_memory.h"
+#include "../include/pof_epoch.h"
 #include "string.h"
 #include "sys/socket.h"
 #include "netinet/in.h"
@@ -39,6 +40,12 @@
 #include "sys/ioctl.h"
 #include "arpa/inet.h"
 
+/* Row of the counter shards which the thread writes, and whether the
+ * thread is the only writer of the row. */
+static __thread uint32_t counterRow = 0;
+static __thread uint8_t counterRowOwned = FALSE;
+static uint32_t counterRowNext = 1;
+
 /* Malloc memory for counter information. Should be free by map_counterDelete(). */
 static struct counterInfo *
 map_counterCreate()
@@ -53,7 +60,8 @@ map_counterDelete(struct counterInfo *counter, struct pof_local_resource *lr)
 {
     hmap_nodeDelete(lr->counterMap, &counter->idNode);
     lr->counterNum --;
-    FREE(counter);
+    poflr_ref_object_delete(&counter->refs, POFLR_REF_COUNTER, counter->id, lr);
+    epoch_free(counter);
 }
 
 static void
@@ -61,6 +69,7 @@ map_counterInsert(struct counterInfo *counter, struct pof_local_resource *lr)
 {
     hmap_nodeInsert(lr->counterMap, &counter->idNode);
     lr->counterNum ++;
+    poflr_ref_object_add(&counter->refs, counter, POFLR_REF_COUNTER, counter->id, lr);
 }
 
 static hash_t
@@ -69,6 +78,36 @@ map_counterHashByID(uint32_t id)
     return hmap_hashForLinear(id);
 }
 
+/* Sum the shards of the counter id over all rows. */
+static void
+counterSum(uint32_t id, const struct pof_local_resource *lr, struct counterShard *sum)
+{
+    const struct counterShard *shard;
+    uint32_t row;
+
+    memset(sum, 0, sizeof(*sum));
+    for(row=0; row<POFLR_COUNTER_ROW_NUM; row++){
+        shard = &lr->counterShards[row * lr->counterRowSize + id];
+        sum->value += __atomic_load_n(&shard->value, __ATOMIC_RELAXED);
+#ifdef POF_SD2N
+        sum->byte_value += __atomic_load_n(&shard->byte_value, __ATOMIC_RELAXED);
+#endif // POF_SD2N
+    }
+}
+
+/* The counter counts from the current sum of its shards. */
+static void
+counterSetBase(struct counterInfo *counter, const struct pof_local_resource *lr)
+{
+    struct counterShard sum;
+
+    counterSum(counter->id, lr, &sum);
+    counter->base = sum.value;
+#ifdef POF_SD2N
+    counter->byte_base = sum.byte_value;
+#endif // POF_SD2N
+}
+
 /***********************************************************************
  * Initialize the counter corresponding the counter_id.
  * Form:     uint32_t poflr_counter_init(uint32_t counter_id, \
@@ -83,7 +122,6 @@ uint32_t
 poflr_counter_init(uint32_t counter_id, struct pof_local_resource *lr)
 {
     struct counterInfo *counter;
-    char *ptr;
 	if(!counter_id){
 		POF_DEBUG_CPRINT_FL(1,GREEN,"The counter_id 0 means that counter is no need.");
 		return POF_OK;
@@ -95,9 +133,12 @@ poflr_counter_init(uint32_t counter_id, struct pof_local_resource *lr)
     }
     if(!poflr_get_counter_with_ID(counter_id, lr)){
         counter = map_counterCreate();
-        POF_MALLOC_ERROR_HANDLE_RETURN_NO_UPWARD(ptr);
+        POF_MALLOC_ERROR_HANDLE_RETURN_NO_UPWARD(counter);
         counter->id = counter_id;
         counter->idNode.hash = map_counterHashByID(counter_id);
+        /* The shards may hold the counts of a deleted counter with
+         * the same id. */
+        counterSetBase(counter, lr);
         map_counterInsert(counter, lr);
     }
 
@@ -163,16 +204,40 @@ poflr_counter_clear(uint32_t counter_id, struct pof_local_resource *lr)
         POF_ERROR_HANDLE_RETURN_NO_UPWARD(POFET_COUNTER_MOD_FAILED, POFCMFC_COUNTER_UNEXIST);
     }
 
-    /* Initialize the counter value. */
-    counter->value = 0;
-#ifdef POF_SD2N
-    counter->byte_value = 0;
-#endif // POF_SD2N
+    /* The shards are left as they are. */
+    counterSetBase(counter, lr);
 
     POF_DEBUG_CPRINT_FL(1,GREEN,"Clear counter[%u] value SUC!", counter_id);
     return POF_OK;
 }
 
+/***********************************************************************
+ * Read counter value.
+ * Form:     void poflr_counter_read(const struct counterInfo *counter, \
+ *                                   const struct pof_local_resource *lr, \
+ *                                   struct counterInfo *copy)
+ * Input:    counter, local resource
+ * Output:   copy of the counter with the value
+ * Return:   VOID
+ * Discribe: This function copies the counter, and fills the value of the
+ *           copy with the sum of the counter shards since the counter is
+ *           created or cleared.
+ ***********************************************************************/
+void
+poflr_counter_read(const struct counterInfo *counter, \
+                   const struct pof_local_resource *lr, \
+                   struct counterInfo *copy)
+{
+    struct counterShard sum;
+
+    *copy = *counter;
+    counterSum(counter->id, lr, &sum);
+    copy->value = sum.value - counter->base;
+#ifdef POF_SD2N
+    copy->byte_value = sum.byte_value - counter->byte_base;
+#endif // POF_SD2N
+}
+
 /***********************************************************************
  * Get counter value.
  * Form:     uint32_t poflr_get_counter_value(uint32_t counter_id \)
@@ -187,7 +252,7 @@ poflr_counter_clear(uint32_t counter_id, struct pof_local_resource *lr)
 uint32_t 
 poflr_get_counter_value(uint32_t counter_id, struct pof_local_resource *lr,int controller)
 {
-    struct counterInfo *counter;
+    struct counterInfo *counter, read;
     pof_counter pofCounter = {0};
 
     /* Check counter_id. */
@@ -197,6 +262,7 @@ poflr_get_counter_value(uint32_t counter_id, struct pof_local_resource *lr,int c
     if(!(counter = poflr_get_counter_with_ID(counter_id, lr))){
         POF_ERROR_HANDLE_RETURN_UPWARD(POFET_COUNTER_MOD_FAILED, POFCMFC_COUNTER_UNEXIST, g_recv_xid,controller);
     }
+    poflr_counter_read(counter, lr, &read);
 
 #ifdef POF_MULTIPLE_SLOTS
     pofCounter.command = POFCC_QUERY_RESULT;
@@ -205,9 +271,9 @@ poflr_get_counter_value(uint32_t counter_id, struct pof_local_resource *lr,int c
     pofCounter.command = POFCC_QUERY;
 #endif // POF_MULTIPLE_SLOTS
     pofCounter.counter_id = counter_id;
-    pofCounter.value = counter->value;
+    pofCounter.value = read.value;
 #ifdef POF_SD2N
-    pofCounter.byte_value = counter->byte_value;
+    pofCounter.byte_value = read.byte_value;
 #endif // POF_SD2N
     pof_NtoH_transfer_counter(&pofCounter);
 
@@ -221,10 +287,10 @@ poflr_get_counter_value(uint32_t counter_id, struct pof_local_resource *lr,int c
 #ifdef POF_SD2N
     POF_DEBUG_CPRINT_FL(1,GREEN,"Get counter value SUC! counter id = %u, counter value = %" \
             POF_PRINT_FORMAT_U64", byte_value = %"POF_PRINT_FORMAT_U64, \
-                        counter_id, counter->value, counter->byte_value);
+                        counter_id, read.value, read.byte_value);
 #else // POF_SD2N
     POF_DEBUG_CPRINT_FL(1,GREEN,"Get counter value SUC! counter id = %u, counter value = %"POF_PRINT_FORMAT_U64, \
-                        counter_id, counter->value);
+                        counter_id, read.value);
 #endif // POF_SD2N
     return POF_OK;
 }
@@ -233,17 +299,18 @@ uint32_t
 poflr_reply_counter_all(const struct pof_local_resource *lr,int controller)
 {
     struct pof_counter pofCounter = {0};
-    struct counterInfo *counter, *next;
+    struct counterInfo *counter, *next, read;
 
     HMAP_NODES_IN_STRUCT_TRAVERSE(counter, next, idNode, lr->counterMap){
+        poflr_counter_read(counter, lr, &read);
         pofCounter.command = POFCC_QUERY_RESULT;
 #ifdef POF_MULTIPLE_SLOTS
         pofCounter.slotID = lr->slotID;
 #endif // POF_MULTIPLE_SLOTS
         pofCounter.counter_id = counter->id;
-        pofCounter.value = counter->value;
+        pofCounter.value = read.value;
 #ifdef POF_SD2N
-        pofCounter.byte_value = counter->byte_value;
+        pofCounter.byte_value = read.byte_value;
 #endif // POF_SD2N
         pof_NtoH_transfer_counter(&pofCounter);
 
@@ -253,6 +320,64 @@ poflr_reply_counter_all(const struct pof_local_resource *lr,int controller)
     }
 }
 
+/***********************************************************************
+ * Register the receive worker to the counter shards
+ * Form:     void poflr_counter_worker_register()
+ * Input:    NONE
+ * Output:   NONE
+ * Return:   VOID
+ * Discribe: This function gives the calling thread a row of the counter
+ *           shards of its own, so that it increases the counters without
+ *           the atomic operations. The rows are not given back. When they
+ *           run out, the workers share the rows atomically.
+ ***********************************************************************/
+void
+poflr_counter_worker_register()
+{
+    uint32_t row = __sync_fetch_and_add(&counterRowNext, 1);
+
+    if(row < POFLR_COUNTER_ROW_NUM){
+        counterRow = row;
+        counterRowOwned = TRUE;
+    }else{
+        counterRow = 1 + row % (POFLR_COUNTER_ROW_NUM - 1);
+        counterRowOwned = FALSE;
+    }
+}
+
+/* The owner of the row is the only writer of its shards. The readers
+ * sum the shards without locks. */
+static inline void
+shardAdd(uint64_t *v, uint64_t n)
+{
+    if(counterRowOwned){
+        __atomic_store_n(v, __atomic_load_n(v, __ATOMIC_RELAXED) + n, __ATOMIC_RELAXED);
+    }else{
+        __atomic_fetch_add(v, n, __ATOMIC_RELAXED);
+    }
+}
+
+#ifdef POF_SD2N
+static void
+counterAdd(const struct counterInfo *counter, uint16_t byte_len, const struct pof_local_resource *lr)
+{
+    struct counterShard *shard = &lr->counterShards[counterRow * lr->counterRowSize + counter->id];
+
+    shardAdd(&shard->value, 1);
+    shardAdd(&shard->byte_value, byte_len);
+    POF_DEBUG_CPRINT_FL(1,GREEN,"The counter %d has increased by %u bytes", counter->id, byte_len);
+}
+#else // POF_SD2N
+static void
+counterAdd(const struct counterInfo *counter, const struct pof_local_resource *lr)
+{
+    struct counterShard *shard = &lr->counterShards[counterRow * lr->counterRowSize + counter->id];
+
+    shardAdd(&shard->value, 1);
+    POF_DEBUG_CPRINT_FL(1,GREEN,"The counter %d has increased", counter->id);
+}
+#endif // POF_SD2N
+
 /***********************************************************************
  * Increace the counter
  * Form:     uint32_t poflr_counter_increace(uint32_t counter_id, \)
@@ -282,25 +407,56 @@ poflr_counter_increace(uint32_t counter_id, struct pof_local_resource *lr)
     if(counter_id >= lr->counterNumMax){
         POF_ERROR_HANDLE_RETURN_NO_UPWARD(POFET_COUNTER_MOD_FAILED, POFCMFC_BAD_COUNTER_ID);
     }
+    /* The counters are created with the flow entries and the groups.
+     * The datapath does not modify the resource. */
     if(!(counter = poflr_get_counter_with_ID(counter_id, lr))){
-		poflr_counter_init(counter_id, lr);
+        POF_ERROR_HANDLE_RETURN_NO_UPWARD(POFET_COUNTER_MOD_FAILED, POFCMFC_COUNTER_UNEXIST);
     }
 
-    counter->value ++;
 #ifdef POF_SD2N
-    counter->byte_value += byte_len;
+    counterAdd(counter, byte_len, lr);
+#else // POF_SD2N
+    counterAdd(counter, lr);
 #endif // POF_SD2N
+    return POF_OK;
+}
 
+/***********************************************************************
+ * Increace the counter through the reference
+ * Form:     uint32_t poflr_counter_increace_ref(const struct poflr_ref *ref, \
+ *                      uint16_t byte_len, struct pof_local_resource *lr)
+ * Input:    reference to the counter
+ * Output:   NONE
+ * Return:   POF_OK or Error code
+ * Discribe: This function increase the counter which the reference is
+ *           bound to by one. If the reference is not bound, the counter
+ *           is looked up by the id of the reference.
+ ***********************************************************************/
 #ifdef POF_SD2N
-    POF_DEBUG_CPRINT_FL(1,GREEN,"The counter %d has increased, value = %" \
-            POF_PRINT_FORMAT_U64", byte_value = %"POF_PRINT_FORMAT_U64, \
-            counter_id, counter->value, counter->byte_value);
+uint32_t
+poflr_counter_increace_ref(const struct poflr_ref *ref, uint16_t byte_len, struct pof_local_resource *lr)
+{
+    struct counterInfo *counter;
+
+    if((counter = POFLR_REF_GET(ref)) == NULL){
+        return poflr_counter_increace(ref->id, byte_len, lr);
+    }
+    counterAdd(counter, byte_len, lr);
+    return POF_OK;
+}
 #else // POF_SD2N
-    POF_DEBUG_CPRINT_FL(1,GREEN,"The counter %d has increased, value = %"POF_PRINT_FORMAT_U64, \
-            counter_id, counter->value);
-#endif // POF_SD2N
+uint32_t
+poflr_counter_increace_ref(const struct poflr_ref *ref, struct pof_local_resource *lr)
+{
+    struct counterInfo *counter;
+
+    if((counter = POFLR_REF_GET(ref)) == NULL){
+        return poflr_counter_increace(ref->id, lr);
+    }
+    counterAdd(counter, lr);
     return POF_OK;
 }
+#endif // POF_SD2N
 
 /* Initialize counter resource. */
 uint32_t poflr_init_counter(struct pof_local_resource *lr){
@@ -309,6 +465,16 @@ uint32_t poflr_init_counter(struct pof_local_resource *lr){
     lr->counterMap = hmap_create(lr->counterNumMax);
     POF_MALLOC_ERROR_HANDLE_RETURN_NO_UPWARD(lr->counterMap);
 
+    /* Initialize counter shards. The rows are rounded up to whole cache
+     * lines, so that the workers never write the same line. */
+    lr->counterRowSize = (lr->counterNumMax * sizeof(struct counterShard) + POFLR_CACHE_LINE_SIZE - 1) \
+                         / POFLR_CACHE_LINE_SIZE * POFLR_CACHE_LINE_SIZE / sizeof(struct counterShard);
+    if(posix_memalign((void **)&lr->counterShards, POFLR_CACHE_LINE_SIZE, \
+            POFLR_COUNTER_ROW_NUM * lr->counterRowSize * sizeof(struct counterShard)) != 0){
+        POF_ERROR_HANDLE_RETURN_NO_UPWARD(POFET_SOFTWARE_FAILED, POF_ALLOCATE_RESOURCE_FAILURE);
+    }
+    memset(lr->counterShards, 0, POFLR_COUNTER_ROW_NUM * lr->counterRowSize * sizeof(struct counterShard));
+
 	return POF_OK;
 }
 
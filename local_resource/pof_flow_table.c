@@ -29,6 +29,8 @@
 #include "../include/pof_local_resource.h"
 #include "../include/pof_log_print.h"
 #include "../include/pof_memory.h"
+#include "../include/pof_epoch.h"
+#include "../include/pof_datapath.h"
 #include "string.h"
 #include "sys/socket.h"
 #include "netinet/in.h"
@@ -69,6 +71,7 @@ map_tableInsert(struct tableInfo *table, struct pof_local_resource *lr)
     hmap_nodeInsert(lr->tableIdMap, &table->idNode);
 //    hmap_nodeInsert(lr->tableTypeMap, &table->typeNode);
     lr->tableNum ++;
+    poflr_ref_object_add(&table->refs, table, POFLR_REF_TABLE, table->id, lr);
 }
 
 /* Malloc memory for table information. Should be FREE by map_tableDelete(). */
@@ -80,13 +83,61 @@ map_tableCreate()
     return table;
 }
 
+static void
+mmSubtableFree(void *ptr)
+{
+    struct mmSubtable *st = ptr;
+
+    hmap_destroy(st->entryMap);
+    FREE(st);
+}
+
+/* FREE the subtable list of the table and the subtables still in it. */
+static void
+mmSubtablesFree(struct tableInfo *table)
+{
+    struct mmSubtableList *list = table->subtables;
+    uint32_t i;
+
+    if(!list){
+        return;
+    }
+    for(i=0; i<list->num; i++){
+        mmSubtableFree(list->item[i].st);
+    }
+    FREE(list);
+}
+
+/* FREE the table and its lookup structures. */
+static void
+map_tableFree(void *ptr)
+{
+    struct tableInfo *table = ptr;
+
+    /* FREE the hash map of the entry in the table. */
+    hmap_destroy(table->entryMap);
+    if(table->type == POF_LPM_TABLE){
+        /* FREE the tree of LPM entry. */
+        tree_destroy(table->tree);
+    }else if(table->type == POF_EM_TABLE){
+        /* FREE the exact match table of EM entry. */
+        emtable_destroy(table->emTable);
+    }else if(table->type == POF_MM_TABLE){
+        /* FREE the empty subtables left by mmDelete(). */
+        mmSubtablesFree(table);
+    }
+    FREE(table);
+}
+
+/* The table is freed after the datapath has left it. */
 static void
 map_tableDelete(struct tableInfo *table, struct pof_local_resource *lr)
 {
     hmap_nodeDelete(lr->tableIdMap, &table->idNode);
 //    hmap_nodeDelete(lr->tableTypeMap, &table->typeNode);
     lr->tableNum --;
-    FREE(table);
+    poflr_ref_object_delete(&table->refs, POFLR_REF_TABLE, table->id, lr);
+    epoch_retire(table, map_tableFree);
 }
 
 struct tableInfo *
@@ -154,15 +205,44 @@ get1sCountInBytes(uint8_t *value, uint32_t n)
     return count;
 }
 
+/* Get the prefix length of the LPM mask. The prefix is counted from the
+ * first bit of the whole key, so the ones of the mask must be contiguous
+ * from there, across the match fields. */
+static uint32_t
+lpmPrefixLen(const uint8_t *mask, uint16_t len_b, uint32_t *bitNum)
+{
+    uint32_t i, n = POF_BITNUM_TO_BYTENUM_CEIL(len_b);
+
+    for(i=0; i<n && *(mask + i) == 0xFF; i++){
+        continue;
+    }
+    *bitNum = i * 8;
+    if(i == n){
+        *bitNum = len_b;
+        return POF_OK;
+    }
+
+    /* The rest of this byte must be a prefix, and all following bytes 0. */
+    if(*(mask + i) & ((uint8_t)~*(mask + i) >> 1)){
+        POF_ERROR_HANDLE_RETURN_NO_UPWARD(POFET_BAD_MATCH, POFBMC_BAD_MASK);
+    }
+    *bitNum += get1sCountInByte(*(mask + i));
+    for(i++; i<n; i++){
+        if(*(mask + i)){
+            POF_ERROR_HANDLE_RETURN_NO_UPWARD(POFET_BAD_MATCH, POFBMC_BAD_MASK);
+        }
+    }
+    return POF_OK;
+}
+
 static uint32_t
 lpmInsert(const struct entryInfo *entry, struct tableInfo *table)
 {
     uint32_t ret, bitNum;
-    uint8_t value[POF_MAX_FIELD_LENGTH_IN_BYTE * POF_MAX_MATCH_FIELD_NUM];
 
-    bitNum = get1sCountInBytes((uint8_t *)entry->mask, POF_BITNUM_TO_BYTENUM_CEIL(table->keyLen));
-    memcpy(value, entry->value, POF_BITNUM_TO_BYTENUM_CEIL(table->keyLen));
-    ret = tree_nodeInsert(table->tree, entry, value, bitNum);
+    ret = lpmPrefixLen(entry->mask, table->keyLen, &bitNum);
+    POF_CHECK_RETVALUE_RETURN_NO_UPWARD(ret);
+    ret = tree_nodeInsert(table->tree, entry, entry->value, bitNum);
     POF_CHECK_RETVALUE_RETURN_NO_UPWARD(ret);
 
     return POF_OK;
@@ -172,22 +252,181 @@ static uint32_t
 lpmDelete(struct entryInfo *entry, struct tableInfo *table)
 {
     uint32_t ret, bitNum;
-    uint8_t value[POF_MAX_FIELD_LENGTH_IN_BYTE * POF_MAX_MATCH_FIELD_NUM];
 
-    bitNum = get1sCountInBytes(entry->mask, POF_BITNUM_TO_BYTENUM_CEIL(table->keyLen));
-    memcpy(value, entry->value, POF_BITNUM_TO_BYTENUM_CEIL(table->keyLen));
-    ret = tree_nodeDelete(table->tree, value, bitNum);
+    ret = lpmPrefixLen(entry->mask, table->keyLen, &bitNum);
+    POF_CHECK_RETVALUE_RETURN_NO_UPWARD(ret);
+    ret = tree_nodeDelete(table->tree, entry, entry->value, bitNum);
     POF_CHECK_RETVALUE_RETURN_NO_UPWARD(ret);
 
     return POF_OK;
 }
 
 static struct entryInfo *
-lpmLookup(uint8_t *key, const struct tableInfo *table)
+lpmLookup(const uint8_t *key, const struct tableInfo *table)
 {
     return tree_nodeLookup(table->tree, key, table->keyLen);
 }
 
+static bool
+maskMatch(const uint8_t *mask, const uint8_t *value, const uint8_t *key, uint16_t len_b)
+{
+    uint32_t i;
+    for(i=0; i<POF_BITNUM_TO_BYTENUM_CEIL(len_b); i++){
+        if((*(mask + i) & *(key + i)) != \
+           (*(mask + i) & *(value + i))){
+            return FALSE;
+        }
+    }
+    return TRUE;
+}
+
+/* Hash the key masked by the subtable mask. */
+static hash_t
+mmMaskedHash(const uint8_t *key, const uint8_t *mask, uint16_t len_b)
+{
+    uint8_t masked[POF_MAX_FIELD_LENGTH_IN_BYTE * POF_MAX_MATCH_FIELD_NUM];
+    uint32_t i;
+    for(i=0; i<POF_BITNUM_TO_BYTENUM_CEIL(len_b); i++){
+        masked[i] = key[i] & mask[i];
+    }
+    return entryHashByValue(masked, len_b);
+}
+
+/* Publish a new subtable list of the table, with the subtable put at its
+ * place by its max priority, or without it if remove. The old list is
+ * freed after the lookups have left it. */
+static uint32_t
+mmSubtableListUpdate(struct mmSubtable *st, struct tableInfo *table, uint8_t remove)
+{
+    struct mmSubtableList *old = table->subtables, *list = NULL;
+    uint32_t oldNum = old ? old->num : 0, num = 0, i;
+    uint8_t placed = remove;
+
+    for(i=0; i<oldNum; i++){
+        if(old->item[i].st != st){
+            num ++;
+        }
+    }
+    num += !remove;
+
+    if(num){
+        POF_MALLOC_SAFE_RETURN_SIZE(list, 1, POF_ERROR, \
+                sizeof(struct mmSubtableList) + num * sizeof(struct mmSubtableItem));
+        for(i=0; i<oldNum; i++){
+            if(old->item[i].st == st){
+                continue;
+            }
+            if(!placed && old->item[i].maxPriority < st->maxPriority){
+                list->item[list->num].st = st;
+                list->item[list->num++].maxPriority = st->maxPriority;
+                placed = TRUE;
+            }
+            list->item[list->num++] = old->item[i];
+        }
+        if(!placed){
+            list->item[list->num].st = st;
+            list->item[list->num++].maxPriority = st->maxPriority;
+        }
+    }
+
+    __atomic_store_n(&table->subtables, list, __ATOMIC_RELEASE);
+    if(old){
+        epoch_free(old);
+    }
+    return POF_OK;
+}
+
+static struct mmSubtable *
+mmSubtableGet(const uint8_t *mask, const struct tableInfo *table)
+{
+    const struct mmSubtableList *list = table->subtables;
+    uint32_t i;
+
+    for(i=0; list && i<list->num; i++){
+        if(memcmp(list->item[i].st->mask, mask, POF_BITNUM_TO_BYTENUM_CEIL(table->keyLen)) == 0){
+            return list->item[i].st;
+        }
+    }
+    return NULL;
+}
+
+/* Insert the MM entry into the subtable with the same mask. Create the
+ * subtable if there is no one. */
+static uint32_t
+mmInsert(struct entryInfo *entry, struct tableInfo *table)
+{
+    struct mmSubtable *st;
+    uint16_t maxPriority;
+
+    if(!(st = mmSubtableGet(entry->mask, table))){
+        POF_MALLOC_SAFE_RETURN(st, 1, POF_ERROR);
+        if(!(st->entryMap = hmap_create(table->size))){
+            FREE(st);
+            return POF_ERROR;
+        }
+        memcpy(st->mask, entry->mask, POF_BITNUM_TO_BYTENUM_CEIL(table->keyLen));
+        st->maxPriority = entry->priority;
+        if(mmSubtableListUpdate(st, table, FALSE) != POF_OK){
+            mmSubtableFree(st);
+            return POF_ERROR;
+        }
+    }else if(entry->priority > st->maxPriority){
+        maxPriority = st->maxPriority;
+        st->maxPriority = entry->priority;
+        if(mmSubtableListUpdate(st, table, FALSE) != POF_OK){
+            st->maxPriority = maxPriority;
+            return POF_ERROR;
+        }
+    }
+
+    entry->maskNode.hash = mmMaskedHash(entry->value, st->mask, table->keyLen);
+    entry->subtable = st;
+    hmap_nodeInsert(st->entryMap, &entry->maskNode);
+    st->entryNum ++;
+    return POF_OK;
+}
+
+/* Remove the MM entry from its subtable. The empty subtable is freed after
+ * the lookups have left it, and the max priority of the subtable is
+ * recalculated if needed. If the new list can not be allocated, the list
+ * keeps the old max priority, which still bounds the entries, or the
+ * empty subtable until the table is freed. */
+static void
+mmDelete(struct entryInfo *entry, struct tableInfo *table)
+{
+    struct mmSubtable *st = entry->subtable;
+    struct entryInfo *tmp;
+    struct hnode *node;
+    uint16_t maxPriority = 0;
+
+    if(!st){
+        return;
+    }
+    hmap_nodeDelete(st->entryMap, &entry->maskNode);
+    entry->subtable = NULL;
+    st->entryNum --;
+
+    if(st->entryNum == 0){
+        if(mmSubtableListUpdate(st, table, TRUE) == POF_OK){
+            epoch_retire(st, mmSubtableFree);
+        }
+        return;
+    }
+
+    if(entry->priority == st->maxPriority){
+        for(node=hmap_nodeFirst(st->entryMap); node; node=hmap_nodeNext(st->entryMap, node)){
+            tmp = POF_STRUCT_FROM_MEMBER(tmp, maskNode, node);
+            if(tmp->priority > maxPriority){
+                maxPriority = tmp->priority;
+            }
+        }
+        if(maxPriority != st->maxPriority){
+            st->maxPriority = maxPriority;
+            mmSubtableListUpdate(st, table, FALSE);
+        }
+    }
+}
+
 /* Fill the struct entryInfo *entry. 
  * Calculate the hash value.
  * Assemble the value and mask.*/
@@ -208,6 +447,9 @@ entryFill(const struct pof_flow_entry *pofEntry,    \
     entry->instruction_num = pofEntry->instruction_num;
     memcpy(entry->instruction, pofEntry->instruction, \
             POF_MAX_INSTRUCTION_NUM * sizeof(struct pof_instruction));
+    /* Decode the instructions once, for the datapath. */
+    entry->prog = (struct pofdp_program *)(entry + 1);
+    pofdp_program_build(entry->prog, entry->instruction, entry->instruction_num);
 #endif // POF_SHT_VXLAN
     entry->match_field_num = pofEntry->match_field_num;
     memcpy(entry->match, pofEntry->match, \
@@ -229,7 +471,7 @@ entryFill(const struct pof_flow_entry *pofEntry,    \
             ret = valueMaskAssemble(pofEntry->match, pofEntry->match_field_num, \
                     entry->value, NULL, table->keyLen) != POF_OK;
             POF_CHECK_RETVALUE_RETURN_NO_UPWARD(ret);
-            entry->node.hash = entryHashByValue(entry->value, table->keyLen);
+            entry->node.hash = entryHashByID(pofEntry->index);
             break;
         case POF_LINEAR_TABLE:
             entry->node.hash = entryHashByID(pofEntry->index);
@@ -240,40 +482,104 @@ entryFill(const struct pof_flow_entry *pofEntry,    \
     return ret;
 }
 
-/* Malloc memory for entryInfo. Free at entryDelete. */
+/* Bind the references of the entry. */
+static void
+entryBind(struct entryInfo *entry, struct pof_local_resource *lr)
+{
+    if(entry->counter_id){
+        poflr_ref_bind(&entry->counterRef, POFLR_REF_COUNTER, entry->counter_id, lr);
+    }
+#ifdef POF_SHT_VXLAN
+    poflr_ref_bind(&entry->insBlockRef, POFLR_REF_INS_BLOCK, entry->insBlockID, lr);
+#else // POF_SHT_VXLAN
+    pofdp_program_bind(entry->prog, lr);
+#endif // POF_SHT_VXLAN
+}
+
+/* FREE the entry with the native code of its program, and with its
+ * references. */
+static void
+entryFree(void *ptr)
+{
+    struct entryInfo *entry = ptr;
+    poflr_ref_unbind(&entry->counterRef);
+#ifdef POF_SHT_VXLAN
+    poflr_ref_unbind(&entry->insBlockRef);
+#else // POF_SHT_VXLAN
+    pofdp_program_unbind(entry->prog);
+    pofdp_program_release(entry->prog);
+#endif // POF_SHT_VXLAN
+    FREE(ptr);
+}
+
+/* Malloc memory for entryInfo. Free at entryDelete through the epoch. */
 /* Transfer the struct pof_flow_entry *pofEntry to the struct entryInfo *entry.
- * Insert the entry into the table.*/
-static uint32_t
-entryInsert(const struct pof_flow_entry *pofEntry, struct tableInfo *table)
+ * Bind its references, and insert the entry into the table, visible from
+ * the version. Return the entry, or NULL if fails. */
+static struct entryInfo *
+entryInsertAt(const struct pof_flow_entry *pofEntry, struct tableInfo *table, \
+              uint32_t version, struct pof_local_resource *lr)
 {
-    uint32_t ret;
     /* Create entry node. */
     struct entryInfo *entry;
 #ifdef POF_SHT_VXLAN
     uint16_t size;
     size = POF_BITNUM_TO_BYTENUM_CEIL(pofEntry->parameter_length);
     size += sizeof(struct entryInfo);
-    POF_MALLOC_SAFE_RETURN_SIZE(entry, 1, POF_ERROR, size);
+    POF_MALLOC_SAFE_RETURN_SIZE(entry, 1, NULL, size);
 #else // POF_SHT_VXLAN
-    POF_MALLOC_SAFE_RETURN(entry, 1, POF_ERROR);
+    uint32_t size;
+    size = sizeof(struct entryInfo);
+    size += pofdp_program_size(pofEntry->instruction, pofEntry->instruction_num);
+    POF_MALLOC_SAFE_RETURN_SIZE(entry, 1, NULL, size);
 #endif // POF_SHT_VXLAN
 
     /* Fill the entry's information. Including the hash value.
      * Assemble the value and mask of the entry. */
     if(entryFill(pofEntry, entry, table) != POF_OK){
         POF_ERROR_HANDLE_NO_RETURN_NO_UPWARD(POFET_TABLE_MOD_FAILED, POFTMFC_UNKNOWN);
-        FREE(entry);
-        return POF_ERROR;
+        entryFree(entry);
+        return NULL;
     }
+    entry->addVersion = version;
+    entry->removeVersion = POFLR_VERSION_MAX;
+    entryBind(entry, lr);
 
     hmap_nodeInsert(table->entryMap, &entry->node);
     table->entryNum ++;
 
     if(table->type == POF_LPM_TABLE){
-        lpmInsert(entry, table);
+        if(lpmInsert(entry, table) != POF_OK){
+            hmap_nodeDelete(table->entryMap, &entry->node);
+            table->entryNum --;
+            epoch_retire(entry, entryFree);
+            return NULL;
+        }
+    }else if(table->type == POF_MM_TABLE){
+        if(mmInsert(entry, table) != POF_OK){
+            hmap_nodeDelete(table->entryMap, &entry->node);
+            table->entryNum --;
+            epoch_retire(entry, entryFree);
+            return NULL;
+        }
+    }else if(table->type == POF_EM_TABLE){
+        if(emtable_insert(table->emTable, entry->value, entry) != POF_OK){
+            hmap_nodeDelete(table->entryMap, &entry->node);
+            table->entryNum --;
+            epoch_retire(entry, entryFree);
+            return NULL;
+        }
     }
 
-    return POF_OK;
+    return entry;
+}
+
+/* Insert the entry into the table, visible at once. */
+static uint32_t
+entryInsert(const struct pof_flow_entry *pofEntry, struct tableInfo *table, \
+            struct pof_local_resource *lr)
+{
+    return entryInsertAt(pofEntry, table, 0, lr) ? POF_OK : POF_ERROR;
 }
 
 static void
@@ -284,70 +590,150 @@ entryDelete(struct entryInfo *entry, struct tableInfo *table)
 
     if(table->type == POF_LPM_TABLE){
         lpmDelete(entry, table);
+    }else if(table->type == POF_MM_TABLE){
+        mmDelete(entry, table);
+    }else if(table->type == POF_EM_TABLE){
+        emtable_delete(table->emTable, entry->value, entry);
     }
 
-    FREE(entry);
+    /* The datapath may still be on the entry. */
+    epoch_retire(entry, entryFree);
 }
 
+/* Build the key extraction steps of the table from its match fields.
+ * Fields next to each other both in the source and in the key are merged
+ * into one step. */
 static void
-keyAssemble(uint8_t *key, const uint8_t *packet, const uint8_t *metadata, \
-        uint8_t match_field_num, const struct pof_match *match)
+keyOpsBuild(struct tableInfo *table)
 {
+    const struct pof_match *match;
+    struct keyOp *op = NULL;
     uint16_t i, offset_b = 0;
-    struct pof_match *matchTmp;
-    for(i=0; i<match_field_num; i++){
-        uint8_t tmp[POF_MAX_FIELD_LENGTH_IN_BYTE] = {0};
-        matchTmp = (struct pof_match *)(match + i);
-        if(matchTmp->field_id == 0xFFFF){
-            pofbf_copy_bit(metadata, tmp, matchTmp->offset, matchTmp->len);
+    uint8_t fromMetadata;
+
+    table->keyOpNum = 0;
+    for(i=0; i<table->match_field_num; i++){
+        match = &table->match[i];
+        fromMetadata = (match->field_id == 0xFFFF);
+        if(op && op->fromMetadata == fromMetadata && \
+                op->srcOffset_b + op->len_b == match->offset){
+            op->len_b += match->len;
         }else{
-            pofbf_copy_bit(packet, tmp, matchTmp->offset, matchTmp->len);
+            op = &table->keyOps[table->keyOpNum++];
+            op->fromMetadata = fromMetadata;
+            op->srcOffset_b = match->offset;
+            op->dstOffset_b = offset_b;
+            op->len_b = match->len;
+        }
+        offset_b += match->len;
+    }
+
+    for(i=0; i<table->keyOpNum; i++){
+        op = &table->keyOps[i];
+        if(op->srcOffset_b % 8 == 0 && op->dstOffset_b % 8 == 0 && op->len_b % 8 == 0){
+            op->type = KEY_OP_COPY;
+        }else{
+            op->type = KEY_OP_SHIFT;
         }
-        pofbf_cover_bit(key, tmp, offset_b, matchTmp->len);
-        offset_b += matchTmp->len;
     }
 }
 
-/* Entry lookup for Linear. */
-struct entryInfo *
-poflr_entry_lookup_Linear(uint32_t index, const struct tableInfo *table)
+/* Run the key extraction steps of the table. The key should have
+ * POF_BITNUM_TO_BYTENUM_CEIL(table->keyLen) bytes. */
+static void
+keyExtract(uint8_t *key, const uint8_t *packet, const uint8_t *metadata, \
+           const struct tableInfo *table)
 {
-    struct entryInfo *entry, *ptr;
-    return HMAP_STRUCT_GET(entry, node, \
-            entryHashByID(index), table->entryMap, ptr);
+    const struct keyOp *op;
+    const uint8_t *src;
+    uint8_t i;
+
+    /* The bits after keyLen in the last byte should be 0. */
+    if(table->keyLen){
+        *(key + POF_BITNUM_TO_BYTENUM_CEIL(table->keyLen) - 1) = 0;
+    }
+
+    for(i=0; i<table->keyOpNum; i++){
+        op = &table->keyOps[i];
+        src = op->fromMetadata ? metadata : packet;
+        if(op->type == KEY_OP_COPY){
+            memcpy(key + op->dstOffset_b / 8, src + op->srcOffset_b / 8, op->len_b / 8);
+        }else{
+            pofbf_move_bit(key, op->dstOffset_b, src, op->srcOffset_b, op->len_b);
+        }
+    }
 }
 
-static bool
-maskMatch(const uint8_t *mask, const uint8_t *value, const uint8_t *key, uint16_t len_b)
+/* Get the entry with the index visible in the version. */
+static struct entryInfo *
+entryGetAt(uint32_t index, const struct tableInfo *table, uint32_t version)
 {
-    uint32_t i;
-    for(i=0; i<POF_BITNUM_TO_BYTENUM_CEIL(len_b); i++){
-        if((*(mask + i) & *(key + i)) != \
-           (*(mask + i) & *(value + i))){
-            return FALSE;
+    struct entryInfo *entry;
+    struct hnode *node;
+    hash_t hash = entryHashByID(index);
+
+    for(node=hmap_nodeGetWithHash(table->entryMap, hash); node; node=node->next){
+        if(node->hash != hash){
+            continue;
+        }
+        entry = POF_STRUCT_FROM_MEMBER(entry, node, node);
+        if(entry->index == index && POFLR_ENTRY_VISIBLE(entry, version)){
+            return entry;
         }
     }
-    return TRUE;
+    return NULL;
+}
+
+/* Entry lookup for Linear. */
+struct entryInfo *
+poflr_entry_lookup_Linear(uint32_t index, const struct tableInfo *table)
+{
+    return entryGetAt(index, table, __atomic_load_n(table->version, __ATOMIC_ACQUIRE));
 }
 
-/* Entry lookup for MM. */
+
+/***********************************************************************
+ * Entry lookup for MM.
+ * Form:     static struct entryInfo *entryLookup_MM(const void *key, \
+ *                                   const struct tableInfo *table)
+ * Input:    key, table
+ * Output:   NONE
+ * Return:   The matched entry with the highest priority, or NULL.
+ * Discribe: Tuple space search. Every subtable holds the entries with one
+ *           mask, so the key masked by the subtable mask is looked up by
+ *           hash. The subtables are sorted by their highest priority, so
+ *           the search stops once no subtable left can beat the match.
+ *           The entries not visible in the table version are skipped.
+ ***********************************************************************/
 static struct entryInfo *
 entryLookup_MM(const void *key, const struct tableInfo *table)
 {
-    struct entryInfo *entry, *next, *ret = NULL;
+    struct entryInfo *entry, *ret = NULL;
+    const struct mmSubtableList *list;
+    const struct mmSubtable *st;
+    struct hnode *node;
+    hash_t hash;
+    uint32_t version = __atomic_load_n(table->version, __ATOMIC_ACQUIRE), i;
+
+    list = __atomic_load_n(&table->subtables, __ATOMIC_ACQUIRE);
+    for(i=0; list && i<list->num; i++){
+        if(ret && ret->priority >= list->item[i].maxPriority){
+            break;
+        }
+        st = list->item[i].st;
 
-    /* Traverse all entries to lookup. */
-    HMAP_NODES_IN_STRUCT_TRAVERSE(entry, next, node, table->entryMap){
-        /* Match or not. */
-        if(maskMatch(entry->mask, entry->value, (uint8_t *)key, table->keyLen)){
-            if(!ret){
-                /* First match. */
+        hash = mmMaskedHash((uint8_t *)key, st->mask, table->keyLen);
+        for(node=hmap_nodeGetWithHash(st->entryMap, hash); node; node=node->next){
+            if(node->hash != hash){
+                continue;
+            }
+            entry = POF_STRUCT_FROM_MEMBER(entry, maskNode, node);
+            if(!maskMatch(st->mask, entry->value, (uint8_t *)key, table->keyLen) || \
+                    !POFLR_ENTRY_VISIBLE(entry, version)){
+                continue;
+            }
+            if(!ret || ret->priority < entry->priority){
                 ret = entry;
-            }else{
-                /* Multiple matches. Competition. */
-                if(ret->priority < entry->priority){
-                    ret = entry;
-                }
             }
         }
     }
@@ -358,10 +744,7 @@ entryLookup_MM(const void *key, const struct tableInfo *table)
 static struct entryInfo *
 entryLookup_EM(const void *key, const struct tableInfo *table)
 {
-    struct entryInfo *entry, *ptr;
-    return HMAP_STRUCT_GET(entry, node,                                         \
-            entryHashByValue(key, table->keyLen),   \
-            table->entryMap, ptr);
+    return emtable_lookup(table->emTable, (const uint8_t *)key);
 }
 
 /* Entry lookup for LPM. */
@@ -370,7 +753,7 @@ entryLookup_LPM(const void *key, const struct tableInfo *table)
 {
 #ifdef LPM_TREE
     /* Find the entry using LPM tree. */
-    return lpmLookup((uint8_t *)key, table);
+    return lpmLookup((const uint8_t *)key, table);
 #else // LPM_TREE
     struct entryInfo *entry, *next, *ret = NULL;
     uint32_t bitNum = 0, tmp;
@@ -401,16 +784,51 @@ entryLookup_Linear(const void *key, const struct tableInfo *table)
 }
 */
 
-/* Entry lookup for EM, MM, LPM type. */
-struct entryInfo *
-poflr_entry_lookup(const uint8_t *packet, const uint8_t *metadata, const struct tableInfo *table)
+/* Extract the find key of the table from the packet and the metadata.
+ * Return the key length in byte. */
+uint16_t
+poflr_entry_key_extract(uint8_t *key, const uint8_t *packet, const uint8_t *metadata, \
+                        const struct tableInfo *table)
 {
-    struct entryInfo *entry;
-    uint8_t *key;
-    POF_MALLOC_SAFE_RETURN(key, POF_BITNUM_TO_BYTENUM_CEIL(table->keyLen), NULL);
+    keyExtract(key, packet, metadata, table);
+    return POF_BITNUM_TO_BYTENUM_CEIL(table->keyLen);
+}
 
-    /* Assemble the find key. */
-    keyAssemble(key, packet, metadata, table->match_field_num, table->match);
+/* Entry lookup for EM and LPM type, skipping the entries not visible in
+ * the version. While a bundle is being committed, the hash or the tree may
+ * hold the entry of the next version in place of the current one, and the
+ * other way round just after the commit. Then all entries are checked. */
+static struct entryInfo *
+entryLookupAt(const uint8_t *key, const struct tableInfo *table, uint32_t version)
+{
+    struct entryInfo *entry, *next, *ret = NULL;
+    uint32_t bitNum = 0, tmp;
+
+    HMAP_NODES_IN_STRUCT_TRAVERSE(entry, next, node, table->entryMap){
+        if(!POFLR_ENTRY_VISIBLE(entry, version)){
+            continue;
+        }
+        if(table->type == POF_EM_TABLE){
+            if(!memcmp(entry->value, key, POF_BITNUM_TO_BYTENUM_CEIL(table->keyLen))){
+                return entry;
+            }
+        }else if(maskMatch(entry->mask, entry->value, key, table->keyLen)){
+            tmp = get1sCountInBytes(entry->mask, POF_BITNUM_TO_BYTENUM_CEIL(table->keyLen));
+            if(!ret || tmp > bitNum){
+                bitNum = tmp;
+                ret = entry;
+            }
+        }
+    }
+    return ret;
+}
+
+/* Entry lookup for EM, MM, LPM type with an extracted key. */
+struct entryInfo *
+poflr_entry_lookup_with_key(const uint8_t *key, const struct tableInfo *table)
+{
+    struct entryInfo *entry = NULL;
+    uint32_t version;
 
     /* Find the matched entry using different ways according to the table type. */
 #define TABLE_TYPE(TYPE) \
@@ -418,10 +836,24 @@ poflr_entry_lookup(const uint8_t *packet, const uint8_t *metadata, const struct
     TABLE_TYPES
 #undef TABLE_TYPE
 
-    FREE(key);
+    version = __atomic_load_n(table->version, __ATOMIC_ACQUIRE);
+    if(entry && !POFLR_ENTRY_VISIBLE(entry, version)){
+        entry = entryLookupAt(key, table, version);
+    }
     return entry;
 }
 
+/* Entry lookup for EM, MM, LPM type. */
+struct entryInfo *
+poflr_entry_lookup(const uint8_t *packet, const uint8_t *metadata, const struct tableInfo *table)
+{
+    uint8_t key[POF_MAX_FIELD_LENGTH_IN_BYTE * POF_MAX_MATCH_FIELD_NUM];
+
+    /* Extract the find key. */
+    keyExtract(key, packet, metadata, table);
+    return poflr_entry_lookup_with_key(key, table);
+}
+
 /* Traverse to find the entry with the index. */
 struct entryInfo *
 poflr_entry_get_with_index(uint32_t index, const struct tableInfo *table)
@@ -478,7 +910,7 @@ poflr_create_flow_table(int controller,          \
 
     /* Malloc memory for table. */
     table = map_tableCreate();
-    POF_MALLOC_ERROR_HANDLE_RETURN_UPWARD(table, g_upward_xid++,controller);
+    POF_MALLOC_ERROR_HANDLE_RETURN_UPWARD(table, __sync_fetch_and_add(&g_upward_xid, 1),controller);
     /* Fill the table information. */
     table->id = ID;
     table->idNode.hash = map_tableHashByID(ID);
@@ -491,8 +923,12 @@ poflr_create_flow_table(int controller,          \
     table->keyLen = key_len;
     table->match_field_num = match_field_num;
     memcpy(table->match, match, match_field_num * sizeof(pof_match));
+    keyOpsBuild(table);
+    table->version = &lr->version;
     if(table->type == POF_LPM_TABLE){
         table->tree = tree_create();
+    }else if(table->type == POF_EM_TABLE){
+        table->emTable = emtable_create(POF_BITNUM_TO_BYTENUM_CEIL(key_len));
     }
     
     /* Insert the table to the local resource. */
@@ -530,13 +966,6 @@ poflr_delete_flow_table(int controller, uint8_t id, uint8_t type, struct pof_loc
         POF_ERROR_HANDLE_RETURN_UPWARD(POFET_TABLE_MOD_FAILED, POFTMFC_TABLE_UNEMPTY, g_recv_xid,controller);
     }
 
-    /* FREE the hash map of the entry in the table. */
-    hmap_destroy(table->entryMap);
-    if(table->type == POF_LPM_TABLE){
-        /* FREE the tree of LPM entry. */
-        tree_destroy(table->tree);
-    }
-
     /* Delete the table from local resource and FREE the memory of table. */
     map_tableDelete(table, lr);
 
@@ -587,7 +1016,7 @@ uint32_t poflr_add_flow_entry(pof_flow_entry *flow_ptr, struct pof_local_resourc
     }
 
     /* Create the entry, and insert to the table. */
-    if(entryInsert(flow_ptr, table) != POF_OK){
+    if(entryInsert(flow_ptr, table, lr) != POF_OK){
         POF_ERROR_HANDLE_RETURN_UPWARD(POFET_FLOW_MOD_FAILED, POFFMFC_UNKNOWN, g_recv_xid,controller);
     }
 
@@ -654,11 +1083,12 @@ uint32_t poflr_modify_flow_entry(pof_flow_entry *flow_ptr, struct pof_local_reso
         POF_CHECK_RETVALUE_RETURN_NO_UPWARD(ret);
     }
 
-    /* Delete the original entry, then insert a new one. */
-    entryDelete(entry, table);
-    if(entryInsert(flow_ptr, table) != POF_OK){
+    /* Insert the new entry before the original one is deleted, so the
+     * datapath always finds one of them. */
+    if(entryInsert(flow_ptr, table, lr) != POF_OK){
         POF_ERROR_HANDLE_RETURN_UPWARD(POFET_FLOW_MOD_FAILED, POFFMFC_UNKNOWN, g_recv_xid,controller);
     }
+    entryDelete(entry, table);
 
     POF_DEBUG_CPRINT_FL(1,GREEN,"Modify flow entry SUC!");
     return POF_OK;
@@ -722,6 +1152,379 @@ uint32_t poflr_delete_flow_entry(pof_flow_entry *flow_ptr, struct pof_local_reso
     return POF_OK;
 }
 
+/* Flow mods staged in a bundle. They are kept as received, and are only
+ * checked and applied to the tables when the bundle is committed. */
+struct bundleMsg{
+    struct bundleMsg *next;
+    pof_flow_entry flow[0];
+};
+
+struct flowBundle{
+    uint32_t id;
+    int controller;             /* -1 if the bundle is not open. */
+    uint8_t closed;
+    uint32_t msgNum;
+    struct bundleMsg *head;
+    struct bundleMsg *tail;
+};
+
+/* One entry added or removed by a committing bundle. */
+struct bundleStep{
+    struct entryInfo *entry;
+    struct tableInfo *table;
+    uint8_t counterDelete;      /* Removed by POFFC_DELETE. */
+    uint8_t counterCreate;      /* Its counter was created for it. */
+};
+
+/* The flow mods of a committing bundle staged in one local resource. */
+struct bundleSlot{
+    struct pof_local_resource *lr;
+    uint32_t version;
+    struct bundleStep *step;
+    uint32_t stepNum;
+};
+
+static struct flowBundle poflr_bundles[POFLR_BUNDLE_NUM] = {
+    [0 ... POFLR_BUNDLE_NUM-1] = {.controller = -1},
+};
+
+static struct flowBundle *
+bundleGet(uint32_t bundle_id, int controller)
+{
+    uint32_t i;
+    for(i=0; i<POFLR_BUNDLE_NUM; i++){
+        if(poflr_bundles[i].controller == controller && poflr_bundles[i].id == bundle_id){
+            return &poflr_bundles[i];
+        }
+    }
+    return NULL;
+}
+
+/* Get the table of the flow mod, and check the index. */
+static uint32_t
+bundleTableGet(const pof_flow_entry *flow_ptr, struct pof_local_resource *lr, \
+               int controller, struct tableInfo **table_ptr)
+{
+    uint8_t ID;
+
+    if(flow_ptr->table_type >= POF_MAX_TABLE_TYPE){
+        POF_ERROR_HANDLE_RETURN_UPWARD(POFET_FLOW_MOD_FAILED, POFFMFC_BAD_TABLE_TYPE, g_recv_xid,controller);
+    }
+    if(flow_ptr->table_id >= lr->tableNumMaxEachType[flow_ptr->table_type]){
+        POF_ERROR_HANDLE_RETURN_UPWARD(POFET_FLOW_MOD_FAILED, POFFMFC_BAD_TABLE_ID, g_recv_xid,controller);
+    }
+    poflr_table_id_to_ID(flow_ptr->table_type, flow_ptr->table_id, &ID, lr);
+    if(!(*table_ptr = poflr_get_table_with_ID(ID, lr))){
+        POF_ERROR_HANDLE_RETURN_UPWARD(POFET_FLOW_MOD_FAILED, POFFMFC_BAD_TABLE_ID, g_recv_xid,controller);
+    }
+    if(flow_ptr->index >= (*table_ptr)->size){
+        POF_ERROR_HANDLE_RETURN_UPWARD(POFET_FLOW_MOD_FAILED, POFFMFC_BAD_ENTRY_ID, g_recv_xid,controller);
+    }
+    return POF_OK;
+}
+
+/* Apply one flow mod of the bundle in the version. The entries added are
+ * not visible yet, and the entries removed are still visible. Every entry
+ * touched is recorded in the steps once. */
+static uint32_t
+bundleStage(const pof_flow_entry *flow_ptr, uint32_t version, struct pof_local_resource *lr, \
+            int controller, struct bundleStep *step, uint32_t *stepNum)
+{
+    struct tableInfo *table;
+    struct entryInfo *entry = NULL, *old = NULL;
+    uint8_t counterCreate = FALSE;
+    uint32_t ret;
+
+    ret = bundleTableGet(flow_ptr, lr, controller, &table);
+    POF_CHECK_RETVALUE_RETURN_NO_UPWARD(ret);
+
+    switch(flow_ptr->command){
+        case POFFC_ADD:
+            if(entryGetAt(flow_ptr->index, table, version)){
+                POF_ERROR_HANDLE_RETURN_UPWARD(POFET_FLOW_MOD_FAILED, POFFMFC_ENTRY_EXIST, g_recv_xid,controller);
+            }
+            break;
+        case POFFC_MODIFY:
+        case POFFC_DELETE:
+            if(!(old = entryGetAt(flow_ptr->index, table, version))){
+                POF_ERROR_HANDLE_RETURN_UPWARD(POFET_FLOW_MOD_FAILED, POFFMFC_ENTRY_UNEXIST, g_recv_xid,controller);
+            }
+            break;
+        default:
+            POF_ERROR_HANDLE_RETURN_UPWARD(POFET_FLOW_MOD_FAILED, POFFMFC_BAD_COMMAND, g_recv_xid,controller);
+    }
+
+    if(flow_ptr->command != POFFC_DELETE){
+        counterCreate = flow_ptr->counter_id && !poflr_get_counter_with_ID(flow_ptr->counter_id, lr);
+        ret = poflr_counter_init(flow_ptr->counter_id, lr);
+        POF_CHECK_RETVALUE_RETURN_NO_UPWARD(ret);
+        if(!(entry = entryInsertAt(flow_ptr, table, version, lr))){
+            if(counterCreate){
+                poflr_counter_delete(flow_ptr->counter_id, lr);
+            }
+            POF_ERROR_HANDLE_RETURN_UPWARD(POFET_FLOW_MOD_FAILED, POFFMFC_UNKNOWN, g_recv_xid,controller);
+        }
+    }
+
+    /* An entry added by this bundle is already in the steps. */
+    if(old){
+        old->removeVersion = version;
+        if(old->addVersion != version){
+            step[*stepNum].entry = old;
+            step[*stepNum].table = table;
+            step[*stepNum].counterDelete = (flow_ptr->command == POFFC_DELETE);
+            step[*stepNum].counterCreate = FALSE;
+            (*stepNum) ++;
+        }
+    }
+    if(entry){
+        step[*stepNum].entry = entry;
+        step[*stepNum].table = table;
+        step[*stepNum].counterDelete = FALSE;
+        step[*stepNum].counterCreate = counterCreate;
+        (*stepNum) ++;
+    }
+    return POF_OK;
+}
+
+/* Undo the steps of the version in reverse order, with the counters
+ * created for them. */
+static void
+bundleRollback(uint32_t version, struct bundleStep *step, uint32_t stepNum, \
+               struct pof_local_resource *lr)
+{
+    struct entryInfo *entry;
+    uint32_t counter_id;
+
+    while(stepNum--){
+        entry = step[stepNum].entry;
+        if(entry->addVersion == version){
+            counter_id = entry->counter_id;
+            entryDelete(entry, step[stepNum].table);
+            if(step[stepNum].counterCreate){
+                poflr_counter_delete(counter_id, lr);
+            }
+            continue;
+        }
+        entry->removeVersion = POFLR_VERSION_MAX;
+        /* The tree may hold the entry deleted above in its place. */
+        if(step[stepNum].table->type == POF_LPM_TABLE){
+            lpmInsert(entry, step[stepNum].table);
+        }
+    }
+}
+
+/***********************************************************************
+ * Open a bundle.
+ * Form:     uint32_t poflr_bundle_open(uint32_t bundle_id, int controller)
+ * Input:    bundle id, controller
+ * Output:   NONE
+ * Return:   POF_OK or ERROR code
+ * Discribe: This function opens an empty bundle of the controller. The
+ *           flow mods added to the bundle are applied only when the
+ *           bundle is committed.
+ ***********************************************************************/
+uint32_t poflr_bundle_open(uint32_t bundle_id, int controller){
+    struct flowBundle *bundle;
+
+    if(bundleGet(bundle_id, controller)){
+        POF_ERROR_HANDLE_RETURN_UPWARD(POFET_BUNDLE_FAILED, POFBFC_BUNDLE_EXIST, g_recv_xid,controller);
+    }
+    for(bundle=poflr_bundles; bundle->controller != -1; bundle++){
+        if(bundle == poflr_bundles + POFLR_BUNDLE_NUM - 1){
+            POF_ERROR_HANDLE_RETURN_UPWARD(POFET_BUNDLE_FAILED, POFBFC_OUT_OF_BUNDLES, g_recv_xid,controller);
+        }
+    }
+
+    memset(bundle, 0, sizeof *bundle);
+    bundle->id = bundle_id;
+    bundle->controller = controller;
+    return POF_OK;
+}
+
+/* Close a bundle. No more flow mods can be added to it. */
+uint32_t poflr_bundle_close(uint32_t bundle_id, int controller){
+    struct flowBundle *bundle;
+
+    if(!(bundle = bundleGet(bundle_id, controller))){
+        POF_ERROR_HANDLE_RETURN_UPWARD(POFET_BUNDLE_FAILED, POFBFC_BAD_ID, g_recv_xid,controller);
+    }
+    if(bundle->closed){
+        POF_ERROR_HANDLE_RETURN_UPWARD(POFET_BUNDLE_FAILED, POFBFC_BUNDLE_CLOSED, g_recv_xid,controller);
+    }
+    bundle->closed = TRUE;
+    return POF_OK;
+}
+
+/***********************************************************************
+ * Add a flow mod to a bundle.
+ * Form:     uint32_t poflr_bundle_add(uint32_t bundle_id, \
+ *                                     const pof_flow_entry *flow_ptr, \
+ *                                     uint16_t len, int controller)
+ * Input:    bundle id, flow entry in host byte order, length of the flow
+ *           entry, controller
+ * Output:   NONE
+ * Return:   POF_OK or ERROR code
+ * Discribe: This function copies the flow mod to the end of the bundle.
+ *           It is checked when the bundle is committed.
+ ***********************************************************************/
+uint32_t poflr_bundle_add(uint32_t bundle_id, const pof_flow_entry *flow_ptr, \
+                          uint16_t len, int controller){
+    struct flowBundle *bundle;
+    struct bundleMsg *msg;
+    uint32_t size;
+
+    if(!(bundle = bundleGet(bundle_id, controller))){
+        POF_ERROR_HANDLE_RETURN_UPWARD(POFET_BUNDLE_FAILED, POFBFC_BAD_ID, g_recv_xid,controller);
+    }
+    if(bundle->closed){
+        POF_ERROR_HANDLE_RETURN_UPWARD(POFET_BUNDLE_FAILED, POFBFC_BUNDLE_CLOSED, g_recv_xid,controller);
+    }
+    if(bundle->msgNum >= POFLR_BUNDLE_MSG_NUM){
+        POF_ERROR_HANDLE_RETURN_UPWARD(POFET_BUNDLE_FAILED, POFBFC_MSG_TOO_MANY, g_recv_xid,controller);
+    }
+
+    /* Never shorter than the struct, so the fields can be read safely. */
+    size = sizeof(struct bundleMsg) + (len > sizeof(pof_flow_entry) ? len : sizeof(pof_flow_entry));
+    POF_MALLOC_SAFE_RETURN_SIZE(msg, 1, POF_ERROR, size);
+    memcpy(msg->flow, flow_ptr, len);
+    if(bundle->tail){
+        bundle->tail->next = msg;
+    }else{
+        bundle->head = msg;
+    }
+    bundle->tail = msg;
+    bundle->msgNum ++;
+    return POF_OK;
+}
+
+/* Stage all of the flow mods of the bundle in the local resource, in
+ * its next version. If any of them fails, the ones before it are undone. */
+static uint32_t
+bundlePrepare(const struct flowBundle *bundle, struct pof_local_resource *lr, \
+              int controller, struct bundleSlot *slot)
+{
+    struct bundleMsg *msg;
+    uint32_t stepMax, ret;
+
+    slot->lr = lr;
+    slot->version = lr->version + 1;
+    slot->stepNum = 0;
+    if(slot->version == POFLR_VERSION_MAX){
+        POF_ERROR_HANDLE_RETURN_UPWARD(POFET_BUNDLE_FAILED, POFBFC_UNKNOWN, g_recv_xid,controller);
+    }
+
+    /* A modify touches two entries. */
+    stepMax = bundle->msgNum * 2 + 1;
+    POF_MALLOC_SAFE_RETURN(slot->step, stepMax, POF_ERROR);
+
+    for(msg=bundle->head; msg; msg=msg->next){
+        if((ret = bundleStage(msg->flow, slot->version, lr, controller, slot->step, &slot->stepNum)) != POF_OK){
+            bundleRollback(slot->version, slot->step, slot->stepNum, lr);
+            FREE(slot->step);
+            return ret;
+        }
+    }
+    return POF_OK;
+}
+
+/***********************************************************************
+ * Commit a bundle.
+ * Form:     uint32_t poflr_bundle_commit(uint32_t bundle_id, \
+ *                                        struct hmap *slotMap, \
+ *                                        int controller)
+ * Input:    bundle id, local resources of the slots, controller
+ * Output:   NONE
+ * Return:   POF_OK or ERROR code
+ * Discribe: This function applies all of the flow mods in the bundle to
+ *           the flow tables of every local resource, all or none of them.
+ *           The flow mods are staged in each local resource first. The
+ *           entries added carry the next table version, and the entries
+ *           removed stay until it, so the lookups do not see any of the
+ *           changes. If any flow mod fails in any local resource, all of
+ *           the staged changes are undone and no version is changed.
+ *           Otherwise the version of each local resource is increased once
+ *           to show all of its changes together, and the removed entries
+ *           are freed. The bundle is kept. Discard it after committing.
+ ***********************************************************************/
+uint32_t poflr_bundle_commit(uint32_t bundle_id, struct hmap *slotMap, int controller){
+    struct flowBundle *bundle;
+    struct pof_local_resource *lr;
+    struct bundleSlot *slot;
+    struct hnode *node;
+    struct bundleStep *step;
+    uint32_t slotNum = 0, slotMax, i, j, ret = POF_OK;
+
+    if(!(bundle = bundleGet(bundle_id, controller))){
+        POF_ERROR_HANDLE_RETURN_UPWARD(POFET_BUNDLE_FAILED, POFBFC_BAD_ID, g_recv_xid,controller);
+    }
+    if(hmap_empty(slotMap)){
+        return POF_OK;
+    }
+    slotMax = HMAP_NODES_COUNT(slotMap);
+    POF_MALLOC_SAFE_RETURN(slot, slotMax, POF_ERROR);
+
+    /* Stage the bundle in every local resource before any of them shows
+     * it, and undo all of them if one fails. */
+    for(node=hmap_nodeFirst(slotMap); node; node=hmap_nodeNext(slotMap, node)){
+        lr = POF_STRUCT_FROM_MEMBER(lr, slotNode, node);
+        if((ret = bundlePrepare(bundle, lr, controller, &slot[slotNum])) != POF_OK){
+            break;
+        }
+        slotNum ++;
+    }
+    if(ret != POF_OK){
+        while(slotNum--){
+            bundleRollback(slot[slotNum].version, slot[slotNum].step, slot[slotNum].stepNum, slot[slotNum].lr);
+            FREE(slot[slotNum].step);
+        }
+        FREE(slot);
+        return ret;
+    }
+
+    /* Show all of the changes at once. The flow cache of the datapath
+     * must be dropped before the removed entries are freed. */
+    for(i=0; i<slotNum; i++){
+        __atomic_store_n(&slot[i].lr->version, slot[i].version, __ATOMIC_RELEASE);
+        POFLR_MOD_GEN_INC(slot[i].lr);
+    }
+
+    for(i=0; i<slotNum; i++){
+        step = slot[i].step;
+        for(j=0; j<slot[i].stepNum; j++){
+            if(step[j].entry->removeVersion == slot[i].version){
+                if(step[j].counterDelete){
+                    poflr_counter_delete(step[j].entry->counter_id, slot[i].lr);
+                }
+                entryDelete(step[j].entry, step[j].table);
+            }
+        }
+        FREE(step);
+    }
+    FREE(slot);
+
+    POF_DEBUG_CPRINT_FL(1,GREEN,"Commit bundle %u SUC! %u flow mods in it.", \
+            bundle_id, bundle->msgNum);
+    return POF_OK;
+}
+
+/* Discard a bundle, and FREE the flow mods in it. */
+uint32_t poflr_bundle_discard(uint32_t bundle_id, int controller){
+    struct flowBundle *bundle;
+    struct bundleMsg *msg, *next;
+
+    if(!(bundle = bundleGet(bundle_id, controller))){
+        POF_ERROR_HANDLE_RETURN_UPWARD(POFET_BUNDLE_FAILED, POFBFC_BAD_ID, g_recv_xid,controller);
+    }
+    for(msg=bundle->head; msg; msg=next){
+        next = msg->next;
+        FREE(msg);
+    }
+    memset(bundle, 0, sizeof *bundle);
+    bundle->controller = -1;
+    return POF_OK;
+}
+
 /* Initialize flow table resource. */
 uint32_t poflr_init_flow_table(struct pof_local_resource *lr){
     uint32_t i;
@@ -755,12 +1558,6 @@ uint32_t poflr_empty_flow_table(struct pof_local_resource *lr){
         HMAP_NODES_IN_STRUCT_TRAVERSE(entry, nextEntry, node, table->entryMap){
             entryDelete(entry, table);
         }
-        /* FREE the hash map of entry in table. */
-        hmap_destroy(table->entryMap);
-        if(table->type == POF_LPM_TABLE){
-            /* FREE the tree of LPM entry in table. */
-            tree_destroy(table->tree);
-        }
         /* Delete the table from local resource, and FREE the memory. */
         map_tableDelete(table, lr);
     }
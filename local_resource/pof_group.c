@@ -31,6 +31,8 @@
 #include "../include/pof_byte_transfer.h"
 #include "../include/pof_log_print.h"
 #include "../include/pof_memory.h"
+#include "../include/pof_epoch.h"
+#include "../include/pof_datapath.h"
 #include "string.h"
 #include "sys/socket.h"
 #include "netinet/in.h"
@@ -39,21 +41,36 @@
 #include "sys/ioctl.h"
 #include "arpa/inet.h"
 
-/* Malloc memory for group information. Should be free by map_groupDelete(). */
+/* Malloc memory for group information, with the program of actNum actions
+ * behind it. Should be free by map_groupDelete(). */
 static struct groupInfo *
-map_groupCreate()
+map_groupCreate(uint8_t actNum)
 {
     struct groupInfo *group;
-    POF_MALLOC_SAFE_RETURN(group, 1, NULL);
+    uint32_t size = sizeof(struct groupInfo) + pofdp_action_program_size(actNum);
+    POF_MALLOC_SAFE_RETURN_SIZE(group, 1, NULL, size);
+    group->prog = (struct pofdp_program *)(group + 1);
     return group;
 }
 
+/* FREE the group with the references it holds. */
+static void
+map_groupFree(void *ptr)
+{
+    struct groupInfo *group = ptr;
+    poflr_ref_unbind(&group->counterRef);
+    pofdp_program_unbind(group->prog);
+    FREE(group);
+}
+
+/* The references to the group move to the group which replaces it. */
 static void
 map_groupDelete(struct groupInfo *group, struct pof_local_resource *lr)
 {
     hmap_nodeDelete(lr->groupMap, &group->idNode);
     lr->groupNum --;
-    FREE(group);
+    poflr_ref_object_delete(&group->refs, POFLR_REF_GROUP, group->id, lr);
+    epoch_retire(group, map_groupFree);
 }
 
 static void
@@ -61,6 +78,7 @@ map_groupInsert(struct groupInfo *group, struct pof_local_resource *lr)
 {
     hmap_nodeInsert(lr->groupMap, &group->idNode);
     lr->groupNum ++;
+    poflr_ref_object_add(&group->refs, group, POFLR_REF_GROUP, group->id, lr);
 }
 
 static hash_t
@@ -69,9 +87,52 @@ map_groupHashByID(uint32_t id)
     return hmap_hashForLinear(id);
 }
 
-/* Fill the group information, including the hash value. */
+/* Fill the lookup table of the SELECT group by Maglev hashing. Every
+ * bucket takes the entries in the order of its own permutation of the
+ * table in turn. The permutation depends only on the action, so the
+ * packets mostly stay in their buckets when the group is modified. */
 static void
-groupFill(const struct pof_group *pofGroup, struct groupInfo *group)
+groupSelectBuild(struct groupInfo *group)
+{
+    uint32_t offset[POF_MAX_ACTION_NUMBER_PER_GROUP], skip[POF_MAX_ACTION_NUMBER_PER_GROUP];
+    uint32_t next[POF_MAX_ACTION_NUMBER_PER_GROUP] = {0};
+    uint32_t i, c, filled = 0, M = POFLR_GROUP_SELECT_TABLE_SIZE;
+    const struct pof_action *act = group->action;
+    hash_t hash;
+
+    if(group->action_number == 0){
+        return;
+    }
+    for(i=0; i<group->action_number; i++){
+#ifdef POF_SHT_VXLAN
+        hash = hmap_hashForBytes(act, act->len);
+        act = (const struct pof_action *)((const uint8_t *)act + act->len);
+#else // POF_SHT_VXLAN
+        hash = hmap_hashForBytes(act, sizeof(struct pof_action));
+        act++;
+#endif // POF_SHT_VXLAN
+        offset[i] = hash % M;
+        skip[i] = hmap_hashForUint32(hash) % (M - 1) + 1;
+    }
+
+    memset(group->selectTable, 0xFF, M);
+    while(filled < M){
+        for(i=0; i<group->action_number && filled<M; i++){
+            do{
+                c = (offset[i] + next[i] * skip[i]) % M;
+                next[i] ++;
+            }while(group->selectTable[c] != 0xFF);
+            group->selectTable[c] = i;
+            filled ++;
+        }
+    }
+}
+
+/* Fill the group information, including the hash value. Bind the
+ * references of the group. */
+static void
+groupFill(const struct pof_group *pofGroup, struct groupInfo *group, \
+          struct pof_local_resource *lr)
 {
     group->type = pofGroup->type;
     group->action_number = pofGroup->action_number;
@@ -79,7 +140,15 @@ groupFill(const struct pof_group *pofGroup, struct groupInfo *group)
     group->counter_id = pofGroup->counter_id;
     memcpy(group->action, pofGroup->action, \
             group->action_number * sizeof(struct pof_action));
+    pofdp_action_program_build(group->prog, group->action, group->action_number);
+    if(group->type == POFGT_SELECT){
+        groupSelectBuild(group);
+    }
     group->idNode.hash = map_groupHashByID(group->id);
+    if(group->counter_id){
+        poflr_ref_bind(&group->counterRef, POFLR_REF_COUNTER, group->counter_id, lr);
+    }
+    pofdp_program_bind(group->prog, lr);
 }
 
 /***********************************************************************
@@ -101,6 +170,10 @@ poflr_add_group_entry(pof_group *group_ptr, struct pof_local_resource *lr)
     if(group_ptr->group_id >= lr->groupNumMax){
         POF_ERROR_HANDLE_RETURN_NO_UPWARD(POFET_GROUP_MOD_FAILED, POFGMFC_INVALID_GROUP);
     }
+    /* Check the group type. */
+    if(group_ptr->type > POFGT_FF){
+        POF_ERROR_HANDLE_RETURN_NO_UPWARD(POFET_GROUP_MOD_FAILED, POFGMFC_BAD_TYPE);
+    }
     if(poflr_get_group_with_ID(group_ptr->group_id, lr)){
         POF_ERROR_HANDLE_RETURN_NO_UPWARD(POFET_GROUP_MOD_FAILED, POFGMFC_GROUP_EXISTS);
     }
@@ -110,9 +183,9 @@ poflr_add_group_entry(pof_group *group_ptr, struct pof_local_resource *lr)
     POF_CHECK_RETVALUE_RETURN_NO_UPWARD(ret);
 
     /* Create group and insert to the local resource. */
-    group = map_groupCreate();
+    group = map_groupCreate(group_ptr->action_number);
     //POF_MALLOC_ERROR_HANDLE_RETURN_UPWARD(group, g_upward_xid++);
-    groupFill(group_ptr, group);
+    groupFill(group_ptr, group, lr);
     map_groupInsert(group, lr);
 
     POF_DEBUG_CPRINT_FL(1,GREEN,"Add group entry SUC!");
@@ -131,12 +204,16 @@ poflr_add_group_entry(pof_group *group_ptr, struct pof_local_resource *lr)
 uint32_t 
 poflr_modify_group_entry(pof_group *group_ptr, struct pof_local_resource *lr)
 {
-    struct groupInfo *group;
+    struct groupInfo *group, *newGroup;
 
     /* Check group_id. */
     if(group_ptr->group_id >= lr->groupNumMax){
         POF_ERROR_HANDLE_RETURN_NO_UPWARD(POFET_GROUP_MOD_FAILED, POFGMFC_INVALID_GROUP);
     }
+    /* Check the group type. */
+    if(group_ptr->type > POFGT_FF){
+        POF_ERROR_HANDLE_RETURN_NO_UPWARD(POFET_GROUP_MOD_FAILED, POFGMFC_BAD_TYPE);
+    }
     /* Get the group. */
     if(!(group = poflr_get_group_with_ID(group_ptr->group_id, lr))){
         POF_ERROR_HANDLE_RETURN_NO_UPWARD(POFET_GROUP_MOD_FAILED, POFGMFC_UNKNOWN_GROUP);
@@ -147,8 +224,14 @@ poflr_modify_group_entry(pof_group *group_ptr, struct pof_local_resource *lr)
         POF_ERROR_HANDLE_RETURN_NO_UPWARD(POFET_GROUP_MOD_FAILED, POFGMFC_BAD_COUNTER_ID);
     }
 
-    /* Modify the information of group. */
-    groupFill(group_ptr, group);
+    /* Modify a copy of the group, and replace the original one with it.
+     * The datapath sees either of them, never a half modified one. */
+    if(!(newGroup = map_groupCreate(group_ptr->action_number))){
+        return POF_ERROR;
+    }
+    groupFill(group_ptr, newGroup, lr);
+    map_groupInsert(newGroup, lr);
+    map_groupDelete(group, lr);
 
     POF_DEBUG_CPRINT_FL(1,GREEN,"Modify group entry SUC!");
     return POF_OK;
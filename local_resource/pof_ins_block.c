@@ -31,26 +31,43 @@
 #include "../include/pof_byte_transfer.h"
 #include "../include/pof_log_print.h"
 #include "../include/pof_memory.h"
+#include "../include/pof_epoch.h"
+#include "../include/pof_datapath.h"
 
 #ifdef POF_SHT_VXLAN
 
 
-/* Malloc memory for instruction block information. Should be free by map_insBlockDelete(). */
+/* Malloc memory for instruction block information, with the program
+ * behind the instructions. Should be free by map_insBlockDelete(). */
 static struct insBlockInfo *
-map_insBlockCreate(uint16_t insSize)
+map_insBlockCreate(uint16_t insSize, uint32_t progSize)
 {
     struct insBlockInfo *insBlock;
-    uint16_t size = insSize + sizeof(struct insBlockInfo);
+    uint32_t size = sizeof(struct insBlockInfo) + POFDP_PROGRAM_OFFSET(insSize) + progSize;
     POF_MALLOC_SAFE_RETURN_SIZE(insBlock, 1, NULL, size);
+    insBlock->prog = (struct pofdp_program *)( \
+            (uint8_t *)insBlock->insData + POFDP_PROGRAM_OFFSET(insSize) );
     return insBlock;
 }
 
+/* FREE the instruction block with the native code and the references
+ * of its program. */
+static void
+map_insBlockFree(void *ptr)
+{
+    struct insBlockInfo *insBlock = ptr;
+    pofdp_program_unbind(insBlock->prog);
+    pofdp_program_release(insBlock->prog);
+    FREE(insBlock);
+}
+
 static void
 map_insBlockDelete(struct insBlockInfo *insBlock, struct pof_local_resource *lr)
 {
     hmap_nodeDelete(lr->insBlockMap, &insBlock->idNode);
     lr->insBlockNum --;
-    FREE(insBlock);
+    poflr_ref_object_delete(&insBlock->refs, POFLR_REF_INS_BLOCK, insBlock->blockID, lr);
+    epoch_retire(insBlock, map_insBlockFree);
 }
 
 static void
@@ -58,6 +75,7 @@ map_insBlockInsert(struct insBlockInfo *insBlock, struct pof_local_resource *lr)
 {
     hmap_nodeInsert(lr->insBlockMap, &insBlock->idNode);
     lr->insBlockNum ++;
+    poflr_ref_object_add(&insBlock->refs, insBlock, POFLR_REF_INS_BLOCK, insBlock->blockID, lr);
 }
 
 static hash_t
@@ -71,9 +89,9 @@ uint32_t
 poflr_init_insBlock(struct pof_local_resource *lr)
 {
     lr->insBlockNumMax = POFLR_INS_BLOCK_NUM;
-    /* Initialize meter table. */
-    lr->meterMap = hmap_create(lr->meterNumMax);
-    POF_MALLOC_ERROR_HANDLE_RETURN_NO_UPWARD(lr->meterMap);
+    /* Initialize instruction block map. */
+    lr->insBlockMap = hmap_create(lr->insBlockNumMax);
+    POF_MALLOC_ERROR_HANDLE_RETURN_NO_UPWARD(lr->insBlockMap);
 
 	return POF_OK;
 }
@@ -95,15 +113,20 @@ poflr_add_insBlock(struct pof_instruction_block *pof_insBlock, struct pof_local_
         insSize += pof_ins->len;
     }
 
-    insBlock = map_insBlockCreate(insSize);
+    insBlock = map_insBlockCreate(insSize, \
+            pofdp_program_size(pof_insBlock->instruction, insNum));
     //POF_MALLOC_ERROR_HANDLE_RETURN_UPWARD(insBlock, g_upward_xid++);
     insBlock->blockID = pof_insBlock->instruction_block_id;
     insBlock->idNode.hash = map_insBlockHashByID(insBlock->blockID);
-    map_insBlockInsert(insBlock, lr);
     insBlock->insNum = insNum;
     insBlock->tableID = pof_insBlock->related_table_id;
     insBlock->lr = lr;
     memcpy(insBlock->insData, pof_insBlock->instruction, insSize);
+    /* Decode the instructions once, for the datapath. */
+    pofdp_program_build(insBlock->prog, insBlock->insData, insNum);
+    pofdp_program_bind(insBlock->prog, lr);
+    /* Visible to the datapath after it is filled. */
+    map_insBlockInsert(insBlock, lr);
 
     POF_DEBUG_CPRINT_FL(1,GREEN,"Add instruction block SUC!");
     return POF_OK;
@@ -280,6 +280,170 @@ uint32_t  poflr_reply_port_resource(int i,struct pof_local_resource *lr){
     return POF_OK;
 }
 
+/* Get the object of the type with the ID, and its references. */
+static struct list *
+refObjectGet(uint8_t type, uint32_t id, const struct pof_local_resource *lr, void **obj)
+{
+    struct counterInfo *counter;
+    struct meterInfo *meter;
+    struct groupInfo *group;
+    struct tableInfo *table;
+#ifdef POF_SHT_VXLAN
+    struct insBlockInfo *insBlock;
+#endif // POF_SHT_VXLAN
+
+    switch(type){
+        case POFLR_REF_COUNTER:
+            if((counter = poflr_get_counter_with_ID(id, lr)) == NULL){
+                return NULL;
+            }
+            *obj = counter;
+            return &counter->refs;
+        case POFLR_REF_METER:
+            if((meter = poflr_get_meter_with_ID(id, lr)) == NULL){
+                return NULL;
+            }
+            *obj = meter;
+            return &meter->refs;
+        case POFLR_REF_GROUP:
+            if((group = poflr_get_group_with_ID(id, lr)) == NULL){
+                return NULL;
+            }
+            *obj = group;
+            return &group->refs;
+        case POFLR_REF_TABLE:
+            if(id > 0xFF || (table = poflr_get_table_with_ID(id, lr)) == NULL){
+                return NULL;
+            }
+            *obj = table;
+            return &table->refs;
+#ifdef POF_SHT_VXLAN
+        case POFLR_REF_INS_BLOCK:
+            if((insBlock = poflr_get_insBlock_with_ID(id, lr)) == NULL){
+                return NULL;
+            }
+            *obj = insBlock;
+            return &insBlock->refs;
+#endif // POF_SHT_VXLAN
+        default:
+            return NULL;
+    }
+}
+
+/* Link the reference into list, and point it to obj. */
+static void
+refMove(struct poflr_ref *ref, struct list *list, void *obj)
+{
+    if(ref->list){
+        list_nodeDelete(ref->list, &ref->node);
+    }
+    list_nodeInsertTail(list, &ref->node);
+    ref->list = list;
+    __atomic_store_n(&ref->obj, obj, __ATOMIC_RELEASE);
+}
+
+/***********************************************************************
+ * Bind the reference
+ * Form:     void poflr_ref_bind(struct poflr_ref *ref, uint8_t type, \
+ *                               uint32_t id, struct pof_local_resource *lr)
+ * Input:    reference, object type, object id, local resource
+ * Output:   ref
+ * Return:   VOID
+ * Discribe: This function binds the reference to the object of the type
+ *           with the id. If there is no such object, the reference is
+ *           NULL until the object is added. poflr_ref_unbind() should be
+ *           called before the reference is freed.
+ ***********************************************************************/
+void
+poflr_ref_bind(struct poflr_ref *ref, uint8_t type, uint32_t id, \
+               struct pof_local_resource *lr)
+{
+    struct list *refs;
+    void *obj = NULL;
+
+    ref->type = type;
+    ref->id = id;
+    if((refs = refObjectGet(type, id, lr, &obj)) == NULL){
+        refs = &lr->unboundRefs[type];
+    }
+    refMove(ref, refs, obj);
+    return;
+}
+
+/* Unlink the reference. Nothing to do if it has never been bound. */
+void
+poflr_ref_unbind(struct poflr_ref *ref)
+{
+    if(ref->list == NULL){
+        return;
+    }
+    list_nodeDelete(ref->list, &ref->node);
+    ref->list = NULL;
+    __atomic_store_n(&ref->obj, NULL, __ATOMIC_RELEASE);
+    return;
+}
+
+/***********************************************************************
+ * Bind the references to the added object
+ * Form:     void poflr_ref_object_add(struct list *refs, void *obj, \
+ *                                     uint8_t type, uint32_t id, \
+ *                                     struct pof_local_resource *lr)
+ * Input:    references of the object, object, object type, object id,
+ *           local resource
+ * Output:   refs
+ * Return:   VOID
+ * Discribe: This function initializes the references of the object,
+ *           and binds the unbound references with the id to it. It
+ *           should be called when the object has been inserted into the
+ *           local resource.
+ ***********************************************************************/
+void
+poflr_ref_object_add(struct list *refs, void *obj, uint8_t type, uint32_t id, \
+                     struct pof_local_resource *lr)
+{
+    struct poflr_ref *ref, *next;
+
+    list_clear(refs);
+    LIST_NODES_IN_STRUCT_TRAVERSE(ref, next, node, &lr->unboundRefs[type]){
+        if(ref->id == id){
+            refMove(ref, refs, obj);
+        }
+    }
+    return;
+}
+
+/***********************************************************************
+ * Move the references off the deleted object
+ * Form:     void poflr_ref_object_delete(struct list *refs, uint8_t type, \
+ *                                        uint32_t id, \
+ *                                        struct pof_local_resource *lr)
+ * Input:    references of the object, object type, object id, local
+ *           resource
+ * Output:   refs
+ * Return:   VOID
+ * Discribe: This function should be called when the object has been
+ *           removed from the local resource. Its references are bound to
+ *           the object with the same id which replaces it, if any, or
+ *           become NULL. The datapath may still be on the object, so it
+ *           should be freed through the epoch.
+ ***********************************************************************/
+void
+poflr_ref_object_delete(struct list *refs, uint8_t type, uint32_t id, \
+                        struct pof_local_resource *lr)
+{
+    struct poflr_ref *ref, *next;
+    struct list *to;
+    void *obj = NULL;
+
+    if((to = refObjectGet(type, id, lr, &obj)) == NULL){
+        to = &lr->unboundRefs[type];
+    }
+    LIST_NODES_IN_STRUCT_TRAVERSE(ref, next, node, refs){
+        refMove(ref, to, obj);
+    }
+    return;
+}
+
 /***********************************************************************
  * Empty the Soft Switch resource.
  * Form:     poflr_empty_resource()
@@ -299,6 +463,7 @@ uint32_t poflr_clear_resource(struct pof_local_resource *lr){
 #ifdef POF_SHT_VXLAN
     poflr_empty_insBlock(lr);
 #endif // POF_SHT_VXLAN
+    POFLR_MOD_GEN_INC(lr);
 
     POF_DEBUG_CPRINT_FL(1,BLUE,"Switch resource has been clear.");
     return POF_OK;
@@ -316,7 +481,11 @@ uint32_t poflr_clear_resource(struct pof_local_resource *lr){
  ***********************************************************************/
 /* Start openflow task. */
 uint32_t pof_localresource_init(struct pof_local_resource *lr){
-    uint32_t ret = POF_OK;
+    uint32_t ret = POF_OK, i;
+
+    for(i=0; i<POFLR_REF_TYPE_NUM; i++){
+        list_clear(&lr->unboundRefs[i]);
+    }
 
     /* Initialize the local physical port infomation. */
     ret = poflr_init_port(lr);
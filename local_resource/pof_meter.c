@@ -31,6 +31,7 @@
 #include "../include/pof_byte_transfer.h"
 #include "../include/pof_log_print.h"
 #include "../include/pof_memory.h"
+#include "../include/pof_epoch.h"
 #include "string.h"
 #include "sys/socket.h"
 #include "netinet/in.h"
@@ -53,7 +54,8 @@ map_meterDelete(struct meterInfo *meter, struct pof_local_resource *lr)
 {
     hmap_nodeDelete(lr->meterMap, &meter->idNode);
     lr->meterNum --;
-    FREE(meter);
+    poflr_ref_object_delete(&meter->refs, POFLR_REF_METER, meter->id, lr);
+    epoch_free(meter);
 }
 
 static void
@@ -61,6 +63,7 @@ map_meterInsert(struct meterInfo *meter, struct pof_local_resource *lr)
 {
     hmap_nodeInsert(lr->meterMap, &meter->idNode);
     lr->meterNum ++;
+    poflr_ref_object_add(&meter->refs, meter, POFLR_REF_METER, meter->id, lr);
 }
 
 static hash_t
@@ -69,6 +72,15 @@ map_meterHashByID(uint32_t id)
     return hmap_hashForLinear(id);
 }
 
+/* The bucket of the meter is full from now. */
+static void
+meterBucketInit(struct meterInfo *meter, const struct pof_local_resource *lr)
+{
+    meter->burst = (uint64_t)lr->meterBurstMs * 1000000;
+    meter->packetMode = lr->meterPacketMode;
+    __atomic_store_n(&meter->full, pofbf_time_ns(), __ATOMIC_RELAXED);
+}
+
 /***********************************************************************
  * Add the meter.
  * Form:     uint32_t poflr_mod_meter_entry(uint32_t meter_id, uint32_t rate)
@@ -95,6 +107,7 @@ poflr_add_meter_entry(uint32_t meter_id, uint32_t rate, struct pof_local_resourc
     //POF_MALLOC_ERROR_HANDLE_RETURN_NO_UPWARD();
     meter->id = meter_id;
     meter->rate = rate;
+    meterBucketInit(meter, lr);
     meter->idNode.hash = map_meterHashByID(meter_id);
     map_meterInsert(meter, lr);
 
@@ -123,13 +136,58 @@ poflr_modify_meter_entry(uint32_t meter_id, uint32_t rate, struct pof_local_reso
     if(!(meter = poflr_get_meter_with_ID(meter_id, lr))){
         POF_ERROR_HANDLE_RETURN_NO_UPWARD(POFET_METER_MOD_FAILED, POFMMFC_UNKNOWN_METER);
     }
-    /* Modify the rate. */
+    /* Modify the rate. The bucket starts over with the new rate. */
     meter->rate = rate;
+    meterBucketInit(meter, lr);
 
     POF_DEBUG_CPRINT_FL(1,GREEN,"Modify meter SUC!");
     return POF_OK;
 }
 
+/***********************************************************************
+ * Police the packet by the meter.
+ * Form:     uint8_t poflr_meter_police(struct meterInfo *meter, uint32_t byte_len)
+ * Input:    meter, packet length
+ * Output:   NONE
+ * Return:   TRUE if the packet is in the rate, or FALSE
+ * Discribe: This function takes the tokens of the packet from the bucket
+ *           of the meter. The bucket is refilled lazily by the time since
+ *           the last packet. A packet which finds the bucket empty is
+ *           counted as dropped, and should be dropped by the caller. The
+ *           receive workers may police by one meter at the same time.
+ ***********************************************************************/
+uint8_t
+poflr_meter_police(struct meterInfo *meter, uint32_t byte_len)
+{
+    uint32_t rate = meter->rate;
+    uint64_t now, full, cost;
+
+    if(!rate){
+        return TRUE;
+    }
+
+    /* The time to fill the tokens of the packet in ns. The rate is in
+     * kbps, that is 8000000 / rate ns for one byte. */
+    if(meter->packetMode){
+        cost = 1000000000 / rate;
+    }else{
+        cost = (uint64_t)byte_len * 8000000 / rate;
+    }
+
+    now = pofbf_time_ns();
+    full = __atomic_load_n(&meter->full, __ATOMIC_RELAXED);
+    do{
+        /* Not enough tokens till the bucket is refilled to the packet. */
+        if(full > now + meter->burst){
+            __atomic_fetch_add(&meter->dropPackets, 1, __ATOMIC_RELAXED);
+            __atomic_fetch_add(&meter->dropBytes, byte_len, __ATOMIC_RELAXED);
+            return FALSE;
+        }
+    }while(!__atomic_compare_exchange_n(&meter->full, &full, (full > now ? full : now) + cost, \
+                                        TRUE, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+    return TRUE;
+}
+
 /***********************************************************************
  * Delete the meter.
  * Form:     uint32_t poflr_mod_meter_entry(uint32_t meter_id, uint32_t rate)
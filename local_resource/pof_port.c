@@ -34,6 +34,7 @@
 #include "../include/pof_hmap.h"
 #include "../include/pof_list.h"
 #include "../include/pof_memory.h"
+#include "../include/pof_epoch.h"
 #include "string.h"
 #include "sys/socket.h"
 #include "netinet/in.h"
@@ -434,12 +435,27 @@ map_portHashByName(const char *name)
     return hmap_hashForString(name);
 }
 
+/* Keep the live bit of the port up with its state. The bits are read by
+ * the datapath through poflr_port_live(). */
+static void
+portLiveUpdate(const struct portInfo *port, uint8_t live, struct pof_local_resource *lr)
+{
+    uint64_t bit = (uint64_t)1 << (port->pofIndex % 64);
+
+    if(live){
+        __atomic_fetch_or(&lr->portLive[port->pofIndex / 64], bit, __ATOMIC_RELAXED);
+    }else{
+        __atomic_fetch_and(&lr->portLive[port->pofIndex / 64], ~bit, __ATOMIC_RELAXED);
+    }
+}
+
 static void
 map_portInsert(struct portInfo *port, struct pof_local_resource *lr)
 {
     hmap_nodeInsert(lr->portPofIndexMap, &port->pofIndexNode);
     hmap_nodeInsert(lr->portNameMap, &port->nameNode);
     lr->portNum ++;
+    portLiveUpdate(port, (port->pofState & POFPS_LIVE) != 0, lr);
 }
 
 /* Malloc memory for port information. should be free by map_portDelete(). */
@@ -457,7 +473,8 @@ map_portDelete(struct portInfo *port, struct pof_local_resource *lr)
     hmap_nodeDelete(lr->portPofIndexMap, &port->pofIndexNode);
     hmap_nodeDelete(lr->portNameMap, &port->nameNode);
     lr->portNum --;
-    FREE(port);
+    portLiveUpdate(port, FALSE, lr);
+    epoch_free(port);
 }
 
 /* Check whether there is a port with the name in the system. */
@@ -485,6 +502,26 @@ checkPortNameInSys(const char *name)
     return ret;
 }
 
+/***********************************************************************
+ * Check whether the port is live.
+ * Form:     uint8_t poflr_port_live(uint32_t port_id, \
+ *                                   const struct pof_local_resource *lr)
+ * Input:    port id, local resource
+ * Output:   NONE
+ * Return:   TRUE or FALSE
+ * Discribe: This function checks the live bit of the port, which is kept
+ *           by the port detection. It does not look up the port, so the
+ *           datapath may call it for every packet.
+ ***********************************************************************/
+uint8_t
+poflr_port_live(uint32_t port_id, const struct pof_local_resource *lr)
+{
+    if(port_id >= 256){
+        return FALSE;
+    }
+    return (__atomic_load_n(&lr->portLive[port_id / 64], __ATOMIC_RELAXED) >> (port_id % 64)) & 1;
+}
+
 struct portInfo *
 poflr_get_port_with_pofindex(uint8_t pofIndex, const struct pof_local_resource *lr)
 {
@@ -501,6 +538,20 @@ poflr_get_port_with_name(const char *name, const struct pof_local_resource *lr)
             map_portHashByName(name), lr->portNameMap, ptr);
 }
 
+/* Shut down all the receive workers of the port. */
+static uint32_t
+portTaskDelete(struct portInfo *port)
+{
+    uint32_t i, ret;
+    for(i=0; i<PORT_MAX_RX_WORKERS; i++){
+        if(port->taskID[i] != POF_INVALID_TASKID){
+            ret = pofbf_task_delete(&port->taskID[i]);
+            POF_CHECK_RETVALUE_RETURN_NO_UPWARD(ret);
+        }
+    }
+    return POF_OK;
+}
+
 /* Remove a port with the name from local resource. */
 uint32_t
 poflr_del_port(const char *ethName, struct pof_local_resource *lr)
@@ -519,8 +570,8 @@ poflr_del_port(const char *ethName, struct pof_local_resource *lr)
 	ret = poflr_port_report(controller,POFPR_DELETE, port);
 	POF_CHECK_RETVALUE_RETURN_NO_UPWARD(ret);
     }
-    /* Shut down the task which listen to the port. */
-	ret = pofbf_task_delete(&port->taskID);
+    /* Shut down the tasks which listen to the port. */
+	ret = portTaskDelete(port);
 	POF_CHECK_RETVALUE_RETURN_NO_UPWARD(ret);
 
     /* Remove the port, and free the memory. */
@@ -791,7 +842,7 @@ static void poflr_port_print(struct portInfo *p){
     POF_DEBUG_CPRINT(1,CYAN,"of_enable=");
     POF_DEBUG_CPRINT(1,WHITE,"0x%.2x ",p->of_enable);
     POF_DEBUG_CPRINT(1,CYAN,"taskID=");
-    POF_DEBUG_CPRINT(1,WHITE,"0x%.lx ",p->taskID);
+    POF_DEBUG_CPRINT(1,WHITE,"0x%.lx ",p->taskID[0]);
 
 	POF_DEBUG_CPRINT(1,WHITE,"\n");
 }
@@ -1009,11 +1060,12 @@ poflr_port_detect_new_add(struct pof_local_resource *lr)
 
 /* Update the port information from new one to an old one. */
 static void
-updatePorts(struct portInfo *port, const struct portInfo *portNew)
+updatePorts(struct portInfo *port, const struct portInfo *portNew, struct pof_local_resource *lr)
 {
     memcpy(port->hwaddr, portNew->hwaddr, POF_ETH_ALEN);
     port->sysIndex = portNew->sysIndex;
     port->pofState = portNew->pofState;
+    portLiveUpdate(port, (port->pofState & POFPS_LIVE) != 0, lr);
 }
 
 /* Check whether the two ports are the same. */
@@ -1048,7 +1100,7 @@ poflr_port_detect_old(struct pof_local_resource *lr)
         tmp.pofState = pofStateCheck(port->name);
         if(comparePorts(port, &tmp) != TRUE){
             /* If the port has been changed, update the port information and report to Controller. */
-            updatePorts(port, &tmp);
+            updatePorts(port, &tmp, lr);
             for (controller=0;controller<n_controller;controller++){
             ret = poflr_port_report(controller,POFPR_MODIFY, port);
             POF_CHECK_RETVALUE_RETURN_NO_UPWARD(ret);
@@ -1136,10 +1188,8 @@ poflr_ports_task_delete(struct pof_local_resource *lr)
     uint32_t ret;
     struct portInfo *port, *next;
     HMAP_NODES_IN_STRUCT_TRAVERSE(port, next, pofIndexNode, lr->portPofIndexMap){
-        if(port->taskID != POF_INVALID_TASKID){
-            ret = pofbf_task_delete(&port->taskID);
-            POF_CHECK_RETVALUE_RETURN_NO_UPWARD(ret);
-        }
+        ret = portTaskDelete(port);
+        POF_CHECK_RETVALUE_RETURN_NO_UPWARD(ret);
     }
     return POF_OK;
 }
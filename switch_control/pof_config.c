@@ -431,6 +431,13 @@ enum pof_init_config_type{
 	POFICT_COUNTER_NUMBER   = 9,
 	POFICT_GROUP_NUMBER     = 10,
 	POFICT_DEVICE_PORT_NUMBER_MAX = 11,
+	POFICT_RX_RING_BLOCK_NUMBER = 12,
+	POFICT_RX_WORKER_NUMBER = 13,
+	POFICT_FLOW_CACHE_ENTRY_NUMBER = 14,
+	POFICT_JIT = 15,
+	POFICT_METER_BURST_MS = 16,
+	POFICT_METER_PACKET_MODE = 17,
+	POFICT_SELECT_HASH_FIELD = 18,
 
 	POFICT_CONFIG_TYPE_MAX,
 };
@@ -440,7 +447,9 @@ char *config_type_str[POFICT_CONFIG_TYPE_MAX] = {
 	"MM_table_number", "LPM_table_number", "EM_table_number", "DT_table_number",
 	"Flow_table_size", "Flow_table_key_length", 
 	"Meter_number", "Counter_number", "Group_number", 
-	"Device_port_number_max"
+	"Device_port_number_max", "Rx_ring_block_number", "Rx_worker_number",
+	"Flow_cache_entry_number", "Jit", "Meter_burst_ms", "Meter_packet_mode",
+	"Select_hash_field"
 };
 
 static uint8_t pofsic_get_config_type(char *str){
@@ -473,7 +482,8 @@ readConfigFile(FILE *fp, struct pof_datapath *dp)
     struct pof_param *param = &dp->param;
 	char     str[POF_STRING_MAX_LEN] = "\0";
 	char     ip_str[POF_STRING_MAX_LEN] = "\0";
-	uint8_t  config_type = 0;
+	uint8_t  config_type = 0, selectHashFieldSet = FALSE;
+	pof_match *field;
 	while(fscanf(fp, "%s", str) == 1){
 		config_type = pofsic_get_config_type(str);
 		if(config_type == POFICT_CONTROLLER_IP){
@@ -518,6 +528,55 @@ readConfigFile(FILE *fp, struct pof_datapath *dp)
 				case POFICT_DEVICE_PORT_NUMBER_MAX:
                     param->portNumMax = data;
 					break;
+				case POFICT_RX_RING_BLOCK_NUMBER:
+                    param->rxRingBlockNum = data;
+					break;
+				case POFICT_RX_WORKER_NUMBER:
+                    if(data < 1 || data > PORT_MAX_RX_WORKERS){
+                        POF_ERROR_CPRINT_FL("Rx_worker_number should be 1 to %d.", PORT_MAX_RX_WORKERS);
+                        ret = POF_ERROR;
+                        break;
+                    }
+                    param->rxWorkerNum = data;
+					break;
+				case POFICT_FLOW_CACHE_ENTRY_NUMBER:
+                    if(data == 1 || (data & (data - 1))){
+                        POF_ERROR_CPRINT_FL("Flow_cache_entry_number should be 0 or a power of 2.");
+                        ret = POF_ERROR;
+                        break;
+                    }
+                    param->flowCacheEntryNum = data;
+					break;
+				case POFICT_JIT:
+                    param->jit = (data != 0);
+					break;
+				case POFICT_METER_BURST_MS:
+                    param->meterBurstMs = data;
+					break;
+				case POFICT_METER_PACKET_MODE:
+                    param->meterPacketMode = (data != 0);
+					break;
+				case POFICT_SELECT_HASH_FIELD:
+                    /* The fields in the file replace the default ones. */
+                    if(!selectHashFieldSet){
+                        param->selectHashFieldNum = 0;
+                        selectHashFieldSet = TRUE;
+                    }
+                    if(param->selectHashFieldNum >= POF_MAX_MATCH_FIELD_NUM){
+                        POF_ERROR_CPRINT_FL("Select_hash_field should be no more than %d.", POF_MAX_MATCH_FIELD_NUM);
+                        ret = POF_ERROR;
+                        break;
+                    }
+                    field = &param->selectHashField[param->selectHashFieldNum];
+                    field->offset = data;
+                    field->len = pofsic_get_config_data(fp, &ret);
+                    if(field->len == 0 || field->len > POF_MAX_FIELD_LENGTH_IN_BYTE * POF_BITNUM_IN_BYTE){
+                        POF_ERROR_CPRINT_FL("Select_hash_field should be followed by the offset and the length in bits.");
+                        ret = POF_ERROR;
+                        break;
+                    }
+                    param->selectHashFieldNum ++;
+					break;
 				default:
 					ret = POF_ERROR;
 					break;
@@ -544,7 +603,9 @@ readConfigFile(FILE *fp, struct pof_datapath *dp)
  *			 "MM_table_number", "LPM_table_number", "EM_table_number", "DT_table_number",
  *			 "Flow_table_size", "Flow_table_key_length", 
  *			 "Meter_number", "Counter_number", "Group_number", 
- *			 "Device_port_number_max"
+ *			 "Device_port_number_max", "Rx_ring_block_number",
+ *			 "Rx_worker_number", "Flow_cache_entry_number", "Jit",
+ *			 "Meter_burst_ms", "Meter_packet_mode", "Select_hash_field"
  ***********************************************************************/
 static uint32_t pof_set_init_config_by_file(struct pof_datapath *dp){
 	char     filename_relative[] = "./pofswitch_config.conf";
@@ -73,7 +73,7 @@ uint32_t pofec_reply_error(uint16_t type, uint16_t code, char *s, uint32_t xid,i
     pof_error *error_ptr;
 
     /* Build the pof body. */
-    error_ptr = (pof_error *)(&queue_msg_bufs[controller] + sizeof(pof_header));
+    error_ptr = (pof_error *)(queue_msg_bufs[controller].pofec_queue_msg_buf + sizeof(pof_header));
     error_ptr->code = code;
     error_ptr->device_id = POF_FE_ID;
 #ifdef POF_MULTIPLE_SLOTS
@@ -82,10 +82,10 @@ uint32_t pofec_reply_error(uint16_t type, uint16_t code, char *s, uint32_t xid,i
     error_ptr->type = type;
     memcpy(error_ptr->err_str, s, strlen(s)+1);
 
-    pof_NtoH_transfer_error(&queue_msg_bufs[controller] + sizeof(pof_header));
+    pof_NtoH_transfer_error(queue_msg_bufs[controller].pofec_queue_msg_buf + sizeof(pof_header));
 
     if(POF_OK != pofec_reply_msg(controller,POFT_ERROR, xid, sizeof(pof_error), NULL)){
-        POF_ERROR_HANDLE_RETURN_UPWARD(POFET_SOFTWARE_FAILED, POF_WRITE_MSG_QUEUE_FAILURE, g_upward_xid++,controller);
+        POF_ERROR_HANDLE_RETURN_UPWARD(POFET_SOFTWARE_FAILED, POF_WRITE_MSG_QUEUE_FAILURE, __sync_fetch_and_add(&g_upward_xid, 1),controller);
     }
 
     POF_DEBUG_CPRINT_FL(1,GREEN,"pofec_reply_error DONE!");
@@ -104,7 +104,8 @@ uint32_t pofec_reply_error(uint16_t type, uint16_t code, char *s, uint32_t xid,i
  * Discribe: This function encapsulats the message, which the soft switch want
  *           to send to the Controller, to OpenFlow format. If msg_body is NULL,
  *           it means the message data has already written into the pofec_queue_msg_buf
- *           start on sizeof(pof_header).
+ *           start on sizeof(pof_header). Otherwise the message is built in a
+ *           buffer of this call, so any task can send it.
 *******************************************************************************/
 uint32_t  pofec_reply_msg(int i ,       \
 		                  uint8_t  type, \
@@ -115,6 +116,8 @@ uint32_t  pofec_reply_msg(int i ,       \
     pofsc_dev_conn_desc *conn_desc_ptr = (pofsc_dev_conn_desc *)&pofsc_conn_desc[i];
     pof_header* header_ptr;
     uint32_t total_len = msg_len + sizeof(pof_header);
+    char msg_buf[POF_QUEUE_MESSAGE_LEN];
+    char *buf_ptr;
 
     /* If valid, fetch one message and send it to controller. */
     switch(conn_desc_ptr->conn_status.state){
@@ -128,7 +131,21 @@ uint32_t  pofec_reply_msg(int i ,       \
 		case POFCS_REQUEST_GET_CONFIG:
         case POFCS_CHANNEL_RUN:
 
-			header_ptr = (pof_header*)queue_msg_bufs[i].pofec_queue_msg_buf;
+			if(total_len > POF_QUEUE_MESSAGE_LEN){
+				POF_ERROR_HANDLE_RETURN_NO_UPWARD(POFET_SOFTWARE_FAILED, POF_WRITE_MSG_QUEUE_FAILURE);
+			}
+
+			/* A message with a body is built on the stack of the caller, so
+			 * the receive workers can send packet-in at the same time. The
+			 * shared buffer is only used by the control task. */
+			if(msg_body != NULL){
+				buf_ptr = msg_buf;
+				memcpy(buf_ptr + sizeof(pof_header), (uint8_t*)msg_body, msg_len);
+			}else{
+				buf_ptr = queue_msg_bufs[i].pofec_queue_msg_buf;
+			}
+
+			header_ptr = (pof_header*)buf_ptr;
 			header_ptr->version = POF_VERSION;
 			header_ptr->type = type;
 			header_ptr->xid = xid;
@@ -136,11 +153,7 @@ uint32_t  pofec_reply_msg(int i ,       \
 
 			pof_HtoN_transfer_header(header_ptr);
 
-			if(msg_body != NULL){
-				memcpy(queue_msg_bufs[i].pofec_queue_msg_buf + sizeof(pof_header), (uint8_t*)msg_body, msg_len);
-			}
-
-			if(POF_OK != pofbf_queue_write(pofsc_send_q_id[i], queue_msg_bufs[i].pofec_queue_msg_buf, total_len, POF_WAIT_FOREVER)){
+			if(POF_OK != pofbf_queue_write(pofsc_send_q_id[i], buf_ptr, total_len, POF_WAIT_FOREVER)){
 				POF_ERROR_HANDLE_RETURN_NO_UPWARD(POFET_SOFTWARE_FAILED, POF_WRITE_MSG_QUEUE_FAILURE);
 			}
             break;
@@ -571,6 +571,8 @@ uint32_t pof_parse_msg_from_controller(char *msg_ptr, struct pof_datapath *dp, i
     pof_meter *meter_ptr;
     pof_group *group_ptr;
     struct pof_queryall_request *queryall_ptr;
+    pof_bundle_ctrl_msg *bundle_ptr;
+    pof_bundle_add_msg *bundle_add_ptr;
     struct pof_slot_config *slotConfig;
     struct pof_instruction_block *pof_insBlock;
     uint32_t ret = POF_OK;
@@ -715,11 +717,13 @@ uint32_t pof_parse_msg_from_controller(char *msg_ptr, struct pof_datapath *dp, i
                                                   table_ptr->match_field_num, \
                                                   table_ptr->match, \
                                                   lr);
+                    POFLR_MOD_GEN_INC(lr);
                 }
                 pof_table_to_p4(msg_ptr);
             } else if (table_ptr->command == POFTC_DELETE) {
                 HMAP_NODES_IN_STRUCT_TRAVERSE(lr, next, slotNode, dp->slotMap) {
                     ret = poflr_delete_flow_table(i, table_ptr->tid, table_ptr->type, lr);
+                    POFLR_MOD_GEN_INC(lr);
                 }
             } else {
                 POF_ERROR_HANDLE_RETURN_UPWARD(POFET_TABLE_MOD_FAILED, POFTMFC_BAD_COMMAND, g_recv_xid, i);
@@ -737,15 +741,18 @@ uint32_t pof_parse_msg_from_controller(char *msg_ptr, struct pof_datapath *dp, i
                 HMAP_NODES_IN_STRUCT_TRAVERSE(lr, next, slotNode, dp->slotMap) {
 
                     ret = poflr_add_flow_entry(flow_ptr, lr, i);
+                    POFLR_MOD_GEN_INC(lr);
 
                 }
             } else if (flow_ptr->command == POFFC_DELETE) {
                 HMAP_NODES_IN_STRUCT_TRAVERSE(lr, next, slotNode, dp->slotMap) {
                     ret = poflr_delete_flow_entry(flow_ptr, lr, i);
+                    POFLR_MOD_GEN_INC(lr);
                 }
             } else if (flow_ptr->command == POFFC_MODIFY) {
                 HMAP_NODES_IN_STRUCT_TRAVERSE(lr, next, slotNode, dp->slotMap) {
                     ret = poflr_modify_flow_entry(flow_ptr, lr, i);
+                    POFLR_MOD_GEN_INC(lr);
                 }
             } else {
                 POF_ERROR_HANDLE_RETURN_UPWARD(POFET_FLOW_MOD_FAILED, POFFMFC_BAD_COMMAND, g_recv_xid, i);
@@ -799,13 +806,17 @@ uint32_t pof_parse_msg_from_controller(char *msg_ptr, struct pof_datapath *dp, i
             pof_NtoH_transfer_packet_out(packet_out);
             //POF_DEBUG_CPRINT_OX_NO_ENTER(packet_out,sizeof(packet_out));
             struct pofdp_packet dpp[1] = {0};
+            struct pofdp_op act_ops[POF_MAX_ACTION_NUMBER_PER_INSTRUCTION];
+            uint8_t packetOutBuf[PFODP_PACKET_BUF_TOTAL_LEN];
             //POF_DEBUG_CPRINT(1,BLUE,"===============start memset\n");
             memset(dpp, 0, sizeof *dpp);
             //POF_DEBUG_CPRINT(1,BLUE,"===============memset success\n");
             //apply the packet_out to the pofdp_packet
-            dpp->packetBuf = dpp->buf;
+            dpp->bufStart = packetOutBuf;
+            dpp->bufEnd = packetOutBuf + sizeof packetOutBuf;
+            dpp->packetBuf = dpp->bufStart + POFDP_PACKET_PREBUF_LEN;
             //POF_DEBUG_CPRINT(1,BLUE,"===============%d point packetbuf to memory success\n",packet_out->packetLen);
-            memcpy(dpp->buf, packet_out->data, packet_out->packetLen);
+            memcpy(dpp->packetBuf, packet_out->data, packet_out->packetLen);
             //POF_DEBUG_CPRINT(1,BLUE,"===============memcpy success\n");
             /* Store packet data, length, received port infomation into the message queue. */
             // dpp->output_port_id=packet_out->inPort;
@@ -814,8 +825,13 @@ uint32_t pof_parse_msg_from_controller(char *msg_ptr, struct pof_datapath *dp, i
             dpp->left_len = dpp->ori_len;
             dpp->buf_offset = dpp->packetBuf;
             dpp->dp = dp;
-            dpp->act = (pof_action *) (packet_out->actionList);
-            POF_DEBUG_CPRINT_0X_NO_ENTER(dpp->act, 48 * 6);
+            POF_DEBUG_CPRINT_0X_NO_ENTER(packet_out->actionList, 48 * 6);
+            if (packet_out->actionNum > POF_MAX_ACTION_NUMBER_PER_INSTRUCTION) {
+                POF_ERROR_HANDLE_RETURN_UPWARD(POFET_BAD_ACTION, POFBAC_TOO_MANY, g_recv_xid, i);
+            }
+            /* The actions are executed once, decode them on the stack. */
+            pofdp_action_decode(act_ops, packet_out->actionList, packet_out->actionNum);
+            dpp->act = act_ops;
             dpp->act_num = packet_out->actionNum;
             //POF_DEBUG_CPRINT(1,BLUE,"===============dpp initialize success\n");
             ret = pofdp_action_execute(dpp, lr);
@@ -832,14 +848,17 @@ uint32_t pof_parse_msg_from_controller(char *msg_ptr, struct pof_datapath *dp, i
             if (meter_ptr->command == POFMC_ADD) {
                 HMAP_NODES_IN_STRUCT_TRAVERSE(lr, next, slotNode, dp->slotMap) {
                     ret = poflr_add_meter_entry(meter_ptr->meter_id, meter_ptr->rate, lr);
+                    POFLR_MOD_GEN_INC(lr);
                 }
             } else if (meter_ptr->command == POFMC_MODIFY) {
                 HMAP_NODES_IN_STRUCT_TRAVERSE(lr, next, slotNode, dp->slotMap) {
                     ret = poflr_modify_meter_entry(meter_ptr->meter_id, meter_ptr->rate, lr);
+                    POFLR_MOD_GEN_INC(lr);
                 }
             } else if (meter_ptr->command == POFMC_DELETE) {
                 HMAP_NODES_IN_STRUCT_TRAVERSE(lr, next, slotNode, dp->slotMap) {
                     ret = poflr_delete_meter_entry(meter_ptr->meter_id, meter_ptr->rate, lr);
+                    POFLR_MOD_GEN_INC(lr);
                 }
             } else {
                 POF_ERROR_HANDLE_RETURN_UPWARD(POFET_METER_MOD_FAILED, POFMMFC_BAD_COMMAND, g_recv_xid, i);
@@ -855,14 +874,17 @@ uint32_t pof_parse_msg_from_controller(char *msg_ptr, struct pof_datapath *dp, i
             if (group_ptr->command == POFGC_ADD) {
                 HMAP_NODES_IN_STRUCT_TRAVERSE(lr, next, slotNode, dp->slotMap) {
                     ret = poflr_add_group_entry(group_ptr, lr);
+                    POFLR_MOD_GEN_INC(lr);
                 }
             } else if (group_ptr->command == POFGC_MODIFY) {
                 HMAP_NODES_IN_STRUCT_TRAVERSE(lr, next, slotNode, dp->slotMap) {
                     ret = poflr_modify_group_entry(group_ptr, lr);
+                    POFLR_MOD_GEN_INC(lr);
                 }
             } else if (group_ptr->command == POFGC_DELETE) {
                 HMAP_NODES_IN_STRUCT_TRAVERSE(lr, next, slotNode, dp->slotMap) {
                     ret = poflr_delete_group_entry(group_ptr, lr);
+                    POFLR_MOD_GEN_INC(lr);
                 }
             } else {
                 POF_ERROR_HANDLE_RETURN_UPWARD(POFET_GROUP_MOD_FAILED, POFGMFC_BAD_COMMAND, g_recv_xid, i);
@@ -904,6 +926,86 @@ uint32_t pof_parse_msg_from_controller(char *msg_ptr, struct pof_datapath *dp, i
             }
             break;
 
+        case POFT_BUNDLE_CONTROL:
+            /* The message is transferred in place and sent back as the
+             * reply, so it has to be whole. */
+            if (len < sizeof(pof_header) + sizeof(pof_bundle_ctrl_msg)) {
+                POF_ERROR_HANDLE_RETURN_UPWARD(POFET_BUNDLE_FAILED, POFBFC_BAD_LEN, g_recv_xid, i);
+            }
+            bundle_ptr = (pof_bundle_ctrl_msg *) (msg_ptr + sizeof(pof_header));
+            pof_NtoH_transfer_bundle_ctrl(bundle_ptr);
+            if (pofsc_conn_desc[i].role != ROLE_MASTER) {
+                POF_ERROR_HANDLE_RETURN_UPWARD(POFET_BAD_REQUEST, POFBRC_IS_SLAVE, g_recv_xid, i);
+            }
+            switch (bundle_ptr->type) {
+                case POFBCT_OPEN_REQUEST:
+                    ret = poflr_bundle_open(bundle_ptr->bundle_id, i);
+                    break;
+                case POFBCT_CLOSE_REQUEST:
+                    ret = poflr_bundle_close(bundle_ptr->bundle_id, i);
+                    break;
+                case POFBCT_COMMIT_REQUEST:
+                    /* Committed to every slot or to none of them. A failed
+                     * bundle is kept, and the controller should discard it. */
+                    ret = poflr_bundle_commit(bundle_ptr->bundle_id, dp->slotMap, i);
+                    if (ret == POF_OK) {
+                        ret = poflr_bundle_discard(bundle_ptr->bundle_id, i);
+                    }
+                    break;
+                case POFBCT_DISCARD_REQUEST:
+                    ret = poflr_bundle_discard(bundle_ptr->bundle_id, i);
+                    break;
+                default:
+                    POF_ERROR_HANDLE_RETURN_UPWARD(POFET_BUNDLE_FAILED, POFBFC_BAD_TYPE, g_recv_xid, i);
+                    break;
+            }
+            POF_CHECK_RETVALUE_RETURN_NO_UPWARD(ret);
+
+            /* Every reply type follows its request type. */
+            bundle_ptr->type++;
+            pof_HtoN_transfer_bundle_ctrl(bundle_ptr);
+            if (POF_OK != pofec_reply_msg(i, POFT_BUNDLE_CONTROL, g_recv_xid, \
+                                          sizeof(pof_bundle_ctrl_msg), (uint8_t *) bundle_ptr)) {
+                POF_ERROR_HANDLE_RETURN_UPWARD(POFET_SOFTWARE_FAILED, POF_WRITE_MSG_QUEUE_FAILURE, g_recv_xid, i);
+            }
+            break;
+
+        case POFT_BUNDLE_ADD_MESSAGE:
+            if (len < sizeof(pof_header) + sizeof(pof_bundle_add_msg)) {
+                POF_ERROR_HANDLE_RETURN_UPWARD(POFET_BUNDLE_FAILED, POFBFC_BAD_LEN, g_recv_xid, i);
+            }
+            bundle_add_ptr = (pof_bundle_add_msg *) (msg_ptr + sizeof(pof_header));
+            pof_NtoH_transfer_bundle_add(bundle_add_ptr);
+            if (pofsc_conn_desc[i].role != ROLE_MASTER) {
+                POF_ERROR_HANDLE_RETURN_UPWARD(POFET_BAD_REQUEST, POFBRC_IS_SLAVE, g_recv_xid, i);
+            }
+            /* Only flow mods can be put into a bundle. */
+            if (bundle_add_ptr->message.type != POFT_FLOW_MOD) {
+                POF_ERROR_HANDLE_RETURN_UPWARD(POFET_BUNDLE_FAILED, POFBFC_MSG_UNSUP, g_recv_xid, i);
+            }
+            if (bundle_add_ptr->message.length != len - sizeof(pof_header) - offsetof(pof_bundle_add_msg, message)) {
+                POF_ERROR_HANDLE_RETURN_UPWARD(POFET_BUNDLE_FAILED, POFBFC_BAD_LEN, g_recv_xid, i);
+            }
+            /* The flow mod is transferred in place, so it has to be whole. */
+            if (bundle_add_ptr->message.length < sizeof(pof_header) + sizeof(pof_flow_entry)) {
+                POF_ERROR_HANDLE_RETURN_UPWARD(POFET_BUNDLE_FAILED, POFBFC_BAD_LEN, g_recv_xid, i);
+            }
+            flow_ptr = (pof_flow_entry *) (bundle_add_ptr + 1);
+            pof_NtoH_transfer_flow_entry(flow_ptr);
+            ret = poflr_bundle_add(bundle_add_ptr->bundle_id, flow_ptr, \
+                                   bundle_add_ptr->message.length - sizeof(pof_header), i);
+            POF_CHECK_RETVALUE_RETURN_NO_UPWARD(ret);
+            break;
+
+        case POFT_BARRIER_REQUEST:
+            /* Messages are handled in order, and every table, flow, meter
+             * and group mod before the barrier has bumped the modification
+             * generation, so any lookup from now on sees them. */
+            if (POF_OK != pofec_reply_msg(i, POFT_BARRIER_REPLY, g_recv_xid, 0, NULL)) {
+                POF_ERROR_HANDLE_RETURN_UPWARD(POFET_SOFTWARE_FAILED, POF_WRITE_MSG_QUEUE_FAILURE, g_recv_xid, i);
+            }
+            break;
+
         case POFT_QUERYALL_REQUEST:
             queryall_ptr = (struct pof_queryall_request *) (msg_ptr + sizeof(pof_header));
             pof_HtoN_transfer_queryall_request(queryall_ptr);
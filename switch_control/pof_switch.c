@@ -32,6 +32,7 @@
 #include "pof_datapath.h"
 #include "pof_byte_transfer.h"
 #include "pof_switch_listen.h"
+#include "pof_epoch.h"
 #include <sys/time.h>
 #include <stdio.h>
 #include <pthread.h>
@@ -40,7 +41,10 @@
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
-#include <sys/msg.h>
+#include <sys/epoll.h>
+#include <poll.h>
+#include <errno.h>
+#include <time.h>
 #include <signal.h>
 #include <linux/if_packet.h>
 #include <linux/if_ether.h>
@@ -81,8 +85,7 @@ pof_error pofsc_protocol_error;
 pthread_mutex_t mutex=PTHREAD_MUTEX_INITIALIZER;
 
 /* Task id. */
-task_t pofsc_main_task_id[10] = {0};
-task_t pofsc_send_task_id[10] = {0};
+task_t pofsc_main_task_id = 0;
 task_t pofsc_listen_task_id = 0;
 
 /* Message queue. */
@@ -90,7 +93,11 @@ uint32_t pofsc_send_q_id[10] = {POF_INVALID_QUEUEID};
 uint32_t send_q_id=POF_INVALID_QUEUEID;
 /* Timer. */
 uint32_t pofsc_echo_interval = POF_ECHO_INTERVAL;
-uint32_t pofsc_echo_timer_id[10] = {0};
+
+/* Event loop of the connections. */
+static int pofsc_epoll_fd = -1;
+static int pofsc_queue_fd[10];
+static int pofsc_conn_num = 0;
 
 /* Openflow connect state string. */
 char *pofsc_state_str[] = {
@@ -108,13 +115,17 @@ char *pofsc_state_str[] = {
 static uint32_t pofsc_main_task(void *arg_ptr);
 static uint32_t pofsc_init();
 static uint32_t pofsc_destroy(struct pof_datapath *dp);
-static uint32_t pofsc_send_msg_task(void *arg_ptr);
-static uint32_t pofsc_echo_timer(uint32_t timer_id, int arg);
+static void pofsc_conn_event(int i, uint32_t events, struct pof_datapath *dp);
+static void pofsc_conn_output(int i, struct pof_datapath *dp);
+static void pofsc_conn_timer(int i, struct pof_datapath *dp);
+static void pofsc_conn_lost(int i, struct pof_datapath *dp);
+static void pofsc_queue_drain(void *arg);
 static uint32_t pofsc_set_conn_attr(struct pofsc_controller controllers[], uint32_t retry_max, uint32_t retry_interval);
 static uint32_t pofsc_create_socket(int *socket_fd_ptr);
-static uint32_t pofsc_connect(int socket_fd, char *server_ip, uint16_t port, struct pof_datapath *dp,int i);
+static uint32_t pofsc_connect(int socket_fd, char *server_ip, uint16_t port);
+static uint32_t pofsc_get_dev_id(int socket_fd, struct pof_datapath *dp, int i);
 static uint32_t pofsc_recv(int socket_fd, char* buf,  int buflen, int* plen, struct pof_datapath *dp,int i);
-static uint32_t pofsc_send(int socket_fd, char* buf, int len, struct pof_datapath *dp,int i);
+static uint32_t pofsc_send(int socket_fd, char* buf, int len, int *plen, struct pof_datapath *dp,int i);
 static uint32_t pofsc_run_process(int i,char *message, uint16_t len, struct pof_datapath *dp);
 static uint32_t pofsc_build_header(pof_header *header, uint8_t type, uint16_t len, uint32_t xid);
 static uint32_t pofsc_set_error(uint16_t type, uint16_t code);
@@ -159,6 +170,7 @@ int main(int argc, char *argv[]){
     return ret;
 }
 
+
 /***********************************************************************
  * Start the OpenFlow communication module in Soft Switch.
  * Form:     uint32_t pofsc_init()
@@ -171,6 +183,8 @@ int main(int argc, char *argv[]){
  *           which is runing on the other PC as a server.
  ***********************************************************************/
 static uint32_t pofsc_init(){
+    int i;
+
     /* Set the signal handle function. */
     signal(SIGINT, terminate_handler);
     signal(SIGTERM, terminate_handler);
@@ -181,39 +195,27 @@ static uint32_t pofsc_init(){
                               pofsc_conn_max_retry, \
                               pofsc_conn_retry_interval);
 
-    /* Create one message queue for storing messages to be sent to controller. */
-    int i;
-    int a[10];
-    for (i=0;i<n_controller;i++){
-       controller_index=i;
-       a[i]=i;
-       if (POF_OK != pofbf_queue_create(&(pofsc_send_q_id[i]),i)){
+    /* Create one message queue for each controller for storing messages
+     * to be sent to it, and one ring for receiving messages from it. */
+    pofsc_conn_num = n_controller;
+    for (i=0;i<pofsc_conn_num;i++){
+        if (POF_OK != pofbf_queue_create(&(pofsc_send_q_id[i]))){
             POF_ERROR_CPRINT_FL("\nCreate message queue, fail and return!");
             return POF_ERROR;
-           }
-
-     /* Create connection and state machine task. */
-       if (POF_OK != pofbf_task_create(&a[i], (void *)pofsc_main_task, &pofsc_main_task_id[i])){
-            POF_ERROR_CPRINT_FL("\nCreate openflow main task, fail and return!");
+        }
+        if (POF_OK != pofbf_ring_map(POFSC_RECV_RING_SIZE, &((pofsc_dev_conn_desc *)&pofsc_conn_desc[i])->recv_buf)){
+            POF_ERROR_CPRINT_FL("\nCreate receive ring, fail and return!");
             return POF_ERROR;
-                       }
-           POF_DEBUG_CPRINT_FL(1,GREEN,">>Startup openflow task!");
+        }
+    }
 
-    /* Create one task for sending  message to controller asynchronously. */
-       if (POF_OK != pofbf_task_create(&a[i], (void *)pofsc_send_msg_task, &pofsc_send_task_id[i])){
+    /* Create one task for the connections with all of the controllers. */
+    if (POF_OK != pofbf_task_create(NULL, (void *)pofsc_main_task, &pofsc_main_task_id)){
         POF_ERROR_CPRINT_FL("\nCreate openflow main task, fail and return!");
         return POF_ERROR;
-        }
-         POF_DEBUG_CPRINT_FL(1,GREEN,">>Startup task for sending message!");
-
+    }
+    POF_DEBUG_CPRINT_FL(1,GREEN,">>Startup openflow task!");
 
-   /* Create one timer for sending echo message. */
-       if (POF_OK != pofbf_timer_create( 1000, pofsc_echo_interval, (void *)pofsc_echo_timer, &pofsc_echo_timer_id[i])){
-           POF_ERROR_CPRINT_FL("\nCreate echo timer, fail and return!");
-           return POF_ERROR;
-        }
-         POF_DEBUG_CPRINT_FL(1,GREEN,">>Create timer for sending echo message successfully!");
-       }
     /* Create one task for listening pofsctrl. */
     if (POF_OK != pofbf_task_create(NULL, (void *)pof_switch_listen_task, &pofsc_listen_task_id)){
         POF_ERROR_CPRINT_FL("\nCreate switch listen task, fail and return!");
@@ -221,8 +223,6 @@ static uint32_t pofsc_init(){
     }
     POF_DEBUG_CPRINT_FL(1,GREEN,">>Startup task for listening pofsctrl!");
 
-
-
     return POF_OK;
 }
 
@@ -232,544 +232,570 @@ static uint32_t pofsc_init(){
  * Input:    NONE
  * Output:   NONE
  * Return:   VOID
- * Discribe: This task function keeps running the state machine of Soft
- *           Switch. The Soft Switch always works on one of states.
- *           Before the POFCS_CHANNEL_RUN state, this function
- *           builds the connection with the Cntroller by sending and
- *           receiving the "Hello" packet, replying the requests from the
- *           Controller, and so on. During the POFCS_CHANNEL_RUN state,
- *           it receive OpenFlow messages from the Controller and send
- *           them to the other modules to handle.
+ * Discribe: This task function runs the connections with all of the
+ *           Controllers in one epoll loop. Every connection keeps its own
+ *           state machine. Before the POFCS_CHANNEL_RUN state, the
+ *           non-blocking socket is connected, the "Hello" packet is
+ *           exchanged, and the requests from the Controller are replied.
+ *           During the POFCS_CHANNEL_RUN state, the OpenFlow messages
+ *           from the Controller are sent to the other modules to handle.
+ *           The messages to the Controller are taken from the send queue
+ *           of the connection when the queue wakes up, and are written
+ *           until the socket is full. The rest are written when the
+ *           socket is writable again, so a slow Controller does not stall
+ *           the others. The connection retries and the echo requests are
+ *           checked every time epoll_wait() returns.
  ***********************************************************************/
 static uint32_t pofsc_main_task(void *arg_ptr){
-	int i=*(int*)arg_ptr;
-    pofsc_dev_conn_desc *conn_desc_ptr = (pofsc_dev_conn_desc *)&pofsc_conn_desc[i];
-    pof_header          *head_ptr, head;
-    int total_len = 0, tmp_len, left_len, rcv_len = 0, process_len = 0, packet_len = 0;
-    int socket_fd;
-    uint32_t ret;
+    struct epoll_event events[POFSC_EPOLL_EVENT_NUM], ev = {0};
     struct pof_datapath *dp = &g_dp;
-    struct pof_local_resource *lr, *lrNext;
+    uint64_t count;
+    int i, j, n;
 
     /* Clear error record. */
     pofsc_protocol_error.type = 0xffff;
-    /* State machine of the control module in Soft Switch. */
-    while(1)
-    {   POF_DEBUG_CPRINT(1,GREEN,">>this is the %d controller",i);
-        if(conn_desc_ptr->conn_status.state != POFCS_CHANNEL_RUN && !conn_desc_ptr->conn_retry_count){
-            POF_DEBUG_CPRINT_FL(1,BLUE, ">>Openflow Channel State: %s", pofsc_state_str[conn_desc_ptr->conn_status.state]);
-        }
-
-        switch(conn_desc_ptr->conn_status.state){
-            case POFCS_CHANNEL_INVALID:
-
-                /* Create openflow channel socket. */
-                ret = pofsc_create_socket(&socket_fd);
-                if(ret == POF_OK){
-                    conn_desc_ptr->sfd = socket_fd;
-                    conn_desc_ptr->conn_status.state = POFCS_CHANNEL_CONNECTING;
-                }else{
-                    POF_ERROR_CPRINT_FL(">>Create socket FAIL!");
-                    terminate_handler();
-                }
-                break;
 
-            case POFCS_CHANNEL_CONNECTING:
-                /* Connect controller. */
-				if(!conn_desc_ptr->conn_retry_count){
-					POF_DEBUG_CPRINT(1,GREEN,">>Connecting to POFController...\n");
-				}
-                ret = pofsc_connect(conn_desc_ptr->sfd, conn_desc_ptr->controller_ip, \
-                        conn_desc_ptr->controller_port,dp,i);
-                if(ret == POF_OK){
-                    POF_DEBUG_CPRINT_FL(1,GREEN,">>Connect to controler SUC! %s: %u", \
-                    		conn_desc_ptr->controller_ip, conn_desc_ptr->controller_port);
-                    conn_desc_ptr->conn_status.state = POFCS_CHANNEL_CONNECTED;
-					conn_desc_ptr->conn_retry_count = 0;
-                }else{
-					if(!conn_desc_ptr->conn_retry_count){
-						POF_DEBUG_CPRINT_FL(1,RED,">>Connect to controler FAIL!");
-					}
-                    /* Delay several seconds. */
-                    pofbf_task_delay(conn_desc_ptr->conn_retry_interval * 1000);
-                    conn_desc_ptr->conn_retry_count++;
-                    conn_desc_ptr->conn_status.last_error = (uint8_t)(POF_CONNECT_SERVER_FAILURE); /**/
-                    conn_desc_ptr->sfd = 0;
-                    conn_desc_ptr->conn_status.state = POFCS_CHANNEL_INVALID;
-                }
-                break;
-
-            case POFCS_CHANNEL_CONNECTED:
-                /* Send hello to controller. Hello message has no body. */
-                pofsc_build_header(&head, \
-                                   POFT_HELLO, \
-                                   sizeof(pof_header), \
-                                   g_upward_xid++);
-                /* send hello message. */
-                ret = pofsc_send(conn_desc_ptr->sfd, (char*)&head, sizeof(pof_header), dp,i);
-                if(ret == POF_OK){
-                    conn_desc_ptr->conn_status.state = POFCS_HELLO;
-                }else{
-                    POF_ERROR_CPRINT_FL("Send HELLO FAIL!");
-                }
-
-                break;
-
-            case POFCS_HELLO:
-                /* Receive hello from controller. */
-                total_len = 0;
-                left_len = 0;
-                rcv_len = 0;
-                process_len = 0;
-                ret = pofsc_recv(conn_desc_ptr->sfd, conn_desc_ptr->recv_buf , \
-                        POF_RECV_BUF_MAX_SIZE, &total_len, dp,i);
-                if(ret == POF_OK){
-                    POF_DEBUG_CPRINT_FL(1,GREEN,">>Recevie HELLO packet SUC!");
-//                    HMAP_NODES_IN_STRUCT_TRAVERSE(lr, lrNext, slotNode, dp->slotMap){
-//					    poflr_clear_resource(lr);
-//                    }
-                    conn_desc_ptr->conn_status.state = POFCS_REQUEST_FEATURE;
-                }else{
-                    POF_ERROR_CPRINT_FL("Recv HELLO FAILE!");
-                    break;
-                }
-                rcv_len += total_len;
-
-                /* Parse. */
-                head_ptr = (pof_header *)conn_desc_ptr->recv_buf;
-                while(total_len < POF_NTOHS(head_ptr->length)){
-                    ret = pofsc_recv(conn_desc_ptr->sfd, conn_desc_ptr->recv_buf  + rcv_len, \
-                            POF_RECV_BUF_MAX_SIZE -rcv_len,  &tmp_len, dp,i);
-                    if(ret != POF_OK){
-                        POF_ERROR_CPRINT_FL("Recv HELLO FAILE!");
-                        break;
-                    }
-
-                    total_len += tmp_len;
-                    rcv_len += tmp_len;
-                }
+    if((pofsc_epoll_fd = epoll_create1(0)) == -1){
+        POF_ERROR_CPRINT_FL(">>Create epoll FAIL!");
+        terminate_handler();
+    }
 
-                if(conn_desc_ptr->conn_status.state == POFCS_CHANNEL_INVALID){
-                    break;
-                }
+    /* The send queues wake up the loop. */
+    for(i=0; i<pofsc_conn_num; i++){
+        if(pofbf_queue_poll_fd(pofsc_send_q_id[i], pofsc_queue_drain, \
+                    (void *)(intptr_t)i, &pofsc_queue_fd[i]) != POF_OK){
+            terminate_handler();
+        }
+        ev.events = EPOLLIN;
+        ev.data.u32 = POFSC_EVENT_QUEUE | i;
+        if(epoll_ctl(pofsc_epoll_fd, EPOLL_CTL_ADD, pofsc_queue_fd[i], &ev) != 0){
+            POF_ERROR_CPRINT_FL(">>Poll message queue FAIL!");
+            terminate_handler();
+        }
+    }
 
-                /* Check any error. */
-                if(head_ptr->version > POF_VERSION){
-                    POF_ERROR_CPRINT_FL("Version of recv-packet is higher than support!");
-                    close(conn_desc_ptr->sfd);
-                    conn_desc_ptr->conn_status.state = POFCS_CHANNEL_INVALID;
-                }else if(head_ptr->type != POFT_HELLO){
-                    POF_ERROR_CPRINT_FL("Type of recv-packet is not HELLO, which we want to recv!");
-                    close(conn_desc_ptr->sfd);
-                    conn_desc_ptr->conn_status.state = POFCS_CHANNEL_INVALID;
-                }
+    while(1){
+        /* Set the pthread cancel point. */
+        pthread_testcancel();
 
-                process_len += POF_NTOHS(head_ptr->length);
-                left_len = rcv_len - process_len;
-                if(left_len == 0){
-                    rcv_len = 0;
-                    process_len = 0;
-                }
-                break;
+        for(i=0; i<pofsc_conn_num; i++){
+            pofsc_conn_timer(i, dp);
+        }
 
-            case POFCS_REQUEST_FEATURE:
-                /* Wait to receive feature request from controller. */
-                head_ptr = (pof_header *)(conn_desc_ptr->recv_buf  + process_len);
-                if(!((left_len >= sizeof(pof_header))&&(left_len >= POF_NTOHS(head_ptr->length)))){
-                    ret = pofsc_recv(conn_desc_ptr->sfd, (conn_desc_ptr->recv_buf  + rcv_len), \
-                            POF_RECV_BUF_MAX_SIZE - rcv_len, &total_len, dp,i);
-                    if(ret == POF_OK){
-                        conn_desc_ptr->conn_status.state = POFCS_SET_CONFIG;
-
-                    }else{
-                        POF_ERROR_CPRINT_FL("Feature request FAIL!");
-                        break;
-                    }
-
-                    rcv_len += total_len;
-                    total_len += left_len;
-
-                    head_ptr = (pof_header *)(conn_desc_ptr->recv_buf + process_len);
-                    while(total_len < POF_NTOHS(head_ptr->length)){
-                        ret = pofsc_recv(conn_desc_ptr->sfd, ((conn_desc_ptr->recv_buf  + rcv_len)), \
-                                POF_RECV_BUF_MAX_SIZE-rcv_len ,&tmp_len, dp,i);
-                        if(ret != POF_OK){
-                            POF_ERROR_CPRINT_FL("Feature request FAIL!");
-                            break;
-                        }
-                        total_len += tmp_len;
-                        rcv_len += tmp_len;
-                    }
+        n = epoll_wait(pofsc_epoll_fd, events, POFSC_EPOLL_EVENT_NUM, POFSC_EPOLL_TIMEOUT);
+        for(j=0; j<n; j++){
+            i = events[j].data.u32 & ~POFSC_EVENT_QUEUE;
+            if(events[j].data.u32 & POFSC_EVENT_QUEUE){
+                /* Clear the wakeup before taking the messages. */
+                if(read(pofsc_queue_fd[i], &count, sizeof count) < 0){
+                    continue;
                 }
+                pofsc_conn_output(i, dp);
+            }else{
+                pofsc_conn_event(i, events[j].events, dp);
+            }
+        }
 
-                if(conn_desc_ptr->conn_status.state == POFCS_CHANNEL_INVALID){
-                    break;
-                }
+        /* Free the objects retired by the messages above, once the
+         * datapath workers have passed a quiescent point. */
+        epoch_reclaim();
+    }
+    return POF_OK;
+}
 
-                head_ptr = (pof_header *)(conn_desc_ptr->recv_buf  + process_len);
+/* Monotonic time in millisecond. */
+static uint64_t pofsc_time_ms(){
+    struct timespec ts;
 
-                /* Check any error. */
-                if(head_ptr->type != POFT_FEATURES_REQUEST){
-                    close(conn_desc_ptr->sfd);
-                    conn_desc_ptr->conn_status.state = POFCS_CHANNEL_INVALID;
-                    break;
-                }
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
 
-                POF_DEBUG_CPRINT_FL(1,GREEN,">>Recevie FEATURE_REQUEST packet SUC!");
-                conn_desc_ptr->conn_status.state = POFCS_SET_CONFIG;
-                packet_len = POF_NTOHS(head_ptr->length);
-                ret = pof_parse_msg_from_controller(conn_desc_ptr->recv_buf + process_len, dp,i);
+static void pofsc_conn_state_set(int i, uint8_t state){
+    pofsc_dev_conn_desc *conn_desc_ptr = (pofsc_dev_conn_desc *)&pofsc_conn_desc[i];
 
+    conn_desc_ptr->conn_status.state = state;
+    if(state != POFCS_CHANNEL_RUN && !conn_desc_ptr->conn_retry_count){
+        POF_DEBUG_CPRINT_FL(1,BLUE, ">>Openflow Channel State: %s", pofsc_state_str[state]);
+    }
+}
 
+/* Set the events of the socket of the connection to be polled. */
+static void pofsc_conn_watch(int i, uint32_t events){
+    pofsc_dev_conn_desc *conn_desc_ptr = (pofsc_dev_conn_desc *)&pofsc_conn_desc[i];
+    struct epoll_event ev = {0};
+    int op = conn_desc_ptr->events ? EPOLL_CTL_MOD : EPOLL_CTL_ADD;
 
-                if(ret != POF_OK){
-                    POF_ERROR_CPRINT_FL("Features request FAIL!");
-                    terminate_handler();
-                    break;
-                }
+    if(conn_desc_ptr->events == events){
+        return;
+    }
+    ev.events = events;
+    ev.data.u32 = i;
+    if(epoll_ctl(pofsc_epoll_fd, op, conn_desc_ptr->sfd, &ev) != 0){
+        POF_ERROR_CPRINT_FL(">>Poll socket FAIL!");
+        terminate_handler();
+    }
+    conn_desc_ptr->events = events;
+}
 
-                process_len += packet_len;
-                left_len = rcv_len - process_len;
-                if(left_len == 0){
-                    rcv_len = 0;
-                    process_len = 0;
-                }
+/* Close the socket of the connection. The unsent part of the pending
+ * message will be sent again from the beginning after reconnecting. */
+static void pofsc_conn_close(int i){
+    pofsc_dev_conn_desc *conn_desc_ptr = (pofsc_dev_conn_desc *)&pofsc_conn_desc[i];
 
-                break;
+    if(conn_desc_ptr->sfd != POFSC_INVALID_SFD){
+        if(conn_desc_ptr->events){
+            epoll_ctl(pofsc_epoll_fd, EPOLL_CTL_DEL, conn_desc_ptr->sfd, NULL);
+        }
+        close(conn_desc_ptr->sfd);
+    }
+    conn_desc_ptr->sfd = POFSC_INVALID_SFD;
+    conn_desc_ptr->events = 0;
+    conn_desc_ptr->recv_head = 0;
+    conn_desc_ptr->recv_tail = 0;
+    conn_desc_ptr->send_offset = 0;
+    conn_desc_ptr->conn_status.state = POFCS_CHANNEL_INVALID;
+}
 
-            case POFCS_SET_CONFIG:
-                /* Receive set_config message from controller. */
-                head_ptr = (pof_header *)(conn_desc_ptr->recv_buf  + process_len);
-                if(!((left_len >= sizeof(pof_header))&&(left_len >= POF_NTOHS(head_ptr->length)))){
-                    ret = pofsc_recv(conn_desc_ptr->sfd, (conn_desc_ptr->recv_buf  + rcv_len), \
-                            POF_RECV_BUF_MAX_SIZE - rcv_len, &total_len, dp,i);
-                    if(ret == POF_OK){
-                        conn_desc_ptr->conn_status.state = POFCS_REQUEST_GET_CONFIG;
-                    }else{
-                        POF_ERROR_CPRINT_FL("Set config FAIL!");
-                        break;
-                    }
-
-                    rcv_len += total_len;
-                    total_len += left_len;
-
-                    head_ptr = (pof_header *)(conn_desc_ptr->recv_buf + process_len);
-                    while(total_len < POF_NTOHS(head_ptr->length)){
-                        ret = pofsc_recv(conn_desc_ptr->sfd, ((conn_desc_ptr->recv_buf  + rcv_len)), \
-                                POF_RECV_BUF_MAX_SIZE-rcv_len ,&tmp_len, dp,i);
-                        if(ret != POF_OK){
-                            POF_ERROR_CPRINT_FL("Set config FAIL!");
-                            break;
-                        }
-                        total_len += tmp_len;
-                        rcv_len += tmp_len;
-                    }
-                }
+/* The connection to the controller is lost. */
+static void pofsc_conn_lost(int i, struct pof_datapath *dp){
+    pofsc_conn_close(i);
+    if(n_controller>0){
+        n_controller--;
+    }
+    POF_DEBUG("lost--n_controller=%d\n",n_controller);
+    pofsc_performance_after_ctrl_disconn(dp,i);
+}
 
-                if(conn_desc_ptr->conn_status.state == POFCS_CHANNEL_INVALID){
-                    break;
-                }
+/* Connecting fails. Connect again after the retry interval. */
+static void pofsc_conn_retry(int i){
+    pofsc_dev_conn_desc *conn_desc_ptr = (pofsc_dev_conn_desc *)&pofsc_conn_desc[i];
 
-                head_ptr = (pof_header *)(conn_desc_ptr->recv_buf  + process_len);
-
-                /* Check any error. */
-                if(head_ptr->version > POF_VERSION){
-                    POF_ERROR_CPRINT_FL("Version of recv-packet is higher than support!");
-                    POF_ERROR_CPRINT_FL("Set config FAIL!");
-                    close(conn_desc_ptr->sfd);
-                    conn_desc_ptr->conn_status.state = POFCS_CHANNEL_INVALID;
-                    break;
-                }else if(head_ptr->type != POFT_SET_CONFIG){
-                    POF_ERROR_CPRINT_FL("Type of recv-packet is not SET_CONFIG, which we want to recv!");
-                    POF_ERROR_CPRINT_FL("Set config FAIL!");
-                    close(conn_desc_ptr->sfd);
-                    conn_desc_ptr->conn_status.state = POFCS_CHANNEL_INVALID;
-                    break;
-                }
+    if(!conn_desc_ptr->conn_retry_count){
+        POF_DEBUG_CPRINT_FL(1,RED,">>Connect to controler FAIL!");
+    }
+    pofsc_conn_close(i);
+    conn_desc_ptr->conn_retry_count++;
+    conn_desc_ptr->conn_status.last_error = (uint8_t)(POF_CONNECT_SERVER_FAILURE);
+    conn_desc_ptr->retry_time = pofsc_time_ms() + conn_desc_ptr->conn_retry_interval * 1000;
+}
 
-                POF_DEBUG_CPRINT_FL(1,BLUE,">>Recevie SET_CONFIG packet SUC!");
-                conn_desc_ptr->conn_status.state = POFCS_REQUEST_GET_CONFIG;
-                packet_len = POF_NTOHS(head_ptr->length);
-                ret = pof_parse_msg_from_controller(conn_desc_ptr->recv_buf + process_len, dp,i);
+/* Create the socket and start connecting. */
+static void pofsc_conn_start(int i){
+    pofsc_dev_conn_desc *conn_desc_ptr = (pofsc_dev_conn_desc *)&pofsc_conn_desc[i];
+    int socket_fd = POFSC_INVALID_SFD;
 
+    /* Create openflow channel socket. */
+    if(pofsc_create_socket(&socket_fd) != POF_OK || socket_fd == POFSC_INVALID_SFD){
+        POF_ERROR_CPRINT_FL(">>Create socket FAIL!");
+        terminate_handler();
+        return;
+    }
+    conn_desc_ptr->sfd = socket_fd;
+    pofsc_conn_state_set(i, POFCS_CHANNEL_CONNECTING);
 
+    /* Connect controller. */
+    if(!conn_desc_ptr->conn_retry_count){
+        POF_DEBUG_CPRINT(1,GREEN,">>Connecting to POFController...\n");
+    }
+    if(pofsc_connect(socket_fd, conn_desc_ptr->controller_ip, conn_desc_ptr->controller_port) != POF_OK){
+        pofsc_conn_retry(i);
+        return;
+    }
 
-                if(ret != POF_OK){
-                    POF_ERROR_CPRINT_FL("Set config FAIL!");
-                    terminate_handler();
-                    break;
-                }
+    /* Writable when the connecting finishes. */
+    pofsc_conn_watch(i, EPOLLOUT);
+}
 
-                process_len += packet_len;
-                left_len = rcv_len - process_len;
+/* The socket is connected. Send hello to controller. */
+static void pofsc_conn_connected(int i, struct pof_datapath *dp){
+    pofsc_dev_conn_desc *conn_desc_ptr = (pofsc_dev_conn_desc *)&pofsc_conn_desc[i];
+    pof_header head;
+    int len;
 
-                if(left_len == 0){
-                    rcv_len = 0;
-                    process_len = 0;
-                }
-                break;
+    if(pofsc_get_dev_id(conn_desc_ptr->sfd, dp, i) != POF_OK){
+        pofsc_conn_retry(i);
+        return;
+    }
+    POF_DEBUG_CPRINT_FL(1,GREEN,">>Connect to controler SUC! %s: %u", \
+            conn_desc_ptr->controller_ip, conn_desc_ptr->controller_port);
+    conn_desc_ptr->conn_retry_count = 0;
+    pofsc_conn_state_set(i, POFCS_CHANNEL_CONNECTED);
+
+    /* Send hello to controller. Hello message has no body. */
+    pofsc_build_header(&head, \
+                       POFT_HELLO, \
+                       sizeof(pof_header), \
+                       __sync_fetch_and_add(&g_upward_xid, 1));
+    if(pofsc_send(conn_desc_ptr->sfd, (char*)&head, sizeof(pof_header), &len, dp, i) != POF_OK){
+        POF_ERROR_CPRINT_FL("Send HELLO FAIL!");
+        return;
+    }
+    if(len != sizeof(pof_header)){
+        POF_ERROR_CPRINT_FL("Send HELLO FAIL!");
+        pofsc_conn_close(i);
+        return;
+    }
 
-            case POFCS_REQUEST_GET_CONFIG:
-                /* Wait to receive feature request from controller. */
-                head_ptr = (pof_header *)(conn_desc_ptr->recv_buf  + process_len);
-                if(!((left_len >= sizeof(pof_header)) && (left_len >= POF_NTOHS(head_ptr->length)))){
-                    ret = pofsc_recv(conn_desc_ptr->sfd, (conn_desc_ptr->recv_buf  + rcv_len), \
-                            POF_RECV_BUF_MAX_SIZE - rcv_len, &total_len, dp,i);
-                    if(ret == POF_OK){
-                        conn_desc_ptr->conn_status.state = POFCS_CHANNEL_RUN;
-                    }else{
-                        POF_ERROR_CPRINT_FL("Get config FAIL!");
-                        break;
-                    }
-
-                    rcv_len += total_len;
-                    total_len += left_len;
-
-                    head_ptr = (pof_header *)(conn_desc_ptr->recv_buf + process_len);
-                    while(total_len < POF_NTOHS(head_ptr->length)){
-                        ret = pofsc_recv(conn_desc_ptr->sfd, ((conn_desc_ptr->recv_buf  + rcv_len)), \
-                                POF_RECV_BUF_MAX_SIZE-rcv_len ,&tmp_len, dp,i);
-                        if(ret != POF_OK){
-                            POF_ERROR_CPRINT_FL("Get config FAIL!");
-                            break;
-                        }
-
-                        total_len += tmp_len;
-                        rcv_len += tmp_len;
-                    }
-                }
+    pofsc_conn_state_set(i, POFCS_HELLO);
+    pofsc_conn_watch(i, EPOLLIN);
+}
 
-                if(conn_desc_ptr->conn_status.state == POFCS_CHANNEL_INVALID){
-                    break;
-                }
+/***********************************************************************
+ * Handle one message from the Controller.
+ * Form:     static uint32_t pofsc_conn_msg(int i, char *message, \
+ *                                          uint16_t len, \
+ *                                          struct pof_datapath *dp)
+ * Input:    controller index, message, length
+ * Output:   NONE
+ * Return:   POF_OK or ERROR code
+ * Discribe: This function handles the message according to the state of
+ *           the connection. Before the POFCS_CHANNEL_RUN state, only the
+ *           message which the state waits for is accepted. Otherwise
+ *           the socket is closed and POF_ERROR is returned.
+ ***********************************************************************/
+static uint32_t pofsc_conn_msg(int i, char *message, uint16_t len, struct pof_datapath *dp){
+    pofsc_dev_conn_desc *conn_desc_ptr = (pofsc_dev_conn_desc *)&pofsc_conn_desc[i];
+    pof_header *head_ptr = (pof_header *)message;
+    uint16_t tmp_len;
+    uint32_t ret;
 
-                head_ptr = (pof_header *)(conn_desc_ptr->recv_buf  + process_len);
-                /* Check any error. */
-                if(head_ptr->type != POFT_GET_CONFIG_REQUEST){
-                    POF_ERROR_CPRINT_FL("Get config FAIL!");
-                    close(conn_desc_ptr->sfd);
-                    conn_desc_ptr->conn_status.state = POFCS_CHANNEL_INVALID;
-                    break;
-                }
+    switch(conn_desc_ptr->conn_status.state){
+        case POFCS_HELLO:
+            /* Check any error. */
+            if(head_ptr->version > POF_VERSION){
+                POF_ERROR_CPRINT_FL("Version of recv-packet is higher than support!");
+                pofsc_conn_close(i);
+                return POF_ERROR;
+            }else if(head_ptr->type != POFT_HELLO){
+                POF_ERROR_CPRINT_FL("Type of recv-packet is not HELLO, which we want to recv!");
+                pofsc_conn_close(i);
+                return POF_ERROR;
+            }
+            POF_DEBUG_CPRINT_FL(1,GREEN,">>Recevie HELLO packet SUC!");
+            pofsc_conn_state_set(i, POFCS_REQUEST_FEATURE);
+            break;
 
-                POF_DEBUG_CPRINT_FL(1,GREEN,">>Recevie GET_CONFIG_REQUEST packet SUC!");
-                packet_len = POF_NTOHS(head_ptr->length);
-                ret = pof_parse_msg_from_controller(conn_desc_ptr->recv_buf + process_len, dp,i);
-                if(ret != POF_OK){
-                    POF_ERROR_CPRINT_FL("Get config FAIL!");
-                    terminate_handler();
-                    break;
-                }
+        case POFCS_REQUEST_FEATURE:
+            /* Check any error. */
+            if(head_ptr->type != POFT_FEATURES_REQUEST){
+                pofsc_conn_close(i);
+                return POF_ERROR;
+            }
 
-                process_len += packet_len;
-                left_len = rcv_len - process_len;
+            POF_DEBUG_CPRINT_FL(1,GREEN,">>Recevie FEATURE_REQUEST packet SUC!");
+            pofsc_conn_state_set(i, POFCS_SET_CONFIG);
+            ret = pof_parse_msg_from_controller(message, dp,i);
+            if(ret != POF_OK){
+                POF_ERROR_CPRINT_FL("Features request FAIL!");
+                terminate_handler();
+            }
+            break;
 
-                if(left_len == 0){
-                    rcv_len = 0;
-                    process_len = 0;
-                }
+        case POFCS_SET_CONFIG:
+            /* Check any error. */
+            if(head_ptr->version > POF_VERSION){
+                POF_ERROR_CPRINT_FL("Version of recv-packet is higher than support!");
+                POF_ERROR_CPRINT_FL("Set config FAIL!");
+                pofsc_conn_close(i);
+                return POF_ERROR;
+            }else if(head_ptr->type != POFT_SET_CONFIG){
+                POF_ERROR_CPRINT_FL("Type of recv-packet is not SET_CONFIG, which we want to recv!");
+                POF_ERROR_CPRINT_FL("Set config FAIL!");
+                pofsc_conn_close(i);
+                return POF_ERROR;
+            }
 
-				//sleep(1);
-				if (n_controller==1){
-				    conn_desc_ptr->role=2;
-                }
-				else{
-					conn_desc_ptr->role=1;
-                }
-                conn_desc_ptr->conn_status.state = POFCS_CHANNEL_RUN;
-				POF_DEBUG_CPRINT(1,GREEN,">>Connect to POFController successfully!\n");
+            POF_DEBUG_CPRINT_FL(1,BLUE,">>Recevie SET_CONFIG packet SUC!");
+            pofsc_conn_state_set(i, POFCS_REQUEST_GET_CONFIG);
+            ret = pof_parse_msg_from_controller(message, dp,i);
+            if(ret != POF_OK){
+                POF_ERROR_CPRINT_FL("Set config FAIL!");
+                terminate_handler();
+            }
+            break;
 
-                break;
+        case POFCS_REQUEST_GET_CONFIG:
+            /* Check any error. */
+            if(head_ptr->type != POFT_GET_CONFIG_REQUEST){
+                POF_ERROR_CPRINT_FL("Get config FAIL!");
+                pofsc_conn_close(i);
+                return POF_ERROR;
+            }
 
-            case POFCS_CHANNEL_RUN:
-                /* Wait to receive feature request from controller. */
-                head_ptr = (pof_header *)(conn_desc_ptr->recv_buf  + process_len);
-                if(!((left_len >= sizeof(pof_header))&&(left_len >= POF_NTOHS(head_ptr->length)))){
-                /* Resv_buf has no space, so should move the left data to the head of the buf. */
-                if(POF_RECV_BUF_MAX_SIZE == rcv_len){
-                    memcpy(conn_desc_ptr->recv_buf,  conn_desc_ptr->recv_buf  + process_len, left_len);
-                    rcv_len = left_len;
-                    process_len = 0;
-                   }
-                ret = pofsc_recv(conn_desc_ptr->sfd, (conn_desc_ptr->recv_buf  + rcv_len), \
-                POF_RECV_BUF_MAX_SIZE - rcv_len, &total_len, dp, i);
-
-                if(ret != POF_OK){
-                	POF_DEBUG_CPRINT(1,GREEN,">>\n *********************************");
-                        break;
-                  }
-
-                rcv_len += total_len;
-                total_len += left_len;
-
-                head_ptr = (pof_header *)(conn_desc_ptr->recv_buf + process_len);
-                while(total_len < POF_NTOHS(head_ptr->length)){
-                left_len = rcv_len - process_len;
-                /* Resv_buf has no space, so should move the left data to the head of the buf. */
-                if(POF_RECV_BUF_MAX_SIZE == rcv_len){
-                memcpy(conn_desc_ptr->recv_buf,  conn_desc_ptr->recv_buf  + process_len, left_len);
-                   rcv_len = left_len;
-                   process_len = 0;
-                  }
-
-                ret = pofsc_recv(conn_desc_ptr->sfd, ((conn_desc_ptr->recv_buf  + rcv_len)), \
-                               POF_RECV_BUF_MAX_SIZE-rcv_len ,&tmp_len, dp,i);
-                       if(ret != POF_OK){
-                    	   POF_DEBUG_CPRINT(1,GREEN,">>\nReceive message error");
-                          break;
-                        }
-                total_len += tmp_len;
-                rcv_len += tmp_len;
-                   }
-                }
+            POF_DEBUG_CPRINT_FL(1,GREEN,">>Recevie GET_CONFIG_REQUEST packet SUC!");
+            ret = pof_parse_msg_from_controller(message, dp,i);
+            if(ret != POF_OK){
+                POF_ERROR_CPRINT_FL("Get config FAIL!");
+                terminate_handler();
+            }
 
+            if (n_controller==1){
+                conn_desc_ptr->role=2;
+            }
+            else{
+                conn_desc_ptr->role=1;
+            }
+            conn_desc_ptr->echo_time = pofsc_time_ms() + pofsc_echo_interval;
+            pofsc_conn_state_set(i, POFCS_CHANNEL_RUN);
+            POF_DEBUG_CPRINT(1,GREEN,">>Connect to POFController successfully!\n");
+            break;
 
+        case POFCS_CHANNEL_RUN:
+            /* Handle the message. Echo messages will be processed here and other messages will be forwarded to LUP. */
+            ret = pofsc_run_process(i, message, len, dp);
+            break;
 
-                if(conn_desc_ptr->conn_status.state == POFCS_CHANNEL_INVALID){
-                    break;
-                }
+        default:
+            conn_desc_ptr->conn_status.last_error = (uint8_t)POF_WRONG_CHANNEL_STATE;
+            break;
+    }
 
-                head_ptr = (pof_header *)(conn_desc_ptr->recv_buf  + process_len);
-                packet_len = POF_NTOHS(head_ptr->length);
-                /* Handle the message. Echo messages will be processed here and other messages will be forwarded to LUP. */
-                ret = pofsc_run_process(i,conn_desc_ptr->recv_buf + process_len, packet_len, dp);
+    /* If any error is detected, reply to controller immediately. */
+    if(pofsc_protocol_error.type != 0xffff){
+        tmp_len = 0;
+        /* Build error message. */
+        (void)pofsc_build_error_msg(conn_desc_ptr->send_buf, &tmp_len);
 
-                process_len += packet_len;
-                left_len = rcv_len - process_len;
+        /* Write error message in queue for sending. */
+        ret = pofbf_queue_write(pofsc_send_q_id[i], conn_desc_ptr->send_buf, (uint32_t)tmp_len, POF_WAIT_FOREVER);
+        POF_CHECK_RETVALUE_TERMINATE(ret);
+    }
+    return POF_OK;
+}
 
-                if(left_len == 0){
-                    rcv_len = 0;
-                    process_len = 0;
-                }
-                break;
+/***********************************************************************
+ * Receive messages from the Controller.
+ * Form:     static void pofsc_conn_input(int i, struct pof_datapath *dp)
+ * Input:    controller index
+ * Output:   NONE
+ * Return:   VOID
+ * Discribe: This function reads the socket once into the free space of
+ *           the receive ring, and handles all of the whole messages in
+ *           it in place. The part of the last message stays in the ring
+ *           and waits for the rest of it. The ring is mapped twice in a
+ *           row, so a message wrapping around the end of the ring is
+ *           still contiguous and is never copied. One read for each
+ *           event keeps a busy Controller from starving the others.
+ ***********************************************************************/
+static void pofsc_conn_input(int i, struct pof_datapath *dp){
+    pofsc_dev_conn_desc *conn_desc_ptr = (pofsc_dev_conn_desc *)&pofsc_conn_desc[i];
+    pof_header *head_ptr;
+    uint32_t packet_len;
+    int len;
 
-            default:
-                conn_desc_ptr->conn_status.last_error = (uint8_t)POF_WRONG_CHANNEL_STATE;
-                break;
+    /* Head is always below POFSC_RECV_RING_SIZE, so the free space after
+     * the tail is contiguous in the mirrored mapping. */
+    if(pofsc_recv(conn_desc_ptr->sfd, conn_desc_ptr->recv_buf + conn_desc_ptr->recv_tail, \
+                POFSC_RECV_RING_SIZE - (conn_desc_ptr->recv_tail - conn_desc_ptr->recv_head), \
+                &len, dp, i) != POF_OK){
+        return;
+    }
+    conn_desc_ptr->recv_tail += len;
+
+    while(conn_desc_ptr->recv_tail - conn_desc_ptr->recv_head >= sizeof(pof_header)){
+        head_ptr = (pof_header *)(conn_desc_ptr->recv_buf + conn_desc_ptr->recv_head);
+        packet_len = POF_NTOHS(head_ptr->length);
+        if(packet_len < sizeof(pof_header) || packet_len > POF_RECV_BUF_MAX_SIZE){
+            POF_ERROR_CPRINT_FL("Length of recv-packet is wrong!");
+            pofsc_conn_close(i);
+            return;
+        }
+        if(conn_desc_ptr->recv_tail - conn_desc_ptr->recv_head < packet_len){
+            break;
         }
 
-        /* If any error is detected, reply to controller immediately. */
-        if(pofsc_protocol_error.type != 0xffff){
-            tmp_len = 0;
-            /* Build error message. */
-            (void)pofsc_build_error_msg(conn_desc_ptr->send_buf, (uint16_t*)&tmp_len);
-
-            /* Write error message in queue for sending. */
-            ret = pofbf_queue_write(pofsc_send_q_id[i], conn_desc_ptr->send_buf, (uint32_t)tmp_len, POF_WAIT_FOREVER);
-            POF_CHECK_RETVALUE_TERMINATE(ret);
+        /* The connection may be lost while sending the replies. */
+        if(pofsc_conn_msg(i, (char *)head_ptr, packet_len, dp) != POF_OK || \
+                conn_desc_ptr->sfd == POFSC_INVALID_SFD){
+            return;
         }
+        conn_desc_ptr->recv_head += packet_len;
+    }
+
+    if(conn_desc_ptr->recv_head >= POFSC_RECV_RING_SIZE){
+        conn_desc_ptr->recv_head -= POFSC_RECV_RING_SIZE;
+        conn_desc_ptr->recv_tail -= POFSC_RECV_RING_SIZE;
     }
-    return;
+
+    /* The replies may be sendable only in the new state. */
+    pofsc_conn_output(i, dp);
 }
 
 /***********************************************************************
- * OpenFlow communication module task for sending message asynchronously.
- * Form:     uint32_t pofsc_send_msg_task(void *arg_ptr)
- * Input:    NONE
+ * Send messages to the Controller.
+ * Form:     static void pofsc_conn_output(int i, struct pof_datapath *dp)
+ * Input:    controller index
  * Output:   NONE
  * Return:   VOID
- * Discribe: Any message is first sent into messaage queue, and the task
- *           always check the message queue for sending. The messages
- *           include two types:
- *           1. Reply to controllers' request.
- *           2. Asynchrous message.
- *           The two types messages are built and sent to queue by two
- *           different tasks.
+ * Discribe: This function takes the messages from the send queue, and
+ *           writes them until the queue is empty or the socket is full.
+ *           If the socket is full, the message is kept in the msg_buf,
+ *           and the rest of it is written when the socket is writable.
+ *           If the connection is lost, the message is kept to be sent
+ *           again after reconnecting.
  ***********************************************************************/
-static uint32_t pofsc_send_msg_task(void *arg_ptr){
-	int i=*(int*)arg_ptr;
-	POF_DEBUG_CPRINT_FL(1,BLUE, ">>this is the %d send_msg_task",i);
+static void pofsc_conn_output(int i, struct pof_datapath *dp){
     pofsc_dev_conn_desc *conn_desc_ptr = (pofsc_dev_conn_desc *)&pofsc_conn_desc[i];
     pof_header *head_ptr;
-    uint32_t   ret;
-    struct pof_datapath *dp = &g_dp;
+    int len;
+
+    /* Messages are sent from the POFCS_REQUEST_FEATURE state on. */
+    switch(conn_desc_ptr->conn_status.state){
+        case POFCS_REQUEST_FEATURE:
+        case POFCS_SET_CONFIG:
+        case POFCS_REQUEST_GET_CONFIG:
+        case POFCS_CHANNEL_RUN:
+            break;
+        default:
+            return;
+    }
 
-    /* Polling the message queue. If valid, fetch one message and send it to controller. */
     while(1){
-        /* Set the pthread cancel point. */
-        pthread_testcancel();
-        switch(conn_desc_ptr->conn_status.state){
-            case POFCS_CHANNEL_INVALID:
-            case POFCS_CHANNEL_CONNECTING:
-            case POFCS_CHANNEL_CONNECTED:
-            case POFCS_HELLO:
-                pofbf_task_delay(100);
+        /* Fetch one message from message queue. */
+        if(conn_desc_ptr->send_len == 0){
+            if(pofbf_queue_read(pofsc_send_q_id[i], conn_desc_ptr->msg_buf, \
+                        POF_QUEUE_MESSAGE_LEN, POF_NO_WAIT) != POF_OK){
                 break;
-            case POFCS_SET_CONFIG:
-            case POFCS_REQUEST_FEATURE:
-            case POFCS_REQUEST_GET_CONFIG:
-            case POFCS_CHANNEL_RUN:
-                /* Fetch one message from message queue. */
-                ret = pofbf_queue_read(pofsc_send_q_id[i], conn_desc_ptr->msg_buf, POF_QUEUE_MESSAGE_LEN, POF_WAIT_FOREVER);
-                if(ret != POF_OK){
-                    pofsc_set_error(POFET_SOFTWARE_FAILED, ret);
-                    break;
-                }
+            }
+            head_ptr = (pof_header*)conn_desc_ptr->msg_buf;
+            conn_desc_ptr->send_len = POF_HTONS(head_ptr->length);
+            conn_desc_ptr->send_offset = 0;
+        }
 
-                /* Send message to server. */
-                head_ptr = (pof_header*)conn_desc_ptr->msg_buf;
-                ret = pofsc_send(conn_desc_ptr->sfd, conn_desc_ptr->msg_buf, POF_HTONS(head_ptr->length), dp,i);
-                if(ret != POF_OK){
-                    /* Return to inalid state. */
-                    conn_desc_ptr->conn_status.last_error = (uint8_t)ret;
-                    conn_desc_ptr->sfd = 0;
-                    conn_desc_ptr->conn_status.state = POFCS_CHANNEL_INVALID;
-
-                    /* Put the message back to queue for sendding next time. */
-                    ret = pofbf_queue_write(pofsc_send_q_id[i], conn_desc_ptr->msg_buf, POF_HTONS(head_ptr->length), POF_WAIT_FOREVER);
-                    if(ret != POF_OK){
-                        pofsc_set_error(POFET_SOFTWARE_FAILED, ret);
-                        break;
-                    }
-                }
-                break;
-            default:
-                conn_desc_ptr->conn_status.last_error = (uint8_t)POF_WRONG_CHANNEL_STATE;
-                break;
+        /* Send message to server. */
+        if(pofsc_send(conn_desc_ptr->sfd, conn_desc_ptr->msg_buf + conn_desc_ptr->send_offset, \
+                    conn_desc_ptr->send_len - conn_desc_ptr->send_offset, &len, dp, i) != POF_OK){
+            return;
+        }
+        if(len == 0){
+            /* The socket is full. */
+            pofsc_conn_watch(i, EPOLLIN | EPOLLOUT);
+            return;
+        }
+
+        conn_desc_ptr->send_offset += len;
+        if(conn_desc_ptr->send_offset == conn_desc_ptr->send_len){
+            conn_desc_ptr->send_len = 0;
+            conn_desc_ptr->send_offset = 0;
         }
     }
-    return POF_OK;
+
+    pofsc_conn_watch(i, EPOLLIN);
+}
+
+/* Handle the events of the socket of the connection. */
+static void pofsc_conn_event(int i, uint32_t events, struct pof_datapath *dp){
+    pofsc_dev_conn_desc *conn_desc_ptr = (pofsc_dev_conn_desc *)&pofsc_conn_desc[i];
+    socklen_t len = sizeof(int);
+    int err = 0;
+
+    switch(conn_desc_ptr->conn_status.state){
+        case POFCS_CHANNEL_INVALID:
+            break;
+
+        case POFCS_CHANNEL_CONNECTING:
+            /* The connecting finishes. */
+            if(getsockopt(conn_desc_ptr->sfd, SOL_SOCKET, SO_ERROR, &err, &len) != 0 || err != 0){
+                pofsc_conn_retry(i);
+                break;
+            }
+            pofsc_conn_connected(i, dp);
+            break;
+
+        default:
+            if(events & (EPOLLIN | EPOLLERR | EPOLLHUP)){
+                pofsc_conn_input(i, dp);
+            }
+            if((events & EPOLLOUT) && conn_desc_ptr->sfd != POFSC_INVALID_SFD){
+                pofsc_conn_output(i, dp);
+            }
+            break;
+    }
 }
 
 /***********************************************************************
- * OpenFlow echo timer routine.
- * Form:     void pofsc_echo_timer(uint32_t timer_id, int arg)
- * Input:    NONE
+ * Check the time of the connection.
+ * Form:     static void pofsc_conn_timer(int i, struct pof_datapath *dp)
+ * Input:    controller index
  * Output:   NONE
  * Return:   VOID
- * Discribe: The routine is only used to send echo request and not wait
- *           for echo reply.Echo reply is received and processed by main
- *           task.
+ * Discribe: This function connects the Controller again when the retry
+ *           interval passes, and writes an echo request into the send
+ *           queue every echo interval during the POFCS_CHANNEL_RUN state.
+ *           Echo reply is received and processed by pofsc_run_process.
  ***********************************************************************/
-static uint32_t pofsc_echo_timer(uint32_t timer_id, int arg){
-    pofsc_dev_conn_desc *conn_desc_ptr = (pofsc_dev_conn_desc *)&pofsc_conn_desc[controller_index];
+static void pofsc_conn_timer(int i, struct pof_datapath *dp){
+    pofsc_dev_conn_desc *conn_desc_ptr = (pofsc_dev_conn_desc *)&pofsc_conn_desc[i];
+    uint64_t now = pofsc_time_ms();
     pof_header head;
     uint16_t len;
     uint32_t ret;
 
-    /* If valid, fetch one message and send it to controller. */
     switch(conn_desc_ptr->conn_status.state){
         case POFCS_CHANNEL_INVALID:
-        case POFCS_CHANNEL_CONNECTING:
-        case POFCS_CHANNEL_CONNECTED:
-        case POFCS_HELLO:
-        case POFCS_REQUEST_FEATURE:
+            if(now >= conn_desc_ptr->retry_time){
+                pofsc_conn_start(i);
+            }
             break;
+
         case POFCS_CHANNEL_RUN:
-            /* Send echo to controller. */
+            if(now < conn_desc_ptr->echo_time){
+                break;
+            }
+            conn_desc_ptr->echo_time = now + pofsc_echo_interval;
+
             /* Build echo message. */
             len = sizeof(pof_header);
-            pofsc_build_header(&head, POFT_ECHO_REQUEST, len, g_upward_xid++);
-            /* Write error message into queue for sending. */
-            ret = pofbf_queue_write(pofsc_send_q_id[controller_index], (char*)&head, len, POF_WAIT_FOREVER);
+            pofsc_build_header(&head, POFT_ECHO_REQUEST, len, __sync_fetch_and_add(&g_upward_xid, 1));
+            /* Write echo message into queue for sending. */
+            ret = pofbf_queue_write(pofsc_send_q_id[i], (char*)&head, len, POF_WAIT_FOREVER);
             if(ret != POF_OK){
                 pofsc_set_error(POFET_SOFTWARE_FAILED, ret);
             }
             break;
+
+        default:
+            break;
+    }
+}
+
+/***********************************************************************
+ * Drain the full send queue of the connection.
+ * Form:     static void pofsc_queue_drain(void *arg)
+ * Input:    controller index
+ * Output:   NONE
+ * Return:   VOID
+ * Discribe: This function is called when the main task writes into the
+ *           full send queue of the connection, as the main task is the
+ *           reader of the queue and can not wait for itself. It waits
+ *           for the socket to be writable for a while and sends. If the
+ *           connection is not able to send, the oldest message is
+ *           dropped.
+ ***********************************************************************/
+static void pofsc_queue_drain(void *arg){
+    int i = (int)(intptr_t)arg;
+    pofsc_dev_conn_desc *conn_desc_ptr = (pofsc_dev_conn_desc *)&pofsc_conn_desc[i];
+    static char drop_buf[POF_QUEUE_MESSAGE_LEN];
+    struct pollfd pfd = {0};
+
+    switch(conn_desc_ptr->conn_status.state){
+        case POFCS_REQUEST_FEATURE:
+        case POFCS_SET_CONFIG:
+        case POFCS_REQUEST_GET_CONFIG:
+        case POFCS_CHANNEL_RUN:
+            pfd.fd = conn_desc_ptr->sfd;
+            pfd.events = POLLOUT;
+            poll(&pfd, 1, POFSC_DRAIN_TIMEOUT);
+            pofsc_conn_output(i, &g_dp);
+            return;
         default:
             break;
     }
-    return POF_OK;
+
+    if(pofbf_queue_read(pofsc_send_q_id[i], drop_buf, POF_QUEUE_MESSAGE_LEN, POF_NO_WAIT) == POF_OK){
+        POF_ERROR_CPRINT_FL("Send queue of controller %d is full, drop one message!", i);
+    }
 }
 
 /***********************************************************************
@@ -799,6 +825,7 @@ static uint32_t pofsc_set_conn_attr(struct pofsc_controller controllers[], \
     pofsc_conn_desc[i].conn_retry_interval = retry_interval;
     pofsc_conn_desc[i].conn_status.echo_interval = pofsc_echo_interval;
     pofsc_conn_desc[i].role = 3;
+    pofsc_conn_desc[i].sfd = POFSC_INVALID_SFD;
     }
 
     return POF_OK;
@@ -810,14 +837,14 @@ static uint32_t pofsc_set_conn_attr(struct pofsc_controller controllers[], \
  * Input:    NONE
  * Output:   socket_fd
  * Return:   POF_OK or ERROR code
- * Discribe: This function create the OpenFlow client socket with TCP
- *           channel.
+ * Discribe: This function create the non-blocking OpenFlow client socket
+ *           with TCP channel.
  ***********************************************************************/
 static uint32_t pofsc_create_socket(int *socket_fd_ptr){
     /* Socket file descriptor. */
     int socket_fd;
 
-    if ((socket_fd = socket(AF_INET, SOCK_STREAM, 0)) == -1){
+    if ((socket_fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0)) == -1){
         POF_DEBUG_CPRINT_FL (1,RED,"Create socket failure!");
         return (POF_CREATE_SOCKET_FAILURE);
     }
@@ -829,24 +856,17 @@ static uint32_t pofsc_create_socket(int *socket_fd_ptr){
 /***********************************************************************
  * Connect controller.
  * Form:     uint32_t pofsc_connect(int socket_fd, char *server_ip, \
- *                                  uint16_t port, struct pof_datapath *dp)
+ *                                  uint16_t port)
  * Input:    socket_fd, server IP string, port
  * Output:   NONE
  * Return:   POF_OK or ERROR code
- * Discribe: This function connect the Soft Switch with the Conteroller
- *           by using the socket_fd
+ * Discribe: This function starts connecting the Soft Switch with the
+ *           Conteroller by using the non-blocking socket_fd. POF_OK
+ *           means the connecting is in progress or done, and the socket
+ *           will be writable when it finishes.
  ***********************************************************************/
-static uint32_t pofsc_connect(int socket_fd, char *server_ip, uint16_t port, struct pof_datapath *dp,int i){
-	pofsc_dev_conn_desc *conn_desc_ptr = (pofsc_dev_conn_desc *)&pofsc_conn_desc[i];//add by wenjian 2015/12/02
-    socklen_t sockaddr_len = sizeof(struct sockaddr_in);
-    struct sockaddr_in serverAddr, localAddr;
-    char localIP[POF_IP_ADDRESS_STRING_LEN] = "\0";
-    uint8_t hwaddr[POF_ETH_ALEN] = {0};
-	uint8_t port_id;
-
-
-	int ifindex;
-    struct pof_local_resource *lr, *lrNext;
+static uint32_t pofsc_connect(int socket_fd, char *server_ip, uint16_t port){
+    struct sockaddr_in serverAddr;
 
     /* Build server socket address. */
     memset ((char *) &serverAddr, 0,  sizeof (struct sockaddr_in));
@@ -854,15 +874,36 @@ static uint32_t pofsc_connect(int socket_fd, char *server_ip, uint16_t port, str
     serverAddr.sin_port = POF_HTONS(port);
     serverAddr.sin_addr.s_addr = inet_addr(server_ip);
 
-    if(connect(socket_fd, (struct sockaddr *)&serverAddr, sizeof (struct sockaddr_in)) == -1){
-        close(socket_fd);
+    if(connect(socket_fd, (struct sockaddr *)&serverAddr, sizeof (struct sockaddr_in)) == -1 && \
+            errno != EINPROGRESS){
         return (POF_CONNECT_SERVER_FAILURE);
     }
 
+    return POF_OK;
+}
+
+/***********************************************************************
+ * Get the device id.
+ * Form:     uint32_t pofsc_get_dev_id(int socket_fd, \
+ *                                     struct pof_datapath *dp, int i)
+ * Input:    connected socket_fd, controller index
+ * Output:   g_poflr_dev_id
+ * Return:   POF_OK or ERROR code
+ * Discribe: If the device id has not been set, this function sets it by
+ *           the hardware address of the local port which connects to
+ *           the Controller.
+ ***********************************************************************/
+static uint32_t pofsc_get_dev_id(int socket_fd, struct pof_datapath *dp, int i){
+	pofsc_dev_conn_desc *conn_desc_ptr = (pofsc_dev_conn_desc *)&pofsc_conn_desc[i];//add by wenjian 2015/12/02
+    socklen_t sockaddr_len = sizeof(struct sockaddr_in);
+    struct sockaddr_in localAddr;
+    char localIP[POF_IP_ADDRESS_STRING_LEN] = "\0";
+    uint8_t hwaddr[POF_ETH_ALEN] = {0};
+    struct pof_local_resource *lr, *lrNext;
+
     if(g_poflr_dev_id == 0){
         if(getsockname(socket_fd, (struct sockaddr *)&localAddr, &sockaddr_len) != POF_OK){
             POF_ERROR_CPRINT_FL("Get socket name fail!");
-            close(socket_fd);
             return POF_ERROR;
         }
 
@@ -902,7 +943,9 @@ static uint32_t pofsc_connect(int socket_fd, char *server_ip, uint16_t port, str
  * Input:    socket_fd, the max length of the buffer
  * Output:   data buffer, data length
  * Return:   POF_OK or ERROR code
- * Discribe: This function receive the messages from the Controller.
+ * Discribe: This function receive the messages from the Controller. The
+ *           data length is 0 if there is nothing to read now. If the
+ *           connection is closed or broken, the connection is lost.
  ***********************************************************************/
 static uint32_t pofsc_recv(int socket_fd, char* buf, int buflen, int* plen, struct pof_datapath *dp,int i){
     pof_header *header_ptr;
@@ -914,15 +957,13 @@ static uint32_t pofsc_recv(int socket_fd, char* buf, int buflen, int* plen, stru
     }
 
     if ((len = read(socket_fd, buf, buflen)) <= 0){
+        if (len < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)){
+            *plen = 0;
+            return POF_OK;
+        }
 
         POF_ERROR_CPRINT_FL("closed socket fd!");
-        close(socket_fd);
-        if(n_controller>0){
-
-            n_controller--;
-        }
-        POF_DEBUG("read--n_controller=%d\n",n_controller);
-        pofsc_performance_after_ctrl_disconn(dp,i);
+        pofsc_conn_lost(i, dp);
         return (POF_RECEIVE_MSG_FAILURE);
     }
     *plen = len;
@@ -946,13 +987,15 @@ static uint32_t pofsc_recv(int socket_fd, char* buf, int buflen, int* plen, stru
 /***********************************************************************
  * Send message.
  * Form:     uint32_t pofsc_send(int socket_fd, char* buf, int len, \
- *                                  struct pof_datapath *dp)
+ *                               int *plen, struct pof_datapath *dp)
  * Input:    socket_fd, data buffer, data length
- * Output:   NONE
+ * Output:   sent length
  * Return:   POF_OK or ERROR code
- * Discribe: This function send messages to the Controller in send task.
+ * Discribe: This function send messages to the Controller. The sent
+ *           length may be less than len, and is 0 if the socket is full.
+ *           If the connection is broken, the connection is lost.
  ***********************************************************************/
-static uint32_t pofsc_send(int socket_fd, char* buf, int len, struct pof_datapath *dp,int i){
+static uint32_t pofsc_send(int socket_fd, char* buf, int len, int *plen, struct pof_datapath *dp,int i){
     int ret;
 #ifndef POF_DEBUG_PRINT_ECHO_ON
     pof_header *header_ptr = (pof_header *)buf;
@@ -964,17 +1007,17 @@ static uint32_t pofsc_send(int socket_fd, char* buf, int len, struct pof_datapat
 #endif
 
     /* Send message to server. */
-    if ((ret = write(socket_fd, (char *)buf, len) == -1)){
-        POF_ERROR_CPRINT_FL("Socket write ERROR!");
-        close(socket_fd);
-        if(n_controller>0){
-            n_controller--;
-
+    if ((ret = write(socket_fd, (char *)buf, len)) == -1){
+        if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR){
+            *plen = 0;
+            return POF_OK;
         }
-        POF_DEBUG("send--n_controller=%d\n",n_controller);
-        pofsc_performance_after_ctrl_disconn(dp,i);
+
+        POF_ERROR_CPRINT_FL("Socket write ERROR!");
+        pofsc_conn_lost(i, dp);
         return (POF_SEND_MSG_FAILURE);
     }
+    *plen = ret;
 
     return (POF_OK);
 }
@@ -1073,7 +1116,7 @@ static uint32_t pofsc_build_error_msg(char *message, uint16_t *len_p){
     uint16_t len = sizeof(pof_header) + sizeof(pof_error);
 
     /* Build header. */
-     pofsc_build_header(head_ptr, POFT_ERROR, len, g_upward_xid++);
+     pofsc_build_header(head_ptr, POFT_ERROR, len, __sync_fetch_and_add(&g_upward_xid, 1));
 
     /* Copy error content into message. */
     memcpy((message + sizeof(pof_header)), &pofsc_protocol_error, sizeof(pof_error));
@@ -1161,21 +1204,15 @@ static uint32_t pofsc_destroy(struct pof_datapath *dp){
 	uint16_t port_number = 0;
     struct pof_local_resource *lr, *lrNext;
 
-    /* Free task,timer and queue. */
-    for (i=0;i<n_controller;i++){
-    if(pofsc_main_task_id[i] != POF_INVALID_TASKID){
-        pofbf_task_delete(&pofsc_main_task_id[i]);
-    }
-
-    if(pofsc_send_task_id[i] != POF_INVALID_TASKID){
-        pofbf_task_delete(&pofsc_send_task_id[i]);
+    /* Free task and queue. */
+    if(pofsc_main_task_id != POF_INVALID_TASKID){
+        pofbf_task_delete(&pofsc_main_task_id);
     }
-    if(pofsc_echo_timer_id[i] != POF_INVALID_TIMERID){
-           pofbf_timer_delete(&pofsc_echo_timer_id[i]);
-       }
+    for (i=0;i<pofsc_conn_num;i++){
     if(pofsc_send_q_id[i] != POF_INVALID_QUEUEID){
            pofbf_queue_delete(&pofsc_send_q_id[i]);
        }
+    pofbf_ring_unmap(&((pofsc_dev_conn_desc *)&pofsc_conn_desc[i])->recv_buf, POFSC_RECV_RING_SIZE);
     }
     if(pofsc_listen_task_id != POF_INVALID_TASKID){
         pofbf_task_delete(&pofsc_listen_task_id);
@@ -231,7 +231,7 @@ listen_meters(LISTEN_ARG)
 static uint32_t
 listen_counters(LISTEN_ARG)
 {
-    struct counterInfo *p, *next;
+    struct counterInfo *p, *next, read;
     struct pof_local_resource *lr, *lrNext;
     struct responseHead respSlots[1] = {
         dp->slotNum, "slots"
@@ -251,7 +251,8 @@ listen_counters(LISTEN_ARG)
         }
 
         HMAP_NODES_IN_STRUCT_TRAVERSE(p, next, idNode, lr->counterMap){
-            if(send(sockfd, p, sizeof(*p), 0) <= 0){
+            poflr_counter_read(p, lr, &read);
+            if(send(sockfd, &read, sizeof(read), 0) <= 0){
                 return POF_ERROR;
             }
         }
@@ -0,0 +1,32 @@
+# Standalone checks, built and run by "make check". Each check is linked
+# with the sources it checks, and stubs the rest of the switch.
+TESTS_FOLDER = tests
+CHECK_PROGS = $(TESTS_FOLDER)/bit_check $(TESTS_FOLDER)/jit_check \
+		$(TESTS_FOLDER)/bundle_check
+
+check-local: $(CHECK_PROGS)
+	@for prog in $(CHECK_PROGS); do \
+		echo "$$prog"; ./$$prog || exit 1; \
+	done
+
+$(TESTS_FOLDER)/bit_check: $(TESTS_FOLDER)/bit_check.c $(COMMON_FOLDER)/pof_basefunc.c
+	$(CC) $(DEFS) $(INCLUDES) $(CFLAGS) -o $@ $^ -lpthread
+
+$(TESTS_FOLDER)/jit_check: $(TESTS_FOLDER)/jit_check.c $(TESTS_FOLDER)/check_stub.c \
+		$(TESTS_FOLDER)/lr_stub.c \
+		$(DATAPATH_FOLDER)/pof_instruction.c $(DATAPATH_FOLDER)/pof_action.c \
+		$(DATAPATH_FOLDER)/pof_jit.c $(COMMON_FOLDER)/pof_basefunc.c \
+		$(COMMON_FOLDER)/pof_hmap.c
+	$(CC) $(DEFS) $(INCLUDES) $(CFLAGS) -o $@ $^ -lpthread
+
+$(TESTS_FOLDER)/bundle_check: $(TESTS_FOLDER)/bundle_check.c $(TESTS_FOLDER)/check_stub.c \
+		$(DATAPATH_FOLDER)/pof_instruction.c $(DATAPATH_FOLDER)/pof_action.c \
+		$(DATAPATH_FOLDER)/pof_jit.c $(COMMON_FOLDER)/pof_basefunc.c \
+		$(COMMON_FOLDER)/pof_byte_transfer.c $(COMMON_FOLDER)/pof_emtable.c \
+		$(COMMON_FOLDER)/pof_epoch.c $(COMMON_FOLDER)/pof_hmap.c \
+		$(COMMON_FOLDER)/pof_list.c $(COMMON_FOLDER)/pof_memory.c \
+		$(COMMON_FOLDER)/pof_tree.c $(LOCAL_RESOURCE_FOLDER)/pof_counter.c \
+		$(LOCAL_RESOURCE_FOLDER)/pof_flow_table.c $(LOCAL_RESOURCE_FOLDER)/pof_group.c \
+		$(LOCAL_RESOURCE_FOLDER)/pof_ins_block.c $(LOCAL_RESOURCE_FOLDER)/pof_local_resource.c \
+		$(LOCAL_RESOURCE_FOLDER)/pof_meter.c
+	$(CC) $(DEFS) $(INCLUDES) $(CFLAGS) -o $@ $^ -lpthread
@@ -0,0 +1,284 @@
+/**
+ * Copyright (c) 2012, 2013, Huawei Technologies Co., Ltd.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* Check of pofbf_copy_bit(), pofbf_cover_bit() and pofbf_move_bit().
+ *
+ * Random offsets and lengths are checked against the byte-wise
+ * pofbf_copy_bit() the word-wide version replaced, and against a bit by
+ * bit reference. The old pofbf_cover_bit() is wrong for many unaligned
+ * positions, so the covers are checked against the reference only. The
+ * bits around the field must be kept.
+ *
+ * "bit_check bench" times the old and the new versions instead. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "pof_global.h"
+#include "pof_log_print.h"
+
+/* The rest of the switch is not linked. */
+pofec_error g_pofec_error;
+struct log_util g_log;
+void pofec_set_error(uint16_t type, char *typeStr, uint16_t code, char *codeStr){}
+
+#define BUF_LEN     (300)       /* Covers the 2048 bits of the longest field
+                                 * at any offset, and one byte more. */
+#define CHECK_NUM   (200000)
+#define BENCH_NUM   (500000)
+#define BENCH_ROUND (10)        /* The best round is taken, with the old and
+                                 * the new versions run in turn. */
+
+/* The byte-wise pofbf_copy_bit() before the word-wide one. It reads one
+ * byte behind the field. The switch calls the kernels from other files,
+ * so the old ones are not inlined into the benchmark either. */
+static __attribute__((noinline)) void
+oldCopyBit(const uint8_t *data_ori, uint8_t *data_res, uint16_t offset_b, uint16_t len_b)
+{
+    uint32_t process_len_b = 0, offset_b_x;
+    uint16_t offset_B;
+    uint8_t *ptr;
+
+    if (NULL == data_ori || NULL == data_res) {
+        return;
+    }
+
+    offset_B = (uint16_t) (offset_b / 8);
+    offset_b_x = offset_b % 8;
+    ptr = (uint8_t *) (data_ori + offset_B);
+
+    while (process_len_b < len_b) {
+        *(data_res++) = POF_MOVE_BIT_LEFT(*ptr, offset_b_x) \
+                | POF_MOVE_BIT_RIGHT(*(ptr + 1), 8 - offset_b_x);
+        ptr++;
+        process_len_b += 8;
+    }
+
+    data_res--;
+    *data_res = *data_res & POF_MOVE_BIT_LEFT(0xff, process_len_b - len_b);
+}
+
+/* The byte-wise pofbf_cover_bit() before the word-wide one. It is used
+ * by the benchmark only, for fields of 16 bits or more. */
+static __attribute__((noinline)) void
+oldCoverBit(uint8_t *data_ori, const uint8_t *value, uint16_t pos_b, uint16_t len_b)
+{
+    uint32_t process_len_b = 0;
+    uint16_t pos_b_x, after_len_b_x;
+    uint8_t *ptr;
+
+    pos_b_x = pos_b % 8;
+    after_len_b_x = (len_b + pos_b - 1) % 8 + 1;
+    ptr = data_ori + (uint16_t) (pos_b / 8);
+
+    if (len_b <= (8 - pos_b_x)) {
+        *ptr = ((*ptr & POF_MOVE_BIT_LEFT(0xff, (8 - pos_b_x))) \
+                | (POF_MOVE_BIT_RIGHT(*value, pos_b_x) & POF_MOVE_BIT_LEFT(0xff, 8 - after_len_b_x)) \
+                | (*ptr & POF_MOVE_BIT_RIGHT(0xff, after_len_b_x)));
+        return;
+    }
+
+    *ptr = (*ptr & POF_MOVE_BIT_LEFT(0xff, (8 - pos_b_x))) \
+            | POF_MOVE_BIT_RIGHT(*value, pos_b_x);
+
+    process_len_b = 8 - pos_b_x;
+    while (process_len_b < (len_b - 8)) {
+        *(++ptr) = POF_MOVE_BIT_LEFT(*value, 8 - pos_b_x) | POF_MOVE_BIT_RIGHT(*(value + 1), pos_b_x);
+        value++;
+        process_len_b += 8;
+    }
+
+    *(ptr + 1) = (POF_MOVE_BIT_LEFT(*value, 8 - pos_b_x) | (POF_MOVE_BIT_RIGHT(*(value + 1), pos_b_x) \
+            & POF_MOVE_BIT_LEFT(0xff, 8 - (len_b - process_len_b)))) \
+            | (*(ptr + 1) & POF_MOVE_BIT_RIGHT(0xff, len_b - process_len_b));
+}
+
+/* Move the bits one by one. */
+static void
+refMoveBit(uint8_t *dst, uint32_t dst_b, const uint8_t *src, uint32_t src_b, uint32_t len_b)
+{
+    uint32_t i, bit;
+
+    for(i=0; i<len_b; i++){
+        bit = (src[(src_b + i) / 8] >> (7 - (src_b + i) % 8)) & 1;
+        dst[(dst_b + i) / 8] &= ~(1 << (7 - (dst_b + i) % 8));
+        dst[(dst_b + i) / 8] |= bit << (7 - (dst_b + i) % 8);
+    }
+}
+
+static void
+randomFill(uint8_t *buf, uint32_t len)
+{
+    uint32_t i;
+
+    for(i=0; i<len; i++){
+        buf[i] = (uint8_t)rand();
+    }
+}
+
+/* Random field: mostly short ones like the packet fields, some up to the
+ * longest metadata. */
+static void
+randomField(uint16_t *pos_b, uint16_t *len_b)
+{
+    *len_b = (rand() % 4) ? rand() % 128 + 1 : rand() % 2048 + 1;
+    *pos_b = rand() % ((BUF_LEN - 1) * 8 - *len_b);
+}
+
+static int
+check(void)
+{
+    uint8_t src[BUF_LEN], dst[BUF_LEN], old[BUF_LEN], ref[BUF_LEN];
+    uint16_t pos_b, dst_b, len_b;
+    uint32_t i;
+
+    for(i=0; i<CHECK_NUM; i++){
+        randomFill(src, BUF_LEN);
+        randomField(&pos_b, &len_b);
+
+        /* Copy: the old one, the reference and the new one agree on the
+         * bytes of the field. The rest of the result is kept. */
+        randomFill(dst, BUF_LEN);
+        memcpy(old, dst, BUF_LEN);
+        memcpy(ref, dst, BUF_LEN);
+        oldCopyBit(src, old, pos_b, len_b);
+        refMoveBit(ref, 0, src, pos_b, len_b);
+        if(len_b % 8){
+            ref[len_b / 8] &= POF_MOVE_BIT_LEFT(0xff, 8 - len_b % 8);
+        }
+        pofbf_copy_bit(src, dst, pos_b, len_b);
+        if(memcmp(dst, old, (len_b + 7) / 8) != 0 || memcmp(dst, ref, BUF_LEN) != 0){
+            printf("FAIL copy offset_b=%u len_b=%u\n", pos_b, len_b);
+            return 1;
+        }
+
+        /* Cover: the bits around the field are kept. */
+        randomFill(dst, BUF_LEN);
+        memcpy(ref, dst, BUF_LEN);
+        refMoveBit(ref, pos_b, src, 0, len_b);
+        pofbf_cover_bit(dst, src, pos_b, len_b);
+        if(memcmp(dst, ref, BUF_LEN) != 0){
+            printf("FAIL cover pos_b=%u len_b=%u\n", pos_b, len_b);
+            return 1;
+        }
+
+        /* Move between two unaligned offsets. */
+        dst_b = rand() % ((BUF_LEN - 1) * 8 - len_b);
+        randomFill(dst, BUF_LEN);
+        memcpy(ref, dst, BUF_LEN);
+        refMoveBit(ref, dst_b, src, pos_b, len_b);
+        pofbf_move_bit(dst, dst_b, src, pos_b, len_b);
+        if(memcmp(dst, ref, BUF_LEN) != 0){
+            printf("FAIL move dst_b=%u src_b=%u len_b=%u\n", dst_b, pos_b, len_b);
+            return 1;
+        }
+    }
+
+    printf("OK %u random fields\n", CHECK_NUM);
+    return 0;
+}
+
+static double
+nowNs(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+typedef void (*COPY_FUNC)(const uint8_t *, uint8_t *, uint16_t, uint16_t);
+typedef void (*COVER_FUNC)(uint8_t *, const uint8_t *, uint16_t, uint16_t);
+
+static double
+benchCopy(COPY_FUNC func, uint8_t *src, uint8_t *dst, uint16_t pos_b, uint16_t len_b)
+{
+    double start = nowNs();
+    uint32_t i;
+
+    for(i=0; i<BENCH_NUM; i++){
+        func(src, dst, pos_b, len_b);
+        __asm__ __volatile__("" : : "r"(dst) : "memory");
+    }
+    return (nowNs() - start) / BENCH_NUM;
+}
+
+static double
+benchCover(COVER_FUNC func, uint8_t *dst, const uint8_t *value, uint16_t pos_b, uint16_t len_b)
+{
+    double start = nowNs();
+    uint32_t i;
+
+    for(i=0; i<BENCH_NUM; i++){
+        func(dst, value, pos_b, len_b);
+        __asm__ __volatile__("" : : "r"(dst) : "memory");
+    }
+    return (nowNs() - start) / BENCH_NUM;
+}
+
+static int
+bench(void)
+{
+    static const struct { uint16_t pos_b, len_b; } field[] = {
+        {0, 16}, {4, 16}, {0, 128}, {3, 128}, {0, 1024}, {3, 1024},
+    };
+    uint8_t src[BUF_LEN], dst[BUF_LEN];
+    double ns[4], t;
+    uint32_t i, j, k;
+
+    randomFill(src, BUF_LEN);
+    randomFill(dst, BUF_LEN);
+    printf("%6s %6s %12s %12s %12s %12s\n", "pos_b", "len_b", \
+            "copy old ns", "copy new ns", "cover old ns", "cover new ns");
+    for(i=0; i<sizeof field / sizeof field[0]; i++){
+        for(j=0; j<BENCH_ROUND; j++){
+            for(k=0; k<4; k++){
+                switch(k){
+                    case 0: t = benchCopy(oldCopyBit, src, dst, field[i].pos_b, field[i].len_b); break;
+                    case 1: t = benchCopy(pofbf_copy_bit, src, dst, field[i].pos_b, field[i].len_b); break;
+                    case 2: t = benchCover(oldCoverBit, dst, src, field[i].pos_b, field[i].len_b); break;
+                    default: t = benchCover(pofbf_cover_bit, dst, src, field[i].pos_b, field[i].len_b); break;
+                }
+                if(j == 0 || t < ns[k]){
+                    ns[k] = t;
+                }
+            }
+        }
+        printf("%6u %6u %12.1f %12.1f %12.1f %12.1f\n", field[i].pos_b, field[i].len_b, \
+                ns[0], ns[1], ns[2], ns[3]);
+    }
+    return 0;
+}
+
+int
+main(int argc, char *argv[])
+{
+    srand(1);
+    if(argc > 1 && strcmp(argv[1], "bench") == 0){
+        return bench();
+    }
+    return check();
+}
@@ -0,0 +1,222 @@
+/**
+ * Copyright (c) 2012, 2013, Huawei Technologies Co., Ltd.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* Check of the flow mod bundles.
+ *
+ * Bundles which touch one index several times, in a MM and a Linear
+ * table of one local resource: a delete and an add of the same index, an
+ * add, delete and add again, two modifies, and one which fails and is
+ * undone. The entries of an index which are not visible in a version are
+ * still in the table, before or after the visible one, so a lookup must
+ * step past them. A lookup which never ends is killed by the alarm. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "pof_common.h"
+#include "pof_type.h"
+#include "pof_global.h"
+#include "pof_local_resource.h"
+#include "pof_datapath.h"
+#include "pof_log_print.h"
+
+/* The rest of the switch is in check_stub.c. */
+pofec_error g_pofec_error;
+struct log_util g_log;
+void pofec_set_error(uint16_t type, char *typeStr, uint16_t code, char *codeStr){}
+uint32_t pofec_reply_error(uint16_t type, uint16_t code, char *s, uint32_t xid, int controller){
+    return POF_OK;
+}
+struct pof_datapath g_dp;
+
+#define TABLE_SIZE  (16)
+#define ALARM_S     (10)
+
+#define CHECK(cond)                                                     \
+            if(!(cond)){                                                \
+                printf("FAIL %s:%d %s\n", __FILE__, __LINE__, #cond);   \
+                return 1;                                               \
+            }
+
+static struct pof_local_resource lr;
+static struct hmap *slotMap;
+
+static void
+lrInit(void)
+{
+    pof_match match = {0, 96, 16, {0}};
+    uint32_t i;
+
+    lr.tableNumMaxEachType[POF_MM_TABLE] = 1;
+    lr.tableNumMaxEachType[POF_LINEAR_TABLE] = 1;
+    lr.tableSizeMax = TABLE_SIZE;
+    lr.groupNumMax = TABLE_SIZE;
+    lr.meterNumMax = TABLE_SIZE;
+    lr.counterNumMax = TABLE_SIZE;
+    for(i=0; i<POFLR_REF_TYPE_NUM; i++){
+        list_clear(&lr.unboundRefs[i]);
+    }
+    poflr_init_flow_table(&lr);
+    poflr_init_group(&lr);
+    poflr_init_meter(&lr);
+    poflr_init_counter(&lr);
+#ifdef POF_SHT_VXLAN
+    poflr_init_insBlock(&lr);
+#endif // POF_SHT_VXLAN
+    poflr_create_flow_table(0, 0, POF_MM_TABLE, 16, TABLE_SIZE, "mm", 1, &match, &lr);
+    poflr_create_flow_table(0, 0, POF_LINEAR_TABLE, 0, TABLE_SIZE, "linear", 0, &match, &lr);
+
+    slotMap = hmap_create(1);
+    hmap_nodeInsert(slotMap, &lr.slotNode);
+}
+
+static struct tableInfo *
+tableGet(uint8_t type)
+{
+    uint8_t ID;
+
+    poflr_table_id_to_ID(type, 0, &ID, &lr);
+    return poflr_get_table_with_ID(ID, &lr);
+}
+
+/* Flow mod of the index in the table of the type. The counter tells the
+ * entries of one index apart. */
+struct flowMod{
+    uint8_t type;
+    uint8_t command;
+    uint32_t index;
+    uint32_t counter_id;
+};
+
+static uint32_t
+bundleRun(uint32_t bundle_id, const struct flowMod *mod, uint32_t modNum)
+{
+    pof_flow_entry flow;
+    uint32_t i, ret;
+
+    poflr_bundle_open(bundle_id, 0);
+    for(i=0; i<modNum; i++){
+        memset(&flow, 0, sizeof flow);
+        flow.command = mod[i].command;
+        flow.table_type = mod[i].type;
+        flow.index = mod[i].index;
+        flow.counter_id = mod[i].counter_id;
+        if(mod[i].type == POF_MM_TABLE){
+            flow.match_field_num = 1;
+            flow.match[0].offset = 96;
+            flow.match[0].len = 16;
+            flow.match[0].value[0] = (uint8_t)mod[i].index;
+            flow.match[0].mask[0] = 0xFF;
+        }
+        poflr_bundle_add(bundle_id, &flow, sizeof flow, 0);
+    }
+    ret = poflr_bundle_commit(bundle_id, slotMap, 0);
+    poflr_bundle_discard(bundle_id, 0);
+    return ret;
+}
+
+/* The counter of the entry of the index visible in the version, or 0. */
+static uint32_t
+linearAt(uint32_t index, uint32_t version)
+{
+    struct tableInfo table = *tableGet(POF_LINEAR_TABLE);
+    struct entryInfo *entry;
+
+    table.version = &version;
+    entry = poflr_entry_lookup_Linear(index, &table);
+    return entry ? entry->counter_id : 0;
+}
+
+static int
+check(uint8_t type)
+{
+    const struct flowMod add[] = {
+        {type, POFFC_ADD, 3, 1},
+    };
+    const struct flowMod readd[] = {
+        {type, POFFC_DELETE, 3, 0},
+        {type, POFFC_ADD, 3, 2},
+    };
+    const struct flowMod addTwice[] = {
+        {type, POFFC_ADD, 5, 3},
+        {type, POFFC_DELETE, 5, 0},
+        {type, POFFC_ADD, 5, 4},
+    };
+    const struct flowMod modifyTwice[] = {
+        {type, POFFC_MODIFY, 3, 5},
+        {type, POFFC_MODIFY, 3, 6},
+    };
+    const struct flowMod fail[] = {
+        {type, POFFC_DELETE, 3, 0},
+        {type, POFFC_ADD, 3, 7},
+        {type, POFFC_ADD, 3, 8},
+    };
+    struct tableInfo *table = tableGet(type);
+    uint32_t version;
+
+    CHECK(bundleRun(1, add, 1) == POF_OK);
+    CHECK(table->entryNum == 1);
+
+    CHECK(bundleRun(2, readd, 2) == POF_OK);
+    CHECK(table->entryNum == 1);
+
+    CHECK(bundleRun(3, addTwice, 3) == POF_OK);
+    CHECK(table->entryNum == 2);
+
+    CHECK(bundleRun(4, modifyTwice, 2) == POF_OK);
+    CHECK(table->entryNum == 2);
+
+    /* The second add finds the first one, and the delete is undone. */
+    version = lr.version;
+    CHECK(bundleRun(5, fail, 3) != POF_OK);
+    CHECK(lr.version == version);
+    CHECK(table->entryNum == 2);
+
+    /* The Linear lookups of the datapath in every version, with the
+     * entries added in the last one still in the table. */
+    if(type == POF_LINEAR_TABLE){
+        CHECK(linearAt(3, version) == 6);
+        CHECK(linearAt(3, version - 1) == 0);
+        CHECK(linearAt(5, version) == 4);
+        CHECK(linearAt(5, version - 1) == 4);
+        CHECK(linearAt(5, version - 2) == 0);
+        CHECK(linearAt(4, version) == 0);
+    }
+
+    printf("OK %s table\n", table->name);
+    return 0;
+}
+
+int
+main(void)
+{
+    alarm(ALARM_S);
+    lrInit();
+    if(check(POF_MM_TABLE) || check(POF_LINEAR_TABLE)){
+        return 1;
+    }
+    return 0;
+}
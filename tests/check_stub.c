@@ -0,0 +1,52 @@
+/**
+ * Copyright (c) 2012, 2013, Huawei Technologies Co., Ltd.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* The functions of the switch the checks do not link. The checks only run
+ * code which does not call them, so every one aborts. No header of the
+ * switch is included, since their prototypes change with the version.
+ * The local resource is stubbed in lr_stub.c, for the checks which do
+ * not link it. */
+
+#include <stdint.h>
+#include <stdlib.h>
+
+uint32_t g_recv_xid;
+uint32_t g_upward_xid;
+char g_versionStr[] = "";
+
+#define CHECK_STUB(func) void func() { abort(); }
+CHECK_STUB(pofdp_entry_lookup)
+CHECK_STUB(pofdp_get_local_resource)
+CHECK_STUB(pofdp_output_release)
+CHECK_STUB(pofdp_send_packet_in_to_controller)
+CHECK_STUB(pofdp_send_raw)
+CHECK_STUB(pofdp_send_raw_flood)
+CHECK_STUB(pofec_reply_msg)
+CHECK_STUB(poflp_flow_entry)
+CHECK_STUB(poflr_disable_all_port)
+CHECK_STUB(poflr_init_port)
+CHECK_STUB(poflr_port_live)
+CHECK_STUB(poflr_port_report)
+CHECK_STUB(terminate_handler)
@@ -0,0 +1,277 @@
+/**
+ * Copyright (c) 2012, 2013, Huawei Technologies Co., Ltd.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+/* Differential check of the JIT against the interpreter.
+ *
+ * Random programs of the instructions the JIT compiles, with byte aligned
+ * and unaligned fields of any length, are built twice: interpreted only,
+ * and with native code. Each one runs on random packets and metadata of
+ * random lengths. The return value, the packet, the metadata,
+ * packet_done and the instruction the program stopped on must be the same.
+ *
+ * "jit_check N" checks N programs instead of CHECK_NUM. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "pof_common.h"
+#include "pof_type.h"
+#include "pof_global.h"
+#include "pof_datapath.h"
+#include "pof_log_print.h"
+
+/* The rest of the switch is in check_stub.c and lr_stub.c. */
+pofec_error g_pofec_error;
+struct log_util g_log;
+void pofec_set_error(uint16_t type, char *typeStr, uint16_t code, char *codeStr){}
+struct pof_datapath g_dp;
+
+#define CHECK_NUM       (20000)
+#define RUN_NUM         (8)         /* Packets each program runs on. */
+#define PACKET_LEN      (256)
+#define METADATA_LEN    (128)
+#define INS_BUF_LEN     (8192)
+
+static uint8_t insBuf[INS_BUF_LEN];
+static uint32_t insLen;
+
+/* The state of the packet after the program. */
+struct runResult{
+    uint32_t ret;
+    uint8_t packet[PACKET_LEN];
+    uint8_t metadata[METADATA_LEN];
+    uint8_t packet_done;
+    long ins;
+};
+
+static void *
+insAdd(uint16_t type, uint32_t dataLen)
+{
+    struct pof_instruction *ins = (struct pof_instruction *)(insBuf + insLen);
+    uint32_t len;
+
+#ifdef POF_SHT_VXLAN
+    len = (sizeof(*ins) + dataLen + 7) & ~7u;
+#else // POF_SHT_VXLAN
+    len = sizeof(*ins);
+#endif // POF_SHT_VXLAN
+    memset(ins, 0, len);
+    ins->type = type;
+    ins->len = len;
+    insLen += len;
+    return ins->instruction_data;
+}
+
+#if defined(POF_SHT_VXLAN) || defined(POF_SD2N)
+/* Random field: mostly byte aligned 8, 16 or 32 bits of the metadata or
+ * of the packet, sometimes not. */
+static void
+randomField(struct pof_match *pm)
+{
+    static const uint16_t lens[] = {8, 16, 32, 8, 16, 32, 12, 24};
+    int r = rand() % 20;
+
+    pm->field_id = (r < 8) ? POFDP_METADATA_FIELD_ID : (r == 19 ? 0x8001 : rand() % 4);
+    pm->offset = (rand() % 50) * 8 + ((rand() % 15 == 0) ? rand() % 8 : 0);
+    pm->len = lens[rand() % 8];
+}
+#endif // POF_SHT_VXLAN || POF_SD2N
+
+/* Build a random program in insBuf. Return the number of instructions. */
+static uint8_t
+randomProgram(void)
+{
+    uint8_t insNum = 1 + rand() % 12, i;
+    int t;
+
+    insLen = 0;
+    for(i=0; i<insNum; i++){
+        t = rand() % 7;
+        if(t == 0){
+            pof_instruction_write_metadata *p = insAdd(POFIT_WRITE_METADATA, sizeof(*p));
+#ifdef POF_SD2N_AFTER1015
+            uint32_t k;
+#endif // POF_SD2N_AFTER1015
+            p->metadata_offset = (rand() % 12) * 8 + (rand() % 10 == 0);
+#ifdef POF_SD2N_AFTER1015
+            p->len = 8 * (rand() % 17);
+            for(k=0; k<sizeof(p->value); k++){
+                p->value[k] = rand();
+            }
+#else // POF_SD2N_AFTER1015
+            p->len = (rand() % 4 + 1) * 8;
+            p->value = rand();
+#endif // POF_SD2N_AFTER1015
+        }else if(t == 1){
+            pof_instruction_write_metadata_from_packet *p = \
+                    insAdd(POFIT_WRITE_METADATA_FROM_PACKET, sizeof(*p));
+            p->metadata_offset = (rand() % 12) * 8;
+            p->packet_offset = (rand() % 60) * 8 + (rand() % 10 == 0);
+            p->len = 8 * (rand() % 17);
+#ifdef POF_SD2N
+        }else if(t == 2 || t == 3){
+            struct pof_instruction_calc_field *p = insAdd(POFIT_CALCULATE_FIELD, sizeof(*p));
+            p->calc_type = rand() % 9;
+            p->src_type = rand() % 2 ? POFVT_IMMEDIATE_NUM : POFVT_FIELD;
+            randomField(&p->dst_field);
+            if(p->dst_field.field_id == 0x8001){
+                p->dst_field.field_id = 0;
+            }
+            if(p->src_type == POFVT_IMMEDIATE_NUM){
+                p->src_operand.value = (rand() % 3 == 0) ? (uint32_t)(rand() % 40) : (uint32_t)rand() * 7u;
+            }else{
+                randomField(&p->src_operand.src_field);
+            }
+#endif // POF_SD2N
+#ifdef POF_SHT_VXLAN
+        }else if(t == 4){
+            struct pof_instruction_compare *p = insAdd(POFIT_COMPARE, sizeof(*p));
+            p->comp_result_field_num = rand() % 4;
+            p->operand2_type = rand() % 2 ? POFVT_IMMEDIATE_NUM : POFVT_FIELD;
+            randomField(&p->operand1);
+            if(p->operand2_type == POFVT_IMMEDIATE_NUM){
+                p->operand2.value = rand() % 4 ? rand() % 256 : rand();
+            }else{
+                randomField(&p->operand2.field);
+            }
+        }else if(t == 5){
+            struct pof_instruction_branch *p = insAdd(POFIT_BRANCH, sizeof(*p));
+            p->skip_instruction_num = 1 + rand() % (insNum - i + 1);
+            p->operand2_type = rand() % 2 ? POFVT_IMMEDIATE_NUM : POFVT_FIELD;
+            randomField(&p->operand1);
+            if(p->operand2_type == POFVT_IMMEDIATE_NUM){
+                p->operand2.value = rand() % 4;
+            }else{
+                randomField(&p->operand2.field);
+            }
+        }else if(t == 6){
+            struct pof_instruction_jmp *p = insAdd(POFIT_JMP, sizeof(*p));
+            p->direction = (rand() % 5 == 0) ? POFD_BACKWARD : POFD_FORWARD;
+            p->instruction_num = (p->direction == POFD_FORWARD) ? rand() % (insNum - i + 1) : 0;
+#endif // POF_SHT_VXLAN
+        }else{
+            pof_instruction_write_metadata *p = insAdd(POFIT_WRITE_METADATA, sizeof(*p));
+            p->metadata_offset = 8;
+            p->len = 8;
+#ifdef POF_SD2N_AFTER1015
+            p->value[0] = 1;
+#else // POF_SD2N_AFTER1015
+            p->value = 1;
+#endif // POF_SD2N_AFTER1015
+        }
+    }
+    return insNum;
+}
+
+/* Mostly small values, so the compares and branches take both ways. */
+static void
+randomFill(uint8_t *buf, uint32_t len)
+{
+    uint32_t i;
+
+    for(i=0; i<len; i++){
+        buf[i] = rand() % 4 ? rand() % 4 : rand();
+    }
+}
+
+static void
+run(struct pofdp_program *prog, const uint8_t *packet, const uint8_t *metadata, \
+    int32_t left_len, uint16_t metadata_len, struct runResult *res)
+{
+    static struct pofdp_packet dpp;
+    static uint8_t buf[PFODP_PACKET_BUF_TOTAL_LEN];
+    /* On the heap, so the sanitizers see an access beyond it. */
+    uint8_t *meta = malloc(METADATA_LEN);
+
+    memset(&dpp, 0, sizeof(dpp));
+    memcpy(meta, metadata, METADATA_LEN);
+    dpp.bufStart = buf;
+    dpp.bufEnd = buf + sizeof(buf);
+    dpp.packetBuf = buf + METADATA_LEN;
+    memcpy(dpp.packetBuf, packet, PACKET_LEN);
+    dpp.buf_offset = dpp.packetBuf;
+    dpp.left_len = left_len;
+    dpp.metadata = (struct pofdp_metadata *)meta;
+    dpp.metadata_len = metadata_len;
+    dpp.prog = prog;
+    dpp.ins = prog->op;
+
+    memset(res, 0, sizeof(*res));
+    res->ret = (pofdp_instruction_execute(&dpp, NULL) == POF_OK);
+    memcpy(res->packet, dpp.packetBuf, PACKET_LEN);
+    memcpy(res->metadata, meta, METADATA_LEN);
+    res->packet_done = dpp.packet_done;
+    res->ins = dpp.ins - prog->op;
+    free(meta);
+}
+
+int
+main(int argc, char *argv[])
+{
+    struct pofdp_program *interp, *native;
+    struct runResult a, b;
+    uint8_t packet[PACKET_LEN], metadata[METADATA_LEN], insNum;
+    long checkNum = (argc > 1) ? atol(argv[1]) : CHECK_NUM, nativeNum = 0, i;
+    uint32_t size, k;
+    int32_t left_len;
+    uint16_t metadata_len;
+
+    srand(1);
+    for(i=0; i<checkNum; i++){
+        insNum = randomProgram();
+        size = pofdp_program_size((struct pof_instruction *)insBuf, insNum);
+        interp = malloc(size);
+        native = malloc(size);
+        g_dp.param.jit = FALSE;
+        pofdp_program_build(interp, (struct pof_instruction *)insBuf, insNum);
+        g_dp.param.jit = TRUE;
+        pofdp_program_build(native, (struct pof_instruction *)insBuf, insNum);
+        nativeNum += (native->jit != NULL);
+
+        for(k=0; k<RUN_NUM; k++){
+            randomFill(packet, PACKET_LEN);
+            randomFill(metadata, METADATA_LEN);
+            left_len = rand() % 100;
+            metadata_len = rand() % 80;
+            run(interp, packet, metadata, left_len, metadata_len, &a);
+            run(native, packet, metadata, left_len, metadata_len, &b);
+            if(memcmp(&a, &b, sizeof(a)) != 0){
+                printf("FAIL program %ld: ret %u/%u packet_done %u/%u ins %ld/%ld " \
+                        "packet %s metadata %s\n", i, a.ret, b.ret, \
+                        a.packet_done, b.packet_done, a.ins, b.ins, \
+                        memcmp(a.packet, b.packet, PACKET_LEN) ? "differs" : "same", \
+                        memcmp(a.metadata, b.metadata, METADATA_LEN) ? "differs" : "same");
+                return 1;
+            }
+        }
+        pofdp_program_release(native);
+        free(interp);
+        free(native);
+    }
+
+    printf("OK %ld programs, %ld with native code\n", checkNum, nativeNum);
+    return 0;
+}
@@ -0,0 +1,46 @@
+/**
+ * Copyright (c) 2012, 2013, Huawei Technologies Co., Ltd.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice, this
+ *    list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions and the following disclaimer in the documentation
+ *    and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* The functions of the local resource, for the checks which do not link
+ * it. As in check_stub.c, every one aborts. */
+
+#include <stdint.h>
+#include <stdlib.h>
+
+uint32_t g_poflr_dev_id;
+
+#define CHECK_STUB(func) void func() { abort(); }
+CHECK_STUB(poflr_counter_increace)
+CHECK_STUB(poflr_counter_increace_ref)
+CHECK_STUB(poflr_entry_lookup_Linear)
+CHECK_STUB(poflr_get_group_with_ID)
+CHECK_STUB(poflr_get_insBlock_with_ID)
+CHECK_STUB(poflr_get_meter_with_ID)
+CHECK_STUB(poflr_get_table_with_ID)
+CHECK_STUB(poflr_meter_police)
+CHECK_STUB(poflr_ref_bind)
+CHECK_STUB(poflr_ref_unbind)
+CHECK_STUB(poflr_table_ID_to_id)
+CHECK_STUB(poflr_table_id_to_ID)